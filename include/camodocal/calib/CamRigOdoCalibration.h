@@ -5,9 +5,13 @@
 #include <glibmm.h>
 
 #include "camodocal/calib/AtomicData.h"
+#include "camodocal/calib/FeatureType.h"
+#include "camodocal/calib/ImageBuffer.h"
 #include "camodocal/calib/PoseSource.h"
 #include "camodocal/calib/SensorDataBuffer.h"
 #include "camodocal/camera_systems/CameraSystem.h"
+#include "camodocal/pose_graph/PoseGraph.h"
+#include "camodocal/sparse_graph/Descriptor.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
 
 namespace camodocal
@@ -17,6 +21,7 @@ namespace camodocal
 class CamOdoThread;
 class CamOdoWatchdogThread;
 class CamRigThread;
+class LocationRecognition;
 
 class CamRigOdoCalibration: public sigc::trackable
 {
@@ -33,15 +38,27 @@ public:
         Options()
          : mode(OFFLINE)
          , poseSource(ODOMETRY)
+         , featureType(SURF_GPU_FEATURES)
+         , kltTracking(false)
          , nMotions(200)
          , preprocessImages(false)
          , saveWorkingData(true)
          , beginStage(0)
          , optimizeIntrinsics(true)
+         , imageStoreFormat(ImageStore::PNG)
+         , imageCacheSize(512 << 20)
+         , descriptorFormat(DESCRIPTOR_FLOAT)
+         , poseGraphBackend(PoseGraph::BACKEND_CERES)
          , verbose(false) {};
 
         Mode mode;
         PoseSource poseSource;
+        // Binary features do not need a GPU, but loop closures are only
+        // detected with SURF features, which the vocabulary is built from.
+        FeatureType featureType;
+        // If set, features are tracked with KLT through the images between
+        // keyframes, and are only detected and matched at keyframes.
+        bool kltTracking;
         int nMotions;
 
         bool preprocessImages;
@@ -49,6 +66,16 @@ public:
         int beginStage;
         bool optimizeIntrinsics;
         std::string dataDir;
+        // If set, keyframe images are kept on disk in this directory,
+        // and only imageCacheSize bytes of them are kept in memory.
+        std::string imageStoreDir;
+        ImageStore::Format imageStoreFormat;
+        size_t imageCacheSize;
+        // Keyframe descriptors are converted to this format once they are
+        // tracked, and are stored and matched in this format.
+        DescriptorFormat descriptorFormat;
+        // optimizer for the pose graph built from the loop closures
+        PoseGraph::Backend poseGraphBackend;
         bool verbose;
     };
 
@@ -56,9 +83,14 @@ public:
                          const Options& options);
     virtual ~CamRigOdoCalibration();
 
+    // The images are copied, as the caller may reuse their data.
     void addFrame(int cameraIdx, const cv::Mat& image, uint64_t timestamp);
     void addFrameSet(const std::vector<cv::Mat>& images, uint64_t timestamp);
 
+    // The images are shared without being copied.
+    void addFrame(int cameraIdx, const ImageBuffer& image, uint64_t timestamp);
+    void addFrameSet(const std::vector<ImageBuffer>& images, uint64_t timestamp);
+
     void addOdometry(double x, double y, double yaw, uint64_t timestamp);
 
     void addGpsIns(double lat, double lon,
@@ -90,8 +122,13 @@ private:
 
     CameraSystem m_cameraSystem;
     SparseGraph m_graph;
+    // keyframes are added to the location recognition database during
+    // data capture, so that it does not need to be built from scratch
+    // for loop closure detection
+    boost::shared_ptr<LocationRecognition> m_locRec;
+    ImageStorePtr m_imageStore;
 
-    std::vector<AtomicData<cv::Mat>* > m_images;
+    std::vector<AtomicData<ImageBuffer>* > m_images;
     std::vector<CameraPtr> m_cameras;
     SensorDataBuffer<OdometryPtr> m_odometryBuffer;
     SensorDataBuffer<OdometryPtr> m_interpOdometryBuffer;
@@ -1,6 +1,7 @@
 #ifndef CAMERACALIBRATION_H
 #define CAMERACALIBRATION_H
 
+#include <Eigen/Dense>
 #include <opencv2/core/core.hpp>
 
 #include "camodocal/camera_models/Camera.h"
@@ -21,10 +22,23 @@ public:
 
     void clear(void);
 
-    void addChessboardData(const std::vector<cv::Point2f>& corners);
+    // In incremental mode, views are rejected if they add little
+    // information to the current intrinsic estimate, and calibrate()
+    // refines the previous solution instead of starting from scratch.
+    // Returns false if the view was rejected.
+    bool addChessboardData(const std::vector<cv::Point2f>& corners);
 
     bool calibrate(void);
 
+    // Refines the previous solution using only the most recent views, so
+    // that the cost of each refinement does not grow with the number of
+    // views. Falls back to calibrate() if there is no previous solution.
+    bool refine(size_t windowSize = 20);
+
+    void setIncremental(bool incremental, double minInformationGain = 0.05);
+    double informationGain(const std::vector<cv::Point2f>& corners) const;
+    double intrinsicsChange(void) const;
+
     int sampleCount(void) const;
     std::vector<std::vector<cv::Point2f> >& imagePoints(void);
     const std::vector<std::vector<cv::Point2f> >& imagePoints(void) const;
@@ -50,7 +64,19 @@ private:
                          std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const;
 
     void optimize(CameraPtr& camera,
-                  std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const;
+                  std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+                  size_t firstView) const;
+
+    double informationGain(const std::vector<cv::Point2f>& corners,
+                           Eigen::MatrixXd& information) const;
+
+    bool viewInformation(const CameraConstPtr& camera,
+                         const std::vector<cv::Point3f>& scenePoints,
+                         const std::vector<cv::Point2f>& imagePoints,
+                         const cv::Mat& rvec, const cv::Mat& tvec,
+                         Eigen::MatrixXd& information) const;
+
+    std::vector<cv::Point3f> boardScenePoints(void) const;
 
     template<typename T>
     void readData(std::ifstream& ifs, T& data) const;
@@ -67,6 +93,13 @@ private:
     std::vector<std::vector<cv::Point2f> > m_imagePoints;
     std::vector<std::vector<cv::Point3f> > m_scenePoints;
 
+    // incremental calibration
+    bool m_incremental;
+    double m_minInformationGain;
+    bool m_warmStart;
+    Eigen::MatrixXd m_information;
+    double m_intrinsicsChange;
+
     bool m_verbose;
 };
 
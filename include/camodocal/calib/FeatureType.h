@@ -0,0 +1,19 @@
+#ifndef FEATURETYPE_H
+#define FEATURETYPE_H
+
+namespace camodocal
+{
+
+// Features which are tracked for visual odometry.
+enum FeatureType
+{
+    // SURF detection, description and matching on the GPU
+    SURF_GPU_FEATURES,
+    // binary features on the CPU
+    ORB_FEATURES,
+    BRISK_FEATURES
+};
+
+}
+
+#endif
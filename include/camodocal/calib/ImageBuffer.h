@@ -0,0 +1,42 @@
+#ifndef IMAGEBUFFER_H
+#define IMAGEBUFFER_H
+
+#include <boost/function.hpp>
+#include <opencv2/core/core.hpp>
+
+namespace camodocal
+{
+
+// Immutable, reference-counted image. Copies of a buffer, and of the
+// matrix header returned by mat(), share the pixel data, so that an
+// image can be handed from the capture thread to the camera threads and
+// on to the sparse graph without being copied. The pixel data must not
+// be modified once it is wrapped in a buffer.
+class ImageBuffer
+{
+public:
+    typedef boost::function<void (unsigned char*)> Deleter;
+
+    ImageBuffer();
+
+    // Shares the pixel data of the image.
+    explicit ImageBuffer(const cv::Mat& image);
+
+    // Wraps pixel data which is owned by the caller, e.g. a buffer of a
+    // capture driver. The deleter is called with the data pointer once
+    // the last reference to the data is released, which may happen on
+    // any thread. A step of 0 denotes rows without padding.
+    ImageBuffer(unsigned char* data, int rows, int cols, int type,
+                size_t step, const Deleter& deleter);
+
+    bool empty(void) const;
+
+    const cv::Mat& mat(void) const;
+
+private:
+    cv::Mat m_mat;
+};
+
+}
+
+#endif
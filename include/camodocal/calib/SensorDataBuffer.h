@@ -1,6 +1,7 @@
 #ifndef SENSORDATABUFFER_H
 #define SENSORDATABUFFER_H
 
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <vector>
 
@@ -20,7 +21,7 @@ public:
     bool before(uint64_t timestamp, T& data);
     bool after(uint64_t timestamp, T& data);
 
-    void nearest(uint64_t timestamp, T& data);
+    bool nearest(uint64_t timestamp, T& data);
     bool nearest(uint64_t timestamp, T& dataBefore, T& dataAfter);
 
     bool current(T& data);
@@ -28,6 +29,10 @@ public:
 
     bool find(uint64_t timestamp, T& data);
 
+    // Blocks until the buffer holds data at or after the timestamp, or
+    // until the timeout expires. Returns true if such data is available.
+    bool timedWaitForData(uint64_t timestamp, const boost::system_time& timeout);
+
 private:
     long int timestampDiff(uint64_t t1, uint64_t t2) const
     {
@@ -63,6 +68,7 @@ private:
     int mIndex;
 
     boost::mutex mGlobalMutex;
+    boost::condition_variable mDataCond;
 };
 
 template <class T>
@@ -203,7 +209,7 @@ SensorDataBuffer<T>::after(uint64_t timestamp, T& data)
 }
 
 template <class T>
-void
+bool
 SensorDataBuffer<T>::nearest(uint64_t timestamp, T& data)
 {
     boost::mutex::scoped_lock lock(mGlobalMutex);
@@ -340,6 +346,8 @@ SensorDataBuffer<T>::push(uint64_t timestamp, const T& data)
         mBuffer.push_back(std::make_pair(timestamp, data));
         ++mIndex;
     }
+
+    mDataCond.notify_all();
 }
 
 template <class T>
@@ -365,6 +373,23 @@ SensorDataBuffer<T>::find(uint64_t timestamp, T& data)
     return false;
 }
 
+template <class T>
+bool
+SensorDataBuffer<T>::timedWaitForData(uint64_t timestamp, const boost::system_time& timeout)
+{
+    boost::mutex::scoped_lock lock(mGlobalMutex);
+
+    while (mBuffer.empty() || mBuffer.at(mIndex).first < timestamp)
+    {
+        if (!mDataCond.timed_wait(lock, timeout))
+        {
+            return !mBuffer.empty() && mBuffer.at(mIndex).first >= timestamp;
+        }
+    }
+
+    return true;
+}
+
 }
 
 #endif
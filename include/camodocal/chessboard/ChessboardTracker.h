@@ -0,0 +1,68 @@
+#ifndef CHESSBOARDTRACKER_H
+#define CHESSBOARDTRACKER_H
+
+#include <opencv2/core/core.hpp>
+
+namespace camodocal
+{
+
+// Tracks a chessboard through a video sequence. Corners found in the
+// previous frame are propagated with pyramidal KLT and refined to subpixel
+// accuracy. If tracking fails, detection is run only inside the predicted
+// region of interest, and if that fails too, the full detector is run
+// over the whole image.
+class ChessboardTracker
+{
+public:
+    enum Mode
+    {
+        NONE,
+        TRACKED,
+        DETECTED_ROI,
+        DETECTED_FULL
+    };
+
+    explicit ChessboardTracker(cv::Size boardSize);
+
+    bool track(cv::Mat& image, bool useOpenCV = false);
+    void reset(void);
+
+    const std::vector<cv::Point2f>& getCorners(void) const;
+    bool cornersFound(void) const;
+    Mode mode(void) const;
+
+    const cv::Mat& getImage(void) const;
+    const cv::Mat& getSketch(void) const;
+
+private:
+    bool trackCorners(const std::vector<cv::Mat>& pyramid,
+                      std::vector<cv::Point2f>& corners) const;
+    bool detectCorners(cv::Mat& image, const cv::Rect& roi, bool useOpenCV,
+                       std::vector<cv::Point2f>& corners) const;
+    bool checkCorners(const std::vector<cv::Point2f>& corners) const;
+    cv::Rect predictROI(const cv::Size& imageSize) const;
+
+    cv::Size mBoardSize;
+
+    cv::Mat mImage;
+    cv::Mat mSketch;
+    std::vector<cv::Mat> mPyramid;
+
+    std::vector<cv::Point2f> mCorners;
+    cv::Point2f mVelocity;
+    bool mCornersFound;
+    Mode mMode;
+
+    // KLT parameters
+    const cv::Size k_kltWindowSize;
+    const int k_kltMaxLevel;
+    const float k_maxForwardBackwardError;
+
+    // margin added around the predicted board region, relative to the
+    // size of the board region
+    const float k_roiMargin;
+};
+
+}
+
+#endif
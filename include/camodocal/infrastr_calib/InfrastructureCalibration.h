@@ -28,6 +28,11 @@ public:
                      uint64_t timestamp, bool preprocess);
     void addOdometry(double x, double y, double yaw, uint64_t timestamp);
 
+    // Once extrinsics are available, either from a previous run() or
+    // set here after loadMap(), each frame set is localized as a whole
+    // from the pooled 2D-3D correspondences of all cameras.
+    void setExtrinsics(const CameraSystem& cameraSystem);
+
     void reset(void);
     void run(void);
 
@@ -37,14 +42,18 @@ public:
     const CameraSystem& cameraSystem(void) const;
 
 private:
+    void extractFeatures(const cv::Mat& image, FramePtr& frame,
+                         bool preprocess) const;
     void estimateCameraPose(const cv::Mat& image, uint64_t timestamp,
                             FramePtr& frame, bool preprocess = false);
+    void estimateRigPose(const std::vector<cv::Mat>& images, uint64_t timestamp,
+                         std::vector<FramePtr>& frames, bool preprocess = false);
+    void findCorrespondences2D3D(const cv::Mat& image, FramePtr& frame, bool preprocess,
+                                 std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& corr2D3D);
+    void addCorrespondences2D3D(FramePtr& frame,
+                                const std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& corr2D3D);
     void optimize(bool optimizeScenePoints);
 
-    cv::Mat buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
-                               std::vector<size_t>& indices) const;
-    std::vector<cv::DMatch> matchFeatures(const std::vector<Point2DFeaturePtr>& queryFeatures,
-                                          const std::vector<Point2DFeaturePtr>& trainFeatures) const;
     void rectifyImagePoint(const CameraConstPtr& camera,
                            const cv::Point2f& src, cv::Point2f& dst) const;
 
@@ -55,6 +64,12 @@ private:
                              const Eigen::Vector3d& ref_p,
                              const Eigen::Vector3d& ref_att,
                              const Eigen::Vector2d& observed_p) const;
+    void worldToCameraTransform(const Eigen::Quaterniond& cam_ref_q,
+                                const Eigen::Vector3d& cam_ref_t,
+                                const Eigen::Vector3d& ref_p,
+                                const Eigen::Vector3d& ref_att,
+                                Eigen::Quaterniond& q_cam,
+                                Eigen::Vector3d& t_cam) const;
 
     void frameReprojectionError(const FramePtr& frame,
                                 const CameraConstPtr& camera,
@@ -70,6 +85,19 @@ private:
     void reprojectionError(double& minError, double& maxError,
                            double& avgError, size_t& featureCount) const;
 
+    typedef struct
+    {
+        double minError;
+        double maxError;
+        double avgError;
+        size_t featureCount;
+    } FrameReprojectionError;
+
+    void frameReprojectionErrorHelper(const std::vector<FramePtr>* frames,
+                                      const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_ref,
+                                      std::vector<FrameReprojectionError>* frameErrors,
+                                      size_t frameId) const;
+
     // Compute the quaternion average using the Markley SVD method
     template <typename FloatT>
     Eigen::Quaternion<FloatT> quaternionAvg(const std::vector<Eigen::Quaternion<FloatT> >& points) const;
@@ -83,8 +111,11 @@ private:
 
     void visualizeMap(const std::string& overlayName, MapType type) const;
     void visualizeCameraPose(const FrameConstPtr& frame,
-                             bool showScenePoints);
-    void visualizeCameraPoses(bool showScenePoints);
+                             bool showScenePoints,
+                             vcharge::GLOverlayExtended& overlay) const;
+    // The current frames are shown with their scene points.
+    void visualizeCameraPoses(bool showScenePoints,
+                              const std::vector<FramePtr>& currentFrames = std::vector<FramePtr>()) const;
     void visualizeExtrinsics(void) const;
     void visualizeOdometry(void) const;
 #endif
@@ -107,12 +138,9 @@ private:
     double m_x_last;
     double m_y_last;
     double m_distance;
+    bool m_useRigLocalization;
     bool m_verbose;
 
-#ifdef VCHARGE_VIZ
-    vcharge::GLOverlayExtended m_overlay;
-#endif
-
     // output
     CameraSystem m_cameraSystem;
 
@@ -4,17 +4,33 @@
 #include <camodocal/camera_systems/CameraSystem.h>
 #include <camodocal/pose_graph/DirectedEdge.h>
 #include <camodocal/sparse_graph/SparseGraph.h>
+#include <set>
 #include <vector>
 
+namespace ceres
+{
+class LossFunction;
+class Problem;
+}
+
 namespace camodocal
 {
 
 // forward declaration
 class LocationRecognition;
+class PoseGraphOptimizer;
 
 class PoseGraph
 {
 public:
+    enum Backend
+    {
+        // generic ceres problem with autodiff cost functions
+        BACKEND_CERES,
+        // dedicated SE(3) optimizer with a block-sparse Cholesky solver
+        BACKEND_NATIVE
+    };
+
     PoseGraph(CameraSystem& cameraSystem,
               SparseGraph& graph,
               float maxDistanceRatio,
@@ -23,6 +39,11 @@ public:
               double nominalFocalLength);
 
     void setVerbose(bool onoff);
+    void setBackend(Backend backend);
+
+    // Uses a location recognition database which may already contain
+    // frames of the graph, e.g. keyframes added during data capture.
+    void setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec);
 
     void buildEdges(void);
 
@@ -40,6 +61,9 @@ private:
 
     typedef DirectedEdge<Transform, Odometry> Edge;
 
+    // frame set segment id and frame set id
+    typedef std::pair<int, int> FrameSetTag;
+
     std::vector<Edge, Eigen::aligned_allocator<Edge> > findOdometryEdges(void) const;
     void findLoopClosures(std::vector<Edge, Eigen::aligned_allocator<Edge> >& loopClosureEdges,
                           std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > >& correspondences2D3D,
@@ -47,11 +71,19 @@ private:
 
     void findLoopClosuresHelper(FrameTag frameTagQuery,
                                 boost::shared_ptr<LocationRecognition> locRec,
+                                const std::set<FrameSetTag>* candidates,
                                 PoseGraph::Edge* edge,
                                 std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >* correspondences2D3D,
                                 double reprojErrorThresh) const;
 
-    bool iterateEM(bool useRobustOptimization);
+    void buildProblem(ceres::Problem& problem,
+                      std::vector<double>& loopClosureSwitches,
+                      bool useRobustOptimization);
+    bool solveProblem(ceres::Problem& problem);
+    void buildProblem(PoseGraphOptimizer& optimizer,
+                      std::vector<double>& loopClosureSwitches,
+                      ceres::LossFunction* lossFunction);
+    bool solveProblem(PoseGraphOptimizer& optimizer);
     void classifySwitches(void);
 
 #ifdef VCHARGE_VIZ
@@ -66,11 +98,21 @@ private:
     std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > m_correspondences2D3D;
 
     const double k_lossWidth;
+    // loop closure candidates are gated by the drift bound
+    // k_loopClosureMinRadius + k_loopClosureDriftRate * distance travelled
+    const double k_loopClosureMinRadius;
+    const double k_loopClosureDriftRate;
+    // minimum distance or yaw change between loop closure queries
+    const double k_loopClosureQueryDistance;
+    const double k_loopClosureQueryYaw;
     const int k_minLoopCorrespondences2D3D;
     const float k_maxDistanceRatio;
     const int k_nImageMatches;
     const double k_nominalFocalLength;
 
+    boost::shared_ptr<LocationRecognition> m_locRec;
+
+    Backend m_backend;
     bool m_verbose;
 };
 
@@ -0,0 +1,44 @@
+#ifndef DESCRIPTOR_H
+#define DESCRIPTOR_H
+
+#include <camodocal/sparse_graph/SparseGraph.h>
+#include <opencv2/core/core.hpp>
+
+namespace camodocal
+{
+
+// Storage formats of 1xN real-valued descriptors such as SURF.
+enum DescriptorFormat
+{
+    // CV_32FC1
+    DESCRIPTOR_FLOAT,
+    // IEEE half-precision floats as CV_16UC1
+    DESCRIPTOR_HALF,
+    // 8-bit integers with a per-descriptor scale as 1x(N+8) CV_8SC1,
+    // followed by the float scale and the float squared norm
+    DESCRIPTOR_INT8
+};
+
+// Converts a float descriptor to the given format.
+cv::Mat compactDescriptor(const cv::Mat& dtor, DescriptorFormat format);
+
+// Converts a descriptor of any of the above types to a float descriptor.
+// Descriptors of other types, e.g. binary descriptors, are returned
+// as they are.
+cv::Mat expandDescriptor(const cv::Mat& dtor);
+
+// Returns the squared L2 distance between two descriptors, or the squared
+// Hamming distance between two binary (CV_8UC1) descriptors.
+// Descriptors of the same type are compared without conversion.
+float descriptorDistanceSquared(const cv::Mat& dtor1, const cv::Mat& dtor2);
+
+// Returns the number of differing bits between two n-byte binary descriptors.
+int hammingDistance(const unsigned char* a, const unsigned char* b, int n);
+
+// Converts the descriptors of the features to the given format.
+void compactDescriptors(const std::vector<Point2DFeaturePtr>& features,
+                        DescriptorFormat format);
+
+}
+
+#endif
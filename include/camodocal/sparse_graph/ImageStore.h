@@ -0,0 +1,119 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <deque>
+#include <list>
+#include <opencv2/core/core.hpp>
+
+namespace camodocal
+{
+
+// Keeps images on disk, and serves them through a bounded LRU cache.
+//
+// Images are written to disk on background threads. An image stays in
+// memory until it is written, and add() blocks while more than the cache
+// size in bytes is waiting to be written. Written images are loaded on
+// demand by get(), or ahead of time by prefetch(), and are evicted from
+// the cache in least recently used order once the cached images exceed
+// the cache size in bytes. The directory must not be shared with other
+// image stores.
+class ImageStore
+{
+public:
+    enum Format
+    {
+        // uncompressed image data
+        RAW,
+        // lossless; images with depths other than 8 and 16 bits
+        // are stored as RAW
+        PNG
+    };
+
+    ImageStore(const std::string& directory,
+               Format format = PNG,
+               size_t cacheSize = 512 << 20,
+               int nThreads = 2);
+    ~ImageStore();
+
+    // Adds an image to the store, and returns its key.
+    // The image data is shared with the store, and must not be modified.
+    size_t add(const cv::Mat& image);
+
+    // Returns the image with the given key, or an empty image
+    // if there is no such image.
+    cv::Mat get(size_t key);
+
+    // Loads the image with the given key into the cache in the background.
+    void prefetch(size_t key);
+
+    // Removes the image with the given key, and deletes its file.
+    void remove(size_t key);
+
+    size_t size(void) const;
+    size_t cachedBytes(void) const;
+
+private:
+    ImageStore(const ImageStore&);
+    ImageStore& operator=(const ImageStore&);
+
+    typedef struct
+    {
+        std::string filename;
+        // the image while it is waiting to be written or is cached
+        cv::Mat image;
+        size_t bytes;
+        bool pending;
+        bool written;
+        bool cached;
+        bool prefetching;
+        std::list<size_t>::iterator lruIt;
+    } Entry;
+
+    typedef struct
+    {
+        size_t key;
+        bool write;
+    } Job;
+
+    void processJobs(void);
+
+    bool writeImage(const std::string& filename, const cv::Mat& image) const;
+    cv::Mat readImage(const std::string& filename) const;
+
+    // These functions must be called with m_mutex held.
+    cv::Mat loadImage(boost::unique_lock<boost::mutex>& lock,
+                      size_t key);
+    void cacheImage(Entry& entry, size_t key);
+    void evictImages(void);
+
+    const std::string k_directory;
+    const Format k_format;
+    const size_t k_cacheSize;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_jobCond;
+    boost::condition_variable m_writtenCond;
+
+    boost::unordered_map<size_t, Entry> m_entries;
+    size_t m_nextKey;
+
+    // most recently used images first
+    std::list<size_t> m_lru;
+    size_t m_cachedBytes;
+    size_t m_pendingBytes;
+
+    std::deque<Job> m_jobs;
+    std::vector<boost::shared_ptr<boost::thread> > m_threads;
+    bool m_stop;
+};
+
+typedef boost::shared_ptr<ImageStore> ImageStorePtr;
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 
+#include <camodocal/sparse_graph/ImageStore.h>
 #include <camodocal/sparse_graph/Odometry.h>
 #include <camodocal/sparse_graph/Pose.h>
 
@@ -36,6 +37,7 @@ class Frame
 {
 public:
     Frame();
+    ~Frame();
 
     PosePtr& cameraPose(void);
     PoseConstPtr cameraPose(void) const;
@@ -55,8 +57,15 @@ public:
     std::vector<Point2DFeaturePtr>& features2D(void);
     const std::vector<Point2DFeaturePtr>& features2D(void) const;
 
-    cv::Mat& image(void);
-    const cv::Mat& image(void) const;
+    // Returns the image, which is read through the image store
+    // if it was moved to one.
+    cv::Mat image(void) const;
+    void setImage(const cv::Mat& image);
+
+    // Moves the image to an image store, which keeps it on disk.
+    void storeImage(const ImageStorePtr& imageStore);
+    // Loads the image into the cache of the image store in the background.
+    void prefetchImage(void) const;
 
 private:
     PosePtr m_cameraPose;
@@ -69,6 +78,8 @@ private:
     std::vector<Point2DFeaturePtr> m_features2D;
 
     cv::Mat m_image;
+    ImageStorePtr m_imageStore;
+    size_t m_imageKey;
 };
 
 typedef boost::shared_ptr<Frame> FramePtr;
@@ -1,6 +1,7 @@
 #ifndef SPARSEGRAPHUTILS_H
 #define SPARSEGRAPHUTILS_H
 
+#include <boost/function.hpp>
 #include <camodocal/camera_models/Camera.h>
 #include <camodocal/sparse_graph/SparseGraph.h>
 #include <opencv2/features2d/features2d.hpp>
@@ -22,6 +23,14 @@ void rectifyImagePoints(const CameraConstPtr& camera,
                         const std::vector<cv::Point2f>& src,
                         std::vector<cv::Point2f>& dst);
 
+// Returns the frames of the graph in segment, frame set and camera order.
+// Missing frames are skipped.
+void graphFrames(const SparseGraph& graph, std::vector<FramePtr>& frames);
+
+// Calls f(i) for i in [0, n) on up to boost::thread::hardware_concurrency()
+// threads, each of which processes a contiguous range of indices.
+void parallelFor(size_t n, const boost::function<void (size_t)>& f);
+
 }
 
 #endif
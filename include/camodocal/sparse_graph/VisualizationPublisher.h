@@ -0,0 +1,99 @@
+#ifndef VISUALIZATIONPUBLISHER_H
+#define VISUALIZATIONPUBLISHER_H
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <deque>
+#include <string>
+
+namespace camodocal
+{
+
+// Publishes visualization data, e.g. overlays, on a background thread, so
+// that visualization does not hold up calibration.
+//
+// Producers draw a snapshot of their data, and queue a task which
+// publishes it under a key such as the overlay name. A queued task is
+// replaced by a newer task with the same key, and the oldest task is
+// dropped once the queue is full, so that a slow consumer only sees the
+// latest snapshots. Tasks are paced by the publish interval, which gives
+// the consumer time to keep up. Nothing should be drawn unless a
+// consumer is attached.
+//
+// Viewers attach while they are shown and detach when they are closed,
+// e.g. CalibrationWindow between open() and close(). Attachments are
+// counted, so the publisher stays attached until every viewer has
+// detached.
+class VisualizationPublisher
+{
+public:
+    typedef boost::function<void ()> Task;
+
+    explicit VisualizationPublisher(size_t capacity = 32,
+                                    double publishInterval = 0.05);
+    // Runs the queued tasks before returning.
+    ~VisualizationPublisher();
+
+    static VisualizationPublisher* instance(void);
+
+    void attach(void);
+    void detach(void);
+    bool attached(void) const;
+
+    // Does nothing if no consumer is attached.
+    void publish(const std::string& key, const Task& task);
+
+    // Queues the publishing of an overlay, which must not be modified
+    // afterwards.
+    template<class Overlay>
+    void publishOverlay(const std::string& key,
+                        const boost::shared_ptr<Overlay>& overlay);
+
+    // Blocks until all queued tasks have run.
+    void flush(void);
+
+private:
+    VisualizationPublisher(const VisualizationPublisher&);
+    VisualizationPublisher& operator=(const VisualizationPublisher&);
+
+    template<class Overlay>
+    static void publishOverlayTask(const boost::shared_ptr<Overlay>& overlay);
+
+    void processTasks(void);
+
+    const size_t k_capacity;
+    const double k_publishInterval;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_taskCond;
+    boost::condition_variable m_idleCond;
+
+    std::deque<std::pair<std::string, Task> > m_tasks;
+    boost::shared_ptr<boost::thread> m_thread;
+    size_t m_attachCount;
+    bool m_busy;
+    bool m_stop;
+};
+
+template<class Overlay>
+void
+VisualizationPublisher::publishOverlay(const std::string& key,
+                                       const boost::shared_ptr<Overlay>& overlay)
+{
+    publish(key, boost::bind(&VisualizationPublisher::publishOverlayTask<Overlay>, overlay));
+}
+
+template<class Overlay>
+void
+VisualizationPublisher::publishOverlayTask(const boost::shared_ptr<Overlay>& overlay)
+{
+    overlay->publish();
+}
+
+}
+
+#endif
@@ -116,6 +116,15 @@ struct BriskLongPair{
 				const cv::Mat& integral,const float key_x,
 					const float key_y, const unsigned int scale,
 					const unsigned int rot, const unsigned int point) const;
+		// all smoothed intensities of the pattern at a keypoint
+		void smoothedIntensities(const cv::Mat& image,
+				const cv::Mat& integral,const float key_x,
+					const float key_y, const unsigned int scale,
+					const unsigned int rot, int* values) const;
+		// descriptors of the keypoints [begin,end), run concurrently by computeImpl
+		void computeDescriptors(const cv::Mat& image, const cv::Mat& integral,
+				std::vector<KeyPoint>& keypoints, const std::vector<int>& kscales,
+				size_t begin, size_t end, Mat& descriptors) const;
 		// pattern properties
 		BriskPatternPoint* patternPoints_; 	//[i][rotation][scale]
 		unsigned int points_; 				// total number of collocation points
@@ -229,6 +238,15 @@ struct BriskLongPair{
 		void getKeypoints(const uint8_t _threshold, std::vector<cv::KeyPoint>& keypoints);
 
 	protected:
+		// the intra-octave layers, derived from the first octave
+		void constructIntraOctaves(const BriskLayer& octave0,
+				std::vector<BriskLayer>& intraOctaves) const;
+		// AGAST corners without non-max suppression of one layer
+		void getAgastPoints(uint8_t layer, std::vector<CvPoint>& agastPoints);
+		// non-max suppression and refinement of the corners of one layer
+		void refineKeypoints(uint8_t layer, const std::vector<CvPoint>& agastPoints,
+				std::vector<cv::KeyPoint>& keypoints);
+
 		// nonmax suppression:
 		__inline__ bool isMax2D(const uint8_t layer,
 				const int x_layer, const int y_layer);
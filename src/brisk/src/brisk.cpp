@@ -36,6 +36,12 @@
 #include <agast/agast5_8.h>
 #include <stdlib.h>
 #include <tmmintrin.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
 
 
 using namespace cv;
@@ -350,6 +356,191 @@ __inline__ int BriskDescriptorExtractor::smoothedIntensity(const cv::Mat& image,
 	return (ret_val+scaling2/2)/scaling2;
 }
 
+#ifdef __AVX2__
+// float(v+0.5), with the addition in double as in smoothedIntensity()
+static inline __m256 addHalf(const __m256 v){
+	const __m256d half=_mm256_set1_pd(0.5);
+	const __m128 lo=_mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),half));
+	const __m128 hi=_mm256_cvtpd_ps(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v,1)),half));
+	return _mm256_set_m128(hi,lo);
+}
+
+// int(v+0.5), with the addition in double as in smoothedIntensity()
+static inline __m256i truncateAddHalf(const __m256 v){
+	const __m256d half=_mm256_set1_pd(0.5);
+	const __m128i lo=_mm256_cvttpd_epi32(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(v)),half));
+	const __m128i hi=_mm256_cvttpd_epi32(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(v,1)),half));
+	return _mm256_set_m128i(hi,lo);
+}
+
+// the integer division of smoothedIntensity(), exact in double for 32 bit operands
+static inline __m256i divide(const __m256i num, const __m256i den){
+	const __m128i lo=_mm256_cvttpd_epi32(_mm256_div_pd(
+			_mm256_cvtepi32_pd(_mm256_castsi256_si128(num)),
+			_mm256_cvtepi32_pd(_mm256_castsi256_si128(den))));
+	const __m128i hi=_mm256_cvttpd_epi32(_mm256_div_pd(
+			_mm256_cvtepi32_pd(_mm256_extracti128_si256(num,1)),
+			_mm256_cvtepi32_pd(_mm256_extracti128_si256(den,1))));
+	return _mm256_set_m128i(hi,lo);
+}
+
+// the box-filtered case of smoothedIntensity() for 8 pattern points at once,
+// with the same arithmetic. Returns the bit mask of the points written to values,
+// the others take the interpolation or small box paths of smoothedIntensity().
+static int smoothedIntensities8(const cv::Mat& image, const cv::Mat& integral,
+		const BriskPatternPoint* points, const float key_x, const float key_y,
+		int* values){
+	// per point constants which only depend on sigma
+	float px[8], py[8], sigma[8];
+	int scalingv[8], scaling2v[8], halfScaling2v[8];
+	for(int i=0; i<8; i++){
+		const float sigma_half=points[i].sigma;
+		const float area=4.0*sigma_half*sigma_half;
+		const int scaling = 4194304.0/area;
+		const int scaling2=float(scaling)*area/1024.0;
+		px[i]=points[i].x;
+		py[i]=points[i].y;
+		sigma[i]=sigma_half;
+		scalingv[i]=scaling;
+		scaling2v[i]=scaling2;
+		halfScaling2v[i]=scaling2/2;
+	}
+
+	const __m256 sigma_half=_mm256_loadu_ps(sigma);
+	const __m256 xf=_mm256_add_ps(_mm256_loadu_ps(px),_mm256_set1_ps(key_x));
+	const __m256 yf=_mm256_add_ps(_mm256_loadu_ps(py),_mm256_set1_ps(key_y));
+
+	// calculate borders
+	const __m256 x_1=_mm256_sub_ps(xf,sigma_half);
+	const __m256 x1=_mm256_add_ps(xf,sigma_half);
+	const __m256 y_1=_mm256_sub_ps(yf,sigma_half);
+	const __m256 y1=_mm256_add_ps(yf,sigma_half);
+
+	const __m256i x_left=truncateAddHalf(x_1);
+	const __m256i y_top=truncateAddHalf(y_1);
+	const __m256i x_right=truncateAddHalf(x1);
+	const __m256i y_bottom=truncateAddHalf(y1);
+
+	// overlap area - multiplication factors:
+	const __m256 r_x_1=addHalf(_mm256_sub_ps(_mm256_cvtepi32_ps(x_left),x_1));
+	const __m256 r_y_1=addHalf(_mm256_sub_ps(_mm256_cvtepi32_ps(y_top),y_1));
+	const __m256 r_x1=addHalf(_mm256_sub_ps(x1,_mm256_cvtepi32_ps(x_right)));
+	const __m256 r_y1=addHalf(_mm256_sub_ps(y1,_mm256_cvtepi32_ps(y_bottom)));
+	const __m256i one=_mm256_set1_epi32(1);
+	const __m256i dx=_mm256_sub_epi32(_mm256_sub_epi32(x_right,x_left),one);
+	const __m256i dy=_mm256_sub_epi32(_mm256_sub_epi32(y_bottom,y_top),one);
+	const __m256i scaling=_mm256_loadu_si256((const __m256i*)scalingv);
+	const __m256 scalingf=_mm256_cvtepi32_ps(scaling);
+	const __m256i A=_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x_1,r_y_1),scalingf));
+	const __m256i B=_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x1,r_y_1),scalingf));
+	const __m256i C=_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x1,r_y1),scalingf));
+	const __m256i D=_mm256_cvttps_epi32(_mm256_mul_ps(_mm256_mul_ps(r_x_1,r_y1),scalingf));
+	const __m256i r_x_1_i=_mm256_cvttps_epi32(_mm256_mul_ps(r_x_1,scalingf));
+	const __m256i r_y_1_i=_mm256_cvttps_epi32(_mm256_mul_ps(r_y_1,scalingf));
+	const __m256i r_x1_i=_mm256_cvttps_epi32(_mm256_mul_ps(r_x1,scalingf));
+	const __m256i r_y1_i=_mm256_cvttps_epi32(_mm256_mul_ps(r_y1,scalingf));
+
+	// only the lanes with sigma_half>=0.5 and dx+dy>2 are handled here
+	const __m256i valid=_mm256_and_si256(
+			_mm256_castps_si256(_mm256_cmp_ps(sigma_half,_mm256_set1_ps(0.5f),_CMP_GE_OQ)),
+			_mm256_cmpgt_epi32(_mm256_add_epi32(dx,dy),_mm256_set1_epi32(2)));
+	const int computed=_mm256_movemask_ps(_mm256_castsi256_ps(valid));
+	if(computed==0) return 0;
+
+	const __m256i zero=_mm256_setzero_si256();
+
+	// first the corners:
+	const __m256i imagecols=_mm256_set1_epi32(image.cols);
+	const __m256i dx1=_mm256_add_epi32(dx,one);
+	const __m256i pA=_mm256_add_epi32(x_left,_mm256_mullo_epi32(imagecols,y_top));
+	const __m256i pB=_mm256_add_epi32(pA,dx1);
+	const __m256i pC=_mm256_add_epi32(pB,_mm256_add_epi32(_mm256_mullo_epi32(dy,imagecols),one));
+	const __m256i pD=_mm256_sub_epi32(pC,dx1);
+	const int* imageData=(const int*)image.data;
+	const __m256i byteMask=_mm256_set1_epi32(0xff);
+	__m256i ret_val=_mm256_mullo_epi32(A,_mm256_and_si256(byteMask,
+			_mm256_mask_i32gather_epi32(zero,imageData,pA,valid,1)));
+	ret_val=_mm256_add_epi32(ret_val,_mm256_mullo_epi32(B,_mm256_and_si256(byteMask,
+			_mm256_mask_i32gather_epi32(zero,imageData,pB,valid,1))));
+	ret_val=_mm256_add_epi32(ret_val,_mm256_mullo_epi32(C,_mm256_and_si256(byteMask,
+			_mm256_mask_i32gather_epi32(zero,imageData,pC,valid,1))));
+	ret_val=_mm256_add_epi32(ret_val,_mm256_mullo_epi32(D,_mm256_and_si256(byteMask,
+			_mm256_mask_i32gather_epi32(zero,imageData,pD,valid,1))));
+
+	// next the edges, along the same path through the integral image:
+	const int* integralData=(const int*)integral.data;
+	const __m256i integralcols=_mm256_set1_epi32(image.cols+1);
+	const __m256i dyIntegral=_mm256_mullo_epi32(dy,integralcols);
+	const __m256i p1=_mm256_add_epi32(_mm256_add_epi32(x_left,_mm256_mullo_epi32(integralcols,y_top)),one);
+	const __m256i p2=_mm256_add_epi32(p1,dx);
+	const __m256i p3=_mm256_add_epi32(p2,integralcols);
+	const __m256i p4=_mm256_add_epi32(p3,one);
+	const __m256i p5=_mm256_add_epi32(p4,dyIntegral);
+	const __m256i p6=_mm256_sub_epi32(p5,one);
+	const __m256i p7=_mm256_add_epi32(p6,integralcols);
+	const __m256i p8=_mm256_sub_epi32(p7,dx);
+	const __m256i p9=_mm256_sub_epi32(p8,integralcols);
+	const __m256i p10=_mm256_sub_epi32(p9,one);
+	const __m256i p11=_mm256_sub_epi32(p10,dyIntegral);
+	const __m256i p12=_mm256_add_epi32(p11,one);
+	const __m256i tmp1=_mm256_mask_i32gather_epi32(zero,integralData,p1,valid,4);
+	const __m256i tmp2=_mm256_mask_i32gather_epi32(zero,integralData,p2,valid,4);
+	const __m256i tmp3=_mm256_mask_i32gather_epi32(zero,integralData,p3,valid,4);
+	const __m256i tmp4=_mm256_mask_i32gather_epi32(zero,integralData,p4,valid,4);
+	const __m256i tmp5=_mm256_mask_i32gather_epi32(zero,integralData,p5,valid,4);
+	const __m256i tmp6=_mm256_mask_i32gather_epi32(zero,integralData,p6,valid,4);
+	const __m256i tmp7=_mm256_mask_i32gather_epi32(zero,integralData,p7,valid,4);
+	const __m256i tmp8=_mm256_mask_i32gather_epi32(zero,integralData,p8,valid,4);
+	const __m256i tmp9=_mm256_mask_i32gather_epi32(zero,integralData,p9,valid,4);
+	const __m256i tmp10=_mm256_mask_i32gather_epi32(zero,integralData,p10,valid,4);
+	const __m256i tmp11=_mm256_mask_i32gather_epi32(zero,integralData,p11,valid,4);
+	const __m256i tmp12=_mm256_mask_i32gather_epi32(zero,integralData,p12,valid,4);
+
+	// assign the weighted surface integrals:
+	const __m256i upper=_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp3,tmp2),tmp1),tmp12),r_y_1_i);
+	const __m256i middle=_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp6,tmp3),tmp12),tmp9),scaling);
+	const __m256i left=_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp9,tmp12),tmp11),tmp10),r_x_1_i);
+	const __m256i right=_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp5,tmp4),tmp3),tmp6),r_x1_i);
+	const __m256i bottom=_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_add_epi32(_mm256_sub_epi32(tmp7,tmp6),tmp9),tmp8),r_y1_i);
+
+	ret_val=_mm256_add_epi32(ret_val,_mm256_add_epi32(_mm256_add_epi32(upper,middle),
+			_mm256_add_epi32(_mm256_add_epi32(left,right),bottom)));
+	ret_val=_mm256_add_epi32(ret_val,_mm256_loadu_si256((const __m256i*)halfScaling2v));
+
+	// the invalid lanes divide by one, their results are discarded
+	const __m256i scaling2=_mm256_blendv_epi8(one,
+			_mm256_loadu_si256((const __m256i*)scaling2v),valid);
+	int result[8];
+	_mm256_storeu_si256((__m256i*)result,divide(ret_val,scaling2));
+	for(int i=0; i<8; i++){
+		if(computed&(1<<i))
+			values[i]=result[i];
+	}
+	return computed;
+}
+#endif
+
+void BriskDescriptorExtractor::smoothedIntensities(const cv::Mat& image,
+		const cv::Mat& integral,const float key_x,
+			const float key_y, const unsigned int scale,
+			const unsigned int rot, int* values) const{
+	unsigned int i=0;
+#ifdef __AVX2__
+	const BriskPatternPoint* points=patternPoints_+scale*n_rot_*points_+rot*points_;
+	for(; i+8<=points_; i+=8){
+		const int computed=smoothedIntensities8(image, integral, points+i, key_x, key_y, values+i);
+		if(computed==0xff) continue;
+		for(unsigned int j=0; j<8; j++){
+			if(!(computed&(1<<j)))
+				values[i+j]=smoothedIntensity(image, integral, key_x, key_y, scale, rot, i+j);
+		}
+	}
+#endif
+	for(; i<points_; i++){
+		values[i]=smoothedIntensity(image, integral, key_x, key_y, scale, rot, i);
+	}
+}
+
 bool RoiPredicate(const float minX, const float minY,
 		const float maxX, const float maxY, const KeyPoint& keyPt){
 	const Point2f& pt = keyPt.pt;
@@ -404,12 +595,39 @@ void BriskDescriptorExtractor::computeImpl(const Mat& image,
 	cv::Mat _integral; // the integral image
 	cv::integral(image, _integral);
 
-	int* _values=new int[points_]; // for temporary use
-
 	// resize the descriptors:
 	descriptors=cv::Mat::zeros(ksize,strings_, CV_8U);
 
-	// now do the extraction for all keypoints:
+	// the keypoints are independent, so they are split into ranges which
+	// are described concurrently
+	static const size_t minKeypointsPerThread=64;
+	const size_t nThreads=std::min(static_cast<size_t>(std::max(boost::thread::hardware_concurrency(), 1u)),
+			(ksize+minKeypointsPerThread-1)/minKeypointsPerThread);
+
+	if(nThreads<=1){
+		computeDescriptors(image, _integral, keypoints, kscales, 0, ksize, descriptors);
+	}
+	else{
+		std::vector<boost::shared_ptr<boost::thread> > threads(nThreads);
+		for(size_t i=0; i<nThreads; i++){
+			threads.at(i).reset(new boost::thread(boost::bind(&BriskDescriptorExtractor::computeDescriptors, this,
+					boost::cref(image), boost::cref(_integral), boost::ref(keypoints), boost::cref(kscales),
+					ksize*i/nThreads, ksize*(i+1)/nThreads, boost::ref(descriptors))));
+		}
+		for(size_t i=0; i<nThreads; i++){
+			threads.at(i)->join();
+		}
+	}
+
+	// clean-up
+	_integral.release();
+}
+
+void BriskDescriptorExtractor::computeDescriptors(const cv::Mat& image, const cv::Mat& _integral,
+		std::vector<KeyPoint>& keypoints, const std::vector<int>& kscales,
+		size_t begin, size_t end, Mat& descriptors) const{
+
+	int* _values=new int[points_]; // for temporary use
 
 	// temporary variables containing gray values at sample points:
 	int t1;
@@ -419,8 +637,8 @@ void BriskDescriptorExtractor::computeImpl(const Mat& image,
 	int direction0;
 	int direction1;
 
-	uchar* ptr = descriptors.data;
-	for(size_t k=0; k<ksize; k++){
+	uchar* ptr = descriptors.ptr(begin);
+	for(size_t k=begin; k<end; k++){
 		int theta;
 		cv::KeyPoint& kp=keypoints[k];
 		const int& scale=kscales[k];
@@ -435,10 +653,7 @@ void BriskDescriptorExtractor::computeImpl(const Mat& image,
 			}
 			else{
 				// get the gray values in the unrotated pattern
-				for(unsigned int i = 0; i<points_; i++){
-					*(pvalues++)=smoothedIntensity(image, _integral, x,
-							y, scale, 0, i);
-				}
+				smoothedIntensities(image, _integral, x, y, scale, 0, pvalues);
 
 				direction0=0;
 				direction1=0;
@@ -484,10 +699,7 @@ void BriskDescriptorExtractor::computeImpl(const Mat& image,
 		//unsigned int mean=0;
 		pvalues =_values;
 		// get the gray values in the rotated pattern
-		for(unsigned int i = 0; i<points_; i++){
-			*(pvalues++)=smoothedIntensity(image, _integral, x,
-					y, scale, theta, i);
-		}
+		smoothedIntensities(image, _integral, x, y, scale, theta, pvalues);
 
 		// now iterate through all the pairings
 		UINT32_ALIAS* ptr2=(UINT32_ALIAS*)ptr;
@@ -510,8 +722,6 @@ void BriskDescriptorExtractor::computeImpl(const Mat& image,
 		ptr+=strings_;
 	}
 
-	// clean-up
-	_integral.release();
 	delete [] _values;
 }
 
@@ -566,17 +776,46 @@ void BriskScaleSpace::constructPyramid(const cv::Mat& image){
 
 	// fill the pyramid:
 	pyramid_.push_back(BriskLayer(image.clone()));
-	if(layers_>1){
-		pyramid_.push_back(BriskLayer(pyramid_.back(),BriskLayer::CommonParams::TWOTHIRDSAMPLE));
+	if(layers_==1){
+		return;
 	}
-	const int octaves2=layers_;
 
+	// the octaves are half-sampled from the octave below and the intra-octaves
+	// from the intra-octave below, so the two chains are built concurrently
+	std::vector<BriskLayer> intraOctaves;
+	boost::thread intraOctaveThread(boost::bind(&BriskScaleSpace::constructIntraOctaves, this,
+			boost::cref(pyramid_[0]), boost::ref(intraOctaves)));
+
+	std::vector<BriskLayer> octaves(1,pyramid_[0]);
+	const int octaves2=layers_;
 	for(uint8_t i=2; i<octaves2; i+=2){
-		pyramid_.push_back(BriskLayer(pyramid_[i-2],BriskLayer::CommonParams::HALFSAMPLE));
-		pyramid_.push_back(BriskLayer(pyramid_[i-1],BriskLayer::CommonParams::HALFSAMPLE));
+		octaves.push_back(BriskLayer(octaves.back(),BriskLayer::CommonParams::HALFSAMPLE));
+	}
+
+	intraOctaveThread.join();
+
+	for(size_t i=0; i<intraOctaves.size(); i++){
+		if(i>0){
+			pyramid_.push_back(octaves[i]);
+		}
+		pyramid_.push_back(intraOctaves[i]);
+	}
+}
+
+void BriskScaleSpace::constructIntraOctaves(const BriskLayer& octave0,
+		std::vector<BriskLayer>& intraOctaves) const{
+	intraOctaves.push_back(BriskLayer(octave0,BriskLayer::CommonParams::TWOTHIRDSAMPLE));
+	const int octaves2=layers_;
+	for(uint8_t i=3; i<octaves2; i+=2){
+		intraOctaves.push_back(BriskLayer(intraOctaves.back(),BriskLayer::CommonParams::HALFSAMPLE));
 	}
 }
 
+void BriskScaleSpace::getAgastPoints(uint8_t layer, std::vector<CvPoint>& agastPoints){
+	// call OAST16_9 without nms
+	pyramid_[layer].getAgastPoints(safeThreshold_,agastPoints);
+}
+
 void BriskScaleSpace::getKeypoints(const uint8_t _threshold, std::vector<cv::KeyPoint>& keypoints){
 	// make sure keypoints is empty
 	keypoints.resize(0);
@@ -588,11 +827,15 @@ void BriskScaleSpace::getKeypoints(const uint8_t _threshold, std::vector<cv::Key
 	std::vector<std::vector<CvPoint> > agastPoints;
 	agastPoints.resize(layers_);
 
-	// go through the octaves and intra layers and calculate fast corner scores:
+	// go through the octaves and intra layers and calculate fast corner scores;
+	// each layer only touches its own scores, so the layers are processed concurrently
+	std::vector<boost::shared_ptr<boost::thread> > threads(layers_);
 	for(uint8_t i = 0; i<layers_; i++){
-		// call OAST16_9 without nms
-		BriskLayer& l=pyramid_[i];
-		l.getAgastPoints(safeThreshold_,agastPoints[i]);
+		threads.at(i).reset(new boost::thread(boost::bind(&BriskScaleSpace::getAgastPoints, this,
+				i, boost::ref(agastPoints[i]))));
+	}
+	for(uint8_t i = 0; i<layers_; i++){
+		threads.at(i)->join();
 	}
 
 	if(layers_==1){
@@ -628,66 +871,86 @@ void BriskScaleSpace::getKeypoints(const uint8_t _threshold, std::vector<cv::Key
 		return;
 	}
 
-	float x,y,scale,score;
+	// the refinement of a layer also computes missing scores of the layers
+	// above and below, so layers which are 3 apart are refined concurrently
+	std::vector<std::vector<cv::KeyPoint> > layerKeypoints(layers_);
+	for(uint8_t phase = 0; phase<3; phase++){
+		threads.clear();
+		for(uint8_t i = phase; i<layers_; i+=3){
+			threads.push_back(boost::shared_ptr<boost::thread>(new boost::thread(boost::bind(
+					&BriskScaleSpace::refineKeypoints, this, i,
+					boost::cref(agastPoints[i]), boost::ref(layerKeypoints[i])))));
+		}
+		for(size_t i = 0; i<threads.size(); i++){
+			threads.at(i)->join();
+		}
+	}
+
 	for(uint8_t i = 0; i<layers_; i++){
-		cv::BriskLayer& l=pyramid_[i];
-		const int num=agastPoints[i].size();
-		if(i==layers_-1){
-			for(int n=0; n < num; n++){
-				const CvPoint& point=agastPoints.at(i)[n];
-				// consider only 2D maxima...
-				if (!isMax2D(i, point.x, point.y))
-					continue;
-
-				bool ismax;
-				float dx, dy;
-				getScoreMaxBelow(i, point.x, point.y,
-						l.getAgastScore(point.x,   point.y, safeThreshold_), ismax,
-						dx, dy);
-				if(!ismax)
-					continue;
-
-				// get the patch on this layer:
-				register int s_0_0 = l.getAgastScore(point.x-1, point.y-1, 1);
-				register int s_1_0 = l.getAgastScore(point.x,   point.y-1, 1);
-				register int s_2_0 = l.getAgastScore(point.x+1, point.y-1, 1);
-				register int s_2_1 = l.getAgastScore(point.x+1, point.y,   1);
-				register int s_1_1 = l.getAgastScore(point.x,   point.y,   1);
-				register int s_0_1 = l.getAgastScore(point.x-1, point.y,   1);
-				register int s_0_2 = l.getAgastScore(point.x-1, point.y+1, 1);
-				register int s_1_2 = l.getAgastScore(point.x,   point.y+1, 1);
-				register int s_2_2 = l.getAgastScore(point.x+1, point.y+1, 1);
-				float delta_x, delta_y;
-				float max = subpixel2D(s_0_0, s_0_1, s_0_2,
-							s_1_0, s_1_1, s_1_2,
-							s_2_0, s_2_1, s_2_2,
-							delta_x, delta_y);
+		keypoints.insert(keypoints.end(), layerKeypoints[i].begin(), layerKeypoints[i].end());
+	}
+}
 
-				// store:
-				keypoints.push_back(cv::KeyPoint((float(point.x)+delta_x)*l.scale()+l.offset(),
-						(float(point.y)+delta_y)*l.scale()+l.offset(), basicSize_*l.scale(), -1, max,i));
-			}
+void BriskScaleSpace::refineKeypoints(uint8_t layer, const std::vector<CvPoint>& agastPoints,
+		std::vector<cv::KeyPoint>& keypoints){
+	float x,y,scale,score;
+	cv::BriskLayer& l=pyramid_[layer];
+	const int num=agastPoints.size();
+	if(layer==layers_-1){
+		for(int n=0; n < num; n++){
+			const CvPoint& point=agastPoints[n];
+			// consider only 2D maxima...
+			if (!isMax2D(layer, point.x, point.y))
+				continue;
+
+			bool ismax;
+			float dx, dy;
+			getScoreMaxBelow(layer, point.x, point.y,
+					l.getAgastScore(point.x,   point.y, safeThreshold_), ismax,
+					dx, dy);
+			if(!ismax)
+				continue;
+
+			// get the patch on this layer:
+			register int s_0_0 = l.getAgastScore(point.x-1, point.y-1, 1);
+			register int s_1_0 = l.getAgastScore(point.x,   point.y-1, 1);
+			register int s_2_0 = l.getAgastScore(point.x+1, point.y-1, 1);
+			register int s_2_1 = l.getAgastScore(point.x+1, point.y,   1);
+			register int s_1_1 = l.getAgastScore(point.x,   point.y,   1);
+			register int s_0_1 = l.getAgastScore(point.x-1, point.y,   1);
+			register int s_0_2 = l.getAgastScore(point.x-1, point.y+1, 1);
+			register int s_1_2 = l.getAgastScore(point.x,   point.y+1, 1);
+			register int s_2_2 = l.getAgastScore(point.x+1, point.y+1, 1);
+			float delta_x, delta_y;
+			float max = subpixel2D(s_0_0, s_0_1, s_0_2,
+						s_1_0, s_1_1, s_1_2,
+						s_2_0, s_2_1, s_2_2,
+						delta_x, delta_y);
+
+			// store:
+			keypoints.push_back(cv::KeyPoint((float(point.x)+delta_x)*l.scale()+l.offset(),
+					(float(point.y)+delta_y)*l.scale()+l.offset(), basicSize_*l.scale(), -1, max,layer));
 		}
-		else{
-			// not the last layer:
-			for(int n=0; n < num; n++){
-				const CvPoint& point=agastPoints.at(i)[n];
-
-				// first check if it is a maximum:
-				if (!isMax2D(i, point.x, point.y))
-					continue;
-
-				// let's do the subpixel and float scale refinement:
-				bool ismax;
-				score=refine3D(i,point.x, point.y,x,y,scale,ismax);
-				if(!ismax){
-					continue;
-				}
+	}
+	else{
+		// not the last layer:
+		for(int n=0; n < num; n++){
+			const CvPoint& point=agastPoints[n];
 
-				// finally store the detected keypoint:
-				if(score>float(threshold_)){
-					keypoints.push_back(cv::KeyPoint(x, y, basicSize_*scale, -1, score,i));
-				}
+			// first check if it is a maximum:
+			if (!isMax2D(layer, point.x, point.y))
+				continue;
+
+			// let's do the subpixel and float scale refinement:
+			bool ismax;
+			score=refine3D(layer,point.x, point.y,x,y,scale,ismax);
+			if(!ismax){
+				continue;
+			}
+
+			// finally store the detected keypoint:
+			if(score>float(threshold_)){
+				keypoints.push_back(cv::KeyPoint(x, y, basicSize_*scale, -1, score,layer));
 			}
 		}
 	}
@@ -0,0 +1,90 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+#include <algorithm>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+
+namespace camodocal
+{
+
+// FIFO queue which connects a producer and a consumer thread. push()
+// blocks while the queue is full, and pop() blocks while it is empty, so
+// a slow consumer throttles the producer.
+template<class T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity);
+
+    void push(const T& item);
+    void pop(T& item);
+
+    size_t size(void);
+
+private:
+    std::deque<T> mItems;
+    size_t mCapacity;
+
+    boost::mutex mMutex;
+    boost::condition_variable mNotEmptyCond;
+    boost::condition_variable mNotFullCond;
+};
+
+template<class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+ : mCapacity(std::max(capacity, static_cast<size_t>(1)))
+{
+
+}
+
+template<class T>
+void
+BoundedQueue<T>::push(const T& item)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+
+        while (mItems.size() >= mCapacity)
+        {
+            mNotFullCond.wait(lock);
+        }
+
+        mItems.push_back(item);
+    }
+
+    mNotEmptyCond.notify_one();
+}
+
+template<class T>
+void
+BoundedQueue<T>::pop(T& item)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mMutex);
+
+        while (mItems.empty())
+        {
+            mNotEmptyCond.wait(lock);
+        }
+
+        item = mItems.front();
+        mItems.pop_front();
+    }
+
+    mNotFullCond.notify_one();
+}
+
+template<class T>
+size_t
+BoundedQueue<T>::size(void)
+{
+    boost::lock_guard<boost::mutex> lock(mMutex);
+
+    return mItems.size();
+}
+
+}
+
+#endif
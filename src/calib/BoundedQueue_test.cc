@@ -0,0 +1,46 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "BoundedQueue.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+produce(BoundedQueue<int>* queue, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        queue->push(i);
+
+        EXPECT_LE(queue->size(), 2u);
+    }
+}
+
+}
+
+TEST(BoundedQueue, Order)
+{
+    BoundedQueue<int> queue(2);
+
+    const int n = 10000;
+    boost::thread producer(boost::bind(&produce, &queue, n));
+
+    for (int i = 0; i < n; ++i)
+    {
+        int item = -1;
+        queue.pop(item);
+
+        EXPECT_EQ(item, i);
+    }
+
+    producer.join();
+
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+}
@@ -1,5 +1,6 @@
 #include "CalibrationWindow.h"
 
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
 #include <GL/freeglut.h>
 
 #include "../../../../library/gpl/CameraEnums.h"
@@ -56,11 +57,16 @@ CalibrationWindow::open(const std::string& title,
     }
 
     mDisplayThread = Glib::Thread::create(sigc::bind(sigc::ptr_fun(&CalibrationWindow::displayHandler), this), true);
+
+    // overlays are only drawn and published while the window is shown
+    VisualizationPublisher::instance()->attach();
 }
 
 void
 CalibrationWindow::close(void)
 {
+    VisualizationPublisher::instance()->detach();
+
     mQuit = true;
 
     mDisplayThread->join();
@@ -1,22 +1,65 @@
 #include "CamOdoThread.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
 #include <iostream>
 
 #include "../gpl/EigenUtils.h"
+#include "../location_recognition/LocationRecognition.h"
 #include "../visual_odometry/FeatureTracker.h"
 #include "utils.h"
 #ifdef VCHARGE_VIZ
 #include "../../../../library/gpl/CameraEnums.h"
 #include "../../../../visualization/overlay/GLOverlayExtended.h"
 #include "CalibrationWindow.h"
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
 #endif
 
 namespace camodocal
 {
 
+// An image on its way through the stages of CamOdoThread.
+class CamOdoThread::FrameJob
+{
+public:
+    FrameJob()
+     : last(false)
+     , keyFrame(true)
+     , timeStamp(0)
+     , camValid(false)
+    {
+
+    }
+
+    // marks the end of the image stream
+    bool last;
+    // images which are not keyframes are only tracked with KLT
+    bool keyFrame;
+
+    uint64_t timeStamp;
+    cv::Mat image;
+
+    OdometryPtr interpOdo;
+    PosePtr interpGpsIns;
+    OdometryPtr gpsIns;
+    // the pose which the frame is tagged with
+    OdometryPtr systemPose;
+
+    TemporalFeatureTracker::Features features;
+
+    FramePtr frame;
+    bool camValid;
+
+    // VO poses and frames of the track which ended with this job
+    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > voPoses;
+    std::vector<FramePtr> voFrames;
+
+    cv::Mat sketch;
+};
+
 CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
                            bool preprocess,
-                           AtomicData<cv::Mat>* image,
+                           AtomicData<ImageBuffer>* image,
                            const CameraConstPtr& camera,
                            SensorDataBuffer<OdometryPtr>& odometryBuffer,
                            SensorDataBuffer<OdometryPtr>& interpOdometryBuffer,
@@ -30,10 +73,13 @@ CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
                            bool& stop,
                            bool verbose)
  : m_poseSource(poseSource)
+ , m_featureType(SURF_GPU_FEATURES)
+ , m_kltTracking(false)
  , m_thread(0)
  , m_cameraId(cameraId)
  , m_running(false)
  , m_preprocess(preprocess)
+ , m_descriptorFormat(DESCRIPTOR_FLOAT)
  , m_image(image)
  , m_camera(camera)
  , m_odometryBuffer(odometryBuffer)
@@ -47,6 +93,12 @@ CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
  , k_keyFrameDistance(0.25)
  , k_minTrackLength(15)
  , k_odometryTimeout(4.0)
+ , k_queueCapacity(2)
+ , m_featureQueue(k_queueCapacity)
+ , m_trackingQueue(k_queueCapacity)
+ , m_bookkeepingQueue(k_queueCapacity)
+ , m_hasKeyFrame(false)
+ , m_keyFrameTimeStamp(0)
  , m_completed(completed)
  , m_stop(stop)
 {
@@ -77,6 +129,36 @@ CamOdoThread::frameSegments(void) const
     return m_frameSegments;
 }
 
+void
+CamOdoThread::setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec)
+{
+    m_locRec = locRec;
+}
+
+void
+CamOdoThread::setImageStore(const ImageStorePtr& imageStore)
+{
+    m_imageStore = imageStore;
+}
+
+void
+CamOdoThread::setFeatureType(FeatureType featureType)
+{
+    m_featureType = featureType;
+}
+
+void
+CamOdoThread::setKLTTracking(bool kltTracking)
+{
+    m_kltTracking = kltTracking;
+}
+
+void
+CamOdoThread::setDescriptorFormat(DescriptorFormat descriptorFormat)
+{
+    m_descriptorFormat = descriptorFormat;
+}
+
 void
 CamOdoThread::reprojectionError(double& minError, double& maxError, double& avgError) const
 {
@@ -170,25 +252,48 @@ CamOdoThread::threadFunction(void)
 {
     m_running = true;
 
-    TemporalFeatureTracker tracker(m_camera,
-                                   SURF_GPU_DETECTOR, SURF_GPU_DESCRIPTOR,
-                                   RATIO_GPU, m_preprocess);
-    tracker.setVerbose(m_camOdoCalib.getVerbose());
-
-    FramePtr framePrev;
-
-    cv::Mat image;
-    cv::Mat colorImage;
+    DetectorType detectorType = SURF_GPU_DETECTOR;
+    DescriptorType descriptorType = SURF_GPU_DESCRIPTOR;
+    MatchTestType matchTestType = RATIO_GPU;
+    switch (m_featureType)
+    {
+    case ORB_FEATURES:
+        detectorType = ORB_DETECTOR;
+        descriptorType = ORB_DESCRIPTOR;
+        matchTestType = RATIO;
+        break;
+    case BRISK_FEATURES:
+        detectorType = BRISK_DETECTOR;
+        descriptorType = BRISK_DESCRIPTOR;
+        matchTestType = RATIO;
+        break;
+    case SURF_GPU_FEATURES:
+    default:
+        break;
+    }
 
-    int trackBreaks = 0;
+    m_tracker.reset(new TemporalFeatureTracker(m_camera,
+                                               detectorType, descriptorType,
+                                               matchTestType, m_preprocess));
+    m_tracker->setVerbose(m_camOdoCalib.getVerbose());
+    m_tracker->setVOMode(TemporalFeatureTracker::VO_ODOMETRY_AIDED);
+    if (m_kltTracking)
+    {
+        m_tracker->setTrackingMode(TemporalFeatureTracker::TRACK_KLT);
+    }
 
-    std::vector<OdometryPtr> odometryPoses;
+    m_hasKeyFrame = false;
+    m_keyFrameTimeStamp = 0;
 
-#ifdef VCHARGE_VIZ
-    std::ostringstream oss;
-    oss << "swba" << m_cameraId + 1;
-    vcharge::GLOverlayExtended overlay(oss.str(), VCharge::COORDINATE_FRAME_GLOBAL);
-#endif
+    // The images pass through a pipeline of stages which run in their
+    // own threads: this thread acquires the images and their vehicle
+    // poses, the feature thread extracts features, the tracking thread
+    // runs VO and bundle adjustment, and the bookkeeping thread collects
+    // the motion segments. The features of an image are thus extracted
+    // while the previous keyframe is being tracked.
+    boost::thread featureThread(boost::bind(&CamOdoThread::featureThreadFunction, this));
+    boost::thread trackingThread(boost::bind(&CamOdoThread::trackingThreadFunction, this));
+    boost::thread bookkeepingThread(boost::bind(&CamOdoThread::bookkeepingThreadFunction, this));
 
     bool halt = false;
 
@@ -202,19 +307,10 @@ CamOdoThread::threadFunction(void)
 
         if (m_stop)
         {
-            std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > voPoses = tracker.getPoses();
-
-            if (odometryPoses.size() >= k_minTrackLength)
-            {
-                addCamOdoCalibData(voPoses, odometryPoses, tracker.getFrames());
-            }
-
-            if (!odometryPoses.empty())
-            {
-                odometryPoses.erase(odometryPoses.begin(), odometryPoses.begin() + voPoses.size() - 1);
-            }
+            FrameJobPtr job(new FrameJob);
+            job->last = true;
 
-            ++trackBreaks;
+            m_featureQueue.push(job);
 
             halt = true;
         }
@@ -225,7 +321,14 @@ CamOdoThread::threadFunction(void)
 
             uint64_t timeStamp = m_image->timeStamp();
 
-            if (framePrev.get() != 0 && timeStamp == framePrev->cameraPose()->timeStamp())
+            bool duplicate;
+            {
+                boost::lock_guard<boost::mutex> lock(m_keyFrameMutex);
+
+                duplicate = m_hasKeyFrame && timeStamp == m_keyFrameTimeStamp;
+            }
+
+            if (duplicate)
             {
                 m_image->unlockData();
                 m_image->notifyProcessingDone();
@@ -233,23 +336,17 @@ CamOdoThread::threadFunction(void)
                 continue;
             }
 
-            m_image->data().copyTo(image);
+            FrameJobPtr job(new FrameJob);
+            job->timeStamp = timeStamp;
 
-            m_image->unlockData();
+            // the image is immutable, and is shared instead of copied
+            job->image = m_image->data().mat();
 
-            if (image.channels() == 1)
-            {
-                cv::cvtColor(image, colorImage, CV_GRAY2BGR);
-            }
-            else
-            {
-                image.copyTo(colorImage);
-            }
+            m_image->unlockData();
 
             // skip if current car position is too near previous position
             OdometryPtr currOdometry;
             PosePtr currGpsIns;
-            Eigen::Vector2d pos;
 
             if (m_poseSource == ODOMETRY && !m_odometryBuffer.current(currOdometry))
             {
@@ -259,51 +356,10 @@ CamOdoThread::threadFunction(void)
             {
                 std::cout << "# WARNING: No data in GPS/INS buffer." << std::endl;
             }
-            else
+            else if (interpolatePoses(timeStamp, job->interpOdo, job->interpGpsIns))
             {
-                m_odometryBufferMutex.lock();
-
-                OdometryPtr interpOdo;
-                if (m_poseSource == ODOMETRY && !m_interpOdometryBuffer.find(timeStamp, interpOdo))
-                {
-                    double timeStart = timeInSeconds();
-                    while (!interpolateOdometry(m_odometryBuffer, timeStamp, interpOdo))
-                    {
-                        if (timeInSeconds() - timeStart > k_odometryTimeout)
-                        {
-                            std::cout << "# ERROR: No odometry data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
-                            exit(1);
-                        }
-
-                        usleep(1000);
-                    }
-
-                    m_interpOdometryBuffer.push(timeStamp, interpOdo);
-                }
-
-                m_odometryBufferMutex.unlock();
-
-                m_gpsInsBufferMutex.lock();
-
-                PosePtr interpGpsIns;
-                if ((m_poseSource == GPS_INS || !m_gpsInsBuffer.empty()) && !m_interpGpsInsBuffer.find(timeStamp, interpGpsIns))
-                {
-                    double timeStart = timeInSeconds();
-                    while (!interpolatePose(m_gpsInsBuffer, timeStamp, interpGpsIns))
-                    {
-                        if (timeInSeconds() - timeStart > k_odometryTimeout)
-                        {
-                            std::cout << "# ERROR: No GPS/INS data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
-                            exit(1);
-                        }
-
-                        usleep(1000);
-                    }
-
-                    m_interpGpsInsBuffer.push(timeStamp, interpGpsIns);
-                }
-
-                m_gpsInsBufferMutex.unlock();
+                const OdometryPtr& interpOdo = job->interpOdo;
+                const PosePtr& interpGpsIns = job->interpGpsIns;
 
                 Eigen::Vector3d pos;
                 if (m_poseSource == ODOMETRY)
@@ -317,84 +373,191 @@ CamOdoThread::threadFunction(void)
                     pos(2) = interpGpsIns->translation()(2);
                 }
 
-                if (framePrev.get() != 0 &&
-                    (pos - framePrev->systemPose()->position()).norm() < k_keyFrameDistance)
+                if (m_poseSource == GPS_INS)
                 {
-                    m_image->notifyProcessingDone();
-                    continue;
+                    job->gpsIns.reset(new Odometry);
+                    job->gpsIns->timeStamp() = interpGpsIns->timeStamp();
+                    job->gpsIns->x() = interpGpsIns->translation()(1);
+                    job->gpsIns->y() = -interpGpsIns->translation()(0);
+
+                    Eigen::Matrix3d R = interpGpsIns->rotation().toRotationMatrix();
+                    double roll, pitch, yaw;
+                    mat2RPY(R, roll, pitch, yaw);
+                    job->gpsIns->yaw() = -yaw;
                 }
 
-                FramePtr frame(new Frame);
-                frame->cameraId() = m_cameraId;
-                image.copyTo(frame->image());
+                // the frame is tagged with this pose, which is also used
+                // as a prior for VO
+                job->systemPose = (m_poseSource == GPS_INS) ? job->gpsIns : interpOdo;
 
-                Eigen::Matrix3d R;
-                Eigen::Vector3d t;
-                bool camValid = tracker.addFrame(frame, m_camera->mask(), R, t);
+                {
+                    boost::lock_guard<boost::mutex> lock(m_keyFrameMutex);
 
-                // tag frame with odometry and GPS/INS data
-                frame->odometryMeasurement().reset(new Odometry);
-                *(frame->odometryMeasurement()) = *interpOdo;
-                frame->systemPose().reset(new Odometry);
-                *(frame->systemPose()) = *interpOdo;
+                    if (m_hasKeyFrame &&
+                        (pos - m_keyFramePos).norm() < k_keyFrameDistance)
+                    {
+                        job->keyFrame = false;
+                    }
+                    else
+                    {
+                        m_hasKeyFrame = true;
+                        m_keyFrameTimeStamp = timeStamp;
+                        m_keyFramePos = job->systemPose->position();
+                    }
+                }
 
-                if (interpGpsIns.get() != 0)
+                // with KLT tracking, the features are tracked through the
+                // skipped images
+                if (job->keyFrame || m_kltTracking)
                 {
-                    frame->gpsInsMeasurement() = interpGpsIns;
+                    m_featureQueue.push(job);
                 }
+            }
 
-                if (m_poseSource == GPS_INS)
-                {
-                    OdometryPtr gpsIns(new Odometry);
-                    gpsIns->timeStamp() = interpGpsIns->timeStamp();
-                    gpsIns->x() = interpGpsIns->translation()(1);
-                    gpsIns->y() = -interpGpsIns->translation()(0);
+            m_image->notifyProcessingDone();
+        }
+    }
 
-                    Eigen::Matrix3d R = interpGpsIns->rotation().toRotationMatrix();
-                    double roll, pitch, yaw;
-                    mat2RPY(R, roll, pitch, yaw);
-                    gpsIns->yaw() = -yaw;
+    featureThread.join();
+    trackingThread.join();
+    bookkeepingThread.join();
 
-                    frame->odometryMeasurement().reset(new Odometry);
-                    *(frame->odometryMeasurement()) = *gpsIns;
-                    frame->systemPose().reset(new Odometry);
-                    *(frame->systemPose()) = *gpsIns;
-                }
+    m_tracker.reset();
+
+    std::cout << "# INFO: Calibrating odometry - camera " << m_cameraId << "..." << std::endl;
+
+//    m_camOdoCalib.writeMotionSegmentsToFile(filename);
+
+    Eigen::Matrix4d H_cam_odo;
+    m_camOdoCalib.calibrate(H_cam_odo);
+
+    std::cout << "# INFO: Finished calibrating odometry - camera " << m_cameraId << "..." << std::endl;
+    std::cout << "Rotation: " << std::endl << H_cam_odo.block<3,3>(0,0) << std::endl;
+    std::cout << "Translation: " << std::endl << H_cam_odo.block<3,1>(0,3).transpose() << std::endl;
+
+    m_camOdoTransform = H_cam_odo;
+
+    m_running = false;
+
+    m_signalFinished();
+}
+
+void
+CamOdoThread::featureThreadFunction(void)
+{
+    bool halt = false;
+
+    while (!halt)
+    {
+        FrameJobPtr job;
+        m_featureQueue.pop(job);
+
+        if (job->last)
+        {
+            halt = true;
+        }
+        else if (job->keyFrame)
+        {
+            extractFeatures(*job);
+        }
 
-                frame->cameraPose()->timeStamp() = timeStamp;
+        m_trackingQueue.push(job);
+    }
+}
 
-                if (camValid)
+void
+CamOdoThread::trackingThreadFunction(void)
+{
+#ifdef VCHARGE_VIZ
+    std::ostringstream oss;
+    oss << "swba" << m_cameraId + 1;
+    std::string overlayName = oss.str();
+#endif
+
+    bool halt = false;
+
+    while (!halt)
+    {
+        FrameJobPtr job;
+        m_trackingQueue.pop(job);
+
+        if (job->last)
+        {
+            job->voPoses = m_tracker->getPoses();
+            job->voFrames = m_tracker->getFrames();
+
+            halt = true;
+        }
+        else
+        {
+            if (!job->keyFrame)
+            {
+                // the skipped image becomes a keyframe if too many
+                // features are lost
+                if (m_tracker->trackFrame(job->image))
                 {
-                    odometryPoses.push_back(frame->systemPose());
+                    continue;
                 }
 
-                framePrev = frame;
+                extractFeatures(*job);
+                job->keyFrame = true;
 
-                if (!camValid)
+                boost::lock_guard<boost::mutex> lock(m_keyFrameMutex);
+
+                if (job->timeStamp > m_keyFrameTimeStamp)
                 {
-                    std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > voPoses = tracker.getPoses();
+                    m_keyFrameTimeStamp = job->timeStamp;
+                    m_keyFramePos = job->systemPose->position();
+                }
+            }
 
-                    if (odometryPoses.size() >= k_minTrackLength)
-                    {
-                        addCamOdoCalibData(voPoses, odometryPoses, tracker.getFrames());
-                    }
+            // the tracker sets the image of the frame
+            FramePtr frame(new Frame);
+            frame->cameraId() = m_cameraId;
 
-                    if (!odometryPoses.empty())
-                    {
-                        odometryPoses.erase(odometryPoses.begin(), odometryPoses.begin() + voPoses.size() - 1);
-                    }
+            Eigen::Matrix3d R;
+            Eigen::Vector3d t;
+            job->camValid = m_tracker->addFrame(frame, job->features, job->systemPose, R, t);
 
-                    ++trackBreaks;
-                }
+            // tag frame with odometry and GPS/INS data
+            frame->odometryMeasurement().reset(new Odometry);
+            *(frame->odometryMeasurement()) = *(job->interpOdo);
+            frame->systemPose().reset(new Odometry);
+            *(frame->systemPose()) = *(job->interpOdo);
+
+            if (job->interpGpsIns.get() != 0)
+            {
+                frame->gpsInsMeasurement() = job->interpGpsIns;
+            }
+
+            if (m_poseSource == GPS_INS)
+            {
+                frame->odometryMeasurement().reset(new Odometry);
+                *(frame->odometryMeasurement()) = *(job->gpsIns);
+                frame->systemPose().reset(new Odometry);
+                *(frame->systemPose()) = *(job->gpsIns);
+            }
+
+            frame->cameraPose()->timeStamp() = job->timeStamp;
+
+            job->frame = frame;
+
+            if (!job->camValid)
+            {
+                job->voPoses = m_tracker->getPoses();
+                job->voFrames = m_tracker->getFrames();
             }
         }
 
 #ifdef VCHARGE_VIZ
+        if (VisualizationPublisher::instance()->attached())
         {
             // visualize camera poses and 3D scene points
-            const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& poses = tracker.getPoses();
+            const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& poses = m_tracker->getPoses();
+
+            boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+            vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
-            overlay.clear();
             overlay.pointSize(2.0f);
             overlay.lineWidth(1.0f);
 
@@ -489,10 +652,78 @@ CamOdoThread::threadFunction(void)
                 overlay.end();
             }
 
-            overlay.publish();
+            VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
+        }
+
+        if (!m_tracker->getSketch().empty())
+        {
+            m_tracker->getSketch().copyTo(job->sketch);
         }
 #endif
 
+        m_bookkeepingQueue.push(job);
+    }
+}
+
+void
+CamOdoThread::bookkeepingThreadFunction(void)
+{
+    int trackBreaks = 0;
+
+    std::vector<OdometryPtr> odometryPoses;
+
+    bool halt = false;
+
+    while (!halt)
+    {
+        FrameJobPtr job;
+        m_bookkeepingQueue.pop(job);
+
+        if (job->last)
+        {
+            halt = true;
+        }
+        else
+        {
+            FramePtr& frame = job->frame;
+
+            if (m_locRec.get() != 0)
+            {
+                m_locRec->addFrame(frame);
+            }
+
+            if (m_imageStore.get() != 0)
+            {
+                frame->storeImage(m_imageStore);
+            }
+
+            if (m_descriptorFormat != DESCRIPTOR_FLOAT)
+            {
+                compactDescriptors(frame->features2D(), m_descriptorFormat);
+            }
+
+            if (job->camValid)
+            {
+                odometryPoses.push_back(frame->systemPose());
+            }
+        }
+
+        // the track ended with this frame
+        if (job->last || !job->camValid)
+        {
+            if (odometryPoses.size() >= k_minTrackLength)
+            {
+                addCamOdoCalibData(job->voPoses, odometryPoses, job->voFrames);
+            }
+
+            if (!odometryPoses.empty())
+            {
+                odometryPoses.erase(odometryPoses.begin(), odometryPoses.begin() + job->voPoses.size() - 1);
+            }
+
+            ++trackBreaks;
+        }
+
         int currentMotionCount = 0;
         if (odometryPoses.size() >= k_minTrackLength)
         {
@@ -508,42 +739,123 @@ CamOdoThread::threadFunction(void)
 
         m_status.assign(oss.str());
 
-        if (!tracker.getSketch().empty())
+        // neither the sketch nor the image are modified, so they are
+        // shared with the display
+        if (!job->sketch.empty())
         {
-            tracker.getSketch().copyTo(m_sketch);
+            m_sketch = job->sketch;
         }
-        else
+        else if (!job->image.empty())
         {
-            colorImage.copyTo(m_sketch);
+            m_sketch = job->image;
         }
 
         CalibrationWindow::instance()->dataMutex().unlock();
 #endif
 
-        m_image->notifyProcessingDone();
-
         if (m_camOdoCalib.getCurrentMotionCount() + currentMotionCount >= m_camOdoCalib.getMotionCount())
         {
             m_completed = true;
         }
     }
+}
 
-    std::cout << "# INFO: Calibrating odometry - camera " << m_cameraId << "..." << std::endl;
+template<class T>
+bool
+CamOdoThread::waitForSensorData(SensorDataBuffer<T>& buffer, uint64_t timeStamp)
+{
+    boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(static_cast<int64_t>(k_odometryTimeout * 1000.0));
 
-//    m_camOdoCalib.writeMotionSegmentsToFile(filename);
+    // wake up periodically to respond to a stop request
+    while (!m_stop)
+    {
+        boost::system_time timeout = std::min(deadline, boost::get_system_time() + boost::posix_time::milliseconds(10));
 
-    Eigen::Matrix4d H_cam_odo;
-    m_camOdoCalib.calibrate(H_cam_odo);
+        if (buffer.timedWaitForData(timeStamp, timeout))
+        {
+            return true;
+        }
 
-    std::cout << "# INFO: Finished calibrating odometry - camera " << m_cameraId << "..." << std::endl;
-    std::cout << "Rotation: " << std::endl << H_cam_odo.block<3,3>(0,0) << std::endl;
-    std::cout << "Translation: " << std::endl << H_cam_odo.block<3,1>(0,3).transpose() << std::endl;
+        if (timeout == deadline)
+        {
+            return false;
+        }
+    }
 
-    m_camOdoTransform = H_cam_odo;
+    return false;
+}
 
-    m_running = false;
+bool
+CamOdoThread::interpolatePoses(uint64_t timeStamp,
+                               OdometryPtr& interpOdo, PosePtr& interpGpsIns)
+{
+    // the buffers are waited on without holding the locks, which only
+    // guard the interpolated poses shared between the camera threads
+    if (m_poseSource == ODOMETRY)
+    {
+        if (!waitForSensorData(m_odometryBuffer, timeStamp))
+        {
+            if (!m_stop)
+            {
+                std::cout << "# WARNING: No odometry data for " << k_odometryTimeout << "s. Skipping image." << std::endl;
+            }
 
-    m_signalFinished();
+            return false;
+        }
+
+        boost::lock_guard<boost::mutex> lock(m_odometryBufferMutex);
+
+        if (!m_interpOdometryBuffer.find(timeStamp, interpOdo))
+        {
+            if (!interpolateOdometry(m_odometryBuffer, timeStamp, interpOdo))
+            {
+                std::cout << "# WARNING: Unable to interpolate odometry data. Skipping image." << std::endl;
+
+                return false;
+            }
+
+            m_interpOdometryBuffer.push(timeStamp, interpOdo);
+        }
+    }
+
+    if (m_poseSource == GPS_INS || !m_gpsInsBuffer.empty())
+    {
+        if (!waitForSensorData(m_gpsInsBuffer, timeStamp))
+        {
+            if (!m_stop)
+            {
+                std::cout << "# WARNING: No GPS/INS data for " << k_odometryTimeout << "s. Skipping image." << std::endl;
+            }
+
+            return false;
+        }
+
+        boost::lock_guard<boost::mutex> lock(m_gpsInsBufferMutex);
+
+        if (!m_interpGpsInsBuffer.find(timeStamp, interpGpsIns))
+        {
+            if (!interpolatePose(m_gpsInsBuffer, timeStamp, interpGpsIns))
+            {
+                std::cout << "# WARNING: Unable to interpolate GPS/INS data. Skipping image." << std::endl;
+
+                return false;
+            }
+
+            m_interpGpsInsBuffer.push(timeStamp, interpGpsIns);
+        }
+    }
+
+    return true;
+}
+
+void
+CamOdoThread::extractFeatures(FrameJob& job)
+{
+    // serializes the keyframe promotions of the tracking thread with the
+    // feature thread, as the detectors are not reentrant
+    boost::lock_guard<boost::mutex> lock(m_extractMutex);
+
+    m_tracker->extractFeatures(job.image, m_camera->mask(), job.features);
 }
 
 void
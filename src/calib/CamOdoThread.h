@@ -1,18 +1,27 @@
 #ifndef CAMODOTHREAD_H
 #define CAMODOTHREAD_H
 
+#include <boost/thread.hpp>
 #include <glibmm.h>
 
 #include "camodocal/calib/AtomicData.h"
 #include "camodocal/calib/CamOdoCalibration.h"
+#include "camodocal/calib/FeatureType.h"
+#include "camodocal/calib/ImageBuffer.h"
 #include "camodocal/calib/PoseSource.h"
 #include "camodocal/calib/SensorDataBuffer.h"
 #include "camodocal/camera_models/Camera.h"
+#include "camodocal/sparse_graph/Descriptor.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
+#include "BoundedQueue.h"
 
 namespace camodocal
 {
 
+// forward declarations
+class LocationRecognition;
+class TemporalFeatureTracker;
+
 class CamOdoThread
 {
 public:
@@ -20,7 +29,7 @@ public:
 
     explicit CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
                           bool preprocess,
-                          AtomicData<cv::Mat>* image,
+                          AtomicData<ImageBuffer>* image,
                           const CameraConstPtr& camera,
                           SensorDataBuffer<OdometryPtr>& odometryBuffer,
                           SensorDataBuffer<OdometryPtr>& interpOdometryBuffer,
@@ -39,6 +48,21 @@ public:
     const Eigen::Matrix4d& camOdoTransform(void) const;
     const std::vector<std::vector<FramePtr> >& frameSegments(void) const;
 
+    // keyframes are added to the location recognition database
+    // as they are produced
+    void setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec);
+
+    // keyframe images are moved to the image store once they are tracked
+    void setImageStore(const ImageStorePtr& imageStore);
+
+    void setFeatureType(FeatureType featureType);
+
+    // features are tracked with KLT through the images between keyframes
+    void setKLTTracking(bool kltTracking);
+
+    // keyframe descriptors are converted to this format once they are tracked
+    void setDescriptorFormat(DescriptorFormat descriptorFormat);
+
     void reprojectionError(double& minError, double& maxError, double& avgError) const;
 
     void launch(void);
@@ -47,13 +71,31 @@ public:
     sigc::signal<void>& signalFinished(void);
 
 private:
+    class FrameJob;
+    typedef boost::shared_ptr<FrameJob> FrameJobPtr;
+
+    // pipeline stages
     void threadFunction(void);
+    void featureThreadFunction(void);
+    void trackingThreadFunction(void);
+    void bookkeepingThreadFunction(void);
+
+    void extractFeatures(FrameJob& job);
+
+    // Returns false if no poses are available for the timestamp, in
+    // which case the image is skipped.
+    bool interpolatePoses(uint64_t timeStamp,
+                          OdometryPtr& interpOdo, PosePtr& interpGpsIns);
+    template<class T>
+    bool waitForSensorData(SensorDataBuffer<T>& buffer, uint64_t timeStamp);
 
     void addCamOdoCalibData(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& camPoses,
                             const std::vector<OdometryPtr>& odoPoses,
                             std::vector<FramePtr>& frameSegment);
 
     PoseSource m_poseSource;
+    FeatureType m_featureType;
+    bool m_kltTracking;
 
     Glib::Threads::Thread* m_thread;
     int m_cameraId;
@@ -63,8 +105,11 @@ private:
 
     CamOdoCalibration m_camOdoCalib;
     std::vector<std::vector<FramePtr> > m_frameSegments;
+    boost::shared_ptr<LocationRecognition> m_locRec;
+    ImageStorePtr m_imageStore;
+    DescriptorFormat m_descriptorFormat;
 
-    AtomicData<cv::Mat>* m_image;
+    AtomicData<ImageBuffer>* m_image;
     const CameraConstPtr m_camera;
     SensorDataBuffer<OdometryPtr>& m_odometryBuffer;
     SensorDataBuffer<OdometryPtr>& m_interpOdometryBuffer;
@@ -79,6 +124,20 @@ private:
     const double k_keyFrameDistance;
     const int k_minTrackLength;
     const double k_odometryTimeout;
+    const size_t k_queueCapacity;
+
+    boost::shared_ptr<TemporalFeatureTracker> m_tracker;
+    boost::mutex m_extractMutex;
+
+    BoundedQueue<FrameJobPtr> m_featureQueue;
+    BoundedQueue<FrameJobPtr> m_trackingQueue;
+    BoundedQueue<FrameJobPtr> m_bookkeepingQueue;
+
+    // the last keyframe, which decides if an image is skipped
+    boost::mutex m_keyFrameMutex;
+    bool m_hasKeyFrame;
+    uint64_t m_keyFrameTimeStamp;
+    Eigen::Vector3d m_keyFramePos;
 
     bool& m_completed;
     bool& m_stop;
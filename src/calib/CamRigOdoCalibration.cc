@@ -7,6 +7,7 @@
 #include <iostream>
 
 #include "../gpl/EigenUtils.h"
+#include "../location_recognition/LocationRecognition.h"
 #include "CamOdoThread.h"
 #include "CamOdoWatchdogThread.h"
 #include "CamRigThread.h"
@@ -30,15 +31,23 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
  , m_odometryBuffer(1000)
  , m_gpsInsBuffer(1000)
  , m_cameraSystem(cameras.size())
+ , m_locRec(new LocationRecognition)
  , m_statuses(cameras.size())
  , m_sketches(cameras.size())
  , m_camOdoCompleted(boost::extents[cameras.size()])
  , m_options(options)
  , m_running(false)
 {
+    if (!options.imageStoreDir.empty())
+    {
+        m_imageStore.reset(new ImageStore(options.imageStoreDir,
+                                          options.imageStoreFormat,
+                                          options.imageCacheSize));
+    }
+
     for (size_t i = 0; i < m_camOdoThreads.size(); ++i)
     {
-        m_images.at(i) = new AtomicData<cv::Mat>();
+        m_images.at(i) = new AtomicData<ImageBuffer>();
         m_camOdoCompleted[i] = false;
 
         CamOdoThread* thread = new CamOdoThread(options.poseSource, options.nMotions, i, options.preprocessImages,
@@ -47,6 +56,15 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
                                                 m_gpsInsBuffer, m_interpGpsInsBuffer, m_gpsInsBufferMutex,
                                                 m_statuses.at(i), m_sketches.at(i), m_camOdoCompleted[i], m_stop,
                                                 options.verbose);
+        if (options.featureType == SURF_GPU_FEATURES)
+        {
+            // the vocabulary can only index SURF descriptors
+            thread->setLocationRecognition(m_locRec);
+        }
+        thread->setImageStore(m_imageStore);
+        thread->setFeatureType(options.featureType);
+        thread->setKLTTracking(options.kltTracking);
+        thread->setDescriptorFormat(options.descriptorFormat);
         m_camOdoThreads.at(i) = thread;
         thread->signalFinished().connect(sigc::bind(sigc::mem_fun(*this, &CamRigOdoCalibration::onCamOdoThreadFinished), thread));
     }
@@ -54,6 +72,8 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
     m_camOdoWatchdogThread = new CamOdoWatchdogThread(m_camOdoCompleted, m_stop);
 
     m_camRigThread = new CamRigThread(m_cameraSystem, m_graph, options.beginStage, options.optimizeIntrinsics, options.saveWorkingData, options.dataDir, options.verbose);
+    m_camRigThread->setLocationRecognition(m_locRec);
+    m_camRigThread->setPoseGraphBackend(options.poseGraphBackend);
     m_camRigThread->signalFinished().connect(sigc::bind(sigc::mem_fun(*this, &CamRigOdoCalibration::onCamRigThreadFinished), m_camRigThread));
 
     for (size_t i = 0; i < m_sketches.size(); ++i)
@@ -72,11 +92,20 @@ void
 CamRigOdoCalibration::addFrame(int cameraId, const cv::Mat& image,
                                uint64_t timestamp)
 {
-    AtomicData<cv::Mat>* frame = m_images.at(cameraId);
+    addFrame(cameraId, ImageBuffer(image.clone()), timestamp);
+}
+
+void
+CamRigOdoCalibration::addFrame(int cameraId, const ImageBuffer& image,
+                               uint64_t timestamp)
+{
+    AtomicData<ImageBuffer>* frame = m_images.at(cameraId);
 
     frame->lockData();
 
-    image.copyTo(frame->data());
+    // the camera thread may still hold the previous image, which is
+    // therefore replaced instead of overwritten
+    frame->data() = image;
 
     frame->timeStamp() = timestamp;
 
@@ -98,10 +127,37 @@ CamRigOdoCalibration::addFrameSet(const std::vector<cv::Mat>& images,
         return;
     }
 
+    void (CamRigOdoCalibration::*addFrameFunction)(int, const cv::Mat&, uint64_t) = &CamRigOdoCalibration::addFrame;
+
+    std::vector<boost::shared_ptr<boost::thread> > threads(m_cameras.size());
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        threads.at(i).reset(new boost::thread(boost::bind(addFrameFunction, this,
+                                                          i, images.at(i), timestamp)));
+    }
+
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        threads.at(i)->join();
+    }
+}
+
+void
+CamRigOdoCalibration::addFrameSet(const std::vector<ImageBuffer>& images,
+                                  uint64_t timestamp)
+{
+    if (images.size() != m_cameras.size())
+    {
+        std::cout << "# WARNING: Number of images does not match number of cameras." << std::endl;
+        return;
+    }
+
+    void (CamRigOdoCalibration::*addFrameFunction)(int, const ImageBuffer&, uint64_t) = &CamRigOdoCalibration::addFrame;
+
     std::vector<boost::shared_ptr<boost::thread> > threads(m_cameras.size());
     for (size_t i = 0; i < m_cameras.size(); ++i)
     {
-        threads.at(i).reset(new boost::thread(boost::bind(&CamRigOdoCalibration::addFrame, this,
+        threads.at(i).reset(new boost::thread(boost::bind(addFrameFunction, this,
                                                           i, images.at(i), timestamp)));
     }
 
@@ -428,6 +484,28 @@ CamRigOdoCalibration::buildGraph(void)
     }
 }
 
+#ifdef VCHARGE_VIZ
+namespace
+{
+
+// the sketch of an image without tracked features is the image itself,
+// which is only converted to color once it is displayed
+void
+copySketch(const cv::Mat& sketch, cv::Mat& view)
+{
+    if (sketch.channels() == 1)
+    {
+        cv::cvtColor(sketch, view, CV_GRAY2BGR);
+    }
+    else
+    {
+        sketch.copyTo(view);
+    }
+}
+
+}
+#endif
+
 bool
 CamRigOdoCalibration::displayHandler(void)
 {
@@ -439,10 +517,10 @@ CamRigOdoCalibration::displayHandler(void)
     CalibrationWindow::instance()->rearText().assign(m_statuses.at(2));
     CalibrationWindow::instance()->rightText().assign(m_statuses.at(3));
 
-    m_sketches.at(0).copyTo(CalibrationWindow::instance()->frontView());
-    m_sketches.at(1).copyTo(CalibrationWindow::instance()->leftView());
-    m_sketches.at(2).copyTo(CalibrationWindow::instance()->rearView());
-    m_sketches.at(3).copyTo(CalibrationWindow::instance()->rightView());
+    copySketch(m_sketches.at(0), CalibrationWindow::instance()->frontView());
+    copySketch(m_sketches.at(1), CalibrationWindow::instance()->leftView());
+    copySketch(m_sketches.at(2), CalibrationWindow::instance()->rearView());
+    copySketch(m_sketches.at(3), CalibrationWindow::instance()->rightView());
 
     CalibrationWindow::instance()->dataMutex().unlock();
 #endif
@@ -20,6 +20,7 @@ CamRigThread::CamRigThread(CameraSystem& cameraSystem,
  , mOptimizeIntrinsics(optimizeIntrinsics)
  , mSaveWorkingData(saveWorkingData)
  , mDataDir(dataDir)
+ , mPoseGraphBackend(PoseGraph::BACKEND_CERES)
  , mVerbose(verbose)
 {
 
@@ -30,6 +31,18 @@ CamRigThread::~CamRigThread()
     g_return_if_fail(mThread == 0);
 }
 
+void
+CamRigThread::setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec)
+{
+    mLocRec = locRec;
+}
+
+void
+CamRigThread::setPoseGraphBackend(PoseGraph::Backend backend)
+{
+    mPoseGraphBackend = backend;
+}
+
 void
 CamRigThread::launch(void)
 {
@@ -65,6 +78,8 @@ CamRigThread::threadFunction(void)
 
     CameraRigBA ba(mCameraSystem, mGraph);
     ba.setVerbose(mVerbose);
+    ba.setLocationRecognition(mLocRec);
+    ba.setPoseGraphBackend(mPoseGraphBackend);
     ba.run(mBeginStage, mOptimizeIntrinsics, mSaveWorkingData, mDataDir);
 
     mRunning = false;
@@ -5,11 +5,15 @@
 
 #include "camodocal/camera_models/Camera.h"
 #include "camodocal/camera_systems/CameraSystem.h"
+#include "camodocal/pose_graph/PoseGraph.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
 
 namespace camodocal
 {
 
+// forward declaration
+class LocationRecognition;
+
 class CamRigThread
 {
 public:
@@ -22,6 +26,9 @@ public:
                           bool verbose = false);
     virtual ~CamRigThread();
 
+    void setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec);
+    void setPoseGraphBackend(PoseGraph::Backend backend);
+
     void launch(void);
     void join(void);
     bool running(void) const;
@@ -41,6 +48,8 @@ private:
     bool mOptimizeIntrinsics;
     bool mSaveWorkingData;
     std::string mDataDir;
+    boost::shared_ptr<LocationRecognition> mLocRec;
+    PoseGraph::Backend mPoseGraphBackend;
     bool mVerbose;
 };
 
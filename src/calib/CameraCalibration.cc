@@ -6,6 +6,7 @@
 #include <iostream>
 #include <algorithm>
 #include <fstream>
+#include <limits>
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -23,6 +24,10 @@ namespace camodocal
 CameraCalibration::CameraCalibration()
  : m_boardSize(cv::Size(0,0))
  , m_squareSize(0.0f)
+ , m_incremental(false)
+ , m_minInformationGain(0.05)
+ , m_warmStart(false)
+ , m_intrinsicsChange(0.0)
  , m_verbose(false)
 {
 
@@ -35,6 +40,10 @@ CameraCalibration::CameraCalibration(const Camera::ModelType modelType,
                                      float squareSize)
  : m_boardSize(boardSize)
  , m_squareSize(squareSize)
+ , m_incremental(false)
+ , m_minInformationGain(0.05)
+ , m_warmStart(false)
+ , m_intrinsicsChange(0.0)
  , m_verbose(false)
 {
     m_camera = CameraFactory::instance()->generateCamera(modelType, cameraName, imageSize);
@@ -45,22 +54,44 @@ CameraCalibration::clear(void)
 {
     m_imagePoints.clear();
     m_scenePoints.clear();
+
+    m_cameraPoses.release();
+    m_warmStart = false;
+    m_information.resize(0, 0);
+    m_intrinsicsChange = 0.0;
 }
 
-void
+bool
 CameraCalibration::addChessboardData(const std::vector<cv::Point2f>& corners)
 {
-    m_imagePoints.push_back(corners);
+    std::vector<cv::Point3f> scenePointsInView = boardScenePoints();
 
-    std::vector<cv::Point3f> scenePointsInView;
-    for (int i = 0; i < m_boardSize.height; ++i)
+    // Once an initial calibration is available, score the view by how much
+    // it reduces the uncertainty of the intrinsic parameters.
+    if (m_incremental && m_warmStart && m_information.rows() > 0)
     {
-        for (int j = 0; j < m_boardSize.width; ++j)
+        Eigen::MatrixXd information;
+        double gain = informationGain(corners, information);
+
+        if (gain < m_minInformationGain)
         {
-            scenePointsInView.push_back(cv::Point3f(i * m_squareSize, j * m_squareSize, 0.0));
+            if (m_verbose)
+            {
+                std::cout << "[" << m_camera->cameraName() << "] "
+                          << "# INFO: Rejected redundant view (information gain = "
+                          << gain << ")" << std::endl;
+            }
+
+            return false;
         }
+
+        m_information += information;
     }
+
+    m_imagePoints.push_back(corners);
     m_scenePoints.push_back(scenePointsInView);
+
+    return true;
 }
 
 bool
@@ -68,6 +99,9 @@ CameraCalibration::calibrate(void)
 {
     int imageCount = m_imagePoints.size();
 
+    std::vector<double> intrinsicsPrev;
+    m_camera->writeParameters(intrinsicsPrev);
+
     // compute intrinsic camera parameters and extrinsic parameters for each of the views
     std::vector<cv::Mat> rvecs;
     std::vector<cv::Mat> tvecs;
@@ -84,9 +118,143 @@ CameraCalibration::calibrate(void)
         m_cameraPoses.at<double>(i,5) = tvecs.at(i).at<double>(2);
     }
 
+    if (m_incremental)
+    {
+        std::vector<double> intrinsics;
+        m_camera->writeParameters(intrinsics);
+
+        Eigen::VectorXd x = Eigen::Map<Eigen::VectorXd>(intrinsics.data(), intrinsics.size());
+        Eigen::VectorXd xPrev = Eigen::Map<Eigen::VectorXd>(intrinsicsPrev.data(), intrinsicsPrev.size());
+
+        m_intrinsicsChange = m_warmStart ? (x - xPrev).norm() / std::max(x.norm(), 1e-12) : 1.0;
+
+        // information about the intrinsics from all views at the new estimate
+        m_information = Eigen::MatrixXd::Zero(intrinsics.size(), intrinsics.size());
+        for (int i = 0; i < imageCount; ++i)
+        {
+            Eigen::MatrixXd information;
+            if (viewInformation(m_camera, m_scenePoints.at(i), m_imagePoints.at(i),
+                                rvecs.at(i), tvecs.at(i), information))
+            {
+                m_information += information;
+            }
+        }
+
+        // weak prior keeps the information matrix positive definite
+        m_information.diagonal().array() += 1e-9 * std::max(m_information.diagonal().maxCoeff(), 1.0);
+
+        if (m_verbose)
+        {
+            std::cout << "[" << m_camera->cameraName() << "] "
+                      << "# INFO: Incremental calibration with " << imageCount
+                      << " views, relative change in intrinsics: "
+                      << m_intrinsicsChange << std::endl;
+        }
+
+        m_warmStart = ret;
+    }
+
     return ret;
 }
 
+bool
+CameraCalibration::refine(size_t windowSize)
+{
+    if (!m_incremental || !m_warmStart ||
+        m_cameraPoses.rows > static_cast<int>(m_scenePoints.size()))
+    {
+        return calibrate();
+    }
+
+    int imageCount = m_imagePoints.size();
+    size_t firstView = 0;
+    if (static_cast<size_t>(imageCount) > windowSize)
+    {
+        firstView = imageCount - windowSize;
+    }
+
+    std::vector<double> intrinsicsPrev;
+    m_camera->writeParameters(intrinsicsPrev);
+
+    // keep the poses of calibrated views, and estimate the poses of new views
+    std::vector<cv::Mat> rvecs(imageCount);
+    std::vector<cv::Mat> tvecs(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+    {
+        if (i < m_cameraPoses.rows)
+        {
+            rvecs.at(i) = (cv::Mat_<double>(3,1) << m_cameraPoses.at<double>(i,0),
+                                                    m_cameraPoses.at<double>(i,1),
+                                                    m_cameraPoses.at<double>(i,2));
+            tvecs.at(i) = (cv::Mat_<double>(3,1) << m_cameraPoses.at<double>(i,3),
+                                                    m_cameraPoses.at<double>(i,4),
+                                                    m_cameraPoses.at<double>(i,5));
+        }
+        else
+        {
+            m_camera->estimateExtrinsics(m_scenePoints.at(i), m_imagePoints.at(i), rvecs.at(i), tvecs.at(i));
+        }
+    }
+
+    // only the intrinsics and the poses of the most recent views are optimized
+    optimize(m_camera, rvecs, tvecs, firstView);
+
+    m_cameraPoses = cv::Mat(imageCount, 6, CV_64F);
+    for (int i = 0; i < imageCount; ++i)
+    {
+        m_cameraPoses.at<double>(i,0) = rvecs.at(i).at<double>(0);
+        m_cameraPoses.at<double>(i,1) = rvecs.at(i).at<double>(1);
+        m_cameraPoses.at<double>(i,2) = rvecs.at(i).at<double>(2);
+        m_cameraPoses.at<double>(i,3) = tvecs.at(i).at<double>(0);
+        m_cameraPoses.at<double>(i,4) = tvecs.at(i).at<double>(1);
+        m_cameraPoses.at<double>(i,5) = tvecs.at(i).at<double>(2);
+    }
+
+    std::vector<double> intrinsics;
+    m_camera->writeParameters(intrinsics);
+
+    Eigen::VectorXd x = Eigen::Map<Eigen::VectorXd>(intrinsics.data(), intrinsics.size());
+    Eigen::VectorXd xPrev = Eigen::Map<Eigen::VectorXd>(intrinsicsPrev.data(), intrinsicsPrev.size());
+
+    m_intrinsicsChange = (x - xPrev).norm() / std::max(x.norm(), 1e-12);
+
+    if (m_verbose)
+    {
+        std::cout << "[" << m_camera->cameraName() << "] "
+                  << "# INFO: Refined calibration over views " << firstView
+                  << " to " << imageCount - 1
+                  << ", relative change in intrinsics: "
+                  << m_intrinsicsChange << std::endl;
+    }
+
+    return true;
+}
+
+void
+CameraCalibration::setIncremental(bool incremental, double minInformationGain)
+{
+    m_incremental = incremental;
+    m_minInformationGain = minInformationGain;
+}
+
+double
+CameraCalibration::informationGain(const std::vector<cv::Point2f>& corners) const
+{
+    if (!m_warmStart || m_information.rows() == 0)
+    {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    Eigen::MatrixXd information;
+    return informationGain(corners, information);
+}
+
+double
+CameraCalibration::intrinsicsChange(void) const
+{
+    return m_intrinsicsChange;
+}
+
 int
 CameraCalibration::sampleCount(void) const
 {
@@ -290,6 +458,10 @@ CameraCalibration::readChessboardData(const std::string& filename)
     readData(ifs, m_boardSize.height);
     readData(ifs, m_squareSize);
 
+    // the poses read below were not estimated with the current intrinsics
+    m_warmStart = false;
+    m_information.resize(0, 0);
+
     int rows, cols, type;
     readData(ifs, rows);
     readData(ifs, cols);
@@ -359,13 +531,37 @@ CameraCalibration::calibrateHelper(CameraPtr& camera,
     rvecs.assign(m_scenePoints.size(), cv::Mat());
     tvecs.assign(m_scenePoints.size(), cv::Mat());
 
+    // In incremental mode, start from the previous solution: the current
+    // intrinsics and the poses of all views that were already calibrated.
+    size_t nWarmViews = 0;
+    if (m_incremental && m_warmStart &&
+        m_cameraPoses.rows <= static_cast<int>(m_scenePoints.size()))
+    {
+        nWarmViews = m_cameraPoses.rows;
+    }
+
     // STEP 1: Estimate intrinsics
-    camera->estimateIntrinsics(m_boardSize, m_scenePoints, m_imagePoints);
+    if (nWarmViews == 0)
+    {
+        camera->estimateIntrinsics(m_boardSize, m_scenePoints, m_imagePoints);
+    }
 
     // STEP 2: Estimate extrinsics
     for (size_t i = 0; i < m_scenePoints.size(); ++i)
     {
-        camera->estimateExtrinsics(m_scenePoints.at(i), m_imagePoints.at(i), rvecs.at(i), tvecs.at(i));
+        if (i < nWarmViews)
+        {
+            rvecs.at(i) = (cv::Mat_<double>(3,1) << m_cameraPoses.at<double>(i,0),
+                                                    m_cameraPoses.at<double>(i,1),
+                                                    m_cameraPoses.at<double>(i,2));
+            tvecs.at(i) = (cv::Mat_<double>(3,1) << m_cameraPoses.at<double>(i,3),
+                                                    m_cameraPoses.at<double>(i,4),
+                                                    m_cameraPoses.at<double>(i,5));
+        }
+        else
+        {
+            camera->estimateExtrinsics(m_scenePoints.at(i), m_imagePoints.at(i), rvecs.at(i), tvecs.at(i));
+        }
     }
 
     if (m_verbose)
@@ -378,7 +574,7 @@ CameraCalibration::calibrateHelper(CameraPtr& camera,
     }
 
     // STEP 3: optimization using ceres
-    optimize(camera, rvecs, tvecs);
+    optimize(camera, rvecs, tvecs, 0);
 
     if (m_verbose)
     {
@@ -394,13 +590,14 @@ CameraCalibration::calibrateHelper(CameraPtr& camera,
 
 void
 CameraCalibration::optimize(CameraPtr& camera,
-                            std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs) const
+                            std::vector<cv::Mat>& rvecs, std::vector<cv::Mat>& tvecs,
+                            size_t firstView) const
 {
     // Use ceres to do optimization
     ceres::Problem problem;
 
     double* extrinsicCameraParams[rvecs.size()];
-    for (size_t i = 0; i < rvecs.size(); ++i)
+    for (size_t i = firstView; i < rvecs.size(); ++i)
     {
         extrinsicCameraParams[i] = new double[7];
 
@@ -418,7 +615,7 @@ CameraCalibration::optimize(CameraPtr& camera,
     m_camera->writeParameters(intrinsicCameraParams);
 
     // create residuals for each observation
-    for (size_t i = 0; i < m_imagePoints.size(); ++i)
+    for (size_t i = firstView; i < m_imagePoints.size(); ++i)
     {
         for (size_t j = 0; j < m_imagePoints.at(i).size(); ++j)
         {
@@ -464,7 +661,7 @@ CameraCalibration::optimize(CameraPtr& camera,
 
     camera->readParameters(intrinsicCameraParams);
 
-    for (size_t i = 0; i < rvecs.size(); ++i)
+    for (size_t i = firstView; i < rvecs.size(); ++i)
     {
         Eigen::Vector3d rvec;
         QuaternionToAngleAxis(extrinsicCameraParams[i], rvec);
@@ -479,6 +676,124 @@ CameraCalibration::optimize(CameraPtr& camera,
     }
 }
 
+double
+CameraCalibration::informationGain(const std::vector<cv::Point2f>& corners,
+                                   Eigen::MatrixXd& information) const
+{
+    std::vector<cv::Point3f> scenePointsInView = boardScenePoints();
+
+    cv::Mat rvec, tvec;
+    m_camera->estimateExtrinsics(scenePointsInView, corners, rvec, tvec);
+
+    if (!viewInformation(m_camera, scenePointsInView, corners, rvec, tvec, information))
+    {
+        information = Eigen::MatrixXd::Zero(m_information.rows(), m_information.cols());
+        return 0.0;
+    }
+
+    // 0.5 * log(det(A + B) / det(A)), with the log-determinants computed
+    // from the Cholesky factors
+    Eigen::MatrixXd infoNew = m_information + information;
+
+    return infoNew.llt().matrixLLT().diagonal().array().log().sum() -
+           m_information.llt().matrixLLT().diagonal().array().log().sum();
+}
+
+bool
+CameraCalibration::viewInformation(const CameraConstPtr& camera,
+                                   const std::vector<cv::Point3f>& scenePoints,
+                                   const std::vector<cv::Point2f>& imagePoints,
+                                   const cv::Mat& rvec, const cv::Mat& tvec,
+                                   Eigen::MatrixXd& information) const
+{
+    std::vector<double> intrinsicCameraParams;
+    camera->writeParameters(intrinsicCameraParams);
+    const int nIntrinsics = intrinsicCameraParams.size();
+
+    double extrinsicCameraParams[7];
+
+    Eigen::Vector3d rvecEigen;
+    cv::cv2eigen(rvec, rvecEigen);
+    AngleAxisToQuaternion(rvecEigen, extrinsicCameraParams);
+
+    extrinsicCameraParams[4] = tvec.at<double>(0);
+    extrinsicCameraParams[5] = tvec.at<double>(1);
+    extrinsicCameraParams[6] = tvec.at<double>(2);
+
+    double* parameters[3] = {intrinsicCameraParams.data(),
+                             extrinsicCameraParams,
+                             extrinsicCameraParams + 4};
+
+    // map the quaternion jacobian onto its 3-dof local parameterization
+    Eigen::Matrix<double,4,3,Eigen::RowMajor> J_local;
+    EigenQuaternionParameterization().ComputeJacobian(extrinsicCameraParams, J_local.data());
+
+    // joint normal equations for the intrinsics and the 6-dof view pose
+    Eigen::MatrixXd H = Eigen::MatrixXd::Zero(nIntrinsics + 6, nIntrinsics + 6);
+
+    Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic,Eigen::RowMajor> J_intrinsics(2, nIntrinsics);
+    Eigen::Matrix<double,2,4,Eigen::RowMajor> J_q;
+    Eigen::Matrix<double,2,3,Eigen::RowMajor> J_t;
+    double* jacobians[3] = {J_intrinsics.data(), J_q.data(), J_t.data()};
+    double residuals[2];
+
+    Eigen::MatrixXd J(2, nIntrinsics + 6);
+    for (size_t i = 0; i < imagePoints.size(); ++i)
+    {
+        const cv::Point3f& spt = scenePoints.at(i);
+        const cv::Point2f& ipt = imagePoints.at(i);
+
+        ceres::CostFunction* costFunction =
+            CostFunctionFactory::instance()->generateCostFunction(camera,
+                                                                  Eigen::Vector3d(spt.x, spt.y, spt.z),
+                                                                  Eigen::Vector2d(ipt.x, ipt.y),
+                                                                  CAMERA_INTRINSICS | CAMERA_EXTRINSICS);
+
+        bool valid = costFunction->Evaluate(parameters, residuals, jacobians);
+        delete costFunction;
+
+        if (!valid)
+        {
+            continue;
+        }
+
+        J.leftCols(nIntrinsics) = J_intrinsics;
+        J.block<2,3>(0, nIntrinsics) = J_q * J_local;
+        J.rightCols<3>() = J_t;
+
+        H.noalias() += J.transpose() * J;
+    }
+
+    // marginalize out the view pose (Schur complement)
+    Eigen::Matrix<double,6,6> H_pp = H.bottomRightCorner<6,6>();
+    Eigen::LDLT<Eigen::Matrix<double,6,6> > ldlt(H_pp);
+    if (ldlt.info() != Eigen::Success || !ldlt.isPositive())
+    {
+        return false;
+    }
+
+    Eigen::MatrixXd H_cp = H.topRightCorner(nIntrinsics, 6);
+    information = H.topLeftCorner(nIntrinsics, nIntrinsics) -
+                  H_cp * ldlt.solve(H_cp.transpose());
+
+    return true;
+}
+
+std::vector<cv::Point3f>
+CameraCalibration::boardScenePoints(void) const
+{
+    std::vector<cv::Point3f> scenePoints;
+    for (int i = 0; i < m_boardSize.height; ++i)
+    {
+        for (int j = 0; j < m_boardSize.width; ++j)
+        {
+            scenePoints.push_back(cv::Point3f(i * m_squareSize, j * m_squareSize, 0.0));
+        }
+    }
+
+    return scenePoints;
+}
+
 template<typename T>
 void
 CameraCalibration::readData(std::ifstream& ifs, T& data) const
@@ -24,11 +24,24 @@
 #ifdef VCHARGE_VIZ
 #include "../../../../library/gpl/CameraEnums.h"
 #include "../../../../visualization/overlay/GLOverlayExtended.h"
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
 #endif
 
 namespace camodocal
 {
 
+namespace
+{
+
+bool
+longerFrameSegment(const std::pair<int, std::vector<FramePtr> >& frameSegment1,
+                   const std::pair<int, std::vector<FramePtr> >& frameSegment2)
+{
+    return frameSegment1.second.size() > frameSegment2.second.size();
+}
+
+}
+
 CameraRigBA::CameraRigBA(CameraSystem& cameraSystem,
                          SparseGraph& graph)
  : m_cameraSystem(cameraSystem)
@@ -41,6 +54,7 @@ CameraRigBA::CameraRigBA(CameraSystem& cameraSystem,
  , k_minInterCorrespondences2D2D(8)
  , k_nearestImageMatches(15)
  , k_nominalFocalLength(300.0)
+ , m_poseGraphBackend(PoseGraph::BACKEND_CERES)
  , m_verbose(false)
 {
 
@@ -197,6 +211,11 @@ CameraRigBA::run(int beginStage, bool optimizeIntrinsics,
                             k_nearestImageMatches,
                             k_nominalFocalLength);
         poseGraph.setVerbose(m_verbose);
+        poseGraph.setBackend(m_poseGraphBackend);
+        if (m_locRec.get() != 0)
+        {
+            poseGraph.setLocationRecognition(m_locRec);
+        }
         poseGraph.buildEdges();
         poseGraph.optimize(true);
 
@@ -579,6 +598,18 @@ CameraRigBA::setVerbose(bool verbose)
     m_verbose = verbose;
 }
 
+void
+CameraRigBA::setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec)
+{
+    m_locRec = locRec;
+}
+
+void
+CameraRigBA::setPoseGraphBackend(PoseGraph::Backend backend)
+{
+    m_poseGraphBackend = backend;
+}
+
 void
 CameraRigBA::frameReprojectionError(const FramePtr& frame,
                                     const CameraConstPtr& camera,
@@ -593,6 +624,23 @@ CameraRigBA::frameReprojectionError(const FramePtr& frame,
     size_t count = 0;
     double totalError = 0.0;
 
+    // world-to-camera transform
+    Eigen::Quaterniond q_cam;
+    Eigen::Vector3d t_cam;
+    if (type == ODOMETRY)
+    {
+        worldToCameraTransform(T_cam_odo.rotation(),
+                               T_cam_odo.translation(),
+                               frame->systemPose()->position(),
+                               frame->systemPose()->attitude(),
+                               q_cam, t_cam);
+    }
+    else
+    {
+        q_cam = frame->cameraPose()->rotation();
+        t_cam = frame->cameraPose()->translation();
+    }
+
     const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
 
     for (size_t i = 0; i < features2D.size(); ++i)
@@ -611,24 +659,8 @@ CameraRigBA::frameReprojectionError(const FramePtr& frame,
             continue;
         }
 
-        double error = 0.0;
-
-        if (type == ODOMETRY)
-        {
-            error = reprojectionError(camera, feature3D->point(),
-                                      T_cam_odo.rotation(),
-                                      T_cam_odo.translation(),
-                                      frame->systemPose()->position(),
-                                      frame->systemPose()->attitude(),
-                                      Eigen::Vector2d(feature2D->keypoint().pt.x, feature2D->keypoint().pt.y));
-        }
-        else
-        {
-            error = camera->reprojectionError(feature3D->point(),
-                                              frame->cameraPose()->rotation(),
-                                              frame->cameraPose()->translation(),
-                                              Eigen::Vector2d(feature2D->keypoint().pt.x, feature2D->keypoint().pt.y));
-        }
+        double error = camera->reprojectionError(feature3D->point(), q_cam, t_cam,
+                                                 Eigen::Vector2d(feature2D->keypoint().pt.x, feature2D->keypoint().pt.y));
 
         if (minError > error)
         {
@@ -667,52 +699,35 @@ CameraRigBA::reprojectionError(double& minError, double& maxError,
     size_t count = 0;
     double totalError = 0.0;
 
-    Pose T_cam_odo[m_cameraSystem.cameraCount()];
+    std::vector<Pose, Eigen::aligned_allocator<Pose> > T_cam_odo(m_cameraSystem.cameraCount());
     for (int i = 0; i < m_cameraSystem.cameraCount(); ++i)
     {
-        T_cam_odo[i] = m_cameraSystem.getGlobalCameraPose(i);
+        T_cam_odo.at(i) = m_cameraSystem.getGlobalCameraPose(i);
     }
 
-    for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
-    {
-        const FrameSetSegment& segment = m_graph.frameSetSegment(i);
-
-        for (size_t j = 0; j < segment.size(); ++j)
-        {
-            const FrameSetPtr& frameSet = segment.at(j);
-
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
-            {
-                const FramePtr& frame = frameSet->frames().at(k);
-
-                if (frame.get() == 0)
-                {
-                    continue;
-                }
+    std::vector<FramePtr> frames;
+    graphFrames(m_graph, frames);
 
-                double frameMinError;
-                double frameMaxError;
-                double frameAvgError;
-                size_t frameFeatureCount;
+    // compute the frame errors in parallel, and reduce them in frame order
+    std::vector<FrameReprojectionError> frameErrors(frames.size());
+    parallelFor(frames.size(),
+                boost::bind(&CameraRigBA::frameReprojectionErrorHelper, this,
+                            &frames, &T_cam_odo, type, &frameErrors, _1));
 
-                frameReprojectionError(frame,
-                                       m_cameraSystem.getCamera(frame->cameraId()),
-                                       T_cam_odo[frame->cameraId()],
-                                       frameMinError, frameMaxError, frameAvgError, frameFeatureCount,
-                                       type);
+    for (size_t i = 0; i < frameErrors.size(); ++i)
+    {
+        const FrameReprojectionError& frameError = frameErrors.at(i);
 
-                if (minError > frameMinError)
-                {
-                    minError = frameMinError;
-                }
-                if (maxError < frameMaxError)
-                {
-                    maxError = frameMaxError;
-                }
-                totalError += frameAvgError * frameFeatureCount;
-                count += frameFeatureCount;
-            }
+        if (minError > frameError.minError)
+        {
+            minError = frameError.minError;
+        }
+        if (maxError < frameError.maxError)
+        {
+            maxError = frameError.maxError;
         }
+        totalError += frameError.avgError * frameError.featureCount;
+        count += frameError.featureCount;
     }
 
     if (count == 0)
@@ -729,6 +744,24 @@ CameraRigBA::reprojectionError(double& minError, double& maxError,
     featureCount = count;
 }
 
+void
+CameraRigBA::frameReprojectionErrorHelper(const std::vector<FramePtr>* frames,
+                                          const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_odo,
+                                          int type,
+                                          std::vector<FrameReprojectionError>* frameErrors,
+                                          size_t frameId) const
+{
+    const FramePtr& frame = frames->at(frameId);
+    FrameReprojectionError& frameError = frameErrors->at(frameId);
+
+    frameReprojectionError(frame,
+                           m_cameraSystem.getCamera(frame->cameraId()),
+                           T_cam_odo->at(frame->cameraId()),
+                           frameError.minError, frameError.maxError, frameError.avgError,
+                           frameError.featureCount,
+                           type);
+}
+
 double
 CameraRigBA::reprojectionError(const CameraConstPtr& camera,
                                const Eigen::Vector3d& P,
@@ -737,17 +770,30 @@ CameraRigBA::reprojectionError(const CameraConstPtr& camera,
                                const Eigen::Vector3d& odo_p,
                                const Eigen::Vector3d& odo_att,
                                const Eigen::Vector2d& observed_p) const
+{
+    Eigen::Quaterniond q_cam;
+    Eigen::Vector3d t_cam;
+    worldToCameraTransform(cam_odo_q, cam_odo_t, odo_p, odo_att, q_cam, t_cam);
+
+    return camera->reprojectionError(P, q_cam, t_cam, observed_p);
+}
+
+void
+CameraRigBA::worldToCameraTransform(const Eigen::Quaterniond& cam_odo_q,
+                                    const Eigen::Vector3d& cam_odo_t,
+                                    const Eigen::Vector3d& odo_p,
+                                    const Eigen::Vector3d& odo_att,
+                                    Eigen::Quaterniond& q_cam,
+                                    Eigen::Vector3d& t_cam) const
 {
     Eigen::Quaterniond q_z_inv(cos(odo_att(0) / 2.0), 0.0, 0.0, -sin(odo_att(0) / 2.0));
     Eigen::Quaterniond q_y_inv(cos(odo_att(1) / 2.0), 0.0, -sin(odo_att(1) / 2.0), 0.0);
     Eigen::Quaterniond q_x_inv(cos(odo_att(2) / 2.0), -sin(odo_att(2) / 2.0), 0.0, 0.0);
 
     Eigen::Quaterniond q_world_odo = q_x_inv * q_y_inv * q_z_inv;
-    Eigen::Quaterniond q_cam = cam_odo_q.conjugate() * q_world_odo;
+    q_cam = cam_odo_q.conjugate() * q_world_odo;
 
-    Eigen::Vector3d t_cam = - q_cam.toRotationMatrix() * odo_p - cam_odo_q.conjugate().toRotationMatrix() * cam_odo_t;
-
-    return camera->reprojectionError(P, q_cam, t_cam, observed_p);
+    t_cam = - q_cam.toRotationMatrix() * odo_p - cam_odo_q.conjugate().toRotationMatrix() * cam_odo_t;
 }
 
 void
@@ -786,47 +832,87 @@ CameraRigBA::triangulateFeatureCorrespondences(void)
         }
     }
 
-    // triangulate feature correspondences to get 3D scene points in odometry frame
+    // split the frames of each camera and segment into runs of
+    // consecutive frames; runs do not share features, and are
+    // triangulated concurrently
+    std::vector<std::pair<int, std::vector<FramePtr> > > frameSegments;
     for (int i = 0; i < m_cameraSystem.cameraCount(); ++i)
     {
-        Pose T_cam_odo(m_cameraSystem.getGlobalCameraPose(i));
-
         for (size_t j = 0; j < m_graph.frameSetSegments().size(); ++j)
         {
             FrameSetSegment& segment = m_graph.frameSetSegment(j);
 
-            std::vector<std::vector<FramePtr> > frameSegments;
-            frameSegments.resize(1);
-
-            for (size_t k = 0; k < segment.size(); ++k)
+            std::vector<FramePtr> frameSegment;
+            for (size_t k = 0; k <= segment.size(); ++k)
             {
-                FramePtr& frame = segment.at(k)->frames().at(i);
-
-                if (frame.get() == 0)
+                if (k < segment.size() && segment.at(k)->frames().at(i).get() != 0)
                 {
-                    frameSegments.resize(frameSegments.size() + 1);
+                    frameSegment.push_back(segment.at(k)->frames().at(i));
+                    continue;
                 }
-                else
+
+                if (frameSegment.size() >= 3)
                 {
-                    frameSegments.back().push_back(frame);
+                    frameSegments.push_back(std::make_pair(i, frameSegment));
                 }
+                frameSegment.clear();
             }
+        }
+    }
 
-            for (size_t k = 0; k < frameSegments.size(); ++k)
-            {
-                std::vector<FramePtr>& frameSegment = frameSegments.at(k);
+    // start with the longest runs to balance the load across threads
+    std::stable_sort(frameSegments.begin(), frameSegments.end(), longerFrameSegment);
 
-                if (frameSegment.size() < 3)
-                {
-                    continue;
-                }
+    size_t nThreads = std::min(std::max(boost::thread::hardware_concurrency(), 1u),
+                               static_cast<unsigned int>(frameSegments.size()));
 
-                for (size_t l = 2; l < frameSegment.size(); ++l)
-                {
-                    triangulateFeatures(frameSegment.at(l-2), frameSegment.at(l-1), frameSegment.at(l),
-                                        m_cameraSystem.getCamera(i), T_cam_odo);
-                }
+    size_t nextFrameSegmentId = 0;
+    boost::mutex frameSegmentMutex;
+
+    std::vector<boost::shared_ptr<boost::thread> > threads(nThreads);
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        threads.at(i).reset(new boost::thread(boost::bind(&CameraRigBA::triangulateFeatureSegments, this,
+                                                          &frameSegments, &nextFrameSegmentId,
+                                                          &frameSegmentMutex)));
+    }
+
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        threads.at(i)->join();
+    }
+}
+
+void
+CameraRigBA::triangulateFeatureSegments(std::vector<std::pair<int, std::vector<FramePtr> > >* frameSegments,
+                                        size_t* nextFrameSegmentId,
+                                        boost::mutex* frameSegmentMutex)
+{
+    while (true)
+    {
+        size_t frameSegmentId;
+        {
+            boost::lock_guard<boost::mutex> lock(*frameSegmentMutex);
+
+            if (*nextFrameSegmentId >= frameSegments->size())
+            {
+                return;
             }
+
+            frameSegmentId = (*nextFrameSegmentId)++;
+        }
+
+        int cameraId = frameSegments->at(frameSegmentId).first;
+        std::vector<FramePtr>& frameSegment = frameSegments->at(frameSegmentId).second;
+
+        Pose T_cam_odo(m_cameraSystem.getGlobalCameraPose(cameraId));
+
+        // each window propagates the scene points of the previous window,
+        // so the windows of a run are triangulated in order
+        for (size_t l = 2; l < frameSegment.size(); ++l)
+        {
+            triangulateFeatures(frameSegment.at(l-2), frameSegment.at(l-1), frameSegment.at(l),
+                                m_cameraSystem.getCamera(cameraId), T_cam_odo);
         }
     }
 }
@@ -1106,6 +1192,28 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
     {
         FrameSetPtr& frameSet = m_graph.frameSetSegment(segmentId).at(frameSetId);
 
+        // load the images of the next frame set while this one is matched;
+        // the images in the windows were loaded in earlier iterations
+        int nextSegmentId = segmentId;
+        int nextFrameSetId = frameSetId + 1;
+        if (nextFrameSetId >= m_graph.frameSetSegment(segmentId).size())
+        {
+            ++nextSegmentId;
+            nextFrameSetId = 0;
+        }
+        if (nextSegmentId < m_graph.frameSetSegments().size())
+        {
+            const FrameSetPtr& nextFrameSet = m_graph.frameSetSegment(nextSegmentId).at(nextFrameSetId);
+
+            for (size_t i = 0; i < nextFrameSet->frames().size(); ++i)
+            {
+                if (nextFrameSet->frames().at(i).get() != 0)
+                {
+                    nextFrameSet->frames().at(i)->prefetchImage();
+                }
+            }
+        }
+
         for (int cameraId = 0; cameraId < m_cameraSystem.cameraCount(); ++cameraId)
         {
             std::list<FramePtr>& window = windows[cameraId];
@@ -1347,7 +1455,9 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
         return;
     }
 
-    if (frame2->image().empty())
+    cv::Mat image1 = frame1->image();
+    cv::Mat image2 = frame2->image();
+    if (image1.empty() || image2.empty())
     {
         return;
     }
@@ -1406,8 +1516,8 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
     }
 
     cv::Mat rimg1, rimg2;
-    cv::remap(frame1->image(), rimg1, mapX1, mapY1, cv::INTER_LINEAR);
-    cv::remap(frame2->image(), rimg2, mapX2, mapY2, cv::INTER_LINEAR);
+    cv::remap(image1, rimg1, mapX1, mapY1, cv::INTER_LINEAR);
+    cv::remap(image2, rimg2, mapX2, mapY2, cv::INTER_LINEAR);
 
     cv::Mat rmask1, rmask2;
     if (m_cameraSystem.getCamera(cameraId1)->mask().empty())
@@ -1679,40 +1789,50 @@ CameraRigBA::tvt(const CameraConstPtr& camera,
                  std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& points3D,
                  std::vector<size_t>& inliers) const
 {
-    Eigen::Matrix<double, 3, 4> P1 = H1.block<3,4>(0,0);
     Eigen::Matrix<double, 3, 4> P2 = H2.block<3,4>(0,0);
     Eigen::Matrix<double, 3, 4> P3 = H3.block<3,4>(0,0);
 
-    Eigen::Matrix4d H12 = H2 * H1.inverse();
-    Eigen::Matrix4d H23 = H3 * H2.inverse();
-    Eigen::Matrix4d H13 = H3 * H1.inverse();
-
-    Eigen::Matrix3d E12 = skew(Eigen::Vector3d(H12.block<3,1>(0,3))) * H12.block<3,3>(0,0);
-    Eigen::Matrix3d E23 = skew(Eigen::Vector3d(H23.block<3,1>(0,3))) * H23.block<3,3>(0,0);
-    Eigen::Matrix3d E13 = skew(Eigen::Vector3d(H13.block<3,1>(0,3))) * H13.block<3,3>(0,0);
+    const size_t nPoints = imagePoints1.size();
 
-    // linear triangulation
-    for (size_t i = 0; i < imagePoints1.size(); ++i)
+    // rectify the image points in the last two views in one batch; the
+    // first view is only used to validate the scene points
+    Eigen::Matrix2Xd rectImagePoints2(2, nPoints);
+    Eigen::Matrix2Xd rectImagePoints3(2, nPoints);
+    for (size_t i = 0; i < nPoints; ++i)
     {
-        const cv::Point2f& p1_cv = imagePoints1.at(i);
         const cv::Point2f& p2_cv = imagePoints2.at(i);
         const cv::Point2f& p3_cv = imagePoints3.at(i);
 
-        cv::Point2f rect_p1_cv, rect_p2_cv, rect_p3_cv;
-        rectifyImagePoint(camera, p1_cv, rect_p1_cv);
-        rectifyImagePoint(camera, p2_cv, rect_p2_cv);
-        rectifyImagePoint(camera, p3_cv, rect_p3_cv);
+        Eigen::Vector2d rect_p2, rect_p3;
+        rectifyImagePoint(camera, Eigen::Vector2d(p2_cv.x, p2_cv.y), rect_p2);
+        rectifyImagePoint(camera, Eigen::Vector2d(p3_cv.x, p3_cv.y), rect_p3);
+
+        rectImagePoints2.col(i) = rect_p2;
+        rectImagePoints3.col(i) = rect_p3;
+    }
+
+    points3D.reserve(points3D.size() + nPoints);
+    inliers.reserve(inliers.size() + nPoints);
 
+    // linear triangulation; the normal equations of the DLT system are
+    // solved with the homogeneous coordinate of the scene point fixed to 1
+    for (size_t i = 0; i < nPoints; ++i)
+    {
         Eigen::Matrix4d J;
-        J.row(0) = P2.row(2) * rect_p2_cv.x - P2.row(0);
-        J.row(1) = P2.row(2) * rect_p2_cv.y - P2.row(1);
-        J.row(2) = P3.row(2) * rect_p3_cv.x - P3.row(0);
-        J.row(3) = P3.row(2) * rect_p3_cv.y - P3.row(1);
+        J.row(0) = P2.row(2) * rectImagePoints2(0,i) - P2.row(0);
+        J.row(1) = P2.row(2) * rectImagePoints2(1,i) - P2.row(1);
+        J.row(2) = P3.row(2) * rectImagePoints3(0,i) - P3.row(0);
+        J.row(3) = P3.row(2) * rectImagePoints3(1,i) - P3.row(1);
+
+        Eigen::Matrix4d JtJ = J.transpose() * J;
 
-        Eigen::JacobiSVD<Eigen::MatrixXd> svd(J, Eigen::ComputeThinU | Eigen::ComputeThinV);
-        Eigen::Vector4d scenePoint = svd.matrixV().block<4,1>(0,3);
+        Eigen::Vector4d scenePoint;
+        scenePoint << JtJ.block<3,3>(0,0).ldlt().solve(-JtJ.block<3,1>(0,3)), 1.0;
 
-        scenePoint /= scenePoint(3);
+        if (!scenePoint.allFinite())
+        {
+            continue;
+        }
 
         // validate scene point
         Eigen::Vector3d p1, p2, p3;
@@ -1783,13 +1903,13 @@ CameraRigBA::triangulate3DPoint(const Point2DFeatureConstPtr& p1,
     H = frame2->systemPose()->toMatrix().inverse() *
         frame1->systemPose()->toMatrix();
 
-    Eigen::MatrixXd A(3,2);
+    Eigen::Matrix<double,3,2> A;
     A.col(0) = H.block<3,3>(0,0) * q1;
     A.col(1) = -q2;
 
     Eigen::Vector3d b = q2.cross(q2p) - H.block<3,3>(0,0) * q1xq1p - H.block<3,1>(0,3);
 
-    Eigen::Vector2d gamma = A.jacobiSvd(Eigen::ComputeThinU | Eigen::ComputeThinV).solve(b);
+    Eigen::Vector2d gamma = A.jacobiSvd(Eigen::ComputeFullU | Eigen::ComputeFullV).solve(b);
 
     scenePoint = q1xq1p + gamma(0) * q1;
 
@@ -1830,116 +1950,128 @@ CameraRigBA::prune(int flags, int poseType)
         H_odo_cam.at(i) = T_cam_odo.at(i).toMatrix().inverse();
     }
 
-    // prune points that are too far away or behind a camera
-    for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
+    std::vector<FramePtr> frames;
+    graphFrames(m_graph, frames);
+
+    // find points that are too far away or behind a camera in parallel
+    std::vector<std::vector<size_t> > pruneFeatureIds(frames.size());
+    parallelFor(frames.size(),
+                boost::bind(&CameraRigBA::pruneHelper, this,
+                            &frames, flags, poseType, &T_cam_odo, &H_odo_cam,
+                            &pruneFeatureIds, _1));
+
+    // delete their feature tracks in frame order
+    for (size_t i = 0; i < frames.size(); ++i)
     {
-        FrameSetSegment& segment = m_graph.frameSetSegment(i);
+        std::vector<Point2DFeaturePtr>& features2D = frames.at(i)->features2D();
 
-        for (size_t j = 0; j < segment.size(); ++j)
+        for (size_t j = 0; j < pruneFeatureIds.at(i).size(); ++j)
         {
-            FrameSetPtr& frameSet = segment.at(j);
+            Point2DFeaturePtr& pf = features2D.at(pruneFeatureIds.at(i).at(j));
 
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
+            // the track may have been deleted with an earlier feature
+            if (pf->feature3D().get() == 0)
             {
-                FramePtr& frame = frameSet->frames().at(k);
+                continue;
+            }
 
-                if (frame.get() == 0)
+            // delete entire feature track
+            std::vector<Point2DFeatureWPtr> features2D = pf->feature3D()->features2D();
+
+            for (size_t m = 0; m < features2D.size(); ++m)
+            {
+                if (Point2DFeaturePtr feature2D = features2D.at(m).lock())
                 {
-                    continue;
+                    feature2D->feature3D() = Point3DFeaturePtr();
                 }
+            }
+        }
+    }
+}
 
-                int cameraId = frame->cameraId();
-
-                std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
+void
+CameraRigBA::pruneHelper(const std::vector<FramePtr>* frames,
+                         int flags, int poseType,
+                         const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_odo,
+                         const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >* H_odo_cam,
+                         std::vector<std::vector<size_t> >* pruneFeatureIds,
+                         size_t frameId) const
+{
+    const FramePtr& frame = frames->at(frameId);
 
-                Eigen::Matrix4d H_cam = Eigen::Matrix4d::Identity();
-                if (frame->cameraPose().get() != 0)
-                {
-                    H_cam = frame->cameraPose()->toMatrix();
-                }
+    int cameraId = frame->cameraId();
+    const CameraConstPtr& camera = m_cameraSystem.getCamera(cameraId);
 
-                Eigen::Matrix4d H_odo_inv = frame->systemPose()->toMatrix().inverse();
+    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
 
-                for (size_t l = 0; l < features2D.size(); ++l)
-                {
-                    Point2DFeaturePtr& pf = features2D.at(l);
+    // world-to-camera transform
+    Eigen::Matrix4d H_cam = Eigen::Matrix4d::Identity();
+    Eigen::Quaterniond q_cam = Eigen::Quaterniond::Identity();
+    Eigen::Vector3d t_cam = Eigen::Vector3d::Zero();
+    if (poseType == CAMERA)
+    {
+        if (frame->cameraPose().get() != 0)
+        {
+            H_cam = frame->cameraPose()->toMatrix();
 
-                    if (pf->feature3D().get() == 0)
-                    {
-                        continue;
-                    }
+            q_cam = frame->cameraPose()->rotation();
+            t_cam = frame->cameraPose()->translation();
+        }
+    }
+    else
+    {
+        H_cam = H_odo_cam->at(cameraId) * frame->systemPose()->toMatrix().inverse();
 
-                    Eigen::Vector4d P;
-                    P << pf->feature3D()->point(), 1.0;
+        worldToCameraTransform(T_cam_odo->at(cameraId).rotation(),
+                               T_cam_odo->at(cameraId).translation(),
+                               frame->systemPose()->position(),
+                               frame->systemPose()->attitude(),
+                               q_cam, t_cam);
+    }
 
-                    Eigen::Vector4d P_cam;
-                    if (poseType == CAMERA)
-                    {
-                        P_cam = H_cam * P;
-                    }
-                    else
-                    {
-                        P_cam = (H_odo_cam.at(cameraId) * H_odo_inv) * P;
-                    }
+    for (size_t i = 0; i < features2D.size(); ++i)
+    {
+        const Point2DFeatureConstPtr& pf = features2D.at(i);
 
-                    bool prune = false;
+        if (pf->feature3D().get() == 0)
+        {
+            continue;
+        }
 
-                    if ((flags & PRUNE_BEHIND_CAMERA) == PRUNE_BEHIND_CAMERA &&
-                        P_cam(2) < 0.0)
-                    {
-                        prune = true;
-                    }
+        Eigen::Vector4d P;
+        P << pf->feature3D()->point(), 1.0;
 
-                    if ((flags & PRUNE_FARAWAY) == PRUNE_FARAWAY &&
-                        P_cam.block<3,1>(0,0).norm() > k_maxPoint3DDistance)
-                    {
-                        prune = true;
-                    }
+        Eigen::Vector4d P_cam = H_cam * P;
 
-                    if ((flags & PRUNE_HIGH_REPROJ_ERR) == PRUNE_HIGH_REPROJ_ERR)
-                    {
-                        double error = 0.0;
+        bool prune = false;
 
-                        if (poseType == CAMERA)
-                        {
-                            error = m_cameraSystem.getCamera(cameraId)->reprojectionError(pf->feature3D()->point(),
-                                                                                          frame->cameraPose()->rotation(),
-                                                                                          frame->cameraPose()->translation(),
-                                                                                          Eigen::Vector2d(pf->keypoint().pt.x, pf->keypoint().pt.y));
-                        }
-                        else
-                        {
-                            error = reprojectionError(m_cameraSystem.getCamera(cameraId),
-                                                      pf->feature3D()->point(),
-                                                      T_cam_odo.at(cameraId).rotation(),
-                                                      T_cam_odo.at(cameraId).translation(),
-                                                      frame->systemPose()->position(),
-                                                      frame->systemPose()->attitude(),
-                                                      Eigen::Vector2d(pf->keypoint().pt.x, pf->keypoint().pt.y));
-                        }
+        if ((flags & PRUNE_BEHIND_CAMERA) == PRUNE_BEHIND_CAMERA &&
+            P_cam(2) < 0.0)
+        {
+            prune = true;
+        }
 
-                        if (error > k_maxReprojErr)
-                        {
-                            prune = true;
-                        }
-                    }
+        if ((flags & PRUNE_FARAWAY) == PRUNE_FARAWAY &&
+            P_cam.block<3,1>(0,0).norm() > k_maxPoint3DDistance)
+        {
+            prune = true;
+        }
 
-                    if (prune)
-                    {
-                        // delete entire feature track
-                        std::vector<Point2DFeatureWPtr> features2D = pf->feature3D()->features2D();
+        if (!prune && (flags & PRUNE_HIGH_REPROJ_ERR) == PRUNE_HIGH_REPROJ_ERR)
+        {
+            double error = camera->reprojectionError(pf->feature3D()->point(), q_cam, t_cam,
+                                                     Eigen::Vector2d(pf->keypoint().pt.x, pf->keypoint().pt.y));
 
-                        for (size_t m = 0; m < features2D.size(); ++m)
-                        {
-                            if (Point2DFeaturePtr feature2D = features2D.at(m).lock())
-                            {
-                                feature2D->feature3D() = Point3DFeaturePtr();
-                            }
-                        }
-                    }
-                }
+            if (error > k_maxReprojErr)
+            {
+                prune = true;
             }
         }
+
+        if (prune)
+        {
+            pruneFeatureIds->at(frameId).push_back(i);
+        }
     }
 }
 
@@ -2491,85 +2623,45 @@ CameraRigBA::reweightScenePoints(void)
     // Note that the observation condition only applies to scene points
     // *locally* observed by multiple cameras.
 
+    std::vector<FramePtr> frames;
+    graphFrames(m_graph, frames);
+
+    std::vector<std::pair<size_t, size_t> > frameScenePointCounts(frames.size());
+    parallelFor(frames.size(),
+                boost::bind(&CameraRigBA::countScenePointsHelper, this,
+                            &frames, &frameScenePointCounts, _1));
+
     size_t nPoints = 0;
     size_t nPointsMultipleCams = 0;
-    boost::unordered_set<Point3DFeature*> scenePointSet;
-    for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
+    for (size_t i = 0; i < frameScenePointCounts.size(); ++i)
     {
-        FrameSetSegment& segment = m_graph.frameSetSegment(i);
-
-        for (size_t j = 0; j < segment.size(); ++j)
-        {
-            FrameSetPtr& frameSet = segment.at(j);
-
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
-            {
-                FramePtr& frame = frameSet->frames().at(k);
-
-                if (frame.get() == 0)
-                {
-                    continue;
-                }
-
-                const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-                for (size_t l = 0; l < features2D.size(); ++l)
-                {
-                    if (features2D.at(l)->feature3D().get() != 0)
-                    {
-                        if (features2D.at(l)->feature3D()->attributes() & Point3DFeature::LOCALLY_OBSERVED_BY_DIFFERENT_CAMERAS)
-                        {
-                            ++nPointsMultipleCams;
-                        }
-
-                        ++nPoints;
-
-                        scenePointSet.insert(features2D.at(l)->feature3D().get());
-                    }
-                }
-            }
-        }
+        nPoints += frameScenePointCounts.at(i).first;
+        nPointsMultipleCams += frameScenePointCounts.at(i).second;
     }
 
     double weightM = static_cast<double>(nPoints - nPointsMultipleCams) / static_cast<double>(nPointsMultipleCams);
 
-    for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
+    // scene points are shared between frames, and are updated serially
+    for (size_t i = 0; i < frames.size(); ++i)
     {
-        FrameSetSegment& segment = m_graph.frameSetSegment(i);
+        const std::vector<Point2DFeaturePtr>& features2D = frames.at(i)->features2D();
 
-        for (size_t j = 0; j < segment.size(); ++j)
+        for (size_t j = 0; j < features2D.size(); ++j)
         {
-            FrameSetPtr& frameSet = segment.at(j);
+            Point3DFeaturePtr& feature3D = features2D.at(j)->feature3D();
 
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
+            if (feature3D.get() == 0)
             {
-                FramePtr& frame = frameSet->frames().at(k);
-
-                if (frame.get() == 0)
-                {
-                    continue;
-                }
-
-                const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-
-                for (size_t l = 0; l < features2D.size(); ++l)
-                {
-                    Point3DFeaturePtr& feature3D = features2D.at(l)->feature3D();
-
-                    if (feature3D.get() == 0)
-                    {
-                        continue;
-                    }
+                continue;
+            }
 
-                    if (feature3D->attributes() & Point3DFeature::LOCALLY_OBSERVED_BY_DIFFERENT_CAMERAS)
-                    {
-                        feature3D->weight() = weightM;
-                    }
-                    else
-                    {
-                        feature3D->weight() = 1.0;
-                    }
-                }
+            if (feature3D->attributes() & Point3DFeature::LOCALLY_OBSERVED_BY_DIFFERENT_CAMERAS)
+            {
+                feature3D->weight() = weightM;
+            }
+            else
+            {
+                feature3D->weight() = 1.0;
             }
         }
     }
@@ -2582,6 +2674,33 @@ CameraRigBA::reweightScenePoints(void)
     }
 }
 
+void
+CameraRigBA::countScenePointsHelper(const std::vector<FramePtr>* frames,
+                                    std::vector<std::pair<size_t, size_t> >* frameScenePointCounts,
+                                    size_t frameId) const
+{
+    const std::vector<Point2DFeaturePtr>& features2D = frames->at(frameId)->features2D();
+
+    std::pair<size_t, size_t>& counts = frameScenePointCounts->at(frameId);
+
+    for (size_t i = 0; i < features2D.size(); ++i)
+    {
+        const Point3DFeatureConstPtr& feature3D = features2D.at(i)->feature3D();
+
+        if (feature3D.get() == 0)
+        {
+            continue;
+        }
+
+        if (feature3D->attributes() & Point3DFeature::LOCALLY_OBSERVED_BY_DIFFERENT_CAMERAS)
+        {
+            ++counts.second;
+        }
+
+        ++counts.first;
+    }
+}
+
 bool
 CameraRigBA::estimateCameraOdometryTransforms(void)
 {
@@ -2648,6 +2767,11 @@ CameraRigBA::estimateAbsoluteGroundHeight(double& zGround) const
 void
 CameraRigBA::visualize(const std::string& overlayPrefix, int type)
 {
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
     for (size_t i = 0; i < m_cameraSystem.cameraCount(); ++i)
     {
         std::ostringstream oss;
@@ -2708,7 +2832,8 @@ CameraRigBA::visualize(const std::string& overlayPrefix, int type)
             origin = cameraPoses.front()->translation();
         }
 
-        vcharge::GLOverlayExtended overlay(oss.str(), VCharge::COORDINATE_FRAME_LOCAL);
+        boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(oss.str(), VCharge::COORDINATE_FRAME_LOCAL));
+        vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
         // visualize camera poses and 3D scene points
         overlay.clear();
@@ -2878,23 +3003,25 @@ CameraRigBA::visualize(const std::string& overlayPrefix, int type)
 
         overlay.end();
 
-        overlay.publish();
-
-        usleep(50000);
+        VisualizationPublisher::instance()->publishOverlay(oss.str(), overlayPtr);
     }
 
     std::ostringstream oss;
     oss << overlayPrefix << "odo";
 
     visualizeSystemPoses(oss.str());
-
-    usleep(50000);
 }
 
 void
 CameraRigBA::visualizeExtrinsics(const std::string& overlayName)
 {
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize extrinsics
     overlay.clear();
@@ -2990,14 +3117,20 @@ CameraRigBA::visualizeExtrinsics(const std::string& overlayName)
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 CameraRigBA::visualizeFrameFrameCorrespondences(const std::string& overlayName,
                                                 const std::vector<std::pair<FramePtr, FramePtr> >& correspondencesFrameFrame) const
 {
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize camera poses and 3D scene points
     overlay.clear();
@@ -3060,12 +3193,17 @@ CameraRigBA::visualizeFrameFrameCorrespondences(const std::string& overlayName,
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 CameraRigBA::visualizeSystemPoses(const std::string& overlayName)
 {
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
     std::vector<OdometryPtr> odometryVec;
 
     for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
@@ -3080,7 +3218,8 @@ CameraRigBA::visualizeSystemPoses(const std::string& overlayName)
         }
     }
 
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_LOCAL);
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_LOCAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     Eigen::Vector3d origin = odometryVec.front()->position();
 
@@ -3132,14 +3271,20 @@ CameraRigBA::visualizeSystemPoses(const std::string& overlayName)
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 CameraRigBA::visualize2D3DCorrespondences(const std::string& overlayName,
                                           const std::vector<Correspondence2D3D>& correspondences) const
 {
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize 3D-3D correspondences
     overlay.clear();
@@ -3206,14 +3351,20 @@ CameraRigBA::visualize2D3DCorrespondences(const std::string& overlayName,
 
     overlay.end();
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 CameraRigBA::visualize3D3DCorrespondences(const std::string& overlayName,
                                           const std::vector<Correspondence3D3D>& correspondences) const
 {
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize 3D-3D correspondences
     overlay.clear();
@@ -3288,13 +3439,18 @@ CameraRigBA::visualize3D3DCorrespondences(const std::string& overlayName,
 
     overlay.end();
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 CameraRigBA::visualize3D3DCorrespondences(const std::string& overlayName,
                                           const std::vector<Correspondence2D2D>& correspondences2D2D) const
 {
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
     std::vector<Correspondence3D3D> correspondences3D3D;
     correspondences3D3D.reserve(correspondences2D2D.size());
 
@@ -3318,7 +3474,13 @@ CameraRigBA::visualize3D3DCorrespondences(const std::string& overlayName,
 void
 CameraRigBA::visualizeGroundPoints(const std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> >& points) const
 {
-    vcharge::GLOverlayExtended overlay("ground-pts", VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended("ground-pts", VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize 3D-3D correspondences
     overlay.clear();
@@ -3336,7 +3498,7 @@ CameraRigBA::visualizeGroundPoints(const std::vector<Eigen::Vector3d, Eigen::ali
 
     overlay.end();
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay("ground-pts", overlayPtr);
 }
 
 #endif
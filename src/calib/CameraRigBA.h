@@ -7,6 +7,7 @@
 
 #include <camodocal/calib/CameraCalibration.h>
 #include <camodocal/camera_systems/CameraSystem.h>
+#include <camodocal/pose_graph/PoseGraph.h>
 #include <camodocal/sparse_graph/SparseGraph.h>
 
 namespace camodocal
@@ -39,6 +40,8 @@ public:
              bool saveWorkingData = false, std::string dataDir = "data");
 
     void setVerbose(bool verbose);
+    void setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec);
+    void setPoseGraphBackend(PoseGraph::Backend backend);
 
     void frameReprojectionError(const FramePtr& frame,
                                 const CameraConstPtr& camera,
@@ -51,6 +54,20 @@ public:
                            int type) const;
 
 private:
+    typedef struct
+    {
+        double minError;
+        double maxError;
+        double avgError;
+        size_t featureCount;
+    } FrameReprojectionError;
+
+    void frameReprojectionErrorHelper(const std::vector<FramePtr>* frames,
+                                      const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_odo,
+                                      int type,
+                                      std::vector<FrameReprojectionError>* frameErrors,
+                                      size_t frameId) const;
+
     double reprojectionError(const CameraConstPtr& camera,
                              const Eigen::Vector3d& P,
                              const Eigen::Quaterniond& cam_odo_q,
@@ -58,12 +75,21 @@ private:
                              const Eigen::Vector3d& odo_p,
                              const Eigen::Vector3d& odo_att,
                              const Eigen::Vector2d& observed_p) const;
+    void worldToCameraTransform(const Eigen::Quaterniond& cam_odo_q,
+                                const Eigen::Vector3d& cam_odo_t,
+                                const Eigen::Vector3d& odo_p,
+                                const Eigen::Vector3d& odo_att,
+                                Eigen::Quaterniond& q_cam,
+                                Eigen::Vector3d& t_cam) const;
 
     void triangulateFeatureCorrespondences(void);
 
     void triangulateFeatures(FramePtr& frame1, FramePtr& frame2, FramePtr& frame3,
                              const CameraConstPtr& camera,
                              const Pose& T_cam_odo);
+    void triangulateFeatureSegments(std::vector<std::pair<int, std::vector<FramePtr> > >* frameSegments,
+                                    size_t* nextFrameSegmentId,
+                                    boost::mutex* frameSegmentMutex);
 
     void find2D2DCorrespondences(const std::vector<Point2DFeaturePtr>& features,
                                  int nViews,
@@ -104,10 +130,19 @@ private:
                             double reprojErrorThresh = 4.0) const;
 
     void prune(int flags = PRUNE_BEHIND_CAMERA, int poseType = ODOMETRY);
+    void pruneHelper(const std::vector<FramePtr>* frames,
+                     int flags, int poseType,
+                     const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_odo,
+                     const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >* H_odo_cam,
+                     std::vector<std::vector<size_t> >* pruneFeatureIds,
+                     size_t frameId) const;
 
     void optimize(int flags, bool optimizeZ = true, int nIterations = 500);
 
     void reweightScenePoints(void);
+    void countScenePointsHelper(const std::vector<FramePtr>* frames,
+                                std::vector<std::pair<size_t, size_t> >* frameScenePointCounts,
+                                size_t frameId) const;
 
     bool estimateCameraOdometryTransforms(void);
 
@@ -157,6 +192,9 @@ private:
     const int k_nearestImageMatches;
     const double k_nominalFocalLength;
 
+    boost::shared_ptr<LocationRecognition> m_locRec;
+    PoseGraph::Backend m_poseGraphBackend;
+
     bool m_verbose;
 };
 
@@ -0,0 +1,103 @@
+#include "camodocal/calib/ImageBuffer.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// Reference count of an external buffer, together with its deleter.
+// OpenCV hands the reference count of a matrix to its allocator once the
+// count drops to zero; as the count is the first member, the allocator
+// recovers the deleter from it.
+struct ExternalBuffer
+{
+    int refcount;
+    ImageBuffer::Deleter deleter;
+};
+
+void
+fastFree(unsigned char* data)
+{
+    cv::fastFree(data);
+}
+
+// Releases external buffers through their deleters. Matrices which share
+// an external buffer also use this allocator if they are reallocated, so
+// it allocates memory the way OpenCV does.
+class ExternalBufferAllocator: public cv::MatAllocator
+{
+public:
+    void
+    allocate(int dims, const int* sizes, int type, int*& refcount,
+             uchar*& datastart, uchar*& data, size_t* step)
+    {
+        size_t total = CV_ELEM_SIZE(type);
+        for (int i = dims - 1; i >= 0; --i)
+        {
+            step[i] = total;
+            total *= sizes[i];
+        }
+
+        ExternalBuffer* buffer = new ExternalBuffer;
+        buffer->refcount = 1;
+        buffer->deleter = &fastFree;
+
+        refcount = &buffer->refcount;
+        datastart = data = static_cast<uchar*>(cv::fastMalloc(total));
+    }
+
+    void
+    deallocate(int* refcount, uchar* datastart, uchar* data)
+    {
+        ExternalBuffer* buffer = reinterpret_cast<ExternalBuffer*>(refcount);
+
+        if (buffer->deleter)
+        {
+            buffer->deleter(datastart);
+        }
+
+        delete buffer;
+    }
+};
+
+ExternalBufferAllocator g_externalBufferAllocator;
+
+}
+
+ImageBuffer::ImageBuffer()
+{
+
+}
+
+ImageBuffer::ImageBuffer(const cv::Mat& image)
+ : m_mat(image)
+{
+
+}
+
+ImageBuffer::ImageBuffer(unsigned char* data, int rows, int cols, int type,
+                         size_t step, const Deleter& deleter)
+ : m_mat(rows, cols, type, data, step == 0 ? cv::Mat::AUTO_STEP : step)
+{
+    ExternalBuffer* buffer = new ExternalBuffer;
+    buffer->refcount = 1;
+    buffer->deleter = deleter;
+
+    m_mat.refcount = &buffer->refcount;
+    m_mat.allocator = &g_externalBufferAllocator;
+}
+
+bool
+ImageBuffer::empty(void) const
+{
+    return m_mat.empty();
+}
+
+const cv::Mat&
+ImageBuffer::mat(void) const
+{
+    return m_mat;
+}
+
+}
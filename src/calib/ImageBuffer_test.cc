@@ -0,0 +1,69 @@
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+
+#include "camodocal/calib/ImageBuffer.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+release(int* count, unsigned char* data)
+{
+    ++(*count);
+    delete [] data;
+}
+
+}
+
+TEST(ImageBuffer, ExternalBuffer)
+{
+    int releases = 0;
+    unsigned char* data = new unsigned char[480 * 64];
+
+    cv::Mat header;
+    {
+        ImageBuffer buffer(data, 480, 60, CV_8UC1, 64,
+                           boost::bind(&release, &releases, _1));
+
+        EXPECT_EQ(buffer.mat().data, data);
+        EXPECT_EQ(buffer.mat().step, 64u);
+
+        ImageBuffer copy = buffer;
+        header = copy.mat();
+    }
+
+    // the header keeps the data alive
+    EXPECT_EQ(releases, 0);
+    EXPECT_EQ(header.data, data);
+
+    header.release();
+    EXPECT_EQ(releases, 1);
+}
+
+TEST(ImageBuffer, Reallocation)
+{
+    int releases = 0;
+    unsigned char* data = new unsigned char[48 * 64];
+
+    ImageBuffer buffer(data, 48, 64, CV_8UC1, 0,
+                       boost::bind(&release, &releases, _1));
+
+    cv::Mat image = buffer.mat();
+    image.create(10, 20, CV_32FC3);
+
+    EXPECT_NE(image.data, data);
+    EXPECT_EQ(image.step, 20u * 3 * sizeof(float));
+
+    buffer = ImageBuffer();
+    EXPECT_EQ(releases, 1);
+
+    // memory allocated for the reallocated header is not passed to the
+    // deleter of the external buffer
+    image.release();
+    EXPECT_EQ(releases, 1);
+}
+
+}
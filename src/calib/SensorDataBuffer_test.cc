@@ -0,0 +1,48 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "camodocal/calib/SensorDataBuffer.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+produce(SensorDataBuffer<int>* buffer, uint64_t timestamp)
+{
+    boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+
+    buffer->push(timestamp, 1);
+}
+
+}
+
+TEST(SensorDataBuffer, WaitForData)
+{
+    SensorDataBuffer<int> buffer(10);
+    buffer.push(100, 0);
+
+    EXPECT_TRUE(buffer.timedWaitForData(100, boost::get_system_time()));
+
+    boost::thread producer(boost::bind(&produce, &buffer, 200));
+
+    EXPECT_TRUE(buffer.timedWaitForData(150, boost::get_system_time() + boost::posix_time::seconds(10)));
+
+    producer.join();
+}
+
+TEST(SensorDataBuffer, WaitForDataTimeout)
+{
+    SensorDataBuffer<int> buffer(10);
+
+    EXPECT_FALSE(buffer.timedWaitForData(100, boost::get_system_time() + boost::posix_time::milliseconds(10)));
+
+    buffer.push(100, 0);
+
+    EXPECT_FALSE(buffer.timedWaitForData(150, boost::get_system_time() + boost::posix_time::milliseconds(10)));
+}
+
+}
@@ -3,6 +3,7 @@
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 
+#include "ChessboardCornerGrid.h"
 #include "ChessboardQuad.h"
 #include "Spline.h"
 
@@ -940,6 +941,11 @@ Chessboard::findQuadNeighbors(std::vector<ChessboardQuadPtr>& quads, int dilatio
     const float thresh_dilation = (float)(2*dilation+3)*(2*dilation+3)*2;    // the "*2" is for the x and y component
                                                                             // the "3" is for initial corner mismatch
 
+    // Corners which do not yet have a neighbor keep their positions while
+    // neighbors are assigned, so the grid built here remains valid for them.
+    ChessboardCornerGrid grid(quads);
+    std::vector<int> candidates;
+
     // Find quad neighbors
     for (size_t idx = 0; idx < quads.size(); ++idx)
     {
@@ -960,9 +966,15 @@ Chessboard::findQuadNeighbors(std::vector<ChessboardQuadPtr>& quads, int dilatio
 
             cv::Point2f pt = curQuad->corners[i]->pt;
 
-            // Find the closest corner in all other quadrangles
-            for (size_t k = 0; k < quads.size(); ++k)
+            // Find the closest corner in all other quadrangles within
+            // matching distance
+            grid.query(pt, sqrtf(curQuad->edge_len + thresh_dilation), candidates);
+
+            for (size_t c = 0; c < candidates.size(); ++c)
             {
+                size_t k = candidates.at(c) / 4;
+                int j = candidates.at(c) % 4;
+
                 if (k == idx)
                 {
                     continue;
@@ -970,31 +982,28 @@ Chessboard::findQuadNeighbors(std::vector<ChessboardQuadPtr>& quads, int dilatio
 
                 ChessboardQuadPtr& quad = quads.at(k);
 
-                for (int j = 0; j < 4; ++j)
+                // If it already has a neighbor
+                if (quad->neighbors[j])
                 {
-                    // If it already has a neighbor
-                    if (quad->neighbors[j])
-                    {
-                        continue;
-                    }
+                    continue;
+                }
 
-                    cv::Point2f dp = pt - quad->corners[j]->pt;
-                    float dist = dp.dot(dp);
+                cv::Point2f dp = pt - quad->corners[j]->pt;
+                float dist = dp.dot(dp);
 
-                    // The following "if" checks, whether "dist" is the
-                    // shortest so far and smaller than the smallest
-                    // edge length of the current and target quads
-                    if (dist < minDist &&
-                        dist <= (curQuad->edge_len + thresh_dilation) &&
-                        dist <= (quad->edge_len + thresh_dilation)   )
+                // The following "if" checks, whether "dist" is the
+                // shortest so far and smaller than the smallest
+                // edge length of the current and target quads
+                if (dist < minDist &&
+                    dist <= (curQuad->edge_len + thresh_dilation) &&
+                    dist <= (quad->edge_len + thresh_dilation)   )
+                {
+                    // Check whether conditions are fulfilled
+                    if (matchCorners(curQuad, i, quad, j))
                     {
-                        // Check whether conditions are fulfilled
-                        if (matchCorners(curQuad, i, quad, j))
-                        {
-                            closestCornerIdx = j;
-                            closestQuad = quad;
-                            minDist = dist;
-                        }
+                        closestCornerIdx = j;
+                        closestQuad = quad;
+                        minDist = dist;
                     }
                 }
             }
@@ -1055,6 +1064,11 @@ Chessboard::augmentBestRun(std::vector<ChessboardQuadPtr>& candidateQuads, int c
     // kernel, which coresponds to the 4-neighborhood.
     const float thresh_dilation = (2*candidateDilation+3)*(2*existingDilation+3)*2;    // the "*2" is for the x and y component
 
+    // Corners of unlabeled candidate quads are not modified before the
+    // function returns, so the grid built here remains valid for them.
+    ChessboardCornerGrid grid(candidateQuads);
+    std::vector<int> candidates;
+
     // Search all old quads which have a neighbor that needs to be linked
     for (size_t idx = 0; idx < existingQuads.size(); ++idx)
     {
@@ -1075,10 +1089,13 @@ Chessboard::augmentBestRun(std::vector<ChessboardQuadPtr>& candidateQuads, int c
 
             cv::Point2f pt = curQuad->corners[i]->pt;
 
-            // Look for a match in all candidateQuads' corners
-            for (size_t k = 0; k < candidateQuads.size(); ++k)
+            // Look for a match in all nearby candidateQuads' corners
+            grid.query(pt, sqrtf(curQuad->edge_len + thresh_dilation), candidates);
+
+            for (size_t c = 0; c < candidates.size(); ++c)
             {
-                ChessboardQuadPtr& candidateQuad = candidateQuads.at(k);
+                ChessboardQuadPtr& candidateQuad = candidateQuads.at(candidates.at(c) / 4);
+                int j = candidates.at(c) % 4;
 
                 // Only look at unlabeled new quads
                 if (candidateQuad->labeled)
@@ -1086,23 +1103,20 @@ Chessboard::augmentBestRun(std::vector<ChessboardQuadPtr>& candidateQuads, int c
                     continue;
                 }
 
-                for (int j = 0; j < 4; ++j)
+                // Only proceed if they are less than dist away from each
+                // other
+                cv::Point2f dp = pt - candidateQuad->corners[j]->pt;
+                float dist = dp.dot(dp);
+
+                if ((dist < minDist) &&
+                    dist <= (curQuad->edge_len + thresh_dilation) &&
+                    dist <= (candidateQuad->edge_len + thresh_dilation))
                 {
-                    // Only proceed if they are less than dist away from each
-                    // other
-                    cv::Point2f dp = pt - candidateQuad->corners[j]->pt;
-                    float dist = dp.dot(dp);
-
-                    if ((dist < minDist) &&
-                        dist <= (curQuad->edge_len + thresh_dilation) &&
-                        dist <= (candidateQuad->edge_len + thresh_dilation))
+                    if (matchCorners(curQuad, i, candidateQuad, j))
                     {
-                        if (matchCorners(curQuad, i, candidateQuad, j))
-                        {
-                            closestCornerIdx = j;
-                            closestQuad = candidateQuad;
-                            minDist = dist;
-                        }
+                        closestCornerIdx = j;
+                        closestQuad = candidateQuad;
+                        minDist = dist;
                     }
                 }
             }
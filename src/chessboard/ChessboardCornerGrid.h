@@ -0,0 +1,156 @@
+#ifndef CHESSBOARDCORNERGRID_H
+#define CHESSBOARDCORNERGRID_H
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "ChessboardQuad.h"
+
+namespace camodocal
+{
+
+// Uniform grid over the corners of a set of quads. The grid stores the
+// corner positions at construction time, and is used to restrict the
+// corner-to-corner neighbour search to nearby cells.
+class ChessboardCornerGrid
+{
+public:
+    ChessboardCornerGrid(const std::vector<ChessboardQuadPtr>& quads)
+     : mCellSize(1.0f)
+     , mCols(1)
+     , mRows(1)
+    {
+        if (quads.empty())
+        {
+            mCellStart.assign(2, 0);
+            return;
+        }
+
+        // Use the median quad side length as cell size. Neighbouring
+        // corners are then at most a few cells apart.
+        std::vector<float> edgeLengths;
+        edgeLengths.reserve(quads.size());
+
+        float minX = FLT_MAX, minY = FLT_MAX;
+        float maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (size_t k = 0; k < quads.size(); ++k)
+        {
+            const ChessboardQuadPtr& quad = quads.at(k);
+
+            edgeLengths.push_back(quad->edge_len);
+
+            for (int j = 0; j < 4; ++j)
+            {
+                const cv::Point2f& pt = quad->corners[j]->pt;
+
+                minX = std::min(minX, pt.x);
+                minY = std::min(minY, pt.y);
+                maxX = std::max(maxX, pt.x);
+                maxY = std::max(maxY, pt.y);
+            }
+        }
+
+        std::nth_element(edgeLengths.begin(),
+                         edgeLengths.begin() + edgeLengths.size() / 2,
+                         edgeLengths.end());
+        mCellSize = std::max(sqrtf(edgeLengths.at(edgeLengths.size() / 2)), 1.0f);
+
+        // keep the number of cells in proportion to the number of corners
+        size_t nCorners = quads.size() * 4;
+        while (static_cast<size_t>(((maxX - minX) / mCellSize + 1.0f) *
+                                   ((maxY - minY) / mCellSize + 1.0f)) > nCorners * 4)
+        {
+            mCellSize *= 2.0f;
+        }
+
+        mOrigin = cv::Point2f(minX, minY);
+        mCols = static_cast<int>((maxX - minX) / mCellSize) + 1;
+        mRows = static_cast<int>((maxY - minY) / mCellSize) + 1;
+
+        // counting sort of corners by cell, stored in compressed row format
+        std::vector<int> cellIds(nCorners);
+        mCellStart.assign(mCols * mRows + 1, 0);
+        for (size_t k = 0; k < quads.size(); ++k)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                int cellId = cellIndex(quads.at(k)->corners[j]->pt);
+
+                cellIds.at(k * 4 + j) = cellId;
+                ++mCellStart.at(cellId + 1);
+            }
+        }
+
+        for (size_t i = 1; i < mCellStart.size(); ++i)
+        {
+            mCellStart.at(i) += mCellStart.at(i - 1);
+        }
+
+        std::vector<int> cellFill(mCellStart.begin(), mCellStart.end() - 1);
+        mEntries.resize(nCorners);
+        for (size_t i = 0; i < nCorners; ++i)
+        {
+            mEntries.at(cellFill.at(cellIds.at(i))++) = i;
+        }
+    }
+
+    // Collects the corners that may lie within the given radius of pt.
+    // Each corner is encoded as 4 * quad index + corner index, and the
+    // result is sorted in ascending order so that callers visit candidates
+    // in the same order as a brute-force loop over all quads.
+    void query(const cv::Point2f& pt, float radius,
+               std::vector<int>& candidates) const
+    {
+        candidates.clear();
+
+        // slack guards against rounding at the cell boundaries
+        radius = radius * 1.0001f + 1.0f;
+
+        int c0 = clampCell((pt.x - radius - mOrigin.x) / mCellSize, mCols);
+        int c1 = clampCell((pt.x + radius - mOrigin.x) / mCellSize, mCols);
+        int r0 = clampCell((pt.y - radius - mOrigin.y) / mCellSize, mRows);
+        int r1 = clampCell((pt.y + radius - mOrigin.y) / mCellSize, mRows);
+
+        for (int r = r0; r <= r1; ++r)
+        {
+            for (int c = c0; c <= c1; ++c)
+            {
+                int cellId = r * mCols + c;
+
+                candidates.insert(candidates.end(),
+                                  mEntries.begin() + mCellStart.at(cellId),
+                                  mEntries.begin() + mCellStart.at(cellId + 1));
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+    }
+
+private:
+    static int clampCell(float x, int n)
+    {
+        // clamp before the conversion so that large radii cannot overflow
+        return static_cast<int>(std::min(std::max(floorf(x), 0.0f),
+                                         static_cast<float>(n - 1)));
+    }
+
+    int cellIndex(const cv::Point2f& pt) const
+    {
+        return clampCell((pt.y - mOrigin.y) / mCellSize, mRows) * mCols +
+               clampCell((pt.x - mOrigin.x) / mCellSize, mCols);
+    }
+
+    cv::Point2f mOrigin;
+    float mCellSize;
+    int mCols;
+    int mRows;
+
+    std::vector<int> mCellStart;
+    std::vector<int> mEntries;
+};
+
+}
+
+#endif
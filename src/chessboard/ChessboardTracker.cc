@@ -0,0 +1,298 @@
+#include "camodocal/chessboard/ChessboardTracker.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "camodocal/chessboard/Chessboard.h"
+
+namespace camodocal
+{
+
+ChessboardTracker::ChessboardTracker(cv::Size boardSize)
+ : mBoardSize(boardSize)
+ , mVelocity(0.0f, 0.0f)
+ , mCornersFound(false)
+ , mMode(NONE)
+ , k_kltWindowSize(21, 21)
+ , k_kltMaxLevel(3)
+ , k_maxForwardBackwardError(0.5f)
+ , k_roiMargin(0.25f)
+{
+
+}
+
+bool
+ChessboardTracker::track(cv::Mat& image, bool useOpenCV)
+{
+    if (image.channels() == 1)
+    {
+        cv::cvtColor(image, mSketch, CV_GRAY2BGR);
+        image.copyTo(mImage);
+    }
+    else
+    {
+        image.copyTo(mSketch);
+        cv::cvtColor(image, mImage, CV_BGR2GRAY);
+    }
+
+    std::vector<cv::Mat> pyramid;
+    cv::buildOpticalFlowPyramid(mImage, pyramid, k_kltWindowSize, k_kltMaxLevel);
+
+    std::vector<cv::Point2f> corners;
+    mMode = NONE;
+
+    if (mCornersFound)
+    {
+        // 1. propagate the previous corners with KLT
+        if (trackCorners(pyramid, corners))
+        {
+            mMode = TRACKED;
+        }
+        // 2. run the detector inside the predicted board region
+        else if (detectCorners(mImage, predictROI(mImage.size()), useOpenCV, corners))
+        {
+            mMode = DETECTED_ROI;
+        }
+    }
+
+    // 3. fall back to the full detector
+    if (mMode == NONE &&
+        detectCorners(mImage, cv::Rect(0, 0, mImage.cols, mImage.rows), useOpenCV, corners))
+    {
+        mMode = DETECTED_FULL;
+    }
+
+    if (mMode == NONE)
+    {
+        reset();
+        return false;
+    }
+
+    // only the board translation is predicted; the velocity is not
+    // meaningful if the corner ordering changed between detections
+    if (mMode == TRACKED)
+    {
+        cv::Point2f shift(0.0f, 0.0f);
+        for (size_t i = 0; i < corners.size(); ++i)
+        {
+            shift += corners.at(i) - mCorners.at(i);
+        }
+        mVelocity = shift * (1.0f / corners.size());
+    }
+    else
+    {
+        mVelocity = cv::Point2f(0.0f, 0.0f);
+    }
+
+    mCorners.swap(corners);
+    mPyramid.swap(pyramid);
+    mCornersFound = true;
+
+    cv::drawChessboardCorners(mSketch, mBoardSize, mCorners, mCornersFound);
+
+    return true;
+}
+
+void
+ChessboardTracker::reset(void)
+{
+    mCorners.clear();
+    mPyramid.clear();
+    mVelocity = cv::Point2f(0.0f, 0.0f);
+    mCornersFound = false;
+    mMode = NONE;
+}
+
+const std::vector<cv::Point2f>&
+ChessboardTracker::getCorners(void) const
+{
+    return mCorners;
+}
+
+bool
+ChessboardTracker::cornersFound(void) const
+{
+    return mCornersFound;
+}
+
+ChessboardTracker::Mode
+ChessboardTracker::mode(void) const
+{
+    return mMode;
+}
+
+const cv::Mat&
+ChessboardTracker::getImage(void) const
+{
+    return mImage;
+}
+
+const cv::Mat&
+ChessboardTracker::getSketch(void) const
+{
+    return mSketch;
+}
+
+bool
+ChessboardTracker::trackCorners(const std::vector<cv::Mat>& pyramid,
+                                std::vector<cv::Point2f>& corners) const
+{
+    if (mPyramid.empty() || mCorners.empty())
+    {
+        return false;
+    }
+
+    cv::TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.01);
+
+    // seed the forward pass with the constant-velocity prediction
+    corners.resize(mCorners.size());
+    for (size_t i = 0; i < mCorners.size(); ++i)
+    {
+        corners.at(i) = mCorners.at(i) + mVelocity;
+    }
+
+    std::vector<uchar> status;
+    std::vector<float> err;
+    cv::calcOpticalFlowPyrLK(mPyramid, pyramid, mCorners, corners,
+                             status, err, k_kltWindowSize, k_kltMaxLevel,
+                             criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    for (size_t i = 0; i < status.size(); ++i)
+    {
+        if (!status.at(i))
+        {
+            return false;
+        }
+    }
+
+    // forward-backward consistency check
+    std::vector<cv::Point2f> cornersBack = mCorners;
+    cv::calcOpticalFlowPyrLK(pyramid, mPyramid, corners, cornersBack,
+                             status, err, k_kltWindowSize, k_kltMaxLevel,
+                             criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+
+    for (size_t i = 0; i < status.size(); ++i)
+    {
+        if (!status.at(i) ||
+            cv::norm(cornersBack.at(i) - mCorners.at(i)) > k_maxForwardBackwardError)
+        {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < corners.size(); ++i)
+    {
+        if (corners.at(i).x < 0.0f || corners.at(i).x > pyramid.front().cols - 1 ||
+            corners.at(i).y < 0.0f || corners.at(i).y > pyramid.front().rows - 1)
+        {
+            return false;
+        }
+    }
+
+    cv::cornerSubPix(pyramid.front(), corners, cv::Size(11, 11), cv::Size(-1,-1),
+                     cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+
+    return checkCorners(corners);
+}
+
+bool
+ChessboardTracker::detectCorners(cv::Mat& image, const cv::Rect& roi, bool useOpenCV,
+                                 std::vector<cv::Point2f>& corners) const
+{
+    if (roi.width <= 0 || roi.height <= 0)
+    {
+        return false;
+    }
+
+    cv::Mat subImage = image(roi);
+
+    Chessboard chessboard(mBoardSize, subImage);
+    chessboard.findCorners(useOpenCV);
+
+    if (!chessboard.cornersFound())
+    {
+        return false;
+    }
+
+    corners = chessboard.getCorners();
+
+    cv::Point2f offset(roi.x, roi.y);
+    for (size_t i = 0; i < corners.size(); ++i)
+    {
+        corners.at(i) += offset;
+    }
+
+    return true;
+}
+
+bool
+ChessboardTracker::checkCorners(const std::vector<cv::Point2f>& corners) const
+{
+    if (corners.size() != static_cast<size_t>(mBoardSize.width * mBoardSize.height))
+    {
+        return false;
+    }
+
+    // Along each row and column of the board, a corner must lie close to the
+    // midpoint of its two neighbours. This holds locally even under strong
+    // lens distortion, and catches corners that drifted onto the wrong
+    // intersection.
+    const float maxRelDeviation = 0.25f;
+
+    for (int r = 0; r < mBoardSize.height; ++r)
+    {
+        for (int c = 0; c < mBoardSize.width; ++c)
+        {
+            const cv::Point2f& p = corners.at(r * mBoardSize.width + c);
+
+            if (c > 0 && c < mBoardSize.width - 1)
+            {
+                const cv::Point2f& p0 = corners.at(r * mBoardSize.width + c - 1);
+                const cv::Point2f& p1 = corners.at(r * mBoardSize.width + c + 1);
+
+                float span = cv::norm(p1 - p0);
+                if (span < 1.0f || cv::norm(p0 + p1 - 2.0f * p) > maxRelDeviation * span)
+                {
+                    return false;
+                }
+            }
+
+            if (r > 0 && r < mBoardSize.height - 1)
+            {
+                const cv::Point2f& p0 = corners.at((r - 1) * mBoardSize.width + c);
+                const cv::Point2f& p1 = corners.at((r + 1) * mBoardSize.width + c);
+
+                float span = cv::norm(p1 - p0);
+                if (span < 1.0f || cv::norm(p0 + p1 - 2.0f * p) > maxRelDeviation * span)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+cv::Rect
+ChessboardTracker::predictROI(const cv::Size& imageSize) const
+{
+    cv::Rect board = cv::boundingRect(mCorners);
+
+    // The outer corners are inner corners of the board, so the margin must
+    // at least cover the outermost row of squares.
+    int marginX = std::max(board.width / (mBoardSize.width - 1),
+                           static_cast<int>(board.width * k_roiMargin));
+    int marginY = std::max(board.height / (mBoardSize.height - 1),
+                           static_cast<int>(board.height * k_roiMargin));
+
+    cv::Rect roi(board.x + lround(mVelocity.x) - marginX,
+                 board.y + lround(mVelocity.y) - marginY,
+                 board.width + 2 * marginX,
+                 board.height + 2 * marginY);
+
+    return roi & cv::Rect(0, 0, imageSize.width, imageSize.height);
+}
+
+}
@@ -19,6 +19,9 @@
 #include <vector>
 #include <string>
 #include <sstream>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
 #include "FClass.h"
 #include "FSurf64.h"
@@ -55,6 +58,21 @@ void FSurf64::meanValue(const std::vector<FSurf64::pDescriptor> &descriptors,
   
 double FSurf64::distance(const FSurf64::TDescriptor &a, const FSurf64::TDescriptor &b)
 {
+#ifdef __AVX__
+  // squared differences in float, accumulated in double as below
+  __m256d acc0 = _mm256_setzero_pd();
+  __m256d acc1 = _mm256_setzero_pd();
+  for(int i = 0; i < FSurf64::L; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]));
+    d = _mm256_mul_ps(d, d);
+    acc0 = _mm256_add_pd(acc0, _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+    acc1 = _mm256_add_pd(acc1, _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+  }
+  acc0 = _mm256_add_pd(acc0, acc1);
+  __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+#else
   double sqd = 0.;
   for(int i = 0; i < FSurf64::L; i += 4)
   {
@@ -64,6 +82,7 @@ double FSurf64::distance(const FSurf64::TDescriptor &a, const FSurf64::TDescript
     sqd += (a[i+3] - b[i+3])*(a[i+3] - b[i+3]);
   }
   return sqd;
+#endif
 }
 
 // --------------------------------------------------------------------------
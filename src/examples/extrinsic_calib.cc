@@ -23,6 +23,12 @@ main(int argc, char** argv)
     bool preprocessImages;
     bool optimizeIntrinsics;
     std::string dataDir;
+    std::string imageStoreDir;
+    int imageCacheSize;
+    std::string featureType;
+    bool kltTracking;
+    std::string descriptorFormat;
+    std::string poseGraphBackend;
     bool verbose;
 
     //================= Handling Program options ==================
@@ -38,6 +44,12 @@ main(int argc, char** argv)
         ("preprocess", boost::program_options::bool_switch(&preprocessImages)->default_value(false), "Preprocess images.")
         ("optimize-intrinsics", boost::program_options::bool_switch(&optimizeIntrinsics)->default_value(false), "Optimize intrinsics in BA step.")
         ("data", boost::program_options::value<std::string>(&dataDir)->default_value("data"), "Location of folder which contains working data.")
+        ("image-store", boost::program_options::value<std::string>(&imageStoreDir)->default_value(""), "Directory to keep keyframe images in instead of memory.")
+        ("image-cache", boost::program_options::value<int>(&imageCacheSize)->default_value(512), "Size of the keyframe image cache in MB when an image store is used.")
+        ("features", boost::program_options::value<std::string>(&featureType)->default_value("surf-gpu"), "Features to track: surf-gpu, orb, or brisk.")
+        ("klt", boost::program_options::bool_switch(&kltTracking)->default_value(false), "Track features with KLT between keyframes.")
+        ("descriptors", boost::program_options::value<std::string>(&descriptorFormat)->default_value("float"), "Storage format of keyframe descriptors: float, half, or int8.")
+        ("pose-graph", boost::program_options::value<std::string>(&poseGraphBackend)->default_value("ceres"), "Pose graph optimizer: ceres, or native.")
         ("verbose,v", boost::program_options::bool_switch(&verbose)->default_value(false), "Verbose output")
         ;
     boost::program_options::variables_map vm;
@@ -130,6 +142,44 @@ main(int argc, char** argv)
     options.saveWorkingData = true;
     options.beginStage = beginStage;
     options.dataDir = dataDir;
+    options.imageStoreDir = imageStoreDir;
+    options.imageCacheSize = static_cast<size_t>(imageCacheSize) << 20;
+    if (featureType == "orb")
+    {
+        options.featureType = ORB_FEATURES;
+    }
+    else if (featureType == "brisk")
+    {
+        options.featureType = BRISK_FEATURES;
+    }
+    else if (featureType != "surf-gpu")
+    {
+        std::cout << "# ERROR: Unknown feature type " << featureType << "." << std::endl;
+        return 1;
+    }
+    options.kltTracking = kltTracking;
+    if (descriptorFormat == "half")
+    {
+        options.descriptorFormat = DESCRIPTOR_HALF;
+    }
+    else if (descriptorFormat == "int8")
+    {
+        options.descriptorFormat = DESCRIPTOR_INT8;
+    }
+    else if (descriptorFormat != "float")
+    {
+        std::cout << "# ERROR: Unknown descriptor format " << descriptorFormat << "." << std::endl;
+        return 1;
+    }
+    if (poseGraphBackend == "native")
+    {
+        options.poseGraphBackend = PoseGraph::BACKEND_NATIVE;
+    }
+    else if (poseGraphBackend != "ceres")
+    {
+        std::cout << "# ERROR: Unknown pose graph optimizer " << poseGraphBackend << "." << std::endl;
+        return 1;
+    }
     options.verbose = verbose;
 
     CamRigOdoCalibration camRigOdoCalib(cameras, options);
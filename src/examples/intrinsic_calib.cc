@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -6,6 +7,7 @@
 #include <opencv2/highgui/highgui.hpp>
 
 #include "camodocal/chessboard/Chessboard.h"
+#include "camodocal/chessboard/ChessboardTracker.h"
 #include "camodocal/calib/CameraCalibration.h"
 #include "../gpl/gpl.h"
 
@@ -19,6 +21,8 @@ int main(int argc, char** argv)
     std::string prefix;
     std::string fileExtension;
     bool useOpenCV;
+    bool video;
+    bool incremental;
     bool viewResults;
     bool verbose;
 
@@ -35,6 +39,8 @@ int main(int argc, char** argv)
         ("camera-model", boost::program_options::value<std::string>(&cameraModel)->default_value("mei"), "Camera model: kannala-brandt | mei | pinhole")
         ("camera-name", boost::program_options::value<std::string>(&cameraName)->default_value("camera"), "Name of camera")
         ("opencv", boost::program_options::bool_switch(&useOpenCV)->default_value(false), "Use OpenCV to detect corners")
+        ("video", boost::program_options::bool_switch(&video)->default_value(false), "Images are consecutive video frames; track the chessboard between frames")
+        ("incremental", boost::program_options::bool_switch(&incremental)->default_value(false), "Reject redundant views and refine the calibration as views are added")
         ("view-results", boost::program_options::bool_switch(&viewResults)->default_value(false), "View results")
         ("verbose,v", boost::program_options::bool_switch(&verbose)->default_value(false), "Verbose output")
         ;
@@ -131,6 +137,12 @@ int main(int argc, char** argv)
         return 1;
     }
 
+    if (video)
+    {
+        // frames are tracked in order of their filenames
+        std::sort(imageFilenames.begin(), imageFilenames.end());
+    }
+
     if (verbose)
     {
         std::cerr << "# INFO: # images: " << imageFilenames.size() << std::endl;
@@ -141,35 +153,71 @@ int main(int argc, char** argv)
 
     camodocal::CameraCalibration calibration(modelType, cameraName, frameSize, boardSize, squareSize);
     calibration.setVerbose(verbose);
+    calibration.setIncremental(incremental);
+
+    camodocal::ChessboardTracker tracker(boardSize);
 
     std::vector<bool> chessboardFound(imageFilenames.size(), false);
     for (size_t i = 0; i < imageFilenames.size(); ++i)
     {
         image = cv::imread(imageFilenames.at(i), -1);
 
-        camodocal::Chessboard chessboard(boardSize, image);
+        bool found = false;
+        std::vector<cv::Point2f> corners;
+        cv::Mat sketch;
+
+        if (video)
+        {
+            found = tracker.track(image, useOpenCV);
+            if (found)
+            {
+                corners = tracker.getCorners();
+                tracker.getSketch().copyTo(sketch);
+            }
+        }
+        else
+        {
+            camodocal::Chessboard chessboard(boardSize, image);
+
+            chessboard.findCorners(useOpenCV);
+            found = chessboard.cornersFound();
+            if (found)
+            {
+                corners = chessboard.getCorners();
+                chessboard.getSketch().copyTo(sketch);
+            }
+        }
 
-        chessboard.findCorners(useOpenCV);
-        if (chessboard.cornersFound())
+        if (found)
         {
             if (verbose)
             {
                 std::cerr << "# INFO: Detected chessboard in image " << i + 1 << std::endl;
             }
 
-            calibration.addChessboardData(chessboard.getCorners());
+            if (!calibration.addChessboardData(corners))
+            {
+                found = false;
+            }
+            else if (incremental && calibration.sampleCount() >= 10 &&
+                     calibration.sampleCount() % 5 == 0)
+            {
+                // refine the previous solution with the most recent views
+                calibration.refine();
 
-            cv::Mat sketch;
-            chessboard.getSketch().copyTo(sketch);
+                std::cout << "# INFO: " << calibration.sampleCount()
+                          << " views, relative change in intrinsics: "
+                          << calibration.intrinsicsChange() << std::endl;
+            }
 
             cv::imshow("Image", sketch);
-            cv::waitKey(50);
+            cv::waitKey(video ? 1 : 50);
         }
         else if (verbose)
         {
             std::cerr << "# INFO: Did not detect chessboard in image " << i + 1 << std::endl;
         }
-        chessboardFound.at(i) = chessboard.cornersFound();
+        chessboardFound.at(i) = found;
     }
     cv::destroyWindow("Image");
 
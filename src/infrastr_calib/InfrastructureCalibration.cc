@@ -1,6 +1,8 @@
 #include "camodocal/infrastr_calib/InfrastructureCalibration.h"
 
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
+#include <camodocal/sparse_graph/SparseGraphUtils.h>
 #include <iostream>
 #include <opencv2/core/eigen.hpp>
 
@@ -11,10 +13,12 @@
 #include "../gpl/OpenCVUtils.h"
 #include "../location_recognition/LocationRecognition.h"
 #include "../npoint/five-point/five-point.hpp"
+#include "../npoint/p3p/p3p.hpp"
 #include "ceres/ceres.h"
 
 #ifdef VCHARGE_VIZ
 #include <boost/unordered_set.hpp>
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
 #include "../../../../library/gpl/CameraEnums.h"
 #endif
 
@@ -27,10 +31,8 @@ InfrastructureCalibration::InfrastructureCalibration(std::vector<CameraPtr>& cam
  , m_x_last(0.0)
  , m_y_last(0.0)
  , m_distance(0.0)
+ , m_useRigLocalization(false)
  , m_verbose(verbose)
-#ifdef VCHARGE_VIZ
- , m_overlay("cameras", VCharge::COORDINATE_FRAME_GLOBAL)
-#endif
  , m_cameraSystem(cameras.size())
  , k_maxDistanceRatio(0.7f)
  , k_minCorrespondences2D3D(25)
@@ -66,8 +68,6 @@ InfrastructureCalibration::loadMap(const std::string& mapDirectory)
 
 #ifdef VCHARGE_VIZ
     visualizeMap("map-ref", REFERENCE_MAP);
-
-    m_overlay.clear();
 #endif
 
     if (m_verbose)
@@ -99,23 +99,34 @@ InfrastructureCalibration::addFrameSet(const std::vector<cv::Mat>& images,
         return;
     }
 
-    std::vector<boost::shared_ptr<boost::thread> > threads(m_cameras.size());
     std::vector<FramePtr> frames(m_cameras.size());
-
-    // estimate camera pose corresponding to each image
     for (size_t i = 0; i < m_cameras.size(); ++i)
     {
         frames.at(i).reset(new Frame);
         frames.at(i)->cameraId() = i;
-
-        threads.at(i).reset(new boost::thread(&InfrastructureCalibration::estimateCameraPose,
-                                              this, images.at(i), timestamp,
-                                              frames.at(i), preprocess));
     }
 
-    for (size_t i = 0; i < m_cameras.size(); ++i)
+    if (m_useRigLocalization)
     {
-        threads.at(i)->join();
+        // estimate camera poses from a single rig pose
+        estimateRigPose(images, timestamp, frames, preprocess);
+    }
+    else
+    {
+        std::vector<boost::shared_ptr<boost::thread> > threads(m_cameras.size());
+
+        // estimate camera pose corresponding to each image
+        for (size_t i = 0; i < m_cameras.size(); ++i)
+        {
+            threads.at(i).reset(new boost::thread(&InfrastructureCalibration::estimateCameraPose,
+                                                  this, images.at(i), timestamp,
+                                                  frames.at(i), preprocess));
+        }
+
+        for (size_t i = 0; i < m_cameras.size(); ++i)
+        {
+            threads.at(i)->join();
+        }
     }
 
     FrameSet frameset;
@@ -214,14 +225,7 @@ InfrastructureCalibration::addFrameSet(const std::vector<cv::Mat>& images,
     }
 
 #ifdef VCHARGE_VIZ
-    visualizeCameraPoses(true);
-    for (size_t i = 0; i < frameset.frames.size(); ++i)
-    {
-        visualizeCameraPose(frameset.frames.at(i), true);
-    }
-    m_overlay.publish();
-
-    usleep(100000);
+    visualizeCameraPoses(true, frameset.frames);
     visualizeMap("map-opt", REFERENCE_POINTS);
 #endif
 }
@@ -239,6 +243,17 @@ InfrastructureCalibration::addOdometry(double x, double y, double yaw,
     m_y_last = y;
 }
 
+void
+InfrastructureCalibration::setExtrinsics(const CameraSystem& cameraSystem)
+{
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        m_cameraSystem.setGlobalCameraPose(i, cameraSystem.getGlobalCameraPose(i));
+    }
+
+    m_useRigLocalization = true;
+}
+
 void
 InfrastructureCalibration::reset(void)
 {
@@ -247,12 +262,9 @@ InfrastructureCalibration::reset(void)
     m_x_last = 0.0;
     m_y_last = 0.0;
     m_distance = 0.0;
+    m_useRigLocalization = false;
 
     m_cameraSystem = CameraSystem(m_cameras.size());
-
-#ifdef VCHARGE_VIZ
-    m_overlay.clear();
-#endif
 }
 
 void
@@ -501,6 +513,9 @@ InfrastructureCalibration::run(void)
     // run non-linear optimization to optimize odometry poses and camera extrinsics
     optimize(false);
 
+    // localize subsequent frame sets with the estimated extrinsics
+    m_useRigLocalization = true;
+
     if (m_verbose)
     {
         std::cout << "# INFO: Odometry distance: " << m_distance << " m" << std::endl;
@@ -508,11 +523,8 @@ InfrastructureCalibration::run(void)
 
 #ifdef VCHARGE_VIZ
     visualizeExtrinsics();
-    sleep(1);
     visualizeOdometry();
-    sleep(1);
     visualizeMap("map-opt", REFERENCE_POINTS);
-    sleep(1);
 #endif
 }
 
@@ -591,13 +603,10 @@ InfrastructureCalibration::saveFrameSets(const std::string& filename) const
 }
 
 void
-InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
-                                              uint64_t timestamp,
-                                              FramePtr& frame,
-                                              bool preprocess)
+InfrastructureCalibration::extractFeatures(const cv::Mat& image,
+                                           FramePtr& frame,
+                                           bool preprocess) const
 {
-    double scaledReprojErrorThresh = k_reprojErrorThresh / k_nominalFocalLength;
-
     cv::Mat imageProc;
     if (preprocess)
     {
@@ -612,8 +621,6 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
         image.copyTo(imageProc);
     }
 
-    double tsStart = timeInSeconds();
-
     // compute keypoints and descriptors
     cv::Ptr<SurfGPU> surf = SurfGPU::instance(300.0);
 
@@ -623,7 +630,7 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
     cv::Mat descriptors;
     surf->compute(imageProc, keypoints, descriptors);
 
-//    image.copyTo(frame->image());
+//    frame->setImage(image.clone());
 
     for (size_t i = 0; i < keypoints.size(); ++i)
     {
@@ -636,21 +643,42 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
 
         frame->features2D().push_back(feature2D);
     }
+}
+
+void
+InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
+                                              uint64_t timestamp,
+                                              FramePtr& frame,
+                                              bool preprocess)
+{
+    double scaledReprojErrorThresh = k_reprojErrorThresh / k_nominalFocalLength;
+
+    double tsStart = timeInSeconds();
+
+    extractFeatures(image, frame, preprocess);
 
     // find k closest matches in vocabulary tree
+    DBoW2::BowVector bowVector;
+    DBoW2::FeatureVector featureVector;
+    m_locrec->getWords(frame, bowVector, featureVector);
+
     std::vector<FrameTag> candidates;
-    m_locrec->knnMatch(frame, k_nearestImageMatches, candidates);
+    m_locrec->knnMatch(bowVector, k_nearestImageMatches, candidates);
 
     // find match with highest number of inlier 2D-2D correspondences
-    std::vector<cv::Point2f> rkeypoints(keypoints.size());
-    for (size_t i = 0; i < keypoints.size(); ++i)
+    std::vector<Eigen::Vector3d> bearings(frame->features2D().size());
+    for (size_t i = 0; i < frame->features2D().size(); ++i)
     {
-        rectifyImagePoint(m_cameras.at(frame->cameraId()), keypoints.at(i).pt, rkeypoints.at(i));
+        const cv::Point2f& pt = frame->features2D().at(i)->keypoint().pt;
+
+        m_cameras.at(frame->cameraId())->liftProjective(Eigen::Vector2d(pt.x, pt.y), bearings.at(i));
+        bearings.at(i).normalize();
     }
 
     int bestInlierCount = 0;
     std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > bestCorr2D3D;
-    cv::Mat best_rvec_cv, best_tvec_cv;
+    Eigen::Matrix3d best_R;
+    Eigen::Vector3d best_t;
 
     for (size_t i = 0; i < candidates.size(); ++i)
     {
@@ -658,18 +686,19 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
 
         FramePtr& trainFrame = m_refGraph.frameSetSegment(tag.frameSetSegmentId).at(tag.frameSetId)->frames().at(tag.frameId);
 
-        // find 2D-2D correspondences
-        std::vector<cv::DMatch> matches = matchFeatures(frame->features2D(), trainFrame->features2D());
+        // find 2D-2D correspondences between features which share
+        // a vocabulary node
+        std::vector<cv::DMatch> matches = m_locrec->matchFeatures(frame, featureVector, trainFrame, k_maxDistanceRatio);
 
         if (matches.size() < k_minCorrespondences2D3D)
         {
             continue;
         }
 
-        // find camera pose from EPnP
+        // find camera pose from P3P
         std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3D;
-        std::vector<cv::Point2f> imagePoints;
-        std::vector<cv::Point3f> scenePoints;
+        std::vector<Eigen::Vector3d> imageBearings;
+        std::vector<Eigen::Vector3d> scenePoints;
         for (size_t j = 0; j < matches.size(); ++j)
         {
             cv::DMatch& match = matches.at(j);
@@ -684,10 +713,8 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
 
             corr2D3D.push_back(std::make_pair(p2D, p3D));
 
-            imagePoints.push_back(rkeypoints.at(match.queryIdx));
-
-            const Eigen::Vector3d& p = p3D->point();
-            scenePoints.push_back(cv::Point3f(p(0), p(1), p(2)));
+            imageBearings.push_back(bearings.at(match.queryIdx));
+            scenePoints.push_back(p3D->point());
         }
 
         if (corr2D3D.size() < k_minCorrespondences2D3D)
@@ -695,14 +722,21 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
             continue;
         }
 
-        cv::Mat rvec_cv, tvec_cv;
+        // this candidate cannot have more inliers than the best one so far
+        if (static_cast<int>(corr2D3D.size()) <= bestInlierCount)
+        {
+            continue;
+        }
+
+        Eigen::Matrix3d R;
+        Eigen::Vector3d t;
         std::vector<int> inliers;
 
-        cv::solvePnPRansac(scenePoints, imagePoints,
-                           cv::Mat::eye(3, 3, CV_32F),
-                           cv::noArray(),
-                           rvec_cv, tvec_cv, false, 200,
-                           scaledReprojErrorThresh, 100, inliers, CV_EPNP);
+        if (!solvePnPRansac(imageBearings, scenePoints, R, t, inliers,
+                            atan(scaledReprojErrorThresh), 0.99, 200))
+        {
+            continue;
+        }
 
         int nInliers = inliers.size();
 
@@ -721,8 +755,8 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
                 bestCorr2D3D.push_back(corr2D3D.at(inliers.at(j)));
             }
 
-            rvec_cv.copyTo(best_rvec_cv);
-            tvec_cv.copyTo(best_tvec_cv);
+            best_R = R;
+            best_t = t;
         }
     }
 
@@ -738,22 +772,209 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
                   << std::endl;
     }
 
-    Eigen::Vector3d rvec, tvec;
-    cv::cv2eigen(best_rvec_cv.reshape(0,3), rvec);
-    cv::cv2eigen(best_tvec_cv.reshape(0,3), tvec);
-
     PosePtr pose(new Pose);
     pose->timeStamp() = timestamp;
-    pose->rotation() = AngleAxisToQuaternion(rvec);
-    pose->translation() = tvec;
+    pose->rotation() = Eigen::Quaterniond(best_R);
+    pose->translation() = best_t;
 
     frame->cameraPose() = pose;
 
+    addCorrespondences2D3D(frame, bestCorr2D3D);
+
+    if (m_verbose)
+    {
+        Eigen::AngleAxisd aa(best_R);
+
+        std::cout << "# INFO: [Cam " << frame->cameraId() <<  "] Estimated camera pose" << std::endl;
+        std::cout << "           rvec: " << (aa.angle() * aa.axis()).transpose() << std::endl;
+        std::cout << "           tvec: " << best_t.transpose() << std::endl;
+        std::cout << "           time: " << timeInSeconds() - tsStart << " s" << std::endl;
+
+        double minError, maxError, avgError;
+        size_t featureCount;
+
+        frameReprojectionError(frame, m_cameras.at(frame->cameraId()),
+                               minError, maxError, avgError, featureCount);
+
+        std::cout << "          reproj: " << avgError << std::endl;
+        std::cout << "              ts: " << pose->timeStamp() << std::endl;
+    }
+}
+
+void
+InfrastructureCalibration::estimateRigPose(const std::vector<cv::Mat>& images,
+                                           uint64_t timestamp,
+                                           std::vector<FramePtr>& frames,
+                                           bool preprocess)
+{
+    double scaledReprojErrorThresh = k_reprojErrorThresh / k_nominalFocalLength;
+
+    double tsStart = timeInSeconds();
+
+    // find candidate 2D-3D correspondences for each camera
+    std::vector<boost::shared_ptr<boost::thread> > threads(m_cameras.size());
+    std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > corr2D3D(m_cameras.size());
+
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        threads.at(i).reset(new boost::thread(&InfrastructureCalibration::findCorrespondences2D3D,
+                                              this, images.at(i), frames.at(i), preprocess,
+                                              boost::ref(corr2D3D.at(i))));
+    }
+
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        threads.at(i)->join();
+    }
+
+    // pool the correspondences of all cameras as rays in the odometry frame
+    std::vector<Eigen::Vector3d> origins;
+    std::vector<Eigen::Vector3d> bearings;
+    std::vector<Eigen::Vector3d> scenePoints;
+    std::vector<int> cameraIds;
+    std::vector<size_t> corrIds;
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        Eigen::Matrix4d H_cam_odo = m_cameraSystem.getGlobalCameraPose(i);
+
+        for (size_t j = 0; j < corr2D3D.at(i).size(); ++j)
+        {
+            const cv::Point2f& pt = corr2D3D.at(i).at(j).first->keypoint().pt;
+
+            Eigen::Vector3d P;
+            m_cameras.at(i)->liftProjective(Eigen::Vector2d(pt.x, pt.y), P);
+
+            origins.push_back(H_cam_odo.block<3,1>(0,3));
+            bearings.push_back(H_cam_odo.block<3,3>(0,0) * P.normalized());
+            scenePoints.push_back(corr2D3D.at(i).at(j).second->point());
+
+            cameraIds.push_back(i);
+            corrIds.push_back(j);
+        }
+    }
+
+    if (scenePoints.size() < k_minCorrespondences2D3D)
+    {
+        return;
+    }
+
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    std::vector<int> inliers;
+
+    if (!solveGPnPRansac(origins, bearings, scenePoints, R, t, inliers,
+                         atan(scaledReprojErrorThresh), 0.99, 500))
+    {
+        return;
+    }
+
+    if (inliers.size() < k_minCorrespondences2D3D)
+    {
+        return;
+    }
+
+    std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > inlierCorr2D3D(m_cameras.size());
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        int idx = inliers.at(i);
+
+        inlierCorr2D3D.at(cameraIds.at(idx)).push_back(corr2D3D.at(cameraIds.at(idx)).at(corrIds.at(idx)));
+    }
+
+    // transform from the reference frame to the odometry frame
+    Eigen::Matrix4d H_odo = Eigen::Matrix4d::Identity();
+    H_odo.block<3,3>(0,0) = R;
+    H_odo.block<3,1>(0,3) = t;
+
+    // every camera with at least one inlier gets a pose, even if it
+    // has too few correspondences to be localized on its own
+    for (size_t i = 0; i < m_cameras.size(); ++i)
+    {
+        if (inlierCorr2D3D.at(i).empty())
+        {
+            continue;
+        }
+
+        Eigen::Matrix4d H_cam = m_cameraSystem.getGlobalCameraPose(i).inverse() * H_odo;
+
+        PosePtr pose(new Pose);
+        pose->timeStamp() = timestamp;
+        pose->rotation() = Eigen::Quaterniond(H_cam.block<3,3>(0,0));
+        pose->translation() = H_cam.block<3,1>(0,3);
+
+        frames.at(i)->cameraPose() = pose;
+
+        addCorrespondences2D3D(frames.at(i), inlierCorr2D3D.at(i));
+    }
+
+    if (m_verbose)
+    {
+        std::cout << "# INFO: Estimated rig pose from " << inliers.size()
+                  << " inlier 2D-3D correspondences [ ";
+        for (size_t i = 0; i < m_cameras.size(); ++i)
+        {
+            std::cout << inlierCorr2D3D.at(i).size() << " ";
+        }
+        std::cout << "]" << std::endl;
+        std::cout << "           time: " << timeInSeconds() - tsStart << " s" << std::endl;
+    }
+}
+
+void
+InfrastructureCalibration::findCorrespondences2D3D(const cv::Mat& image,
+                                                   FramePtr& frame,
+                                                   bool preprocess,
+                                                   std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& corr2D3D)
+{
+    corr2D3D.clear();
+
+    extractFeatures(image, frame, preprocess);
+
+    // find k closest matches in vocabulary tree
+    DBoW2::BowVector bowVector;
+    DBoW2::FeatureVector featureVector;
+    m_locrec->getWords(frame, bowVector, featureVector);
+
+    std::vector<FrameTag> candidates;
+    m_locrec->knnMatch(bowVector, k_nearestImageMatches, candidates);
+
+    // collect the 2D-3D correspondences over all candidates, with each
+    // feature matched to the scene point from the best ranked candidate
+    boost::unordered_set<Point2DFeature*> matched;
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        FrameTag tag = candidates.at(i);
+
+        FramePtr& trainFrame = m_refGraph.frameSetSegment(tag.frameSetSegmentId).at(tag.frameSetId)->frames().at(tag.frameId);
+
+        std::vector<cv::DMatch> matches = m_locrec->matchFeatures(frame, featureVector, trainFrame, k_maxDistanceRatio);
+
+        for (size_t j = 0; j < matches.size(); ++j)
+        {
+            cv::DMatch& match = matches.at(j);
+
+            Point2DFeaturePtr& p2D = frame->features2D().at(match.queryIdx);
+            Point3DFeaturePtr& p3D = trainFrame->features2D().at(match.trainIdx)->feature3D();
+
+            if (p3D.get() == 0 || !matched.insert(p2D.get()).second)
+            {
+                continue;
+            }
+
+            corr2D3D.push_back(std::make_pair(p2D, p3D));
+        }
+    }
+}
+
+void
+InfrastructureCalibration::addCorrespondences2D3D(FramePtr& frame,
+                                                  const std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >& corr2D3D)
+{
     // store inlier 2D-3D correspondences
-    for (size_t i = 0; i < bestCorr2D3D.size(); ++i)
+    for (size_t i = 0; i < corr2D3D.size(); ++i)
     {
-        Point2DFeaturePtr& p2D = bestCorr2D3D.at(i).first;
-        Point3DFeaturePtr& p3D = bestCorr2D3D.at(i).second;
+        const Point2DFeaturePtr& p2D = corr2D3D.at(i).first;
+        const Point3DFeaturePtr& p3D = corr2D3D.at(i).second;
 
         boost::lock_guard<boost::mutex> lock(m_feature3DMapMutex);
         boost::unordered_map<Point3DFeature*, Point3DFeaturePtr>::iterator it = m_feature3DMap.find(p3D.get());
@@ -788,23 +1009,6 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
             ++it;
         }
     }
-
-    if (m_verbose)
-    {
-        std::cout << "# INFO: [Cam " << frame->cameraId() <<  "] Estimated camera pose" << std::endl;
-        std::cout << "           rvec: " << rvec.transpose() << std::endl;
-        std::cout << "           tvec: " << tvec.transpose() << std::endl;
-        std::cout << "           time: " << timeInSeconds() - tsStart << " s" << std::endl;
-
-        double minError, maxError, avgError;
-        size_t featureCount;
-
-        frameReprojectionError(frame, m_cameras.at(frame->cameraId()),
-                               minError, maxError, avgError, featureCount);
-
-        std::cout << "          reproj: " << avgError << std::endl;
-        std::cout << "              ts: " << pose->timeStamp() << std::endl;
-    }
 }
 
 const CameraSystem&
@@ -931,121 +1135,6 @@ InfrastructureCalibration::optimize(bool optimizeScenePoints)
     }
 }
 
-cv::Mat
-InfrastructureCalibration::buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
-                                              std::vector<size_t>& indices) const
-{
-    for (size_t i = 0; i < features.size(); ++i)
-    {
-         indices.push_back(i);
-    }
-
-    cv::Mat dtor(indices.size(), features.at(0)->descriptor().cols, features.at(0)->descriptor().type());
-
-    for (size_t i = 0; i < indices.size(); ++i)
-    {
-         features.at(indices.at(i))->descriptor().copyTo(dtor.row(i));
-    }
-
-    return dtor;
-}
-
-std::vector<cv::DMatch>
-InfrastructureCalibration::matchFeatures(const std::vector<Point2DFeaturePtr>& queryFeatures,
-                                         const std::vector<Point2DFeaturePtr>& trainFeatures) const
-{
-    std::vector<size_t> queryIndices, trainIndices;
-    cv::Mat queryDtor = buildDescriptorMat(queryFeatures, queryIndices);
-    cv::Mat trainDtor = buildDescriptorMat(trainFeatures, trainIndices);
-
-    if (queryDtor.cols != trainDtor.cols)
-    {
-        std::cout << "# WARNING: Descriptor lengths do not match." << std::endl;
-        return std::vector<cv::DMatch>();
-    }
-
-    if (queryDtor.type() != trainDtor.type())
-    {
-        std::cout << "# WARNING: Descriptor types do not match." << std::endl;
-        return std::vector<cv::DMatch>();
-    }
-
-    cv::Ptr<SurfGPU> surf = SurfGPU::instance(300.0);
-
-    std::vector<std::vector<cv::DMatch> > candidateFwdMatches;
-    surf->knnMatch(queryDtor, trainDtor, candidateFwdMatches, 2);
-
-    std::vector<std::vector<cv::DMatch> > candidateRevMatches;
-    surf->knnMatch(trainDtor, queryDtor, candidateRevMatches, 2);
-
-    std::vector<std::vector<cv::DMatch> > fwdMatches(candidateFwdMatches.size());
-    for (size_t i = 0; i < candidateFwdMatches.size(); ++i)
-    {
-        std::vector<cv::DMatch>& match = candidateFwdMatches.at(i);
-
-        if (match.size() < 2)
-        {
-            continue;
-        }
-
-        float distanceRatio = match.at(0).distance / match.at(1).distance;
-
-        if (distanceRatio < k_maxDistanceRatio)
-        {
-            fwdMatches.at(i).push_back(match.at(0));
-        }
-    }
-
-    std::vector<std::vector<cv::DMatch> > revMatches(candidateRevMatches.size());
-    for (size_t i = 0; i < candidateRevMatches.size(); ++i)
-    {
-        std::vector<cv::DMatch>& match = candidateRevMatches.at(i);
-
-        if (match.size() < 2)
-        {
-            continue;
-        }
-
-        float distanceRatio = match.at(0).distance / match.at(1).distance;
-
-        if (distanceRatio < k_maxDistanceRatio)
-        {
-            revMatches.at(i).push_back(match.at(0));
-        }
-    }
-
-    // cross-check
-    std::vector<cv::DMatch> matches;
-    for (size_t i = 0; i < fwdMatches.size(); ++i)
-    {
-        if (fwdMatches.at(i).empty())
-        {
-            continue;
-        }
-
-        cv::DMatch& fwdMatch = fwdMatches.at(i).at(0);
-
-        if (revMatches.at(fwdMatch.trainIdx).empty())
-        {
-            continue;
-        }
-
-        cv::DMatch& revMatch = revMatches.at(fwdMatch.trainIdx).at(0);
-
-        if (fwdMatch.queryIdx == revMatch.trainIdx &&
-            fwdMatch.trainIdx == revMatch.queryIdx)
-        {
-            cv::DMatch match;
-            match.queryIdx = queryIndices.at(fwdMatch.queryIdx);
-            match.trainIdx = trainIndices.at(revMatch.queryIdx);
-
-            matches.push_back(match);
-        }
-    }
-
-    return matches;
-}
-
 void
 InfrastructureCalibration::rectifyImagePoint(const CameraConstPtr& camera,
                                              const cv::Point2f& src, cv::Point2f& dst) const
@@ -1068,17 +1157,30 @@ InfrastructureCalibration::reprojectionError(const CameraConstPtr& camera,
                                              const Eigen::Vector3d& ref_p,
                                              const Eigen::Vector3d& ref_att,
                                              const Eigen::Vector2d& observed_p) const
+{
+    Eigen::Quaterniond q_cam;
+    Eigen::Vector3d t_cam;
+    worldToCameraTransform(cam_ref_q, cam_ref_t, ref_p, ref_att, q_cam, t_cam);
+
+    return camera->reprojectionError(P, q_cam, t_cam, observed_p);
+}
+
+void
+InfrastructureCalibration::worldToCameraTransform(const Eigen::Quaterniond& cam_ref_q,
+                                                  const Eigen::Vector3d& cam_ref_t,
+                                                  const Eigen::Vector3d& ref_p,
+                                                  const Eigen::Vector3d& ref_att,
+                                                  Eigen::Quaterniond& q_cam,
+                                                  Eigen::Vector3d& t_cam) const
 {
     Eigen::Quaterniond q_z_inv(cos(ref_att(0) / 2.0), 0.0, 0.0, -sin(ref_att(0) / 2.0));
     Eigen::Quaterniond q_y_inv(cos(ref_att(1) / 2.0), 0.0, -sin(ref_att(1) / 2.0), 0.0);
     Eigen::Quaterniond q_x_inv(cos(ref_att(2) / 2.0), -sin(ref_att(2) / 2.0), 0.0, 0.0);
 
     Eigen::Quaterniond q_world_ref = q_x_inv * q_y_inv * q_z_inv;
-    Eigen::Quaterniond q_cam = cam_ref_q.conjugate() * q_world_ref;
+    q_cam = cam_ref_q.conjugate() * q_world_ref;
 
-    Eigen::Vector3d t_cam = - q_cam.toRotationMatrix() * ref_p - cam_ref_q.conjugate().toRotationMatrix() * cam_ref_t;
-
-    return camera->reprojectionError(P, q_cam, t_cam, observed_p);
+    t_cam = - q_cam.toRotationMatrix() * ref_p - cam_ref_q.conjugate().toRotationMatrix() * cam_ref_t;
 }
 
 void
@@ -1094,6 +1196,15 @@ InfrastructureCalibration::frameReprojectionError(const FramePtr& frame,
     size_t count = 0;
     double totalError = 0.0;
 
+    // world-to-camera transform
+    Eigen::Quaterniond q_cam;
+    Eigen::Vector3d t_cam;
+    worldToCameraTransform(T_cam_ref.rotation(),
+                           T_cam_ref.translation(),
+                           frame->systemPose()->position(),
+                           frame->systemPose()->attitude(),
+                           q_cam, t_cam);
+
     const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
 
     for (size_t i = 0; i < features2D.size(); ++i)
@@ -1106,13 +1217,8 @@ InfrastructureCalibration::frameReprojectionError(const FramePtr& frame,
             continue;
         }
 
-        double error
-            = reprojectionError(camera, feature3D->point(),
-                                T_cam_ref.rotation(),
-                                T_cam_ref.translation(),
-                                frame->systemPose()->position(),
-                                frame->systemPose()->attitude(),
-                                Eigen::Vector2d(feature2D->keypoint().pt.x, feature2D->keypoint().pt.y));
+        double error = camera->reprojectionError(feature3D->point(), q_cam, t_cam,
+                                                 Eigen::Vector2d(feature2D->keypoint().pt.x, feature2D->keypoint().pt.y));
 
         if (minError > error)
         {
@@ -1205,37 +1311,40 @@ InfrastructureCalibration::reprojectionError(double& minError, double& maxError,
     size_t count = 0;
     double totalError = 0.0;
 
+    std::vector<Pose, Eigen::aligned_allocator<Pose> > T_cam_ref(m_cameraSystem.cameraCount());
+    for (int i = 0; i < m_cameraSystem.cameraCount(); ++i)
+    {
+        T_cam_ref.at(i) = m_cameraSystem.getGlobalCameraPose(i);
+    }
+
+    std::vector<FramePtr> frames;
     for (size_t i = 0; i < m_framesets.size(); ++i)
     {
         const FrameSet& frameset = m_framesets.at(i);
 
-        for (size_t j = 0; j < frameset.frames.size(); ++j)
-        {
-            const FramePtr& frame = frameset.frames.at(j);
-
-            Pose T_cam_ref(m_cameraSystem.getGlobalCameraPose(frame->cameraId()));
+        frames.insert(frames.end(), frameset.frames.begin(), frameset.frames.end());
+    }
 
-            double frameMinError;
-            double frameMaxError;
-            double frameAvgError;
-            size_t frameFeatureCount;
+    // compute the frame errors in parallel, and reduce them in frame order
+    std::vector<FrameReprojectionError> frameErrors(frames.size());
+    parallelFor(frames.size(),
+                boost::bind(&InfrastructureCalibration::frameReprojectionErrorHelper, this,
+                            &frames, &T_cam_ref, &frameErrors, _1));
 
-            frameReprojectionError(frame,
-                                   m_cameraSystem.getCamera(frame->cameraId()),
-                                   T_cam_ref,
-                                   frameMinError, frameMaxError, frameAvgError, frameFeatureCount);
+    for (size_t i = 0; i < frameErrors.size(); ++i)
+    {
+        const FrameReprojectionError& frameError = frameErrors.at(i);
 
-            if (minError > frameMinError)
-            {
-                minError = frameMinError;
-            }
-            if (maxError < frameMaxError)
-            {
-                maxError = frameMaxError;
-            }
-            totalError += frameAvgError * frameFeatureCount;
-            count += frameFeatureCount;
+        if (minError > frameError.minError)
+        {
+            minError = frameError.minError;
+        }
+        if (maxError < frameError.maxError)
+        {
+            maxError = frameError.maxError;
         }
+        totalError += frameError.avgError * frameError.featureCount;
+        count += frameError.featureCount;
     }
 
     if (count == 0)
@@ -1252,11 +1361,33 @@ InfrastructureCalibration::reprojectionError(double& minError, double& maxError,
     featureCount = count;
 }
 
+void
+InfrastructureCalibration::frameReprojectionErrorHelper(const std::vector<FramePtr>* frames,
+                                                        const std::vector<Pose, Eigen::aligned_allocator<Pose> >* T_cam_ref,
+                                                        std::vector<FrameReprojectionError>* frameErrors,
+                                                        size_t frameId) const
+{
+    const FramePtr& frame = frames->at(frameId);
+    FrameReprojectionError& frameError = frameErrors->at(frameId);
+
+    frameReprojectionError(frame,
+                           m_cameraSystem.getCamera(frame->cameraId()),
+                           T_cam_ref->at(frame->cameraId()),
+                           frameError.minError, frameError.maxError, frameError.avgError,
+                           frameError.featureCount);
+}
+
 #ifdef VCHARGE_VIZ
 void
 InfrastructureCalibration::visualizeMap(const std::string& overlayName, MapType type) const
 {
-    vcharge::GLOverlayExtended overlay(overlayName, VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended(overlayName, VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize camera poses
     overlay.pointSize(2.0f);
@@ -1391,12 +1522,13 @@ InfrastructureCalibration::visualizeMap(const std::string& overlayName, MapType
         }
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay(overlayName, overlayPtr);
 }
 
 void
 InfrastructureCalibration::visualizeCameraPose(const FrameConstPtr& frame,
-                                               bool showScenePoints)
+                                               bool showScenePoints,
+                                               vcharge::GLOverlayExtended& overlay) const
 {
     Eigen::Matrix4d H_cam = frame->cameraPose()->toMatrix().inverse();
 
@@ -1416,50 +1548,50 @@ InfrastructureCalibration::visualizeCameraPose(const FrameConstPtr& frame,
         frustum.at(k) = transformPoint(H_cam, frustum.at(k));
     }
 
-    m_overlay.color4f(1.0f, 1.0f, 1.0f, 1.0f);
-    m_overlay.begin(VCharge::LINES);
+    overlay.color4f(1.0f, 1.0f, 1.0f, 1.0f);
+    overlay.begin(VCharge::LINES);
 
     for (int k = 1; k < 5; ++k)
     {
-        m_overlay.vertex3f(frustum.at(0)(0), frustum.at(0)(1), frustum.at(0)(2));
-        m_overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
+        overlay.vertex3f(frustum.at(0)(0), frustum.at(0)(1), frustum.at(0)(2));
+        overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
     }
 
-    m_overlay.end();
+    overlay.end();
 
     switch (frame->cameraId())
     {
     case vcharge::CAMERA_FRONT:
-        m_overlay.color4f(1.0f, 0.0f, 0.0f, 0.5f);
+        overlay.color4f(1.0f, 0.0f, 0.0f, 0.5f);
         break;
     case vcharge::CAMERA_LEFT:
-        m_overlay.color4f(0.0f, 1.0f, 0.0f, 0.5f);
+        overlay.color4f(0.0f, 1.0f, 0.0f, 0.5f);
         break;
     case vcharge::CAMERA_REAR:
-        m_overlay.color4f(0.0f, 1.0f, 1.0f, 0.5f);
+        overlay.color4f(0.0f, 1.0f, 1.0f, 0.5f);
         break;
     case vcharge::CAMERA_RIGHT:
-        m_overlay.color4f(1.0f, 1.0f, 0.0f, 0.5f);
+        overlay.color4f(1.0f, 1.0f, 0.0f, 0.5f);
         break;
     default:
-        m_overlay.color4f(1.0f, 1.0f, 1.0f, 0.5f);
+        overlay.color4f(1.0f, 1.0f, 1.0f, 0.5f);
     }
 
-    m_overlay.begin(VCharge::POLYGON);
+    overlay.begin(VCharge::POLYGON);
 
     for (int k = 1; k < 5; ++k)
     {
-        m_overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
+        overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
     }
 
-    m_overlay.end();
+    overlay.end();
 
     if (!showScenePoints)
     {
         return;
     }
 
-    m_overlay.begin(VCharge::LINES);
+    overlay.begin(VCharge::LINES);
     for (size_t i = 0; i < frame->features2D().size(); ++i)
     {
         const Point2DFeaturePtr& p2D = frame->features2D().at(i);
@@ -1470,24 +1602,31 @@ InfrastructureCalibration::visualizeCameraPose(const FrameConstPtr& frame,
 
         Eigen::Vector3d scenePoint = p2D->feature3D()->point();
 
-        m_overlay.vertex3f(H_cam(0,3), H_cam(1,3), H_cam(2,3));
-        m_overlay.vertex3f(scenePoint(0), scenePoint(1), scenePoint(2));
+        overlay.vertex3f(H_cam(0,3), H_cam(1,3), H_cam(2,3));
+        overlay.vertex3f(scenePoint(0), scenePoint(1), scenePoint(2));
     }
-    m_overlay.end();
+    overlay.end();
 }
 
 void
-InfrastructureCalibration::visualizeCameraPoses(bool showScenePoints)
+InfrastructureCalibration::visualizeCameraPoses(bool showScenePoints,
+                                                const std::vector<FramePtr>& currentFrames) const
 {
-    m_overlay.clear();
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended("cameras", VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     for (size_t i = 0; i < m_framesets.size(); ++i)
     {
-        FrameSet& frameset = m_framesets.at(i);
+        const FrameSet& frameset = m_framesets.at(i);
 
         for (size_t j = 0; j < frameset.frames.size(); ++j)
         {
-            FramePtr& frame = frameset.frames.at(j);
+            const FramePtr& frame = frameset.frames.at(j);
 
             Eigen::Matrix4d H_cam = frame->cameraPose()->toMatrix().inverse();
 
@@ -1507,16 +1646,16 @@ InfrastructureCalibration::visualizeCameraPoses(bool showScenePoints)
                 frustum.at(k) = transformPoint(H_cam, frustum.at(k));
             }
 
-            m_overlay.color4f(1.0f, 1.0f, 1.0f, 1.0f);
-            m_overlay.begin(VCharge::LINES);
+            overlay.color4f(1.0f, 1.0f, 1.0f, 1.0f);
+            overlay.begin(VCharge::LINES);
 
             for (int k = 1; k < 5; ++k)
             {
-                m_overlay.vertex3f(frustum.at(0)(0), frustum.at(0)(1), frustum.at(0)(2));
-                m_overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
+                overlay.vertex3f(frustum.at(0)(0), frustum.at(0)(1), frustum.at(0)(2));
+                overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
             }
 
-            m_overlay.end();
+            overlay.end();
 
             if (!showScenePoints)
             {
@@ -1526,31 +1665,31 @@ InfrastructureCalibration::visualizeCameraPoses(bool showScenePoints)
             switch (frame->cameraId())
             {
             case vcharge::CAMERA_FRONT:
-                m_overlay.color4f(1.0f, 0.0f, 0.0f, 0.5f);
+                overlay.color4f(1.0f, 0.0f, 0.0f, 0.5f);
                 break;
             case vcharge::CAMERA_LEFT:
-                m_overlay.color4f(0.0f, 1.0f, 0.0f, 0.5f);
+                overlay.color4f(0.0f, 1.0f, 0.0f, 0.5f);
                 break;
             case vcharge::CAMERA_REAR:
-                m_overlay.color4f(0.0f, 1.0f, 1.0f, 0.5f);
+                overlay.color4f(0.0f, 1.0f, 1.0f, 0.5f);
                 break;
             case vcharge::CAMERA_RIGHT:
-                m_overlay.color4f(1.0f, 1.0f, 0.0f, 0.5f);
+                overlay.color4f(1.0f, 1.0f, 0.0f, 0.5f);
                 break;
             default:
-                m_overlay.color4f(1.0f, 1.0f, 1.0f, 0.5f);
+                overlay.color4f(1.0f, 1.0f, 1.0f, 0.5f);
             }
 
-            m_overlay.begin(VCharge::POLYGON);
+            overlay.begin(VCharge::POLYGON);
 
             for (int k = 1; k < 5; ++k)
             {
-                m_overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
+                overlay.vertex3f(frustum.at(k)(0), frustum.at(k)(1), frustum.at(k)(2));
             }
 
-            m_overlay.end();
+            overlay.end();
 
-            m_overlay.begin(VCharge::POINTS);
+            overlay.begin(VCharge::POINTS);
             for (size_t i = 0; i < frame->features2D().size(); ++i)
             {
                 const Point2DFeaturePtr& p2D = frame->features2D().at(i);
@@ -1561,19 +1700,31 @@ InfrastructureCalibration::visualizeCameraPoses(bool showScenePoints)
 
                 Eigen::Vector3d scenePoint = p2D->feature3D()->point();
 
-                m_overlay.vertex3f(scenePoint(0), scenePoint(1), scenePoint(2));
+                overlay.vertex3f(scenePoint(0), scenePoint(1), scenePoint(2));
             }
-            m_overlay.end();
+            overlay.end();
         }
     }
 
-    m_overlay.publish();
+    // the current frames are shown with their scene points
+    for (size_t i = 0; i < currentFrames.size(); ++i)
+    {
+        visualizeCameraPose(currentFrames.at(i), true, overlay);
+    }
+
+    VisualizationPublisher::instance()->publishOverlay("cameras", overlayPtr);
 }
 
 void
 InfrastructureCalibration::visualizeExtrinsics(void) const
 {
-    vcharge::GLOverlayExtended overlay("infra-extrinsics", VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended("infra-extrinsics", VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     // visualize extrinsics
     overlay.clear();
@@ -1659,13 +1810,19 @@ InfrastructureCalibration::visualizeExtrinsics(void) const
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay("infra-extrinsics", overlayPtr);
 }
 
 void
 InfrastructureCalibration::visualizeOdometry(void) const
 {
-    vcharge::GLOverlayExtended overlay("infra-odo", VCharge::COORDINATE_FRAME_GLOBAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended("infra-odo", VCharge::COORDINATE_FRAME_GLOBAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     overlay.lineWidth(1.0f);
     overlay.color3f(0.7f, 0.7f, 0.7f);
@@ -1714,7 +1871,7 @@ InfrastructureCalibration::visualizeOdometry(void) const
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay("infra-odo", overlayPtr);
 }
 
 #endif
@@ -1,26 +1,82 @@
 #include "LocationRecognition.h"
 
+#include <camodocal/sparse_graph/Descriptor.h>
+#include <cmath>
+#include <limits>
+
 namespace camodocal
 {
 
-LocationRecognition::LocationRecognition()
+namespace
+{
+
+// two nearest neighbours by squared descriptor distance
+struct NearestNeighbours
+{
+    NearestNeighbours()
+     : index(-1)
+     , distance(std::numeric_limits<float>::max())
+     , secondDistance(std::numeric_limits<float>::max())
+    {
+
+    }
+
+    void update(int i, float d)
+    {
+        if (d < distance)
+        {
+            secondDistance = distance;
+            distance = d;
+            index = i;
+        }
+        else if (d < secondDistance)
+        {
+            secondDistance = d;
+        }
+    }
+
+    bool passesRatioTest(float maxDistanceRatio) const
+    {
+        return index != -1 &&
+               secondDistance != std::numeric_limits<float>::max() &&
+               distance < maxDistanceRatio * maxDistanceRatio * secondDistance;
+    }
+
+    int index;
+    float distance;
+    float secondDistance;
+};
+
+}
+
+LocationRecognition::LocationRecognition(int directIndexLevels)
+ : m_vocabularyLoaded(false)
+ , k_directIndexLevels(directIndexLevels)
 {
 
 }
 
 void
-LocationRecognition::setup(const SparseGraph& graph)
+LocationRecognition::setup(void)
 {
+    loadVocabulary();
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+    m_db.clear();
+
+    m_words.clear();
     m_frameTags.clear();
     m_frames.clear();
+}
 
-    Surf64Vocabulary voc;
-    voc.load("surf64.yml.gz");
-
-    m_db.setVocabulary(voc);
+void
+LocationRecognition::setup(const SparseGraph& graph)
+{
+    loadVocabulary();
 
-    // build vocabulary tree
-    std::vector<std::vector<std::vector<float> > > features;
+    std::vector<FrameTag> frameTags;
+    std::vector<FramePtr> frames;
 
     for (size_t segmentId = 0; segmentId < graph.frameSetSegments().size(); ++segmentId)
     {
@@ -44,29 +100,170 @@ LocationRecognition::setup(const SparseGraph& graph)
                 tag.frameSetId = frameSetId;
                 tag.frameId = frameId;
 
-                m_frameTags.push_back(tag);
+                frameTags.push_back(tag);
 
-                m_frames.push_back(frame);
+                frames.push_back(frame);
+            }
+        }
+    }
 
-                features.push_back(frameToBOW(frame));
+    // transform the frames which were not added before
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const FramePtr& frame = frames.at(i);
+
+        {
+            boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+            std::map<const Frame*, Words>::const_iterator it = m_words.find(frame.get());
+            if (it != m_words.end() && it->second.frame.lock() == frame)
+            {
+                continue;
             }
         }
+
+        Words words;
+        transform(frame, words);
+
+        boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+        m_words[frame.get()] = words;
     }
 
-    for (size_t i = 0; i < features.size(); ++i)
+    // rebuild the inverted and direct indices from the cached words
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+    std::map<const Frame*, Words>::iterator it = m_words.begin();
+    while (it != m_words.end())
     {
-        m_db.add(features.at(i));
+        if (it->second.frame.expired())
+        {
+            m_words.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    m_db.clear();
+
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const Words& words = m_words[frames.at(i).get()];
+
+        m_db.add(words.bowVector, words.featureVector);
     }
+
+    m_frameTags.swap(frameTags);
+    m_frames.assign(frames.begin(), frames.end());
+}
+
+bool
+LocationRecognition::addFrame(const FramePtr& frame)
+{
+    loadVocabulary();
+
+    {
+        boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+        std::map<const Frame*, Words>::const_iterator it = m_words.find(frame.get());
+        if (it != m_words.end() && it->second.frame.lock() == frame)
+        {
+            return false;
+        }
+    }
+
+    Words words;
+    transform(frame, words);
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+    std::map<const Frame*, Words>::const_iterator it = m_words.find(frame.get());
+    if (it != m_words.end() && it->second.frame.lock() == frame)
+    {
+        // added concurrently
+        return false;
+    }
+
+    m_words[frame.get()] = words;
+
+    m_db.add(words.bowVector, words.featureVector);
+
+    FrameTag tag;
+    tag.frameSetSegmentId = -1;
+    tag.frameSetId = -1;
+    tag.frameId = -1;
+
+    m_frameTags.push_back(tag);
+    m_frames.push_back(frame);
+
+    return true;
 }
 
 void
 LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
                               std::vector<FrameTag>& matches) const
 {
+    DBoW2::BowVector bowVector;
+    DBoW2::FeatureVector featureVector;
+    getWords(frame, bowVector, featureVector);
+
+    knnMatch(bowVector, k, matches);
+}
+
+void
+LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
+                              std::vector<FramePtr>& matches) const
+{
+    matches.clear();
+
+    // the database is empty until the vocabulary is loaded
+    if (!vocabularyLoaded())
+    {
+        return;
+    }
+
+    DBoW2::BowVector bowVector;
+    DBoW2::FeatureVector featureVector;
+    getWords(frame, bowVector, featureVector);
+
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
     DBoW2::QueryResults ret;
-    m_db.query(frameToBOW(frame), ret, k);
+    m_db.query(bowVector, ret, k);
+
+    for (size_t i = 0; i < ret.size(); ++i)
+    {
+        FramePtr match = m_frames.at(ret.at(i).Id).lock();
+
+        // skip frames which were removed from the graph
+        if (match.get() == 0)
+        {
+            continue;
+        }
+
+        matches.push_back(match);
+    }
+}
 
+void
+LocationRecognition::knnMatch(const DBoW2::BowVector& bowVector, int k,
+                              std::vector<FrameTag>& matches) const
+{
     matches.clear();
+
+    // the database is empty until the vocabulary is loaded
+    if (!vocabularyLoaded())
+    {
+        return;
+    }
+
+    boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+
+    DBoW2::QueryResults ret;
+    m_db.query(bowVector, ret, k);
+
     for (size_t i = 0; i < ret.size(); ++i)
     {
         FrameTag tag = m_frameTags.at(ret.at(i).Id);
@@ -76,19 +273,140 @@ LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
 }
 
 void
-LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
-                              std::vector<FramePtr>& matches) const
+LocationRecognition::getWords(const FrameConstPtr& frame,
+                              DBoW2::BowVector& bowVector,
+                              DBoW2::FeatureVector& featureVector) const
 {
-    DBoW2::QueryResults ret;
-    m_db.query(frameToBOW(frame), ret, k);
+    {
+        boost::shared_lock<boost::shared_mutex> lock(m_mutex);
 
-    matches.clear();
-    for (size_t i = 0; i < ret.size(); ++i)
+        std::map<const Frame*, Words>::const_iterator it = m_words.find(frame.get());
+        if (it != m_words.end() && it->second.frame.lock() == frame)
+        {
+            bowVector = it->second.bowVector;
+            featureVector = it->second.featureVector;
+            return;
+        }
+    }
+
+    Words words;
+    transform(frame, words);
+
+    bowVector.swap(words.bowVector);
+    featureVector.swap(words.featureVector);
+}
+
+std::vector<cv::DMatch>
+LocationRecognition::matchFeatures(const FrameConstPtr& queryFrame,
+                                   const DBoW2::FeatureVector& queryFeatureVector,
+                                   const FrameConstPtr& trainFrame,
+                                   float maxDistanceRatio) const
+{
+    DBoW2::BowVector trainBowVector;
+    DBoW2::FeatureVector trainFeatureVector;
+    getWords(trainFrame, trainBowVector, trainFeatureVector);
+
+    const std::vector<Point2DFeaturePtr>& queryFeatures = queryFrame->features2D();
+    const std::vector<Point2DFeaturePtr>& trainFeatures = trainFrame->features2D();
+
+    // find the two nearest neighbours of each query feature among the
+    // train features in the same node, and vice versa
+    std::vector<NearestNeighbours> fwdNeighbours(queryFeatures.size());
+    std::vector<NearestNeighbours> revNeighbours(trainFeatures.size());
+
+    DBoW2::FeatureVector::const_iterator queryIt = queryFeatureVector.begin();
+    DBoW2::FeatureVector::const_iterator trainIt = trainFeatureVector.begin();
+    while (queryIt != queryFeatureVector.end() &&
+           trainIt != trainFeatureVector.end())
     {
-        const FramePtr& frame = m_frames.at(ret.at(i).Id);
+        if (queryIt->first < trainIt->first)
+        {
+            queryIt = queryFeatureVector.lower_bound(trainIt->first);
+        }
+        else if (trainIt->first < queryIt->first)
+        {
+            trainIt = trainFeatureVector.lower_bound(queryIt->first);
+        }
+        else
+        {
+            const std::vector<unsigned int>& queryIndices = queryIt->second;
+            const std::vector<unsigned int>& trainIndices = trainIt->second;
+
+            for (size_t j = 0; j < trainIndices.size(); ++j)
+            {
+                int trainIdx = trainIndices.at(j);
+
+                const Point2DFeatureConstPtr& trainFeature = trainFeatures.at(trainIdx);
+                if (trainFeature->feature3D().get() == 0)
+                {
+                    continue;
+                }
+
+                for (size_t i = 0; i < queryIndices.size(); ++i)
+                {
+                    int queryIdx = queryIndices.at(i);
+
+                    float d = descriptorDistanceSquared(queryFeatures.at(queryIdx)->descriptor(),
+                                                        trainFeature->descriptor());
 
-        matches.push_back(frame);
+                    fwdNeighbours.at(queryIdx).update(trainIdx, d);
+                    revNeighbours.at(trainIdx).update(queryIdx, d);
+                }
+            }
+
+            ++queryIt;
+            ++trainIt;
+        }
     }
+
+    // ratio test and cross-check
+    std::vector<cv::DMatch> matches;
+    for (size_t i = 0; i < fwdNeighbours.size(); ++i)
+    {
+        const NearestNeighbours& fwd = fwdNeighbours.at(i);
+        if (!fwd.passesRatioTest(maxDistanceRatio))
+        {
+            continue;
+        }
+
+        const NearestNeighbours& rev = revNeighbours.at(fwd.index);
+        if (!rev.passesRatioTest(maxDistanceRatio) || rev.index != static_cast<int>(i))
+        {
+            continue;
+        }
+
+        matches.push_back(cv::DMatch(i, fwd.index, sqrt(fwd.distance)));
+    }
+
+    return matches;
+}
+
+void
+LocationRecognition::loadVocabulary(void)
+{
+    boost::lock_guard<boost::mutex> vocabularyLock(m_vocabularyMutex);
+
+    if (m_vocabularyLoaded)
+    {
+        return;
+    }
+
+    Surf64Vocabulary voc;
+    voc.load("surf64.yml.gz");
+
+    boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+
+    m_db.setVocabulary(voc, true, k_directIndexLevels);
+
+    m_vocabularyLoaded = true;
+}
+
+bool
+LocationRecognition::vocabularyLoaded(void) const
+{
+    boost::lock_guard<boost::mutex> vocabularyLock(m_vocabularyMutex);
+
+    return m_vocabularyLoaded;
 }
 
 std::vector<std::vector<float> >
@@ -101,13 +419,11 @@ LocationRecognition::frameToBOW(const FrameConstPtr& frame) const
             it != features2D.end(); ++it)
     {
         const Point2DFeatureConstPtr& feature2D = (*it);
-        const cv::Mat& dtor = feature2D->descriptor();
+        // the vocabulary is built from float descriptors
+        cv::Mat dtor = expandDescriptor(feature2D->descriptor());
 
-        std::vector<float> w(dtor.cols);
-        for (int j = 0; j < dtor.cols; ++j)
-        {
-            w.at(j) = dtor.at<float>(0,j);
-        }
+        const float* d = dtor.ptr<float>(0);
+        std::vector<float> w(d, d + dtor.cols);
 
         bow.push_back(w);
     }
@@ -115,4 +431,31 @@ LocationRecognition::frameToBOW(const FrameConstPtr& frame) const
     return bow;
 }
 
+void
+LocationRecognition::transform(const FrameConstPtr& frame, Words& words) const
+{
+    words.frame = frame;
+
+    // frames have no words until the vocabulary is loaded
+    if (!vocabularyLoaded())
+    {
+        return;
+    }
+
+    // the vocabulary is built from SURF descriptors, and binary
+    // descriptors have no words
+    const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
+    if (!features2D.empty() &&
+        expandDescriptor(features2D.front()->descriptor()).type() != CV_32FC1)
+    {
+        return;
+    }
+
+    // the vocabulary is not modified once it is loaded, and can be used
+    // without holding m_mutex
+    m_db.getVocabulary()->transform(frameToBOW(frame),
+                                    words.bowVector, words.featureVector,
+                                    m_db.getDirectIndexLevels());
+}
+
 }
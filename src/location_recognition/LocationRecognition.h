@@ -1,6 +1,9 @@
 #ifndef LOCATIONRECOGNITION_H
 #define LOCATIONRECOGNITION_H
 
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 #include "camodocal/sparse_graph/SparseGraph.h"
 #include "../dbow2/DBoW2/DBoW2.h"
 #include "../dbow2/DUtils/DUtils.h"
@@ -13,20 +16,74 @@ namespace camodocal
 class LocationRecognition
 {
 public:
-    LocationRecognition();
+    // Features are indexed by their vocabulary nodes at directIndexLevels
+    // levels up from the words, and are only matched to features which
+    // share the same node.
+    explicit LocationRecognition(int directIndexLevels = 2);
+
+    // Empties the database. The vocabulary is only loaded the first time
+    // the database is set up or a frame is added.
+    void setup(void);
 
+    // Rebuilds the database over all frames in the graph. The BoW vectors
+    // of frames which were already added are reused.
     void setup(const SparseGraph& graph);
 
+    // Adds a frame to the database, e.g. as keyframes are produced during
+    // data capture. The frame tag is not known until the frame is part of
+    // a graph, and is set by setup(graph).
+    // Returns false if the frame is already in the database.
+    bool addFrame(const FramePtr& frame);
+
     void knnMatch(const FrameConstPtr& frame, int k, std::vector<FrameTag>& matches) const;
     void knnMatch(const FrameConstPtr& frame, int k, std::vector<FramePtr>& matches) const;
+    void knnMatch(const DBoW2::BowVector& bowVector, int k, std::vector<FrameTag>& matches) const;
+
+    // Returns the BoW vector and the direct index entry of a frame.
+    // The frame is transformed if it is not in the database.
+    void getWords(const FrameConstPtr& frame,
+                  DBoW2::BowVector& bowVector,
+                  DBoW2::FeatureVector& featureVector) const;
+
+    // Matches the features of a query frame to the features of a frame
+    // in the database, only comparing features which share a vocabulary
+    // node in the direct index. Train features without scene points are
+    // skipped. Matches pass a distance ratio test and a cross-check.
+    std::vector<cv::DMatch> matchFeatures(const FrameConstPtr& queryFrame,
+                                          const DBoW2::FeatureVector& queryFeatureVector,
+                                          const FrameConstPtr& trainFrame,
+                                          float maxDistanceRatio) const;
 
 private:
+    void loadVocabulary(void);
+    bool vocabularyLoaded(void) const;
+
+    typedef struct
+    {
+        boost::weak_ptr<const Frame> frame;
+        DBoW2::BowVector bowVector;
+        DBoW2::FeatureVector featureVector;
+    } Words;
+
     std::vector<std::vector<float> > frameToBOW(const FrameConstPtr& frame) const;
+    void transform(const FrameConstPtr& frame, Words& words) const;
 
     Surf64Database m_db;
 
+    // words of all frames which were added, indexed by frame
+    std::map<const Frame*, Words> m_words;
+
     std::vector<FrameTag> m_frameTags;
-    std::vector<FramePtr> m_frames;
+    // the graph owns the frames
+    std::vector<boost::weak_ptr<Frame> > m_frames;
+
+    // queries hold a shared lock, and updates an exclusive lock
+    mutable boost::shared_mutex m_mutex;
+
+    mutable boost::mutex m_vocabularyMutex;
+    bool m_vocabularyLoaded;
+
+    const int k_directIndexLevels;
 };
 
 }
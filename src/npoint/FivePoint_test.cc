@@ -0,0 +1,78 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <limits>
+#include <opencv2/core/core.hpp>
+
+#include "five-point/five-point.hpp"
+
+namespace camodocal
+{
+
+TEST(FivePoint, Solver)
+{
+    cv::RNG rng;
+
+    for (int k = 0; k < 100; ++k)
+    {
+        Eigen::Vector3d axis(rng.uniform(-1.0, 1.0),
+                             rng.uniform(-1.0, 1.0),
+                             rng.uniform(-1.0, 1.0));
+        Eigen::Matrix3d R_true;
+        R_true = Eigen::AngleAxisd(rng.uniform(-0.3, 0.3), axis.normalized());
+
+        Eigen::Vector3d t_true(rng.uniform(-1.0, 1.0),
+                               rng.uniform(-1.0, 1.0),
+                               rng.uniform(-1.0, 1.0));
+        t_true.normalize();
+
+        Eigen::Matrix<double, 5, 2> q1, q2;
+        for (int i = 0; i < 5; ++i)
+        {
+            Eigen::Vector3d P(rng.uniform(-2.0, 2.0),
+                              rng.uniform(-2.0, 2.0),
+                              rng.uniform(4.0, 8.0));
+            Eigen::Vector3d Q = R_true * P + t_true;
+
+            q1.row(i) << P(0) / P(2), P(1) / P(2);
+            q2.row(i) << Q(0) / Q(2), Q(1) / Q(2);
+        }
+
+        Eigen::Matrix3d t_skew;
+        t_skew << 0.0, -t_true(2), t_true(1),
+                  t_true(2), 0.0, -t_true(0),
+                  -t_true(1), t_true(0), 0.0;
+        Eigen::Matrix3d E_true = t_skew * R_true;
+        E_true.normalize();
+
+        Eigen::Matrix3d E[10];
+        int nSolutions = solveEssentialMat5Point(q1, q2, E);
+
+        ASSERT_GT(nSolutions, 0);
+        ASSERT_LE(nSolutions, 10);
+
+        double minError = std::numeric_limits<double>::max();
+        for (int j = 0; j < nSolutions; ++j)
+        {
+            // epipolar constraints
+            for (int i = 0; i < 5; ++i)
+            {
+                Eigen::Vector3d x1(q1(i, 0), q1(i, 1), 1.0);
+                Eigen::Vector3d x2(q2(i, 0), q2(i, 1), 1.0);
+
+                EXPECT_NEAR(0.0, x2.dot(E[j] * x1), 1e-8);
+            }
+
+            // two equal singular values and one zero singular value
+            Eigen::Vector3d s = E[j].jacobiSvd().singularValues();
+            EXPECT_NEAR(s(0), s(1), 1e-8);
+            EXPECT_NEAR(0.0, s(2), 1e-8);
+
+            minError = std::min(minError, std::min((E[j] - E_true).norm(),
+                                                   (E[j] + E_true).norm()));
+        }
+
+        EXPECT_LT(minError, 1e-6);
+    }
+}
+
+}
@@ -0,0 +1,244 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <limits>
+#include <opencv2/core/core.hpp>
+
+#include "p3p/p3p.hpp"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+randomPose(cv::RNG& rng, Eigen::Matrix3d& R, Eigen::Vector3d& t)
+{
+    Eigen::Vector3d axis(rng.uniform(-1.0, 1.0),
+                         rng.uniform(-1.0, 1.0),
+                         rng.uniform(-1.0, 1.0));
+    R = Eigen::AngleAxisd(rng.uniform(-M_PI, M_PI), axis.normalized());
+
+    t << rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0);
+}
+
+// scene point in front of the camera with pose (R, t)
+Eigen::Vector3d
+randomScenePoint(cv::RNG& rng, const Eigen::Matrix3d& R, const Eigen::Vector3d& t)
+{
+    Eigen::Vector3d P_cam(rng.uniform(-4.0, 4.0),
+                          rng.uniform(-4.0, 4.0),
+                          rng.uniform(2.0, 10.0));
+
+    return R.transpose() * (P_cam - t);
+}
+
+}
+
+TEST(P3P, Solver)
+{
+    cv::RNG rng;
+
+    for (int k = 0; k < 100; ++k)
+    {
+        Eigen::Matrix3d R_true;
+        Eigen::Vector3d t_true;
+        randomPose(rng, R_true, t_true);
+
+        Eigen::Vector3d f[3], P[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            P[i] = randomScenePoint(rng, R_true, t_true);
+            f[i] = (R_true * P[i] + t_true).normalized();
+        }
+
+        Eigen::Matrix3d R[4];
+        Eigen::Vector3d t[4];
+        int nSolutions = solveP3P(f, P, R, t);
+
+        ASSERT_GT(nSolutions, 0);
+        ASSERT_LE(nSolutions, 4);
+
+        double minError = std::numeric_limits<double>::max();
+        for (int j = 0; j < nSolutions; ++j)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                EXPECT_NEAR(1.0, f[i].dot((R[j] * P[i] + t[j]).normalized()), 1e-8);
+            }
+
+            EXPECT_NEAR(1.0, R[j].determinant(), 1e-8);
+
+            minError = std::min(minError, (R[j] - R_true).norm() + (t[j] - t_true).norm());
+        }
+
+        EXPECT_LT(minError, 1e-5);
+    }
+}
+
+TEST(P3P, Ransac)
+{
+    cv::RNG rng;
+
+    Eigen::Matrix3d R_true;
+    Eigen::Vector3d t_true;
+    randomPose(rng, R_true, t_true);
+
+    const int nPoints = 200;
+    const int nOutliers = 80;
+    const double noise = 1e-3;
+
+    std::vector<Eigen::Vector3d> bearings, scenePoints;
+    for (int i = 0; i < nPoints; ++i)
+    {
+        Eigen::Vector3d P = randomScenePoint(rng, R_true, t_true);
+        Eigen::Vector3d f = R_true * P + t_true;
+
+        if (i < nOutliers)
+        {
+            f << rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), 1.0;
+        }
+        else
+        {
+            f /= f(2);
+            f(0) += rng.gaussian(noise);
+            f(1) += rng.gaussian(noise);
+        }
+
+        bearings.push_back(f.normalized());
+        scenePoints.push_back(P);
+    }
+
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    std::vector<int> inliers;
+    ASSERT_TRUE(solvePnPRansac(bearings, scenePoints, R, t, inliers, 5.0 * noise));
+
+    EXPECT_GE(inliers.size(), static_cast<size_t>(0.95 * (nPoints - nOutliers)));
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        EXPECT_GE(inliers.at(i), nOutliers);
+    }
+
+    EXPECT_LT((R - R_true).norm(), 1e-2);
+    EXPECT_LT((t - t_true).norm(), 5e-2);
+}
+
+TEST(P3P, GeneralizedSolver)
+{
+    cv::RNG rng;
+
+    for (int k = 0; k < 100; ++k)
+    {
+        Eigen::Matrix3d R_true;
+        Eigen::Vector3d t_true;
+        randomPose(rng, R_true, t_true);
+
+        // rays from different centres in the rig frame
+        Eigen::Vector3d c[3], f[3], P[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            c[i] << rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0);
+
+            Eigen::Vector3d X = c[i] + Eigen::Vector3d(rng.uniform(-4.0, 4.0),
+                                                       rng.uniform(-4.0, 4.0),
+                                                       rng.uniform(2.0, 10.0));
+            f[i] = (X - c[i]).normalized();
+            P[i] = R_true.transpose() * (X - t_true);
+        }
+
+        Eigen::Matrix3d R[8];
+        Eigen::Vector3d t[8];
+        int nSolutions = solveGP3P(c, f, P, R, t);
+
+        ASSERT_GT(nSolutions, 0);
+        ASSERT_LE(nSolutions, 8);
+
+        double minError = std::numeric_limits<double>::max();
+        for (int j = 0; j < nSolutions; ++j)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                EXPECT_NEAR(1.0, f[i].dot((R[j] * P[i] + t[j] - c[i]).normalized()), 1e-8);
+            }
+
+            EXPECT_NEAR(1.0, R[j].determinant(), 1e-8);
+
+            minError = std::min(minError, (R[j] - R_true).norm() + (t[j] - t_true).norm());
+        }
+
+        EXPECT_LT(minError, 1e-4);
+    }
+}
+
+TEST(P3P, GeneralizedRansac)
+{
+    cv::RNG rng;
+
+    Eigen::Matrix3d R_true;
+    Eigen::Vector3d t_true;
+    randomPose(rng, R_true, t_true);
+
+    // three cameras looking forwards, sideways and backwards, with the
+    // third camera seeing too few points to be localized on its own
+    const int nCameras = 3;
+    const int nPoints[nCameras] = {100, 60, 5};
+    const double noise = 1e-3;
+
+    std::vector<Eigen::Vector3d> origins, bearings, scenePoints;
+    std::vector<bool> outlier;
+    for (int k = 0; k < nCameras; ++k)
+    {
+        Eigen::Matrix3d R_cam;
+        R_cam = Eigen::AngleAxisd(k * M_PI / 2.0, Eigen::Vector3d::UnitY());
+        Eigen::Vector3d t_cam(0.5 * k, 0.0, 0.2 * k);
+
+        for (int i = 0; i < nPoints[k]; ++i)
+        {
+            Eigen::Vector3d X = R_cam * Eigen::Vector3d(rng.uniform(-4.0, 4.0),
+                                                        rng.uniform(-4.0, 4.0),
+                                                        rng.uniform(2.0, 10.0)) + t_cam;
+            Eigen::Vector3d f = R_cam.transpose() * (X - t_cam);
+
+            bool isOutlier = (k < 2 && i % 3 == 0);
+            if (isOutlier)
+            {
+                f << rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), 1.0;
+            }
+            else
+            {
+                f /= f(2);
+                f(0) += rng.gaussian(noise);
+                f(1) += rng.gaussian(noise);
+            }
+
+            origins.push_back(t_cam);
+            bearings.push_back(R_cam * f.normalized());
+            scenePoints.push_back(R_true.transpose() * (X - t_true));
+            outlier.push_back(isOutlier);
+        }
+    }
+
+    Eigen::Matrix3d R;
+    Eigen::Vector3d t;
+    std::vector<int> inliers;
+    ASSERT_TRUE(solveGPnPRansac(origins, bearings, scenePoints, R, t, inliers, 5.0 * noise));
+
+    int nInliersLastCamera = 0;
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        EXPECT_FALSE(outlier.at(inliers.at(i)));
+
+        if (inliers.at(i) >= nPoints[0] + nPoints[1])
+        {
+            ++nInliersLastCamera;
+        }
+    }
+
+    EXPECT_GE(nInliersLastCamera, nPoints[2] - 1);
+
+    EXPECT_LT((R - R_true).norm(), 1e-2);
+    EXPECT_LT((t - t_true).norm(), 5e-2);
+}
+
+}
@@ -0,0 +1,199 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include "five-point/five-point.hpp"
+#include "ransac/Ransac.h"
+
+namespace camodocal
+{
+
+// 2D line y = a * x + b with vertical residuals
+class LineKernel
+{
+public:
+    typedef Eigen::Vector2d Model;
+
+    enum
+    {
+        SampleSize = 2,
+        MaxModels = 1
+    };
+
+    LineKernel(const Eigen::ArrayXd& x, const Eigen::ArrayXd& y)
+     : mX(x)
+     , mY(y)
+    {
+
+    }
+
+    int size(void) const
+    {
+        return mX.size();
+    }
+
+    int fit(const int* sample, Model* models) const
+    {
+        double dx = mX(sample[1]) - mX(sample[0]);
+        if (fabs(dx) < 1e-12)
+        {
+            return 0;
+        }
+
+        models[0](0) = (mY(sample[1]) - mY(sample[0])) / dx;
+        models[0](1) = mY(sample[0]) - models[0](0) * mX(sample[0]);
+
+        return 1;
+    }
+
+    void evaluate(const Model& model, int begin, int end, double* errors) const
+    {
+        Eigen::Map<Eigen::ArrayXd>(errors, end - begin) =
+            (mY.segment(begin, end - begin) -
+             model(0) * mX.segment(begin, end - begin) - model(1)).abs();
+    }
+
+    bool refit(const std::vector<int>& indices, Model& model) const
+    {
+        Eigen::MatrixXd A(indices.size(), 2);
+        Eigen::VectorXd b(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            A(i, 0) = mX(indices.at(i));
+            A(i, 1) = 1.0;
+            b(i) = mY(indices.at(i));
+        }
+
+        model = A.colPivHouseholderQr().solve(b);
+
+        return true;
+    }
+
+private:
+    Eigen::ArrayXd mX;
+    Eigen::ArrayXd mY;
+};
+
+void
+generateLine(int nPoints, int nOutliers, Eigen::ArrayXd& x, Eigen::ArrayXd& y)
+{
+    cv::RNG rng;
+
+    x.resize(nPoints);
+    y.resize(nPoints);
+    for (int i = 0; i < nPoints; ++i)
+    {
+        x(i) = rng.uniform(-10.0, 10.0);
+        if (i < nPoints - nOutliers)
+        {
+            y(i) = 2.0 * x(i) - 1.0 + rng.gaussian(0.01);
+        }
+        else
+        {
+            y(i) = rng.uniform(-30.0, 30.0);
+        }
+    }
+}
+
+TEST(Ransac, Line)
+{
+    Eigen::ArrayXd x, y;
+    generateLine(1000, 600, x, y);
+
+    LineKernel kernel(x, y);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Ransac<LineKernel> ransac(kernel);
+        ransac.setThreshold(0.05);
+        ransac.setProsac(i & 1);
+        ransac.setSprt(i & 2);
+        ransac.setLocalOptimization(i & 4);
+
+        Eigen::Vector2d model;
+        std::vector<unsigned char> inliers;
+        ASSERT_TRUE(ransac.estimate(model, inliers));
+
+        EXPECT_NEAR(2.0, model(0), 1e-2);
+        EXPECT_NEAR(-1.0, model(1), 1e-2);
+
+        int nInliers = 0;
+        for (int j = 0; j < 400; ++j)
+        {
+            nInliers += inliers.at(j);
+        }
+        EXPECT_GT(nInliers, 390);
+
+        if (ransac.modelsRejected() > 0)
+        {
+            EXPECT_TRUE(i & 2);
+        }
+    }
+}
+
+TEST(Ransac, TooFewPoints)
+{
+    Eigen::ArrayXd x(1), y(1);
+    x << 1.0;
+    y << 1.0;
+
+    LineKernel kernel(x, y);
+    Ransac<LineKernel> ransac(kernel);
+
+    Eigen::Vector2d model;
+    std::vector<unsigned char> inliers;
+    EXPECT_FALSE(ransac.estimate(model, inliers));
+    EXPECT_EQ(1, static_cast<int>(inliers.size()));
+}
+
+TEST(Ransac, EssentialMatrix)
+{
+    cv::RNG rng;
+
+    Eigen::Matrix3d R_true;
+    R_true = Eigen::AngleAxisd(0.1, Eigen::Vector3d(0.1, 1.0, 0.2).normalized());
+    Eigen::Vector3d t_true(0.8, 0.1, 0.3);
+    t_true.normalize();
+
+    const double focal = 500.0;
+
+    std::vector<cv::Point2f> points1, points2;
+    for (int i = 0; i < 300; ++i)
+    {
+        Eigen::Vector3d P(rng.uniform(-2.0, 2.0),
+                          rng.uniform(-2.0, 2.0),
+                          rng.uniform(4.0, 8.0));
+        Eigen::Vector3d Q = R_true * P + t_true;
+
+        points1.push_back(cv::Point2f(focal * P(0) / P(2), focal * P(1) / P(2)));
+        if (i % 3 == 0)
+        {
+            points2.push_back(cv::Point2f(rng.uniform(-250.0, 250.0),
+                                          rng.uniform(-250.0, 250.0)));
+        }
+        else
+        {
+            points2.push_back(cv::Point2f(focal * Q(0) / Q(2), focal * Q(1) / Q(2)));
+        }
+    }
+
+    cv::Mat inliers;
+    cv::Mat E = findEssentialMat(points1, points2, focal, cv::Point2d(0.0, 0.0),
+                                 CV_FM_RANSAC, 0.99, 1.0, 1000, inliers);
+
+    EXPECT_GE(cv::countNonZero(inliers), 195);
+
+    cv::Mat R, t;
+    recoverPose(E, points1, points2, R, t, focal, cv::Point2d(0.0, 0.0), inliers);
+
+    for (int r = 0; r < 3; ++r)
+    {
+        EXPECT_NEAR(t_true(r), t.at<double>(r), 1e-2);
+        for (int c = 0; c < 3; ++c)
+        {
+            EXPECT_NEAR(R_true(r, c), R.at<double>(r, c), 1e-2);
+        }
+    }
+}
+
+}
@@ -1,34 +1,49 @@
 #include <iostream>
-#include "precomp.hpp"
-#include "_modelest.h"
 
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include "five-point.hpp"
-#include <ctime>
+#include "../ransac/Ransac.h"
 
 using namespace cv; 
 using namespace std; 
 
-class CvEMEstimator : public CvModelEstimator2
+static void calibrated_fivepoint_helper( double *eet, double* at ); 
+
+// Essential matrix kernel for camodocal::Ransac. 
+// Points are normalized image coordinates stored as separate 
+// coordinate arrays, so that the Sampson errors of a block of 
+// points are computed with vectorized Eigen array expressions. 
+// Models satisfy x2' * E * x1 = 0. 
+class EssentialKernel
 {
 public:
-    CvEMEstimator(); 
-    virtual int runKernel( const CvMat* m1, const CvMat* m2, CvMat* model ); 
-    virtual int run5Point( const CvMat* _q1, const CvMat* _q2, CvMat* _ematrix ); 
-protected: 
-	bool reliable( const CvMat* m1, const CvMat* m2, const CvMat* model ); 
-    virtual void calibrated_fivepoint_helper( double *eet, double* at ); 
-    virtual void computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error );
-}; 
+	typedef Eigen::Matrix3d Model; 
+
+	enum
+	{
+		SampleSize = 5, 
+		MaxModels = 10
+	}; 
 
+	EssentialKernel( const Mat& points1, const Mat& points2 ); 
 
+	int size(void) const; 
+	int fit( const int* sample, Model* models ) const; 
+	void evaluate( const Model& E, int begin, int end, double* errors ) const; 
+	bool refit( const std::vector<int>& indices, Model& E ) const; 
+
+protected: 
+	bool reliable( const Model& E, const int* sample ) const; 
+
+	Eigen::ArrayXd x1, y1, x2, y2; 
+}; 
 
 // Input should be a vector of n 2D points or a Nx2 matrix
 Mat findEssentialMat( InputArray _points1, InputArray _points2, double focal, Point2d pp, 
-					int method, double prob, double threshold, int maxIters, OutputArray _mask) 
+					int method, double prob, double threshold, int maxIters, OutputArray _mask, 
+					bool sortedByQuality ) 
 {
 	Mat points1, points2; 
 	_points1.getMat().copyTo(points1); 
@@ -50,32 +65,37 @@ Mat findEssentialMat( InputArray _points1, InputArray _points2, double focal, Po
 	points2.col(0) = (points2.col(0) - pp.x) / focal; 
 	points1.col(1) = (points1.col(1) - pp.y) / focal; 
 	points2.col(1) = (points2.col(1) - pp.y) / focal; 
-	
-	// Reshape data to fit opencv ransac function
-	points1 = points1.reshape(2, 1); 
-	points2 = points2.reshape(2, 1); 
 
-	Mat E(3, 3, CV_64F); 
-	CvEMEstimator estimator; 
+	// LMedS is not supported by the RANSAC engine; all methods 
+	// use RANSAC with SPRT and local optimization. 
+	(void) method; 
 
-	CvMat p1 = points1; 
-	CvMat p2 = points2; 
-	CvMat _E = E;  
-	CvMat* tempMask = cvCreateMat(1, npoints, CV_8U); 
-	
-	assert(npoints >= 5); 
+	EssentialKernel kernel(points1, points2); 
+	camodocal::Ransac<EssentialKernel> ransac(kernel); 
+
+	// The Sampson error is a squared distance. 
 	threshold /= focal; 
-	if (method = CV_FM_RANSAC)
-	{
-		estimator.runRANSAC(&p1, &p2, &_E, tempMask, threshold, prob, maxIters); 
-	}
-	else
+	ransac.setThreshold(threshold * threshold); 
+	ransac.setConfidence(prob); 
+	ransac.setMaxIterations(maxIters); 
+	ransac.setProsac(sortedByQuality); 
+
+	Eigen::Matrix3d E_eigen = Eigen::Matrix3d::Zero(); 
+	std::vector<uchar> inliers; 
+	ransac.estimate(E_eigen, inliers); 
+
+	if (_mask.needed())
 	{
-		estimator.runLMeDS(&p1, &p2, &_E, tempMask, prob, maxIters); 
+		_mask.create(1, npoints, CV_8U, -1, true); 
+		Mat mask = _mask.getMat(); 
+		if (npoints > 0)
+		{
+			Mat(inliers).reshape(1, 1).copyTo(mask); 
+		}
 	}
-	_mask.create(1, npoints, CV_8U, -1, true); 
-	Mat mask = _mask.getMat(); 
-	mask = Mat(tempMask) * 1.0; 
+
+	Mat E; 
+	eigen2cv(E_eigen, E); 
 
 	return E; 
 
@@ -239,143 +259,215 @@ void decomposeEssentialMat( const Mat & E, Mat & R1, Mat & R2, Mat & t )
 }
 
 
-CvEMEstimator::CvEMEstimator()
-: CvModelEstimator2( 5, cvSize(3,3),  10 )
+// Stewenius' five-point solver with fixed-size Eigen matrices only, so that 
+// no memory is allocated per minimal sample. 
+int solveEssentialMat5Point( const Eigen::Matrix<double, 5, 2> & q1, 
+							 const Eigen::Matrix<double, 5, 2> & q2, 
+							 Eigen::Matrix3d * E )
 {
-}
+	// Each row is the epipolar constraint q2' * E * q1 = 0 in the 
+	// column-major entries of E. 
+	Eigen::Matrix<double, 9, 5> Qt; 
+	for (int i = 0; i < 5; i++)
+	{
+		Qt(0, i) = q2(i, 0) * q1(i, 0); 
+		Qt(1, i) = q2(i, 1) * q1(i, 0); 
+		Qt(2, i) = q1(i, 0); 
+		Qt(3, i) = q2(i, 0) * q1(i, 1); 
+		Qt(4, i) = q2(i, 1) * q1(i, 1); 
+		Qt(5, i) = q1(i, 1); 
+		Qt(6, i) = q2(i, 0); 
+		Qt(7, i) = q2(i, 1); 
+		Qt(8, i) = 1.0; 
+	}
 
-int CvEMEstimator::runKernel( const CvMat* m1, const CvMat* m2, CvMat* model )
-{
-    run5Point(m1, m2, model); 
-}
+	// The last 4 columns of the orthogonal factor of Q' span the 
+	// null space of Q. 
+	Eigen::HouseholderQR<Eigen::Matrix<double, 9, 5> > qr(Qt); 
+	Eigen::Matrix<double, 9, 9> H = qr.householderQ(); 
+	Eigen::Matrix<double, 9, 4> EE = H.rightCols<4>(); 
 
-// Notice to keep compatibility with opencv ransac, q1 and q2 have
-// to be of 1 row x n col x 2 channel. 
-int CvEMEstimator::run5Point( const CvMat* q1, const CvMat* q2, CvMat* ematrix )
-{
-	// Notice to keep notion consistence with our reference Matlab code, 
-	// in this function Q1 denotes right points while Q2 left. 
-	// Therefore, left q1 and right q2 are swap to Q2 and Q1. 
-	// Q1 and Q2 are Nx2 (with omitted third coord as 1). 
-	Eigen::MatrixXd Q1, Q2; 
-	cv::cv2eigen(cv::Mat(q1).reshape(1, q1->cols), Q2); 
-	cv::cv2eigen(cv::Mat(q2).reshape(1, q2->cols), Q1); 
-//	std::cout << Q1 << std::endl; 
-//	std::cout << Q2 << std::endl; 
-
-
-	int n = Q1.rows(); 
-	Eigen::MatrixXd Q(n, 9), V, EE; 
-	Q.col(0) = Q1.col(0).array() * Q2.col(0).array(); 
-	Q.col(1) = Q1.col(1).array() * Q2.col(0).array(); 
-	Q.col(2) = Q2.col(0).array(); 
-	Q.col(3) = Q1.col(0).array() * Q2.col(1).array(); 
-	Q.col(4) = Q1.col(1).array() * Q2.col(1).array(); 
-	Q.col(5) = Q2.col(1).array(); 
-	Q.col(6) = Q1.col(0).array(); 
-	Q.col(7) = Q1.col(1).array(); 
-	Q.col(8).setOnes(); 
-	V = Q.jacobiSvd(Eigen::ComputeFullV|Eigen::ComputeThinU).matrixV(); 
-	EE = V.block<9, 4>(0, 5); 
-
-	Eigen::MatrixXd A(10, 20); 
+	Eigen::Matrix<double, 10, 20> A; 
 	calibrated_fivepoint_helper(EE.data(), A.data()); 
-	A = A.block<10, 10>(0, 0).inverse() * A.block<10, 10>(0, 10); 
-	
-	Eigen::MatrixXd M = Eigen::MatrixXd::Zero(10, 10); 
-	M.row(0) = -A.row(0); 
-	M.row(1) = -A.row(1); 
-	M.row(2) = -A.row(2); 
-	M.row(3) = -A.row(4); 
-	M.row(4) = -A.row(5); 
-	M.row(5) = -A.row(7); 
+	Eigen::Matrix<double, 10, 10> B = A.leftCols<10>().partialPivLu().solve(A.rightCols<10>()); 
+
+	// action matrix
+	Eigen::Matrix<double, 10, 10> M = Eigen::Matrix<double, 10, 10>::Zero(); 
+	M.row(0) = -B.row(0); 
+	M.row(1) = -B.row(1); 
+	M.row(2) = -B.row(2); 
+	M.row(3) = -B.row(4); 
+	M.row(4) = -B.row(5); 
+	M.row(5) = -B.row(7); 
 	M(6, 0) = 1; 
 	M(7, 1) = 1; 
 	M(8, 3) = 1; 
 	M(9, 6) = 1; 
 
-	Eigen::EigenSolver<Eigen::MatrixXd> es(M); 
-	Eigen::MatrixXcd Vc, SOLS; 
-	Vc = es.eigenvectors(); 
-	SOLS = Vc.block<3, 10>(6, 0).array() / (Eigen::MatrixXd::Ones(3, 1) * Vc.row(9)).array(); 
-
-	Eigen::MatrixXcd temp(4, 10); 
-	temp << SOLS, Eigen::MatrixXcd::Ones(1, 10); 
-	Eigen::MatrixXcd Evec = EE * temp; 
-	Evec = Evec.array() / (Eigen::MatrixXd::Ones(9, 1) * Evec.array().square().matrix().colwise().sum().cwiseSqrt()).array(); 
-
-	assert( CV_IS_MAT_CONT(ematrix->type) ); 
-	int count = 0, c, r; 
-	double* e = ematrix->data.db; 
-	CvMat* _e = cvCreateMat(3, 3, CV_64FC1); 
-	for (c = 0; c < Evec.cols(); c++)
+	Eigen::EigenSolver<Eigen::Matrix<double, 10, 10> > es(M); 
+	const Eigen::Matrix<double, 10, 10> & V = es.pseudoEigenvectors(); 
+
+	int count = 0; 
+	for (int c = 0; c < 10; c++)
+	{
+		// For real eigenvalues, the columns of the pseudo eigenvector 
+		// matrix are the eigenvectors. 
+		if (es.eigenvalues()(c).imag() != 0 || V(9, c) == 0) continue; 
+
+		Eigen::Vector4d xyz1(V(6, c) / V(9, c), V(7, c) / V(9, c), V(8, c) / V(9, c), 1.0); 
+		Eigen::Matrix<double, 9, 1> e = EE * xyz1; 
+		e.normalize(); 
+
+		E[count++] = Eigen::Map<Eigen::Matrix3d>(e.data()); 
+	}
+
+	return count; 
+}
+
+EssentialKernel::EssentialKernel( const Mat& points1, const Mat& points2 )
+{
+	// points are N x 2 CV_64F
+	int n = points1.rows; 
+	x1.resize(n); y1.resize(n); 
+	x2.resize(n); y2.resize(n); 
+	for (int i = 0; i < n; i++)
 	{
-		if (Evec(1, c).imag() == 0) 
+		x1(i) = points1.at<double>(i, 0); 
+		y1(i) = points1.at<double>(i, 1); 
+		x2(i) = points2.at<double>(i, 0); 
+		y2(i) = points2.at<double>(i, 1); 
+	}
+}
+
+int EssentialKernel::size(void) const
+{
+	return x1.size(); 
+}
+
+int EssentialKernel::fit( const int* sample, Model* models ) const
+{
+	Eigen::Matrix<double, 5, 2> q1, q2; 
+	for (int i = 0; i < SampleSize; i++)
+	{
+		int k = sample[i]; 
+		q1(i, 0) = x1(k); q1(i, 1) = y1(k); 
+		q2(i, 0) = x2(k); q2(i, 1) = y2(k); 
+	}
+
+	Model E[10]; 
+	int nsols = solveEssentialMat5Point(q1, q2, E); 
+
+	int count = 0; 
+	for (int c = 0; c < nsols; c++)
+	{
+		if (reliable(E[c], sample))
 		{
-			for (r = 0; r < 9; r++) _e->data.db[3 * (r%3) + r/3] = Evec(r, c).real(); 
-			if (reliable(q2, q1, _e)) // Notice q2 is left and q1 right. 
-			{
-				for (r = 0; r < 9; r++) e[3 * (r%3) + r/3] = Evec(r, c).real(); 
-				e += 9; 
-				count++; 
-			}
+			models[count++] = E[c]; 
 		}
 	}
 
-/*	ematrix->rows = count; 
-	ematrix->cols = 9; 
-	ematrix->type = CV_64F; 
-*/
-//	std::cout << cv::Mat(ematrix) << std::endl; 
-
 	return count; 
-    
 }
 
-bool CvEMEstimator::reliable( const CvMat* m1, const CvMat* m2, const CvMat* model )
+// Cheirality check of the minimal sample: the sample points must be in 
+// front of both cameras for one of the four decompositions of E. 
+// Notice a threshold dist is used to filter out far away points 
+// as in recoverPose. 
+bool EssentialKernel::reliable( const Model& E, const int* sample ) const
 { 
-	Mat R, t; 
-	return recoverPose( Mat(model), Mat(m1), Mat(m2), R, t ) >= 5; 
+	Eigen::JacobiSVD<Eigen::Matrix3d> svd(E, Eigen::ComputeFullU|Eigen::ComputeFullV); 
+	Eigen::Matrix3d U = svd.matrixU(); 
+	Eigen::Matrix3d V = svd.matrixV(); 
+	if (U.determinant() < 0) U = -U; 
+	if (V.determinant() < 0) V = -V; 
+
+	Eigen::Matrix3d W; 
+	W << 0, 1, 0, -1, 0, 0, 0, 0, 1; 
+
+	Eigen::Matrix3d R[2]; 
+	R[0] = U * W * V.transpose(); 
+	R[1] = U * W.transpose() * V.transpose(); 
+	Eigen::Vector3d t = U.col(2); 
+
+	const double dist = 1000.0; 
+	for (int k = 0; k < 4; k++)
+	{
+		const Eigen::Matrix3d& Rk = R[k % 2]; 
+		Eigen::Vector3d tk = (k < 2) ? t : Eigen::Vector3d(-t); 
+
+		int good = 0; 
+		for (int i = 0; i < SampleSize; i++)
+		{
+			int j = sample[i]; 
+
+			// Solve d2 * p2 = d1 * R * p1 + t for the depths d1 and d2. 
+			Eigen::Vector3d a = Rk * Eigen::Vector3d(x1(j), y1(j), 1.0); 
+			Eigen::Vector3d b(-x2(j), -y2(j), -1.0); 
+			Eigen::Matrix2d AtA; 
+			AtA << a.dot(a), a.dot(b), a.dot(b), b.dot(b); 
+			Eigen::Vector2d d = AtA.inverse() * Eigen::Vector2d(-a.dot(tk), -b.dot(tk)); 
+
+			if (d(0) > 0 && d(0) < dist && d(1) > 0 && d(1) < dist) good++; 
+		}
+
+		if (good == SampleSize) return true; 
+	}
+
+	return false; 
 }
 
-// Same as the runKernel (run5Point), m1 and m2 should be
-// 1 row x n col x 2 channels. 
-// And also, error has to be of CV_32FC1. 
-void CvEMEstimator::computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error )
+// Sampson error of the points [begin, end). 
+void EssentialKernel::evaluate( const Model& E, int begin, int end, double* errors ) const
 {
-	Eigen::MatrixXd X1t, X2t; 
-	cv::cv2eigen(cv::Mat(m1).reshape(1, m1->cols), X1t); 
-	cv::cv2eigen(cv::Mat(m2).reshape(1, m2->cols), X2t); 
-	Eigen::MatrixXd X1(3, X1t.rows()); 
-	Eigen::MatrixXd X2(3, X2t.rows()); 
-	X1.topRows(2) = X1t.transpose(); 
-	X2.topRows(2) = X2t.transpose(); 
-	X1.row(2).setOnes(); 
-	X2.row(2).setOnes(); 
-
-	Eigen::MatrixXd E; 
-	cv::cv2eigen(cv::Mat(model), E); 
-	
-	// Compute Simpson's error
-	Eigen::MatrixXd Ex1, x2tEx1, Etx2, SimpsonError; 
-	Ex1 = E * X1; 
-	x2tEx1 = (X2.array() * Ex1.array()).matrix().colwise().sum(); 
-	Etx2 = E.transpose() * X2; 
-	SimpsonError = x2tEx1.array().square() / (Ex1.row(0).array().square() + Ex1.row(1).array().square() + Etx2.row(0).array().square() + Etx2.row(1).array().square()); 
-	
-	assert( CV_IS_MAT_CONT(error->type) ); 
-	int i; 
-	cv::Mat isInliers, R, t; 	
-//	recoverPose( Mat(model), Mat(m1), Mat(m2), R, t, 1.0, cv::Point2d(0, 0), isInliers ); 
-	for (int i = 0; i < SimpsonError.cols(); i++) 
+	int n = end - begin; 
+	Eigen::ArrayXd::ConstSegmentReturnType 
+		u1 = x1.segment(begin, n), v1 = y1.segment(begin, n), 
+		u2 = x2.segment(begin, n), v2 = y2.segment(begin, n); 
+
+	Eigen::Map<Eigen::ArrayXd> e(errors, n); 
+	e = ( u2 * (E(0, 0) * u1 + E(0, 1) * v1 + E(0, 2)) + 
+		  v2 * (E(1, 0) * u1 + E(1, 1) * v1 + E(1, 2)) + 
+		  (E(2, 0) * u1 + E(2, 1) * v1 + E(2, 2)) ).square() / 
+		( (E(0, 0) * u1 + E(0, 1) * v1 + E(0, 2)).square() + 
+		  (E(1, 0) * u1 + E(1, 1) * v1 + E(1, 2)).square() + 
+		  (E(0, 0) * u2 + E(1, 0) * v2 + E(2, 0)).square() + 
+		  (E(0, 1) * u2 + E(1, 1) * v2 + E(2, 1)).square() ); 
+}
+
+// Linear eight-point fit to the inliers, projected onto the 
+// essential manifold. 
+bool EssentialKernel::refit( const std::vector<int>& indices, Model& E ) const
+{
+	if (indices.size() < 8) return false; 
+
+	Eigen::Matrix<double, 9, 9> AtA = Eigen::Matrix<double, 9, 9>::Zero(); 
+	for (size_t i = 0; i < indices.size(); i++)
 	{
-		error->data.fl[i] = SimpsonError(0, i); 
+		int k = indices[i]; 
+		Eigen::Matrix<double, 9, 1> a; 
+		a << x2(k) * x1(k), x2(k) * y1(k), x2(k), 
+			 y2(k) * x1(k), y2(k) * y1(k), y2(k), 
+			 x1(k), y1(k), 1.0; 
+		AtA.selfadjointView<Eigen::Upper>().rankUpdate(a); 
 	}
 
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double, 9, 9> > es(AtA.selfadjointView<Eigen::Upper>()); 
+	Eigen::Matrix<double, 9, 1> e = es.eigenvectors().col(0); 
+
+	Eigen::Matrix3d F; 
+	F << e(0), e(1), e(2), 
+		 e(3), e(4), e(5), 
+		 e(6), e(7), e(8); 
+
+	Eigen::JacobiSVD<Eigen::Matrix3d> svd(F, Eigen::ComputeFullU|Eigen::ComputeFullV); 
+	Eigen::Vector3d s(1.0, 1.0, 0.0); 
+	E = svd.matrixU() * s.asDiagonal() * svd.matrixV().transpose(); 
+	E /= E.norm(); 
+
+	return true; 
 }
 
-void CvEMEstimator::calibrated_fivepoint_helper( double *EE, double* A )
+static void calibrated_fivepoint_helper( double *EE, double* A )
 {
   double e00,e01,e02,e03,e04,e05,e06,e07,e08;
   double e10,e11,e12,e13,e14,e15,e16,e17,e18;
@@ -1,5 +1,6 @@
 #ifndef FIVE_POINT_HPP
 #define FIVE_POINT_HPP
+#include <Eigen/Dense>
 #include <opencv2/core/core.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 
@@ -7,7 +8,15 @@ using namespace cv;
 
 Mat findEssentialMat( InputArray points1, InputArray points2, double focal = 1.0, Point2d pp = Point2d(0, 0), 
 					int method = CV_FM_RANSAC, 
-					double prob = 0.999, double threshold = 1, int maxIters = 1000, OutputArray mask = noArray() ); 
+					double prob = 0.999, double threshold = 1, int maxIters = 1000, OutputArray mask = noArray(), 
+					bool sortedByQuality = false ); 
+
+// Minimal five-point solver. q1 and q2 are five correspondences in 
+// normalized image coordinates. Writes up to 10 essential matrices with 
+// q2' * E * q1 = 0 to E, and returns their number. 
+int solveEssentialMat5Point( const Eigen::Matrix<double, 5, 2> & q1, 
+							 const Eigen::Matrix<double, 5, 2> & q2, 
+							 Eigen::Matrix3d * E ); 
 
 void decomposeEssentialMat( const Mat & E, Mat & R1, Mat & R2, Mat & t ); 
 
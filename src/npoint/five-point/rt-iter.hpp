@@ -1,87 +1,107 @@
+#ifndef RT_ITER_HPP
+#define RT_ITER_HPP
 #include <iostream>
-#include "precomp.hpp"
-#include "_modelest.h"
 
 #include <eigen3/Eigen/Eigen>
 #include <opencv2/core/eigen.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
+#include "../ransac/Ransac.h"
 
-class CvTranslationIterator : public CvModelEstimator2
+using namespace cv; 
+
+// Translation kernel for camodocal::Ransac. 
+// Estimates the translation direction t for a known rotation R, 
+// such that x2' * [t]x * R * x1 = 0. 
+class TranslationKernel
 {
 public:	
-	CvTranslationIterator(const CvMat* _R); 
-	virtual int runKernel( const CvMat* m1, const CvMat* m2, CvMat* model ); 
+	typedef Eigen::Vector3d Model; 
 
-protected:
-	CvMat* R; 
-    virtual void computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error );
-}; 
+	enum
+	{
+		SampleSize = 2, 
+		MaxModels = 1
+	}; 
 
-CvTranslationIterator::CvTranslationIterator(const CvMat* _R)
-: CvModelEstimator2( 2, cvSize(3, 1), 1 )
-{
-	R = cvCreateMat(3, 3, CV_64FC1); 
-	cvConvert(_R, R); 
-}
+	TranslationKernel( const Mat& points1, const Mat& points2, const Eigen::Matrix3d& _R )
+	 : R(_R)
+	{
+		// points are N x 2 CV_64F
+		int n = points1.rows; 
+		x1.resize(n); y1.resize(n); 
+		x2.resize(n); y2.resize(n); 
+		for (int i = 0; i < n; i++)
+		{
+			x1(i) = points1.at<double>(i, 0); 
+			y1(i) = points1.at<double>(i, 1); 
+			x2(i) = points2.at<double>(i, 0); 
+			y2(i) = points2.at<double>(i, 1); 
+		}
+	}
 
-int CvTranslationIterator::runKernel( const CvMat* m1, const CvMat* m2, CvMat* model )
-{
-	Eigen::MatrixXd M1, M2; 
-	cv::cv2eigen(cv::Mat(m1).reshape(1, m1->cols), M1); 
-	cv::cv2eigen(cv::Mat(m2).reshape(1, m2->cols), M2); 
-
-	Eigen::MatrixXd A(M1.rows(), 3), T; 
-	A.col(0) = M2.col(1) - M1.col(1); 
-	A.col(1) = -(M2.col(0) - M1.col(0)); 
-	A.col(2).array() = M2.col(0).array() * M1.col(1).array() - M1.col(0).array() * M2.col(1).array(); 
-	
-	T = A.jacobiSvd(Eigen::ComputeFullV).matrixV().col(2); 
-	
-	double* t = model->data.db; 
-	memcpy(t, T.data(), sizeof(double) * 3); 
-	return 1; 
+	int size(void) const
+	{
+		return x1.size(); 
+	}
 
-}
+	int fit( const int* sample, Model* models ) const
+	{
+		// Each point gives one linear constraint (R * x1 x x2)' * t = 0. 
+		models[0] = constraint(sample[0]).cross(constraint(sample[1])); 
+		if (models[0].norm() < 1e-12) return 0; 
 
+		models[0].normalize(); 
+		return 1; 
+	}
 
-// Same as the runKernel, m1 and m2 should be
-// 1 row x n col x 2 channels. 
-// And also, error has to be of CV_32FC1. 
-void CvTranslationIterator::computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error )
-{
-	Eigen::MatrixXd X1t, X2t; 
-	cv::cv2eigen(cv::Mat(m1).reshape(1, m1->cols), X1t); 
-	cv::cv2eigen(cv::Mat(m2).reshape(1, m2->cols), X2t); 
-	Eigen::MatrixXd X1(3, X1t.rows()); 
-	Eigen::MatrixXd X2(3, X2t.rows()); 
-	X1.topRows(2) = X1t.transpose(); 
-	X2.topRows(2) = X2t.transpose(); 
-	X1.row(2).setOnes(); 
-	X2.row(2).setOnes(); 
-
-	Eigen::MatrixXd E, t, t_skew(3, 3), _R; 
-	cv::cv2eigen(cv::Mat(model), t); 
-	t_skew << 0, -t(2), t(1), t(2), 0, -t(0), -t(1), t(0), 0; 
-	cv::cv2eigen(cv::Mat(R), _R); 
-	E = t_skew * _R; 
-	
-	// Compute Simpson's error
-	Eigen::MatrixXd Ex1, x2tEx1, Etx2, SimpsonError; 
-	Ex1 = E * X1; 
-	x2tEx1 = (X2.array() * Ex1.array()).matrix().colwise().sum(); 
-	Etx2 = E.transpose() * X2; 
-	SimpsonError = x2tEx1.array().square() / (Ex1.row(0).array().square() + Ex1.row(1).array().square() + Etx2.row(0).array().square() + Etx2.row(1).array().square()); 
-	
-	assert( CV_IS_MAT_CONT(error->type) ); 
-	int i; 
-	for (int i = 0; i < SimpsonError.cols(); i++) 
-		error->data.fl[i] = SimpsonError(0, i); 
+	// Sampson error of the points [begin, end). 
+	void evaluate( const Model& t, int begin, int end, double* errors ) const
+	{
+		Eigen::Matrix3d t_skew; 
+		t_skew << 0, -t(2), t(1), t(2), 0, -t(0), -t(1), t(0), 0; 
+		Eigen::Matrix3d E = t_skew * R; 
+
+		int n = end - begin; 
+		Eigen::ArrayXd::ConstSegmentReturnType 
+			u1 = x1.segment(begin, n), v1 = y1.segment(begin, n), 
+			u2 = x2.segment(begin, n), v2 = y2.segment(begin, n); 
+
+		Eigen::Map<Eigen::ArrayXd> e(errors, n); 
+		e = ( u2 * (E(0, 0) * u1 + E(0, 1) * v1 + E(0, 2)) + 
+			  v2 * (E(1, 0) * u1 + E(1, 1) * v1 + E(1, 2)) + 
+			  (E(2, 0) * u1 + E(2, 1) * v1 + E(2, 2)) ).square() / 
+			( (E(0, 0) * u1 + E(0, 1) * v1 + E(0, 2)).square() + 
+			  (E(1, 0) * u1 + E(1, 1) * v1 + E(1, 2)).square() + 
+			  (E(0, 0) * u2 + E(1, 0) * v2 + E(2, 0)).square() + 
+			  (E(0, 1) * u2 + E(1, 1) * v2 + E(2, 1)).square() ); 
+	}
 
-}
+	// Least squares fit of t to the constraints of all given points. 
+	bool refit( const std::vector<int>& indices, Model& t ) const
+	{
+		Eigen::Matrix3d AtA = Eigen::Matrix3d::Zero(); 
+		for (size_t i = 0; i < indices.size(); i++)
+		{
+			Eigen::Vector3d a = constraint(indices[i]); 
+			AtA += a * a.transpose(); 
+		}
+
+		Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es(AtA); 
+		t = es.eigenvectors().col(0); 
+		return true; 
+	}
+
+protected:
+	Eigen::Vector3d constraint( int k ) const
+	{
+		return (R * Eigen::Vector3d(x1(k), y1(k), 1.0)).cross(Eigen::Vector3d(x2(k), y2(k), 1.0)); 
+	}
 
-Mat iterateTranslation( InputArray _points1, InputArray _points2, const cv::Mat & R, double focal = 1.0, Point2d pp = Point2d(0, 0), 
+	Eigen::Matrix3d R; 
+	Eigen::ArrayXd x1, y1, x2, y2; 
+}; 
+
+inline Mat iterateTranslation( InputArray _points1, InputArray _points2, const cv::Mat & R, double focal = 1.0, Point2d pp = Point2d(0, 0), 
 					int method = CV_FM_RANSAC, 
 					double prob = 0.999, double threshold = 1, OutputArray _mask = noArray() ) 
 {
@@ -107,38 +127,40 @@ Mat iterateTranslation( InputArray _points1, InputArray _points2, const cv::Mat
 	points2.col(0) = (points2.col(0) - pp.x) / focal; 
 	points1.col(1) = (points1.col(1) - pp.y) / focal; 
 	points2.col(1) = (points2.col(1) - pp.y) / focal; 
-	
-	// Reshape data to fit opencv ransac function
-	points1 = points1.reshape(2, 1); 
-	points2 = points2.reshape(2, 1); 
-	
-	cv::Mat t(1, 3, CV_64F); 
-	CvMat _R = R; 
-	CvTranslationIterator iterator(&_R); 
 
-	CvMat p1 = points1; 
-	CvMat p2 = points2; 
-	CvMat _t = t; 
-	CvMat* tempMask = cvCreateMat(1, npoints, CV_8U); 
-	
-	assert(npoints >= 2); 
+	// LMedS is not supported by the RANSAC engine. 
+	(void) method; 
+
+	Eigen::Matrix3d R_eigen; 
+	cv2eigen(R, R_eigen); 
+
+	TranslationKernel kernel(points1, points2, R_eigen); 
+	camodocal::Ransac<TranslationKernel> ransac(kernel); 
+
+	// The Sampson error is a squared distance. 
 	threshold /= focal; 
-	if (method = CV_FM_RANSAC)
-	{
-		iterator.runRANSAC(&p1, &p2, &_t, tempMask, threshold, prob); 
-	}
-	else
-	{
-		iterator.runLMeDS(&p1, &p2, &_t, tempMask, prob); 
-	}
+	ransac.setThreshold(threshold * threshold); 
+	ransac.setConfidence(prob); 
+
+	Eigen::Vector3d t_eigen = Eigen::Vector3d::Zero(); 
+	std::vector<uchar> inliers; 
+	ransac.estimate(t_eigen, inliers); 
 
 	if (_mask.needed()) 
 	{
 		_mask.create(1, npoints, CV_8U, -1, true); 
 		Mat mask = _mask.getMat(); 
-		mask = Mat(tempMask) * 1.0; 
+		if (npoints > 0)
+		{
+			Mat(inliers).reshape(1, 1).copyTo(mask); 
+		}
 	}
 	
+	cv::Mat t(1, 3, CV_64F); 
+	for (int i = 0; i < 3; i++) t.at<double>(0, i) = t_eigen(i); 
+
 	return t; 
 
 }
+
+#endif
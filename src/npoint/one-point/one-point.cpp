@@ -1,45 +1,70 @@
 
 #include <opencv2/opencv.hpp>
+#include <eigen3/Eigen/Eigen>
 
-#include "_modelest.h"
 #include "one-point.hpp"
+#include "../ransac/Ransac.h"
 
 using namespace cv; 
 
 
 
-class CvOnePointEstimator : public CvModelEstimator2
+// 1-point kernel for camodocal::Ransac. 
+// The model is the vehicle turning angle theta of the circular motion 
+// model (Scaramuzza, Real-Time Monocular Visual Odometry for On-Road 
+// Vehicles with 1-Point RANSAC, ICRA 2009). 
+class OnePointKernel
 {
 public:
-    CvOnePointEstimator(); 
-    virtual int runKernel( const CvMat* m1, const CvMat* m2, CvMat* model ); 
+    typedef double Model; 
+
+    enum
+    {
+        SampleSize = 1, 
+        MaxModels = 1
+    }; 
+
+    OnePointKernel( const Mat& points1, const Mat& points2 ); 
+
+    int size(void) const; 
+    int fit( const int* sample, Model* models ) const; 
+    void evaluate( const Model& theta, int begin, int end, double* errors ) const; 
+    bool refit( const std::vector<int>& indices, Model& theta ) const; 
+
 protected: 
-    virtual void computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error );
+    Eigen::ArrayXd x1, y1, x2, y2; 
 }; 
 
 
-CvOnePointEstimator::CvOnePointEstimator()
-: CvModelEstimator2( 1, cvSize(1, 1), 1 ) 
+OnePointKernel::OnePointKernel( const Mat& points1, const Mat& points2 )
 {
+    // points are N x 2 CV_64F
+    int n = points1.rows; 
+    x1.resize(n); y1.resize(n); 
+    x2.resize(n); y2.resize(n); 
+    for (int i = 0; i < n; i++)
+    {
+        x1(i) = points1.at<double>(i, 0); 
+        y1(i) = points1.at<double>(i, 1); 
+        x2(i) = points2.at<double>(i, 0); 
+        y2(i) = points2.at<double>(i, 1); 
+    }
 }
 
+int OnePointKernel::size(void) const
+{
+    return x1.size(); 
+}
 
-// Notice to keep compatibility with opencv ransac, q1 and q2 have
-// to be of 1 row x n col x 2 channel. 
-int CvOnePointEstimator::runKernel( const CvMat* q1, const CvMat* q2, CvMat* _theta )
+int OnePointKernel::fit( const int* sample, Model* models ) const
 {
-    double x1, y1, x2, y2; 
-    x1 = q1->data.db[0]; 
-    y1 = q1->data.db[1]; 
-    x2 = q2->data.db[0]; 
-    y2 = q2->data.db[1]; 
+    int k = sample[0]; 
 
     // Transform the coord to be consistent with Scaramuzza's paper. 
     double x, y, z, x_, y_, z_; 
     x = x_ = 1; 
-    y = -x1; y_ = -x2; 
-    z = -y1; z_ = y2; 
+    y = -x1(k); y_ = -x2(k); 
+    z = -y1(k); z_ = y2(k); 
 
     double theta = -2.0 * atan( (y_ * z - z_ * y) / (x_ * z + z_ * x) ); 
     if (theta > CV_PI / 2) theta -= CV_PI; 
@@ -48,48 +73,37 @@ int CvOnePointEstimator::runKernel( const CvMat* q1, const CvMat* q2, CvMat* _th
     // Back transform angle.
     // This angle (-theta) is the vehicle turning angle in image coord system. 
     // Note the rotation angle for image coord system should be theta. 
-    _theta->data.db[0] = -theta; 
+    models[0] = -theta; 
  
     return 1 ; 
 }
 
-// Same as the runKernel, m1 and m2 should be
-// 1 row x n col x 2 channels. 
-// And also, error has to be of CV_32FC1. 
-void CvOnePointEstimator::computeReprojError( const CvMat* m1, const CvMat* m2,
-                                     const CvMat* model, CvMat* error )
+// Sampson error of the points [begin, end). 
+void OnePointKernel::evaluate( const Model& theta, int begin, int end, double* errors ) const
 {
-    Mat X1(m1), X2(m2); 
-    int n = X1.cols; 
-    X1 = X1.reshape(1, n); 
-    X2 = X2.reshape(1, n); 
-
-    X1.convertTo(X1, CV_64F); 
-    X2.convertTo(X2, CV_64F); 
-
-    double theta = model->data.db[0]; 
-
     // Note this E is for image normal camera system, not the system in 1-pt paper
-    Mat E = (Mat_<double>(3, 3) << 0, -cos(theta * 0.5), 0, 
-                                   cos(theta * 0.5), 0, -sin(theta * 0.5), 
-                                   0, -sin(theta * 0.5), 0); 
-    for (int i = 0; i < n; i++)
-    {
-        Mat x1 = (Mat_<double>(3, 1) << X1.at<double>(i, 0), X1.at<double>(i, 1), 1.0); 
-        Mat x2 = (Mat_<double>(3, 1) << X2.at<double>(i, 0), X2.at<double>(i, 1), 1.0); 
-        double x2tEx1 = x2.dot(E * x1); 
-        Mat Ex1 = E * x1; 
-        Mat Etx2 = E * x2; 
-        double a = Ex1.at<double>(0) * Ex1.at<double>(0); 
-        double b = Ex1.at<double>(1) * Ex1.at<double>(1); 
-        double c = Etx2.at<double>(0) * Etx2.at<double>(0); 
-        double d = Etx2.at<double>(0) * Etx2.at<double>(0); 
-
-        error->data.fl[i] = x2tEx1 * x2tEx1 / (a + b + c + d); 
-
-    }
+    //     [ 0  -c   0 ]
+    // E = [ c   0  -s ]
+    //     [ 0  -s   0 ]
+    double c = cos(theta * 0.5); 
+    double s = sin(theta * 0.5); 
+
+    int n = end - begin; 
+    Eigen::ArrayXd::ConstSegmentReturnType 
+        u1 = x1.segment(begin, n), v1 = y1.segment(begin, n), 
+        u2 = x2.segment(begin, n), v2 = y2.segment(begin, n); 
+
+    // E * x1 = (-c v1, c u1 - s, -s v1), E' * x2 = (c v2, -c u2 - s, -s v2) 
+    Eigen::Map<Eigen::ArrayXd> e(errors, n); 
+    e = ( -c * u2 * v1 + v2 * (c * u1 - s) - s * v1 ).square() / 
+        ( (c * v1).square() + (c * u1 - s).square() + 
+          (c * v2).square() + (c * u2 + s).square() ); 
+}
 
-}    
+bool OnePointKernel::refit( const std::vector<int>& indices, Model& theta ) const
+{
+    return false; 
+}
 
 void findPose_1pt(cv::InputArray _points1, cv::InputArray _points2, 
               double focal, cv::Point2d pp, 
@@ -117,41 +131,34 @@ void findPose_1pt(cv::InputArray _points1, cv::InputArray _points2,
 	points1.col(1) = (points1.col(1) - pp.y) / focal; 
 	points2.col(1) = (points2.col(1) - pp.y) / focal; 
 	
-	// Reshape data to fit opencv ransac function
-	points1 = points1.reshape(2, 1); 
-	points2 = points2.reshape(2, 1); 
+    // LMedS is not supported by the RANSAC engine; all methods 
+    // use RANSAC with SPRT. 
+    (void) method; 
 
-    CvOnePointEstimator estimator; 
-    Mat theta(1, 1, CV_64F); 
+    OnePointKernel kernel(points1, points2); 
+    camodocal::Ransac<OnePointKernel> ransac(kernel); 
 
-	CvMat p1 = points1; 
-	CvMat p2 = points2; 
-	CvMat _theta = theta; 
-	CvMat* tempMask = cvCreateMat(1, npoints, CV_8U); 
-	
-	assert(npoints >= 1); 
+    // The Sampson error is a squared distance. 
 	threshold /= focal; 
-    if (method == CV_RANSAC)
-	{
-		estimator.runRANSAC(&p1, &p2, &_theta, tempMask, threshold, prob); 
-	}
-	else
-	{
-		estimator.runLMeDS(&p1, &p2, &_theta, tempMask, prob); 
-	}
+    ransac.setThreshold(threshold * threshold); 
+    ransac.setConfidence(prob); 
+
+    double theta = 0.0; 
+    std::vector<uchar> inliers; 
+    ransac.estimate(theta, inliers); 
 
     if (_mask.needed())
     {
     	_mask.create(1, npoints, CV_8U, -1, true); 
     	Mat mask = _mask.getMat(); 
-    	Mat(tempMask).copyTo(mask); 
+    	Mat(inliers).reshape(1, 1).copyTo(mask); 
     }
 
 
     _rvec.create(3, 2, CV_64F, -1, true); 
     _tvec.create(3, 2, CV_64F, -1, true); 
 
-    double t = theta.at<double>(0); 
+    double t = theta; 
     Mat rvec = (Mat_<double>(3, 2) << 0, 0, 
                                      -t, -t, 
                                       0, 0); 
@@ -0,0 +1,868 @@
+#include "p3p.hpp"
+
+#include <cmath>
+#include <complex>
+
+#include "../ransac/Ransac.h"
+
+namespace camodocal
+{
+
+// Absolute pose kernel for camodocal::Ransac.
+// Each 2D point is a ray with a unit bearing vector and, for a generalized
+// camera, an origin, both in the frame in which the pose is estimated.
+// The residual of a correspondence is 1 - cos of the angle between the
+// bearing vector and the direction from the ray origin to the transformed
+// scene point.
+class PnPKernel
+{
+public:
+    struct Model
+    {
+        Eigen::Matrix3d R;
+        Eigen::Vector3d t;
+    };
+
+    enum
+    {
+        SampleSize = 3,
+        MaxModels = 8
+    };
+
+    // origins may be 0 for a central camera
+    PnPKernel(const std::vector<Eigen::Vector3d>* origins,
+              const std::vector<Eigen::Vector3d>& bearings,
+              const std::vector<Eigen::Vector3d>& scenePoints);
+
+    int size(void) const;
+    int fit(const int* sample, Model* models) const;
+    void evaluate(const Model& model, int begin, int end, double* errors) const;
+    bool refit(const std::vector<int>& indices, Model& model) const;
+
+private:
+    const std::vector<Eigen::Vector3d>* mOrigins;
+    const std::vector<Eigen::Vector3d>& mBearings;
+    const std::vector<Eigen::Vector3d>& mScenePoints;
+
+    Eigen::ArrayXd mCx, mCy, mCz;
+    Eigen::ArrayXd mFx, mFy, mFz;
+    Eigen::ArrayXd mX, mY, mZ;
+
+    const int k_refitIterations;
+};
+
+PnPKernel::PnPKernel(const std::vector<Eigen::Vector3d>* origins,
+                     const std::vector<Eigen::Vector3d>& bearings,
+                     const std::vector<Eigen::Vector3d>& scenePoints)
+ : mOrigins(origins)
+ , mBearings(bearings)
+ , mScenePoints(scenePoints)
+ , k_refitIterations(10)
+{
+    int n = bearings.size();
+
+    mFx.resize(n); mFy.resize(n); mFz.resize(n);
+    mX.resize(n); mY.resize(n); mZ.resize(n);
+    for (int i = 0; i < n; ++i)
+    {
+        mFx(i) = bearings.at(i)(0);
+        mFy(i) = bearings.at(i)(1);
+        mFz(i) = bearings.at(i)(2);
+
+        mX(i) = scenePoints.at(i)(0);
+        mY(i) = scenePoints.at(i)(1);
+        mZ(i) = scenePoints.at(i)(2);
+    }
+
+    if (mOrigins)
+    {
+        mCx.resize(n); mCy.resize(n); mCz.resize(n);
+        for (int i = 0; i < n; ++i)
+        {
+            mCx(i) = origins->at(i)(0);
+            mCy(i) = origins->at(i)(1);
+            mCz(i) = origins->at(i)(2);
+        }
+    }
+}
+
+int
+PnPKernel::size(void) const
+{
+    return mBearings.size();
+}
+
+int
+PnPKernel::fit(const int* sample, Model* models) const
+{
+    Eigen::Vector3d c[3], f[3], P[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        f[i] = mBearings[sample[i]];
+        P[i] = mScenePoints[sample[i]];
+    }
+
+    Eigen::Matrix3d R[8];
+    Eigen::Vector3d t[8];
+    int nModels = 0;
+
+    if (mOrigins)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            c[i] = (*mOrigins)[sample[i]];
+        }
+
+        nModels = solveGP3P(c, f, P, R, t);
+    }
+    else
+    {
+        nModels = solveP3P(f, P, R, t);
+    }
+
+    for (int i = 0; i < nModels; ++i)
+    {
+        models[i].R = R[i];
+        models[i].t = t[i];
+    }
+
+    return nModels;
+}
+
+void
+PnPKernel::evaluate(const Model& model, int begin, int end, double* errors) const
+{
+    const Eigen::Matrix3d& R = model.R;
+    const Eigen::Vector3d& t = model.t;
+
+    int n = end - begin;
+    Eigen::ArrayXd::ConstSegmentReturnType
+        X = mX.segment(begin, n), Y = mY.segment(begin, n), Z = mZ.segment(begin, n);
+
+    Eigen::ArrayXd xc = R(0,0) * X + R(0,1) * Y + R(0,2) * Z + t(0);
+    Eigen::ArrayXd yc = R(1,0) * X + R(1,1) * Y + R(1,2) * Z + t(1);
+    Eigen::ArrayXd zc = R(2,0) * X + R(2,1) * Y + R(2,2) * Z + t(2);
+
+    if (mOrigins)
+    {
+        xc -= mCx.segment(begin, n);
+        yc -= mCy.segment(begin, n);
+        zc -= mCz.segment(begin, n);
+    }
+
+    // points behind the camera get residuals above 1
+    Eigen::Map<Eigen::ArrayXd> e(errors, n);
+    e = 1.0 - (mFx.segment(begin, n) * xc +
+               mFy.segment(begin, n) * yc +
+               mFz.segment(begin, n) * zc) /
+              (xc.square() + yc.square() + zc.square()).sqrt().max(1e-12);
+}
+
+// Gauss-Newton on the tangent-plane components of the normalized ray-frame
+// points, with the pose updated as
+// R <- exp(dtheta) * R, t <- exp(dtheta) * t + dt.
+bool
+PnPKernel::refit(const std::vector<int>& indices, Model& model) const
+{
+    if (static_cast<int>(indices.size()) < SampleSize)
+    {
+        return false;
+    }
+
+    Model m = model;
+    for (int iter = 0; iter < k_refitIterations; ++iter)
+    {
+        Eigen::Matrix<double,6,6> H = Eigen::Matrix<double,6,6>::Zero();
+        Eigen::Matrix<double,6,1> g = Eigen::Matrix<double,6,1>::Zero();
+
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            const Eigen::Vector3d& f = mBearings[indices[i]];
+
+            Eigen::Vector3d y = m.R * mScenePoints[indices[i]] + m.t;
+            Eigen::Vector3d x = y;
+            if (mOrigins)
+            {
+                x -= (*mOrigins)[indices[i]];
+            }
+
+            double norm = x.norm();
+            if (norm < 1e-12)
+            {
+                continue;
+            }
+            Eigen::Vector3d u = x / norm;
+
+            // orthonormal basis of the plane orthogonal to f
+            Eigen::Vector3d b1 = f.unitOrthogonal();
+            Eigen::Matrix<double,2,3> B;
+            B.row(0) = b1.transpose();
+            B.row(1) = f.cross(b1).transpose();
+
+            Eigen::Matrix3d skew;
+            skew <<     0.0, -y(2),  y(1),
+                       y(2),   0.0, -y(0),
+                      -y(1),  y(0),   0.0;
+
+            Eigen::Matrix<double,3,6> dx;
+            dx.leftCols<3>() = -skew;
+            dx.rightCols<3>() = Eigen::Matrix3d::Identity();
+
+            Eigen::Matrix<double,2,6> J =
+                B * (Eigen::Matrix3d::Identity() - u * u.transpose()) / norm * dx;
+            Eigen::Vector2d r = B * u;
+
+            H += J.transpose() * J;
+            g += J.transpose() * r;
+        }
+
+        Eigen::Matrix<double,6,1> delta = H.ldlt().solve(-g);
+        if (!delta.allFinite())
+        {
+            return false;
+        }
+
+        Eigen::Vector3d w = delta.head<3>();
+        Eigen::Matrix3d dR = Eigen::Matrix3d::Identity();
+        if (w.norm() > 0.0)
+        {
+            dR = Eigen::AngleAxisd(w.norm(), w.normalized()).toRotationMatrix();
+        }
+        m.R = dR * m.R;
+        m.t = dR * m.t + delta.tail<3>();
+
+        if (delta.norm() < 1e-10)
+        {
+            break;
+        }
+    }
+
+    model = m;
+
+    return true;
+}
+
+namespace
+{
+
+// real roots of a4 x^4 + a3 x^3 + a2 x^2 + a1 x + a0 in [-1, 1]
+int
+solveQuartic(const double* a, double* roots)
+{
+    if (fabs(a[4]) < 1e-14)
+    {
+        return 0;
+    }
+
+    Eigen::Matrix4d C = Eigen::Matrix4d::Zero();
+    C.block<3,3>(1,0) = Eigen::Matrix3d::Identity();
+    for (int i = 0; i < 4; ++i)
+    {
+        C(i,3) = -a[i] / a[4];
+    }
+
+    Eigen::EigenSolver<Eigen::Matrix4d> es(C, false);
+    if (es.info() != Eigen::Success)
+    {
+        return 0;
+    }
+
+    int nRoots = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        double x = es.eigenvalues()(i).real();
+
+        // polish the root, as the companion matrix loses accuracy
+        // for nearly repeated roots
+        for (int j = 0; j < 2; ++j)
+        {
+            double p = (((a[4] * x + a[3]) * x + a[2]) * x + a[1]) * x + a[0];
+            double dp = ((4.0 * a[4] * x + 3.0 * a[3]) * x + 2.0 * a[2]) * x + a[1];
+            if (dp == 0.0)
+            {
+                break;
+            }
+            x -= p / dp;
+        }
+
+        if (fabs(es.eigenvalues()(i).imag()) > 1e-6 * std::max(1.0, fabs(x)) ||
+            fabs(x) > 1.0 + 1e-6)
+        {
+            continue;
+        }
+
+        roots[nRoots++] = std::max(-1.0, std::min(1.0, x));
+    }
+
+    return nRoots;
+}
+
+}
+
+int
+solveP3P(const Eigen::Vector3d f_[3], const Eigen::Vector3d P_[3],
+         Eigen::Matrix3d R[4], Eigen::Vector3d t[4])
+{
+    Eigen::Vector3d f1 = f_[0], f2 = f_[1], f3 = f_[2];
+    Eigen::Vector3d P1 = P_[0], P2 = P_[1], P3 = P_[2];
+
+    // reject collinear scene points
+    if ((P2 - P1).cross(P3 - P1).norm() < 1e-10)
+    {
+        return 0;
+    }
+
+    // intermediate camera frame with f1 as the x-axis and f2 in the xy-plane
+    Eigen::Vector3d e1 = f1;
+    Eigen::Vector3d e3 = f1.cross(f2);
+    if (e3.norm() < 1e-10)
+    {
+        return 0;
+    }
+    e3.normalize();
+    Eigen::Vector3d e2 = e3.cross(e1);
+
+    Eigen::Matrix3d T;
+    T.row(0) = e1.transpose();
+    T.row(1) = e2.transpose();
+    T.row(2) = e3.transpose();
+
+    Eigen::Vector3d f3_tau = T * f3;
+
+    // f3 has to lie in the negative half-space of the intermediate frame
+    if (f3_tau(2) > 0.0)
+    {
+        std::swap(f1, f2);
+        std::swap(P1, P2);
+
+        e1 = f1;
+        e3 = f1.cross(f2).normalized();
+        e2 = e3.cross(e1);
+
+        T.row(0) = e1.transpose();
+        T.row(1) = e2.transpose();
+        T.row(2) = e3.transpose();
+
+        f3_tau = T * f3;
+    }
+
+    if (fabs(f3_tau(2)) < 1e-10)
+    {
+        return 0;
+    }
+
+    // intermediate world frame with P1 as the origin, P2 on the x-axis
+    // and P3 in the xy-plane
+    Eigen::Vector3d n1 = P2 - P1;
+    double d_12 = n1.norm();
+    n1 /= d_12;
+    Eigen::Vector3d n3 = n1.cross(P3 - P1).normalized();
+    Eigen::Vector3d n2 = n3.cross(n1);
+
+    Eigen::Matrix3d N;
+    N.row(0) = n1.transpose();
+    N.row(1) = n2.transpose();
+    N.row(2) = n3.transpose();
+
+    Eigen::Vector3d P3_eta = N * (P3 - P1);
+
+    double f_1 = f3_tau(0) / f3_tau(2);
+    double f_2 = f3_tau(1) / f3_tau(2);
+    double p_1 = P3_eta(0);
+    double p_2 = P3_eta(1);
+
+    double cos_beta = f1.dot(f2);
+    double b = 1.0 / (1.0 - cos_beta * cos_beta) - 1.0;
+    b = (cos_beta < 0.0) ? -sqrt(b) : sqrt(b);
+
+    double f_1_pw2 = f_1 * f_1;
+    double f_2_pw2 = f_2 * f_2;
+    double p_1_pw2 = p_1 * p_1;
+    double p_1_pw3 = p_1_pw2 * p_1;
+    double p_1_pw4 = p_1_pw3 * p_1;
+    double p_2_pw2 = p_2 * p_2;
+    double p_2_pw3 = p_2_pw2 * p_2;
+    double p_2_pw4 = p_2_pw3 * p_2;
+    double d_12_pw2 = d_12 * d_12;
+    double b_pw2 = b * b;
+
+    // quartic in cos(theta), where theta is the angle between the
+    // intermediate world and camera planes; a[i] is the coefficient of x^i
+    double a[5];
+    a[4] = -f_2_pw2 * p_2_pw4 - p_2_pw4 * f_1_pw2 - p_2_pw4;
+    a[3] = 2.0 * p_2_pw3 * d_12 * b + 2.0 * f_2_pw2 * p_2_pw3 * d_12 * b
+           - 2.0 * f_2 * p_2_pw3 * f_1 * d_12;
+    a[2] = -f_2_pw2 * p_2_pw2 * p_1_pw2 - f_2_pw2 * p_2_pw2 * d_12_pw2 * b_pw2
+           - f_2_pw2 * p_2_pw2 * d_12_pw2 + f_2_pw2 * p_2_pw4 + p_2_pw4 * f_1_pw2
+           + 2.0 * p_1 * p_2_pw2 * d_12 + 2.0 * f_1 * f_2 * p_1 * p_2_pw2 * d_12 * b
+           - p_2_pw2 * p_1_pw2 * f_1_pw2 + 2.0 * p_1 * p_2_pw2 * f_2_pw2 * d_12
+           - p_2_pw2 * d_12_pw2 * b_pw2 - 2.0 * p_1_pw2 * p_2_pw2;
+    a[1] = 2.0 * p_1_pw2 * p_2 * d_12 * b + 2.0 * f_2 * p_2_pw3 * f_1 * d_12
+           - 2.0 * f_2_pw2 * p_2_pw3 * d_12 * b - 2.0 * p_1 * p_2 * d_12_pw2 * b;
+    a[0] = -2.0 * f_2 * p_2_pw2 * f_1 * p_1 * d_12 * b + f_2_pw2 * p_2_pw2 * d_12_pw2
+           + 2.0 * p_1_pw3 * d_12 - p_1_pw2 * d_12_pw2 + f_2_pw2 * p_2_pw2 * p_1_pw2
+           - p_1_pw4 - 2.0 * f_2_pw2 * p_2_pw2 * p_1 * d_12
+           + p_2_pw2 * f_1_pw2 * p_1_pw2 + f_2_pw2 * p_2_pw2 * d_12_pw2 * b_pw2;
+
+    double roots[4];
+    int nRoots = solveQuartic(a, roots);
+
+    int nSolutions = 0;
+    for (int i = 0; i < nRoots; ++i)
+    {
+        double cos_theta = roots[i];
+        double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+
+        double denom = -f_1 * cos_theta * p_2 / f_2 + p_1 - d_12;
+        if (fabs(denom) < 1e-14)
+        {
+            continue;
+        }
+        double cot_alpha = (-f_1 * p_1 / f_2 - cos_theta * p_2 + d_12 * b) / denom;
+
+        double sin_alpha = sqrt(1.0 / (cot_alpha * cot_alpha + 1.0));
+        double cos_alpha = sqrt(1.0 - sin_alpha * sin_alpha);
+        if (cot_alpha < 0.0)
+        {
+            cos_alpha = -cos_alpha;
+        }
+
+        double k = d_12 * sin_alpha * (sin_alpha * b + cos_alpha);
+
+        // camera centre in the intermediate world frame
+        Eigen::Vector3d C(d_12 * cos_alpha * (sin_alpha * b + cos_alpha),
+                          cos_theta * k,
+                          sin_theta * k);
+        C = P1 + N.transpose() * C;
+
+        Eigen::Matrix3d Q;
+        Q << -cos_alpha, -sin_alpha * cos_theta, -sin_alpha * sin_theta,
+              sin_alpha, -cos_alpha * cos_theta, -cos_alpha * sin_theta,
+                    0.0,             -sin_theta,              cos_theta;
+
+        // camera-to-world rotation
+        Eigen::Matrix3d R_wc = N.transpose() * Q.transpose() * T;
+
+        R[nSolutions] = R_wc.transpose();
+        t[nSolutions] = -R[nSolutions] * C;
+
+        // the quartic also has roots for which the scene points lie
+        // on the lines, but not on the rays, through the bearing vectors
+        bool consistent = true;
+        for (int j = 0; j < 3; ++j)
+        {
+            Eigen::Vector3d x = R[nSolutions] * P_[j] + t[nSolutions];
+            if (f_[j].dot(x) < (1.0 - 1e-6) * x.norm())
+            {
+                consistent = false;
+                break;
+            }
+        }
+
+        if (consistent)
+        {
+            ++nSolutions;
+        }
+    }
+
+    return nSolutions;
+}
+
+namespace
+{
+
+// bivariate polynomial sum_ij p(i,j) y^i z^j of total degree at most 4
+typedef Eigen::Matrix<double,5,5> Poly2;
+
+Poly2
+multiply(const Poly2& p, const Poly2& q)
+{
+    Poly2 r = Poly2::Zero();
+    for (int i1 = 0; i1 < 5; ++i1)
+    {
+        for (int j1 = 0; i1 + j1 < 5; ++j1)
+        {
+            if (p(i1,j1) == 0.0)
+            {
+                continue;
+            }
+
+            for (int i2 = 0; i1 + i2 < 5; ++i2)
+            {
+                for (int j2 = 0; i1 + i2 + j1 + j2 < 5; ++j2)
+                {
+                    r(i1 + i2, j1 + j2) += p(i1,j1) * q(i2,j2);
+                }
+            }
+        }
+    }
+
+    return r;
+}
+
+// real roots of the polynomial sum_i a[i] x^i
+int
+solvePolynomial(const double* a, int degree, double* roots)
+{
+    double maxCoeff = 0.0;
+    for (int i = 0; i <= degree; ++i)
+    {
+        maxCoeff = std::max(maxCoeff, fabs(a[i]));
+    }
+
+    while (degree > 0 && fabs(a[degree]) <= 1e-12 * maxCoeff)
+    {
+        --degree;
+    }
+
+    if (degree == 0)
+    {
+        return 0;
+    }
+
+    Eigen::MatrixXd C = Eigen::MatrixXd::Zero(degree, degree);
+    C.bottomLeftCorner(degree - 1, degree - 1).setIdentity();
+    for (int i = 0; i < degree; ++i)
+    {
+        C(i,degree - 1) = -a[i] / a[degree];
+    }
+
+    Eigen::EigenSolver<Eigen::MatrixXd> es(C, false);
+    if (es.info() != Eigen::Success)
+    {
+        return 0;
+    }
+
+    int nRoots = 0;
+    for (int i = 0; i < degree; ++i)
+    {
+        std::complex<double> lambda = es.eigenvalues()(i);
+        if (fabs(lambda.imag()) > 1e-6 * std::max(1.0, std::abs(lambda)))
+        {
+            continue;
+        }
+
+        double x = lambda.real();
+        for (int j = 0; j < 2; ++j)
+        {
+            double p = 0.0, dp = 0.0;
+            for (int k = degree; k >= 0; --k)
+            {
+                dp = dp * x + p;
+                p = p * x + a[k];
+            }
+            if (dp == 0.0)
+            {
+                break;
+            }
+            x -= p / dp;
+        }
+
+        roots[nRoots++] = x;
+    }
+
+    return nRoots;
+}
+
+}
+
+// The depths x, y, z of the three scene points along their rays satisfy
+// one quadratic distance constraint per pair of points. The constraints
+// for the pairs (1,2) and (1,3) are quadratics in x, whose difference is
+// linear in x. Substituting x into the first constraint and reducing the
+// result modulo the constraint for the pair (2,3) gives z as a rational
+// function of y and an octic in y (Nister and Stewenius, A Minimal
+// Solution to the Generalised 3-Point Pose Problem, JMIV 2007).
+int
+solveGP3P(const Eigen::Vector3d c_[3], const Eigen::Vector3d f[3],
+          const Eigen::Vector3d P_[3],
+          Eigen::Matrix3d R[8], Eigen::Vector3d t[8])
+{
+    // normalize the scale for numerical stability
+    double scale = std::max((P_[0] - P_[1]).norm(),
+                            std::max((P_[0] - P_[2]).norm(), (P_[1] - P_[2]).norm()));
+    if (scale < 1e-10)
+    {
+        return 0;
+    }
+
+    Eigen::Vector3d c[3], P[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        c[i] = c_[i] / scale;
+        P[i] = P_[i] / scale;
+    }
+
+    // reject collinear scene points
+    if ((P[1] - P[0]).cross(P[2] - P[0]).norm() < 1e-10)
+    {
+        return 0;
+    }
+
+    Eigen::Vector3d c12 = c[0] - c[1];
+    Eigen::Vector3d c13 = c[0] - c[2];
+    Eigen::Vector3d c23 = c[1] - c[2];
+
+    double e12 = c12.squaredNorm() - (P[0] - P[1]).squaredNorm();
+    double e13 = c13.squaredNorm() - (P[0] - P[2]).squaredNorm();
+    double e23 = c23.squaredNorm() - (P[1] - P[2]).squaredNorm();
+
+    // pair (1,2): x^2 + a x + b = 0
+    Poly2 a = Poly2::Zero(), b = Poly2::Zero();
+    a(0,0) = 2.0 * f[0].dot(c12);
+    a(1,0) = -2.0 * f[0].dot(f[1]);
+    b(0,0) = e12;
+    b(1,0) = -2.0 * f[1].dot(c12);
+    b(2,0) = 1.0;
+
+    // pair (1,3): x^2 + a' x + b' = 0
+    Poly2 a_ = Poly2::Zero(), b_ = Poly2::Zero();
+    a_(0,0) = 2.0 * f[0].dot(c13);
+    a_(0,1) = -2.0 * f[0].dot(f[2]);
+    b_(0,0) = e13;
+    b_(0,1) = -2.0 * f[2].dot(c13);
+    b_(0,2) = 1.0;
+
+    // x = (b' - b) / (a - a')
+    Poly2 num = b_ - b;
+    Poly2 den = a - a_;
+
+    // (a - a')^2 times the constraint of pair (1,2)
+    Poly2 G = multiply(num, num) + multiply(multiply(a, num), den) +
+              multiply(b, multiply(den, den));
+
+    // pair (2,3): z^2 + A1(y) z + A0(y) = 0
+    double A1[2] = {-2.0 * f[2].dot(c23), -2.0 * f[1].dot(f[2])};
+    double A0[3] = {e23, 2.0 * f[1].dot(c23), 1.0};
+
+    // reduce G modulo the constraint of pair (2,3) to r1(y) z + r0(y)
+    for (int j = 4; j >= 2; --j)
+    {
+        for (int i = 0; i + j < 5; ++i)
+        {
+            double g = G(i,j);
+            if (g == 0.0)
+            {
+                continue;
+            }
+            G(i,j) = 0.0;
+
+            // g y^i z^j = -g y^i z^(j-2) (A1 z + A0)
+            for (int k = 0; k < 2; ++k)
+            {
+                G(i + k,j - 1) -= g * A1[k];
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                G(i + k,j - 2) -= g * A0[k];
+            }
+        }
+    }
+
+    double r0[5], r1[5];
+    for (int i = 0; i < 5; ++i)
+    {
+        r0[i] = G(i,0);
+        r1[i] = G(i,1);
+    }
+
+    // z = -r0 / r1 substituted into the constraint of pair (2,3):
+    // r0^2 - A1 r0 r1 + A0 r1^2 = 0
+    double h[9] = {0.0};
+    for (int i = 0; i < 5; ++i)
+    {
+        for (int j = 0; j < 5; ++j)
+        {
+            h[i + j] += r0[i] * r0[j];
+
+            for (int k = 0; k < 2; ++k)
+            {
+                if (i + j + k < 9)
+                {
+                    h[i + j + k] -= A1[k] * r0[i] * r1[j];
+                }
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                if (i + j + k < 9)
+                {
+                    h[i + j + k] += A0[k] * r1[i] * r1[j];
+                }
+            }
+        }
+    }
+
+    double roots[8];
+    int nRoots = solvePolynomial(h, 8, roots);
+
+    int nSolutions = 0;
+    for (int k = 0; k < nRoots; ++k)
+    {
+        double y = roots[k];
+
+        double r0y = 0.0, r1y = 0.0;
+        for (int i = 4; i >= 0; --i)
+        {
+            r0y = r0y * y + r0[i];
+            r1y = r1y * y + r1[i];
+        }
+        if (fabs(r1y) < 1e-14)
+        {
+            continue;
+        }
+        double z = -r0y / r1y;
+
+        double denom = den(0,0) + den(1,0) * y + den(0,1) * z;
+        if (fabs(denom) < 1e-14)
+        {
+            continue;
+        }
+        double x = (num(0,0) + num(1,0) * y + num(2,0) * y * y +
+                    num(0,1) * z + num(0,2) * z * z) / denom;
+
+        if (x <= 0.0 || y <= 0.0 || z <= 0.0)
+        {
+            continue;
+        }
+
+        // scene points in the frame of the rays
+        Eigen::Vector3d X[3];
+        X[0] = c[0] + x * f[0];
+        X[1] = c[1] + y * f[1];
+        X[2] = c[2] + z * f[2];
+
+        // discard spurious roots introduced by the elimination
+        if (fabs((X[0] - X[1]).norm() - (P[0] - P[1]).norm()) > 1e-4 ||
+            fabs((X[0] - X[2]).norm() - (P[0] - P[2]).norm()) > 1e-4 ||
+            fabs((X[1] - X[2]).norm() - (P[1] - P[2]).norm()) > 1e-4)
+        {
+            continue;
+        }
+
+        // absolute orientation between the scene points and X
+        Eigen::Vector3d P_mean = (P[0] + P[1] + P[2]) / 3.0;
+        Eigen::Vector3d X_mean = (X[0] + X[1] + X[2]) / 3.0;
+
+        Eigen::Matrix3d M = Eigen::Matrix3d::Zero();
+        for (int i = 0; i < 3; ++i)
+        {
+            M += (X[i] - X_mean) * (P[i] - P_mean).transpose();
+        }
+
+        Eigen::JacobiSVD<Eigen::Matrix3d> svd(M, Eigen::ComputeFullU | Eigen::ComputeFullV);
+        Eigen::Matrix3d D = Eigen::Matrix3d::Identity();
+        D(2,2) = (svd.matrixU() * svd.matrixV().transpose()).determinant();
+
+        R[nSolutions] = svd.matrixU() * D * svd.matrixV().transpose();
+        t[nSolutions] = (X_mean - R[nSolutions] * P_mean) * scale;
+
+        ++nSolutions;
+    }
+
+    return nSolutions;
+}
+
+namespace
+{
+
+bool
+estimatePose(const std::vector<Eigen::Vector3d>* origins,
+             const std::vector<Eigen::Vector3d>& bearings,
+             const std::vector<Eigen::Vector3d>& scenePoints,
+             Eigen::Matrix3d& R, Eigen::Vector3d& t,
+             std::vector<int>& inliers,
+             double angularThresh,
+             double confidence,
+             int maxIterations)
+{
+    inliers.clear();
+
+    if (bearings.size() != scenePoints.size() ||
+        (origins && origins->size() != bearings.size()) ||
+        static_cast<int>(bearings.size()) < PnPKernel::SampleSize)
+    {
+        return false;
+    }
+
+    PnPKernel kernel(origins, bearings, scenePoints);
+    Ransac<PnPKernel> ransac(kernel);
+
+    double threshold = 1.0 - cos(angularThresh);
+    ransac.setThreshold(threshold);
+    ransac.setConfidence(confidence);
+    ransac.setMaxIterations(maxIterations);
+
+    PnPKernel::Model model;
+    std::vector<unsigned char> mask;
+    if (!ransac.estimate(model, mask))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < mask.size(); ++i)
+    {
+        if (mask.at(i))
+        {
+            inliers.push_back(i);
+        }
+    }
+
+    // final refinement on all inliers, kept only if it does not lose inliers
+    PnPKernel::Model refined = model;
+    if (kernel.refit(inliers, refined))
+    {
+        std::vector<double> errors(kernel.size());
+        kernel.evaluate(refined, 0, kernel.size(), &errors[0]);
+
+        std::vector<int> refinedInliers;
+        for (size_t i = 0; i < errors.size(); ++i)
+        {
+            if (errors.at(i) <= threshold)
+            {
+                refinedInliers.push_back(i);
+            }
+        }
+
+        if (refinedInliers.size() >= inliers.size())
+        {
+            model = refined;
+            inliers.swap(refinedInliers);
+        }
+    }
+
+    R = model.R;
+    t = model.t;
+
+    return true;
+}
+
+}
+
+bool
+solvePnPRansac(const std::vector<Eigen::Vector3d>& bearings,
+               const std::vector<Eigen::Vector3d>& scenePoints,
+               Eigen::Matrix3d& R, Eigen::Vector3d& t,
+               std::vector<int>& inliers,
+               double angularThresh,
+               double confidence,
+               int maxIterations)
+{
+    return estimatePose(0, bearings, scenePoints, R, t, inliers,
+                        angularThresh, confidence, maxIterations);
+}
+
+bool
+solveGPnPRansac(const std::vector<Eigen::Vector3d>& origins,
+                const std::vector<Eigen::Vector3d>& bearings,
+                const std::vector<Eigen::Vector3d>& scenePoints,
+                Eigen::Matrix3d& R, Eigen::Vector3d& t,
+                std::vector<int>& inliers,
+                double angularThresh,
+                double confidence,
+                int maxIterations)
+{
+    return estimatePose(&origins, bearings, scenePoints, R, t, inliers,
+                        angularThresh, confidence, maxIterations);
+}
+
+}
@@ -0,0 +1,57 @@
+#ifndef P3P_HPP
+#define P3P_HPP
+
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace camodocal
+{
+
+// Minimal P3P solver (Kneip et al., A Novel Parametrization of the
+// Perspective-Three-Point Problem for a Direct Computation of Absolute
+// Camera Position and Orientation, CVPR 2011).
+// f are unit bearing vectors and P the corresponding scene points.
+// Writes up to 4 poses with f_i ~ R * P_i + t, and returns their number.
+int solveP3P(const Eigen::Vector3d f[3], const Eigen::Vector3d P[3],
+             Eigen::Matrix3d R[4], Eigen::Vector3d t[4]);
+
+// Minimal generalized P3P solver for rays that do not share a centre,
+// e.g. bearing vectors from several cameras of a rig.
+// c are the ray origins and f the unit bearing vectors in the rig frame,
+// and P the corresponding scene points.
+// Writes up to 8 poses with P_i mapped by R * P_i + t onto the ray
+// c_i + lambda_i * f_i with lambda_i > 0, and returns their number.
+int solveGP3P(const Eigen::Vector3d c[3], const Eigen::Vector3d f[3],
+              const Eigen::Vector3d P[3],
+              Eigen::Matrix3d R[8], Eigen::Vector3d t[8]);
+
+// Robust absolute pose from 2D-3D correspondences, with the 2D points
+// given as unit bearing vectors so that any camera model can be used.
+// Runs P3P in LO-RANSAC with SPRT verification and adaptive termination,
+// and refines the pose on all inliers by minimizing the angular error.
+// The threshold is the maximum angle in radians between a bearing vector
+// and the direction to its scene point. Returns false if no pose was found.
+bool solvePnPRansac(const std::vector<Eigen::Vector3d>& bearings,
+                    const std::vector<Eigen::Vector3d>& scenePoints,
+                    Eigen::Matrix3d& R, Eigen::Vector3d& t,
+                    std::vector<int>& inliers,
+                    double angularThresh,
+                    double confidence = 0.99,
+                    int maxIterations = 200);
+
+// Generalized camera counterpart of solvePnPRansac, where each 2D point
+// is a ray with origin and unit bearing vector in the rig frame.
+// Uses gP3P as the minimal solver, and returns the pose of the rig.
+bool solveGPnPRansac(const std::vector<Eigen::Vector3d>& origins,
+                     const std::vector<Eigen::Vector3d>& bearings,
+                     const std::vector<Eigen::Vector3d>& scenePoints,
+                     Eigen::Matrix3d& R, Eigen::Vector3d& t,
+                     std::vector<int>& inliers,
+                     double angularThresh,
+                     double confidence = 0.99,
+                     int maxIterations = 200);
+
+}
+
+#endif
@@ -0,0 +1,628 @@
+#ifndef RANSAC_H
+#define RANSAC_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+namespace camodocal
+{
+
+// Generic robust estimator shared by the npoint solvers.
+//
+// A kernel provides the minimal solver and the residuals of one model type:
+//
+// class Kernel
+// {
+// public:
+//     typedef ... Model;
+//
+//     enum
+//     {
+//         SampleSize = ...,   // size of a minimal sample
+//         MaxModels = ...     // maximum number of models per minimal sample
+//     };
+//
+//     // number of data points
+//     int size(void) const;
+//
+//     // Computes the models consistent with the minimal sample given by
+//     // SampleSize point indices, and returns the number of models.
+//     int fit(const int* sample, Model* models) const;
+//
+//     // Writes the residuals of points [begin, end) to errors[0..end-begin).
+//     // Residuals are compared against the threshold as they are, i.e. a
+//     // kernel with squared residuals expects a squared threshold.
+//     void evaluate(const Model& model, int begin, int end, double* errors) const;
+//
+//     // Non-minimal fit to the given points, used for local optimization.
+//     // Returns false if the kernel has no non-minimal solver.
+//     bool refit(const std::vector<int>& indices, Model& model) const;
+// };
+//
+// Residuals are scored in blocks so that kernels can evaluate them with
+// vectorized Eigen array expressions instead of one point at a time.
+//
+// The estimator supports:
+// - PROSAC sampling, if the data points are sorted by decreasing quality
+//   (Chum and Matas, Matching with PROSAC - Progressive Sample Consensus,
+//   CVPR 2005).
+// - SPRT model verification, which preempts the scoring of a model as soon
+//   as it is likely to be bad (Chum and Matas, Optimal Randomized RANSAC,
+//   PAMI 2008).
+// - Local optimization of each so-far-the-best model by iterative
+//   non-minimal fitting to its inliers (Chum et al., Locally Optimized
+//   RANSAC, DAGM 2003).
+// - Adaptive termination based on the current inlier ratio.
+template<class Kernel>
+class Ransac
+{
+public:
+    typedef typename Kernel::Model Model;
+
+    explicit Ransac(const Kernel& kernel);
+
+    void setThreshold(double threshold);
+    void setConfidence(double confidence);
+    void setMaxIterations(int maxIterations);
+    void setProsac(bool enable);
+    void setSprt(bool enable);
+    void setLocalOptimization(bool enable);
+
+    // Returns false if no model with at least SampleSize inliers was found.
+    bool estimate(Model& model, std::vector<unsigned char>& inlierMask);
+
+    int iterations(void) const;
+    int modelsEvaluated(void) const;
+    int modelsRejected(void) const;
+
+private:
+    void drawSample(int* sample);
+    void drawUniformSample(int n, int* sample, int nDrawn = 0);
+
+    int score(const Model& model, int bestScore, bool& rejected);
+    int countInliers(const Model& model, std::vector<int>* inliers);
+    int optimize(Model& model);
+
+    void updateSprtThreshold(void);
+    int requiredIterations(double epsilon) const;
+    int prosacRequiredIterations(const Model& model);
+
+    const Kernel& mKernel;
+
+    double mThreshold;
+    double mConfidence;
+    int mMaxIterations;
+    bool mUseProsac;
+    bool mUseSprt;
+    bool mUseLocalOptimization;
+
+    cv::RNG mRNG;
+    std::vector<double> mErrors;
+
+    // PROSAC state
+    int mProsacSubsetSize;
+    int mProsacSamples;
+    int mProsacGrowthSample;
+    double mProsacExpectedSamples;
+
+    // SPRT state
+    double mSprtEpsilon;
+    double mSprtDelta;
+    double mSprtThreshold;
+    double mSprtModelsPerSample;
+    int mSprtRejectedCount;
+
+    int mIterations;
+    int mModelsEvaluated;
+    int mModelsRejected;
+
+    // number of residuals scored at once
+    const int k_blockSize;
+    // maximum number of samples before PROSAC degenerates to RANSAC
+    const int k_prosacMaxSamples;
+    // cost of computing the models of one sample, in units of the cost of
+    // scoring one residual
+    const double k_sprtModelCost;
+    const int k_localOptimizationIterations;
+};
+
+template<class Kernel>
+Ransac<Kernel>::Ransac(const Kernel& kernel)
+ : mKernel(kernel)
+ , mThreshold(1.0)
+ , mConfidence(0.99)
+ , mMaxIterations(1000)
+ , mUseProsac(false)
+ , mUseSprt(true)
+ , mUseLocalOptimization(true)
+ , mRNG(0xffffffff)
+ , mIterations(0)
+ , mModelsEvaluated(0)
+ , mModelsRejected(0)
+ , k_blockSize(64)
+ , k_prosacMaxSamples(200000)
+ , k_sprtModelCost(200.0)
+ , k_localOptimizationIterations(4)
+{
+
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setThreshold(double threshold)
+{
+    mThreshold = threshold;
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setConfidence(double confidence)
+{
+    mConfidence = std::min(std::max(confidence, 0.0), 1.0 - 1e-12);
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setMaxIterations(int maxIterations)
+{
+    mMaxIterations = std::max(maxIterations, 1);
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setProsac(bool enable)
+{
+    mUseProsac = enable;
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setSprt(bool enable)
+{
+    mUseSprt = enable;
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::setLocalOptimization(bool enable)
+{
+    mUseLocalOptimization = enable;
+}
+
+template<class Kernel>
+bool
+Ransac<Kernel>::estimate(Model& model, std::vector<unsigned char>& inlierMask)
+{
+    const int nPoints = mKernel.size();
+    const int m = Kernel::SampleSize;
+
+    inlierMask.assign(std::max(nPoints, 0), 0);
+
+    mIterations = 0;
+    mModelsEvaluated = 0;
+    mModelsRejected = 0;
+
+    if (nPoints < m)
+    {
+        return false;
+    }
+
+    mErrors.resize(std::min(nPoints, k_blockSize));
+
+    // PROSAC: expected number of samples drawn from the top m points
+    // out of k_prosacMaxSamples samples drawn from all points
+    mProsacSubsetSize = m;
+    mProsacSamples = 0;
+    mProsacGrowthSample = 1;
+    mProsacExpectedSamples = k_prosacMaxSamples;
+    for (int i = 0; i < m; ++i)
+    {
+        mProsacExpectedSamples *= static_cast<double>(m - i) / (nPoints - i);
+    }
+
+    // SPRT is only enabled once a model has been found that gives an
+    // estimate of the inlier ratio
+    mSprtEpsilon = 0.0;
+    mSprtDelta = 0.01;
+    mSprtThreshold = std::numeric_limits<double>::max();
+    mSprtModelsPerSample = 1.0;
+    mSprtRejectedCount = 0;
+
+    int sample[Kernel::SampleSize];
+    Model models[Kernel::MaxModels];
+
+    int bestScore = 0;
+    int maxIterations = mMaxIterations;
+    int nModelsTotal = 0;
+
+    while (mIterations < maxIterations)
+    {
+        ++mIterations;
+
+        drawSample(sample);
+
+        int nModels = mKernel.fit(sample, models);
+
+        nModelsTotal += nModels;
+        mSprtModelsPerSample = std::max(static_cast<double>(nModelsTotal) / mIterations, 1.0);
+
+        for (int i = 0; i < nModels; ++i)
+        {
+            ++mModelsEvaluated;
+
+            bool rejected = false;
+            int s = score(models[i], bestScore, rejected);
+
+            if (rejected)
+            {
+                ++mModelsRejected;
+                continue;
+            }
+
+            if (s <= bestScore)
+            {
+                continue;
+            }
+
+            model = models[i];
+            bestScore = s;
+
+            if (mUseLocalOptimization)
+            {
+                bestScore = optimize(model);
+            }
+
+            if (mUseSprt)
+            {
+                mSprtEpsilon = static_cast<double>(bestScore) / nPoints;
+                updateSprtThreshold();
+            }
+
+            maxIterations = std::min(maxIterations,
+                                     requiredIterations(static_cast<double>(bestScore) / nPoints));
+            if (mUseProsac)
+            {
+                maxIterations = std::min(maxIterations, prosacRequiredIterations(model));
+            }
+        }
+    }
+
+    if (bestScore < m)
+    {
+        return false;
+    }
+
+    std::vector<int> inliers;
+    countInliers(model, &inliers);
+
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        inlierMask.at(inliers.at(i)) = 1;
+    }
+
+    return true;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::iterations(void) const
+{
+    return mIterations;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::modelsEvaluated(void) const
+{
+    return mModelsEvaluated;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::modelsRejected(void) const
+{
+    return mModelsRejected;
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::drawSample(int* sample)
+{
+    const int nPoints = mKernel.size();
+    const int m = Kernel::SampleSize;
+
+    ++mProsacSamples;
+
+    if (!mUseProsac || mProsacSamples > k_prosacMaxSamples)
+    {
+        drawUniformSample(nPoints, sample);
+        return;
+    }
+
+    // grow the subset once the expected number of samples from it is reached
+    if (mProsacSamples == mProsacGrowthSample && mProsacSubsetSize < nPoints)
+    {
+        double expectedSamples = mProsacExpectedSamples * (mProsacSubsetSize + 1) /
+                                 (mProsacSubsetSize + 1 - m);
+
+        mProsacGrowthSample += static_cast<int>(ceil(expectedSamples - mProsacExpectedSamples));
+        mProsacExpectedSamples = expectedSamples;
+        ++mProsacSubsetSize;
+    }
+
+    if (mProsacGrowthSample < mProsacSamples)
+    {
+        drawUniformSample(mProsacSubsetSize, sample);
+    }
+    else
+    {
+        // the newest point of the subset is always part of the sample
+        sample[0] = mProsacSubsetSize - 1;
+        drawUniformSample(mProsacSubsetSize - 1, sample, 1);
+    }
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::drawUniformSample(int n, int* sample, int nDrawn)
+{
+    for (int i = nDrawn; i < Kernel::SampleSize; ++i)
+    {
+        bool duplicate = true;
+        while (duplicate)
+        {
+            sample[i] = mRNG.uniform(0, n);
+
+            duplicate = false;
+            for (int j = 0; j < i; ++j)
+            {
+                if (sample[j] == sample[i])
+                {
+                    duplicate = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::score(const Model& model, int bestScore, bool& rejected)
+{
+    const int nPoints = mKernel.size();
+
+    // SPRT likelihood ratio increments for consistent and inconsistent points
+    bool useSprt = mUseSprt && mSprtThreshold < std::numeric_limits<double>::max();
+    double lambdaInlier = 1.0, lambdaOutlier = 1.0;
+    if (useSprt)
+    {
+        lambdaInlier = mSprtDelta / mSprtEpsilon;
+        lambdaOutlier = (1.0 - mSprtDelta) / (1.0 - mSprtEpsilon);
+    }
+    double lambda = 1.0;
+
+    // SPRT assumes the points are tested in random order, so start
+    // at a random block offset
+    int offset = useSprt ? mRNG.uniform(0, nPoints) : 0;
+
+    rejected = false;
+
+    int inlierCount = 0;
+    int tested = 0;
+    while (tested < nPoints)
+    {
+        int begin = (offset + tested) % nPoints;
+        int end = std::min(begin + k_blockSize, nPoints);
+        end = std::min(end, begin + nPoints - tested);
+
+        mKernel.evaluate(model, begin, end, &mErrors[0]);
+
+        for (int i = 0; i < end - begin; ++i)
+        {
+            if (mErrors[i] <= mThreshold)
+            {
+                ++inlierCount;
+                lambda *= lambdaInlier;
+            }
+            else
+            {
+                lambda *= lambdaOutlier;
+            }
+        }
+
+        tested += end - begin;
+
+        if (useSprt && lambda > mSprtThreshold)
+        {
+            // the model is likely bad; update the estimate of the
+            // probability that a point is consistent with a bad model
+            double delta = static_cast<double>(inlierCount) / tested;
+
+            ++mSprtRejectedCount;
+            mSprtDelta += (delta - mSprtDelta) / mSprtRejectedCount;
+            mSprtDelta = std::min(std::max(mSprtDelta, 1e-4), 0.5 * mSprtEpsilon);
+            updateSprtThreshold();
+
+            rejected = true;
+            return inlierCount;
+        }
+
+        // the model cannot beat the best model anymore
+        if (inlierCount + nPoints - tested <= bestScore)
+        {
+            return inlierCount;
+        }
+    }
+
+    return inlierCount;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::countInliers(const Model& model, std::vector<int>* inliers)
+{
+    const int nPoints = mKernel.size();
+
+    if (inliers)
+    {
+        inliers->clear();
+    }
+
+    int inlierCount = 0;
+    for (int begin = 0; begin < nPoints; begin += k_blockSize)
+    {
+        int end = std::min(begin + k_blockSize, nPoints);
+
+        mKernel.evaluate(model, begin, end, &mErrors[0]);
+
+        for (int i = 0; i < end - begin; ++i)
+        {
+            if (mErrors[i] <= mThreshold)
+            {
+                ++inlierCount;
+                if (inliers)
+                {
+                    inliers->push_back(begin + i);
+                }
+            }
+        }
+    }
+
+    return inlierCount;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::optimize(Model& model)
+{
+    std::vector<int> inliers;
+    int inlierCount = countInliers(model, &inliers);
+
+    for (int i = 0; i < k_localOptimizationIterations; ++i)
+    {
+        if (static_cast<int>(inliers.size()) <= Kernel::SampleSize)
+        {
+            break;
+        }
+
+        Model refinedModel = model;
+        if (!mKernel.refit(inliers, refinedModel))
+        {
+            break;
+        }
+
+        std::vector<int> refinedInliers;
+        int refinedInlierCount = countInliers(refinedModel, &refinedInliers);
+        if (refinedInlierCount <= inlierCount)
+        {
+            break;
+        }
+
+        model = refinedModel;
+        inlierCount = refinedInlierCount;
+        inliers.swap(refinedInliers);
+    }
+
+    return inlierCount;
+}
+
+template<class Kernel>
+void
+Ransac<Kernel>::updateSprtThreshold(void)
+{
+    if (mSprtEpsilon <= mSprtDelta || mSprtEpsilon >= 1.0)
+    {
+        mSprtThreshold = std::numeric_limits<double>::max();
+        return;
+    }
+
+    // Chum and Matas, eq. 2 and 17
+    double C = (1.0 - mSprtDelta) * log((1.0 - mSprtDelta) / (1.0 - mSprtEpsilon)) +
+               mSprtDelta * log(mSprtDelta / mSprtEpsilon);
+    double K = k_sprtModelCost * C / mSprtModelsPerSample + 1.0;
+
+    double A = K;
+    for (int i = 0; i < 10; ++i)
+    {
+        A = K + log(A);
+    }
+
+    mSprtThreshold = A;
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::requiredIterations(double epsilon) const
+{
+    // probability that an all-inlier sample gives an accepted model
+    double pGood = pow(epsilon, static_cast<int>(Kernel::SampleSize));
+    if (mUseSprt && mSprtThreshold < std::numeric_limits<double>::max())
+    {
+        pGood *= 1.0 - 1.0 / mSprtThreshold;
+    }
+
+    if (pGood >= 1.0)
+    {
+        return 1;
+    }
+    if (pGood <= std::numeric_limits<double>::epsilon())
+    {
+        return std::numeric_limits<int>::max();
+    }
+
+    double k = log(1.0 - mConfidence) / log(1.0 - pGood);
+    if (k >= std::numeric_limits<int>::max())
+    {
+        return std::numeric_limits<int>::max();
+    }
+
+    return std::max(static_cast<int>(ceil(k)), 1);
+}
+
+template<class Kernel>
+int
+Ransac<Kernel>::prosacRequiredIterations(const Model& model)
+{
+    const int nPoints = mKernel.size();
+    const int m = Kernel::SampleSize;
+
+    std::vector<int> inliers;
+    countInliers(model, &inliers);
+
+    // PROSAC termination: the smallest number of samples over all subsets
+    // of the top n points whose inlier count is unlikely to be random.
+    // The inliers are sorted by index.
+    const double beta = std::max(mSprtDelta, 0.05);
+    const double chi = 2.706;
+
+    int minIterations = std::numeric_limits<int>::max();
+    size_t inlierCount = 0;
+    for (int n = m + 1; n <= nPoints; ++n)
+    {
+        while (inlierCount < inliers.size() && inliers.at(inlierCount) < n)
+        {
+            ++inlierCount;
+        }
+
+        double minInlierCount = m + beta * (n - m) +
+                                chi * sqrt(beta * (1.0 - beta) * (n - m));
+        if (inlierCount < minInlierCount)
+        {
+            continue;
+        }
+
+        minIterations = std::min(minIterations,
+                                 requiredIterations(static_cast<double>(inlierCount) / n));
+    }
+
+    return minIterations;
+}
+
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <camodocal/pose_graph/PoseGraph.h>
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 #include <camodocal/sparse_graph/SparseGraphUtils.h>
 #include <ceres/ceres.h>
@@ -8,10 +9,15 @@
 #include <opencv2/core/eigen.hpp>
 
 #include "../gpl/EigenQuaternionParameterization.h"
+#include "../gpl/gpl.h"
 #include "../location_recognition/LocationRecognition.h"
+#include "../npoint/p3p/p3p.hpp"
 #include "PoseGraphError.h"
+#include "PoseGraphOptimizer.h"
+#include "PositionKdTree.h"
 
 #ifdef VCHARGE_VIZ
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
 #include "../../../../visualization/overlay/GLOverlayExtended.h"
 #endif
 
@@ -27,10 +33,15 @@ PoseGraph::PoseGraph(CameraSystem& cameraSystem,
  : m_cameraSystem(cameraSystem)
  , m_graph(graph)
  , k_lossWidth(0.01)
+ , k_loopClosureMinRadius(5.0)
+ , k_loopClosureDriftRate(0.05)
+ , k_loopClosureQueryDistance(2.0)
+ , k_loopClosureQueryYaw(5.0 / 180.0 * M_PI)
  , k_maxDistanceRatio(maxDistanceRatio)
  , k_minLoopCorrespondences2D3D(minLoopCorrespondences2D3D)
  , k_nImageMatches(nImageMatches)
  , k_nominalFocalLength(nominalFocalLength)
+ , m_backend(BACKEND_CERES)
  , m_verbose(false)
 {
 
@@ -42,6 +53,18 @@ PoseGraph::setVerbose(bool onoff)
     m_verbose = onoff;
 }
 
+void
+PoseGraph::setBackend(Backend backend)
+{
+    m_backend = backend;
+}
+
+void
+PoseGraph::setLocationRecognition(const boost::shared_ptr<LocationRecognition>& locRec)
+{
+    m_locRec = locRec;
+}
+
 void
 PoseGraph::buildEdges(void)
 {
@@ -79,22 +102,76 @@ PoseGraph::optimize(bool useRobustOptimization)
     // G.H. Lee, F. Fraundorfer, and M. Pollefeys,
     // Robust Pose-Graph Loop-Closures with Expectation-Maximization,
     // In International Conference on Intelligent Robots and Systems, 2013.
+
+    // The problem is built once over all edges. Between EM iterations,
+    // loop closure edges are switched on and off in place by scaling
+    // their residuals, and the solver is warm-started from the poses
+    // of the previous iteration. Only the selected backend is built.
+    boost::scoped_ptr<ceres::Problem> problem;
+    boost::scoped_ptr<PoseGraphOptimizer> optimizer;
+    ceres::CauchyLoss lossFunction(k_lossWidth);
+
+    std::vector<double> loopClosureSwitches(m_loopClosureEdges.size());
+    for (size_t i = 0; i < m_loopClosureEdgeSwitches.size(); ++i)
+    {
+        loopClosureSwitches.at(i) = (m_loopClosureEdgeSwitches.at(i) == ON) ? 1.0 : 0.0;
+    }
+
+    if (m_backend == BACKEND_NATIVE)
+    {
+        optimizer.reset(new PoseGraphOptimizer);
+        buildProblem(*optimizer, loopClosureSwitches,
+                     useRobustOptimization ? &lossFunction : 0);
+    }
+    else
+    {
+        problem.reset(new ceres::Problem);
+        buildProblem(*problem, loopClosureSwitches, useRobustOptimization);
+    }
+
     if (useRobustOptimization)
     {
         for (int i = 0; i < 20; ++i)
         {
-            if (!iterateEM(true))
+            bool solved = optimizer ?
+                          solveProblem(*optimizer) : solveProblem(*problem);
+            if (!solved)
             {
-#ifdef VCHARGE_VIZ
-                visualizeLoopClosureEdges();
-#endif
-                return;
+                break;
+            }
+
+            std::vector<EdgeSwitchState> switchesPrev = m_loopClosureEdgeSwitches;
+
+            classifySwitches();
+
+            if (m_loopClosureEdgeSwitches == switchesPrev)
+            {
+                if (m_verbose)
+                {
+                    std::cout << "# INFO: Edge switches converged after "
+                              << i + 1 << " EM iterations." << std::endl;
+                }
+
+                break;
+            }
+
+            for (size_t j = 0; j < m_loopClosureEdgeSwitches.size(); ++j)
+            {
+                loopClosureSwitches.at(j) = (m_loopClosureEdgeSwitches.at(j) == ON) ? 1.0 : 0.0;
             }
         }
+
+#ifdef VCHARGE_VIZ
+        visualizeLoopClosureEdges();
+#endif
+    }
+    else if (optimizer)
+    {
+        solveProblem(*optimizer);
     }
     else
     {
-        iterateEM(false);
+        solveProblem(*problem);
     }
 }
 
@@ -157,17 +234,120 @@ PoseGraph::findLoopClosures(std::vector<PoseGraph::Edge, Eigen::aligned_allocato
                             std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > >& correspondences2D3D,
                             double reprojErrorThresh) const
 {
-    boost::shared_ptr<LocationRecognition> locRec(new LocationRecognition);
+    boost::shared_ptr<LocationRecognition> locRec = m_locRec;
+    if (locRec.get() == 0)
+    {
+        locRec.reset(new LocationRecognition);
+    }
     locRec->setup(m_graph);
 
+    // index the system poses of all frame sets, together with the
+    // distance travelled from the first frame set, accumulated over all
+    // segments in frame set order
+    std::vector<Eigen::Vector3d> positions;
+    std::vector<FrameSetTag> frameSetTags;
+    std::vector<double> pathLengths;
+    double pathLength = 0.0;
+    for (int i = 0; i < m_graph.frameSetSegments().size(); ++i)
+    {
+        const FrameSetSegment& segment = m_graph.frameSetSegment(i);
+
+        for (int j = 0; j < segment.size(); ++j)
+        {
+            const OdometryPtr& systemPose = segment.at(j)->systemPose();
+
+            if (systemPose.get() == 0)
+            {
+                continue;
+            }
+
+            if (!positions.empty())
+            {
+                pathLength += (systemPose->position() - positions.back()).norm();
+            }
+
+            positions.push_back(systemPose->position());
+            frameSetTags.push_back(std::make_pair(i, j));
+            pathLengths.push_back(pathLength);
+        }
+    }
+
+    PositionKdTree kdTree(positions);
+
+    size_t nQueries = 0;
+    size_t nCandidates = 0;
+
+    size_t idx = 0;
     for (int i = 0; i < m_graph.frameSetSegments().size(); ++i)
     {
         const FrameSetSegment& segment = m_graph.frameSetSegment(i);
 
+        // subsample the query frame sets along straight drives
+        OdometryPtr lastQueryPose;
+
         for (int j = 0; j < segment.size(); ++j)
         {
             const FrameSetPtr& frameSet = segment.at(j);
 
+            if (frameSet->systemPose().get() == 0)
+            {
+                continue;
+            }
+
+            size_t queryIdx = idx++;
+
+            if (lastQueryPose.get() != 0)
+            {
+                double dYaw = normalizeTheta(frameSet->systemPose()->yaw() - lastQueryPose->yaw());
+
+                if ((frameSet->systemPose()->position() - lastQueryPose->position()).norm() < k_loopClosureQueryDistance &&
+                    fabs(dYaw) < k_loopClosureQueryYaw)
+                {
+                    continue;
+                }
+            }
+
+            lastQueryPose = frameSet->systemPose();
+
+            // find the frame sets that are within the drift bounds of the
+            // query frame set, i.e. the uncertainty of their relative
+            // position given the distance travelled in between
+            double maxPathLength = std::max(pathLengths.at(queryIdx),
+                                            pathLength - pathLengths.at(queryIdx));
+
+            std::vector<int> indices;
+            kdTree.radiusSearch(positions.at(queryIdx),
+                                k_loopClosureMinRadius +
+                                k_loopClosureDriftRate * maxPathLength,
+                                indices);
+
+            std::set<FrameSetTag> candidates;
+            for (size_t k = 0; k < indices.size(); ++k)
+            {
+                int candidateIdx = indices.at(k);
+                const FrameSetTag& tag = frameSetTags.at(candidateIdx);
+
+                if (tag.first == i && std::abs(tag.second - j) < 20)
+                {
+                    continue;
+                }
+
+                double radius = k_loopClosureMinRadius +
+                                k_loopClosureDriftRate * fabs(pathLengths.at(queryIdx) - pathLengths.at(candidateIdx));
+                if ((positions.at(candidateIdx) - positions.at(queryIdx)).norm() <= radius)
+                {
+                    candidates.insert(tag);
+                }
+            }
+
+            if (candidates.empty())
+            {
+                continue;
+            }
+
+            ++nQueries;
+            nCandidates += candidates.size();
+
             boost::shared_ptr<boost::thread> threads[frameSet->frames().size()];
             PoseGraph::Edge edges[frameSet->frames().size()];
             std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3D[frameSet->frames().size()];
@@ -187,7 +367,7 @@ PoseGraph::findLoopClosures(std::vector<PoseGraph::Edge, Eigen::aligned_allocato
                 frameTag.frameId = k;
 
                 threads[k].reset(new boost::thread(boost::bind(&PoseGraph::findLoopClosuresHelper, this,
-                                                               frameTag, locRec,
+                                                               frameTag, locRec, &candidates,
                                                                &edges[k], &corr2D3D[k],
                                                                reprojErrorThresh)));
             }
@@ -208,11 +388,20 @@ PoseGraph::findLoopClosures(std::vector<PoseGraph::Edge, Eigen::aligned_allocato
             }
         }
     }
+
+    if (m_verbose)
+    {
+        std::cout << "# INFO: Queried " << nQueries << "/" << positions.size()
+                  << " frame sets for loop closures with on average "
+                  << (nQueries == 0 ? 0.0 : static_cast<double>(nCandidates) / nQueries)
+                  << " candidate frame sets within the drift bounds." << std::endl;
+    }
 }
 
 void
 PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
                                   boost::shared_ptr<LocationRecognition> locRec,
+                                  const std::set<FrameSetTag>* candidates,
                                   PoseGraph::Edge* edge,
                                   std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >* correspondences2D3D,
                                   double reprojErrorThresh) const
@@ -229,8 +418,12 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
     Pose T_cam_odo(m_cameraSystem.getGlobalCameraPose(frameQuery->cameraId()));
 
     // find closest matching images
+    DBoW2::BowVector bowVector;
+    DBoW2::FeatureVector featureVector;
+    locRec->getWords(frameQuery, bowVector, featureVector);
+
     std::vector<FrameTag> frameTags;
-    locRec->knnMatch(frameQuery, k_nImageMatches, frameTags);
+    locRec->knnMatch(bowVector, k_nImageMatches, frameTags);
 
     std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3DBest;
     Transform transformBest;
@@ -240,26 +433,27 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
     {
         FrameTag frameTag = frameTags.at(i);
 
-        if (frameTagQuery.frameSetSegmentId == frameTag.frameSetSegmentId &&
-            std::abs(frameTagQuery.frameSetId - frameTag.frameSetId) < 20)
+        // only verify candidates within the drift bounds
+        if (candidates->find(std::make_pair(frameTag.frameSetSegmentId,
+                                            frameTag.frameSetId)) == candidates->end())
         {
             continue;
         }
 
         const FramePtr& frame = m_graph.frameSetSegment(frameTag.frameSetSegmentId).at(frameTag.frameSetId)->frames().at(frameTag.frameId);
 
-        // mark 3D-3D correspondences between maps
-        std::vector<cv::DMatch> matches = matchFeatures(frameQuery->features2D(), frame->features2D(), k_maxDistanceRatio);
+        // match features which share a vocabulary node
+        std::vector<cv::DMatch> matches = locRec->matchFeatures(frameQuery, featureVector, frame, k_maxDistanceRatio);
 
         if (matches.size() < k_minLoopCorrespondences2D3D)
         {
             continue;
         }
 
-        // find camera pose from EPnP
+        // find camera pose from P3P
         std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3D;
-        std::vector<cv::Point2f> imagePoints;
-        std::vector<cv::Point3f> scenePoints;
+        std::vector<Eigen::Vector3d> bearings;
+        std::vector<Eigen::Vector3d> scenePoints;
         for (size_t j = 0; j < matches.size(); ++j)
         {
             cv::DMatch& match = matches.at(j);
@@ -272,13 +466,13 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
                 continue;
             }
 
-            cv::Point2f rectPt;
-            rectifyImagePoint(m_cameraSystem.getCamera(frameQuery->cameraId()), p2D->keypoint().pt, rectPt);
+            const cv::Point2f& pt = p2D->keypoint().pt;
 
-            imagePoints.push_back(rectPt);
+            Eigen::Vector3d P;
+            m_cameraSystem.getCamera(frameQuery->cameraId())->liftProjective(Eigen::Vector2d(pt.x, pt.y), P);
 
-            const Eigen::Vector3d& p = p3D->point();
-            scenePoints.push_back(cv::Point3f(p(0), p(1), p(2)));
+            bearings.push_back(P.normalized());
+            scenePoints.push_back(p3D->point());
 
             corr2D3D.push_back(std::make_pair(p2D, p3D));
         }
@@ -288,14 +482,21 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
             continue;
         }
 
-        cv::Mat rvec_cv, tvec_cv;
+        // this frame cannot have more inliers than the best frame so far
+        if (corr2D3D.size() <= corr2D3DBest.size())
+        {
+            continue;
+        }
+
+        Eigen::Matrix3d R_cam;
+        Eigen::Vector3d t_cam;
         std::vector<int> inliers;
 
-        cv::solvePnPRansac(scenePoints, imagePoints,
-                           cv::Mat::eye(3, 3, CV_32F),
-                           cv::noArray(),
-                           rvec_cv, tvec_cv, false, 200,
-                           reprojErrorThresh, 100, inliers, CV_EPNP);
+        if (!solvePnPRansac(bearings, scenePoints, R_cam, t_cam, inliers,
+                            atan(reprojErrorThresh), 0.99, 200))
+        {
+            continue;
+        }
 
         int nInliers = inliers.size();
 
@@ -310,13 +511,9 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
             frameTagBest = frameTag;
 
             // compute loop closure constraint
-            Eigen::Vector3d rvec, tvec;
-            cv::cv2eigen(rvec_cv, rvec);
-            cv::cv2eigen(tvec_cv, tvec);
-
             Eigen::Matrix4d H_cam = Eigen::Matrix4d::Identity();
-            H_cam.block<3,3>(0,0) = Eigen::AngleAxisd(rvec.norm(), rvec.normalized()).toRotationMatrix();
-            H_cam.block<3,1>(0,3) = tvec;
+            H_cam.block<3,3>(0,0) = R_cam;
+            H_cam.block<3,1>(0,3) = t_cam;
 
             Eigen::Matrix4d H_0 = H_cam.inverse() * T_cam_odo.toMatrix().inverse();
 
@@ -361,11 +558,11 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
     }
 }
 
-bool
-PoseGraph::iterateEM(bool useRobustOptimization)
+void
+PoseGraph::buildProblem(ceres::Problem& problem,
+                        std::vector<double>& loopClosureSwitches,
+                        bool useRobustOptimization)
 {
-    ceres::Problem problem;
-
     // odometry edges
     for (size_t i = 0; i < m_odometryEdges.size(); ++i)
     {
@@ -393,16 +590,12 @@ PoseGraph::iterateEM(bool useRobustOptimization)
     // loop closure edges
     for (size_t i = 0; i < m_loopClosureEdges.size(); ++i)
     {
-        if (m_loopClosureEdgeSwitches.at(i) != ON)
-        {
-            continue;
-        }
-
         Edge& edge = m_loopClosureEdges.at(i);
 
         ceres::CostFunction* costFunction =
             new ceres::AutoDiffCostFunction<PoseGraphError, 6, 3, 3, 3, 3>(
-                new PoseGraphError(edge.property(), edge.weight()));
+                new PoseGraphError(edge.property(), edge.weight(),
+                                   &loopClosureSwitches.at(i)));
 
         OdometryPtr pose1, pose2;
         pose1 = edge.inVertex().lock();
@@ -418,8 +611,14 @@ PoseGraph::iterateEM(bool useRobustOptimization)
                                  pose1->positionData(), pose1->attitudeData(),
                                  pose2->positionData(), pose2->attitudeData());
     }
+}
 
+bool
+PoseGraph::solveProblem(ceres::Problem& problem)
+{
     ceres::Solver::Options options;
+    options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+
     ceres::Solver::Summary summary;
     ceres::Solve(options, &problem, &summary);
 
@@ -430,11 +629,52 @@ PoseGraph::iterateEM(bool useRobustOptimization)
 
     int nIterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
 
-    if (nIterations != 0 && useRobustOptimization)
+    return (nIterations != 0);
+}
+
+void
+PoseGraph::buildProblem(PoseGraphOptimizer& optimizer,
+                        std::vector<double>& loopClosureSwitches,
+                        ceres::LossFunction* lossFunction)
+{
+    // odometry edges
+    for (size_t i = 0; i < m_odometryEdges.size(); ++i)
+    {
+        Edge& edge = m_odometryEdges.at(i);
+
+        OdometryPtr pose1, pose2;
+        pose1 = edge.inVertex().lock();
+        pose2 = edge.outVertex().lock();
+
+        optimizer.addEdge(pose1, pose2, edge.property(), edge.weight());
+
+        if (i == 0)
+        {
+            optimizer.setVertexConstant(pose1);
+        }
+    }
+
+    // loop closure edges
+    for (size_t i = 0; i < m_loopClosureEdges.size(); ++i)
     {
-        classifySwitches();
+        Edge& edge = m_loopClosureEdges.at(i);
+
+        OdometryPtr pose1, pose2;
+        pose1 = edge.inVertex().lock();
+        pose2 = edge.outVertex().lock();
+
+        optimizer.addEdge(pose1, pose2, edge.property(), edge.weight(),
+                          &loopClosureSwitches.at(i), lossFunction);
     }
 
+    optimizer.setVerbose(m_verbose);
+}
+
+bool
+PoseGraph::solveProblem(PoseGraphOptimizer& optimizer)
+{
+    int nIterations = optimizer.solve();
+
     return (nIterations != 0);
 }
 
@@ -523,7 +763,13 @@ PoseGraph::classifySwitches(void)
 void
 PoseGraph::visualizeLoopClosureEdges(void)
 {
-    vcharge::GLOverlayExtended overlay("loop-closure-edges", VCharge::COORDINATE_FRAME_LOCAL);
+    if (!VisualizationPublisher::instance()->attached())
+    {
+        return;
+    }
+
+    boost::shared_ptr<vcharge::GLOverlayExtended> overlayPtr(new vcharge::GLOverlayExtended("loop-closure-edges", VCharge::COORDINATE_FRAME_LOCAL));
+    vcharge::GLOverlayExtended& overlay = *overlayPtr;
 
     Eigen::Vector3d origin = Eigen::Vector3d::Zero();
     if (OdometryPtr o = m_odometryEdges.front().inVertex().lock())
@@ -560,7 +806,7 @@ PoseGraph::visualizeLoopClosureEdges(void)
         overlay.end();
     }
 
-    overlay.publish();
+    VisualizationPublisher::instance()->publishOverlay("loop-closure-edges", overlayPtr);
 }
 
 #endif
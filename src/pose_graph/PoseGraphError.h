@@ -13,6 +13,7 @@ class PoseGraphError
 public:
     PoseGraphError(Transform& meas_T_01)
      : m_meas_T_01(meas_T_01)
+     , m_scale(0)
     {
         for (size_t i = 0; i < 6; ++i)
         {
@@ -22,6 +23,21 @@ public:
 
     PoseGraphError(Transform& meas_T_01, const std::vector<double>& weight)
      : m_meas_T_01(meas_T_01)
+     , m_scale(0)
+    {
+        for (size_t i = 0; i < 6; ++i)
+        {
+            m_weight[i] = weight.at(i);
+        }
+    }
+
+    // The residuals are also multiplied by *scale, which is read at each
+    // evaluation so that an edge can be switched on and off without
+    // rebuilding the problem.
+    PoseGraphError(Transform& meas_T_01, const std::vector<double>& weight,
+                   const double* scale)
+     : m_meas_T_01(meas_T_01)
+     , m_scale(scale)
     {
         for (size_t i = 0; i < 6; ++i)
         {
@@ -56,13 +72,15 @@ public:
         T roll, pitch, yaw;
         mat2RPY(err_R, roll, pitch, yaw);
 
-        residuals[0] = err_H(0,3) * T(m_weight[0]);
-        residuals[1] = err_H(1,3) * T(m_weight[1]);
-        residuals[2] = err_H(2,3) * T(m_weight[2]);
+        double scale = m_scale ? *m_scale : 1.0;
+
+        residuals[0] = err_H(0,3) * T(m_weight[0] * scale);
+        residuals[1] = err_H(1,3) * T(m_weight[1] * scale);
+        residuals[2] = err_H(2,3) * T(m_weight[2] * scale);
 
-        residuals[3] = roll * T(m_weight[3]);
-        residuals[4] = pitch * T(m_weight[4]);
-        residuals[5] = yaw * T(m_weight[5]);
+        residuals[3] = roll * T(m_weight[3] * scale);
+        residuals[4] = pitch * T(m_weight[4] * scale);
+        residuals[5] = yaw * T(m_weight[5] * scale);
 
         return true;
     }
@@ -70,6 +88,7 @@ public:
 private:
     Transform m_meas_T_01;
     double m_weight[6];
+    const double* m_scale;
 };
 
 }
@@ -0,0 +1,594 @@
+#include "PoseGraphOptimizer.h"
+
+#include <algorithm>
+#include <ceres/loss_function.h>
+#include <Eigen/OrderingMethods>
+#include <Eigen/SparseCore>
+#include <iostream>
+
+#include "../gpl/EigenUtils.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// inverse of the right Jacobian of SO(3) at the rotation vector phi
+Eigen::Matrix3d
+rightJacobianInverse(const Eigen::Vector3d& phi)
+{
+    double theta = phi.norm();
+    Eigen::Matrix3d Phi = skew(phi);
+
+    double c;
+    if (theta < 1e-4)
+    {
+        c = 1.0 / 12.0 + theta * theta / 720.0;
+    }
+    else
+    {
+        c = 1.0 / (theta * theta) -
+            (1.0 + cos(theta)) / (2.0 * theta * sin(theta));
+    }
+
+    return Eigen::Matrix3d::Identity() + 0.5 * Phi + c * Phi * Phi;
+}
+
+}
+
+PoseGraphOptimizer::PoseGraphOptimizer()
+ : m_structureValid(false)
+ , m_maxIterations(50)
+ , m_verbose(false)
+{
+
+}
+
+void
+PoseGraphOptimizer::setVerbose(bool onoff)
+{
+    m_verbose = onoff;
+}
+
+void
+PoseGraphOptimizer::setMaxIterations(int maxIterations)
+{
+    m_maxIterations = maxIterations;
+}
+
+void
+PoseGraphOptimizer::addEdge(const OdometryPtr& pose0, const OdometryPtr& pose1,
+                            const Transform& meas_T_01,
+                            const std::vector<double>& weight,
+                            const double* scale,
+                            ceres::LossFunction* lossFunction)
+{
+    Edge edge;
+    edge.vertex[0] = addVertex(pose0);
+    edge.vertex[1] = addVertex(pose1);
+
+    Eigen::Matrix4d meas_H_01 = meas_T_01.toMatrix();
+    edge.meas_R_01 = meas_H_01.block<3,3>(0,0);
+    edge.meas_t_01 = meas_H_01.block<3,1>(0,3);
+
+    for (int i = 0; i < 6; ++i)
+    {
+        edge.weight(i) = weight.at(i);
+    }
+
+    edge.scale = scale;
+    edge.lossFunction = lossFunction;
+    edge.column = -1;
+    edge.offset = -1;
+
+    m_edges.push_back(edge);
+
+    m_structureValid = false;
+}
+
+void
+PoseGraphOptimizer::setVertexConstant(const OdometryPtr& pose)
+{
+    m_vertices.at(addVertex(pose)).constant = true;
+
+    m_structureValid = false;
+}
+
+int
+PoseGraphOptimizer::solve(void)
+{
+    if (!m_structureValid)
+    {
+        analyzeStructure();
+    }
+
+    if (m_hessianDiag.empty())
+    {
+        return 0;
+    }
+
+    // Levenberg-Marquardt with the diagonal of the Hessian as damping
+    // matrix, using the same step control and tolerances as the ceres
+    // trust region minimizer
+    double lambda = 1e-4;
+    double nu = 2.0;
+
+    double initialCost = linearize();
+    double cost = initialCost;
+
+    int nIterations = 0;
+    bool converged = (m_gradient.lpNorm<Eigen::Infinity>() <= 1e-10);
+    while (!converged && nIterations < m_maxIterations)
+    {
+        ++nIterations;
+
+        if (!factorize(lambda))
+        {
+            lambda *= nu;
+            nu *= 2.0;
+            continue;
+        }
+
+        Eigen::VectorXd delta = -m_gradient;
+        solveFactorized(delta);
+
+        std::vector<Vertex> vertices = m_vertices;
+        double norm = 0.0;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            Vertex& vertex = vertices.at(i);
+            norm += vertex.t.squaredNorm();
+
+            if (vertex.block == -1)
+            {
+                continue;
+            }
+
+            Vector6d dx = delta.segment<6>(vertex.block * 6);
+
+            vertex.t += dx.head<3>();
+            Eigen::Quaterniond q(vertex.R * AngleAxisToRotationMatrix<double>(dx.tail<3>()));
+            vertex.R = q.normalized().toRotationMatrix();
+        }
+
+        if (delta.norm() <= 1e-8 * (sqrt(norm) + 1e-8))
+        {
+            converged = true;
+            break;
+        }
+
+        double newCost = evaluateCost(vertices);
+
+        // reduction predicted by the damped model
+        double modelReduction = -0.5 * m_gradient.dot(delta);
+        for (size_t i = 0; i < m_hessianDiag.size(); ++i)
+        {
+            Vector6d d = m_hessianDiag.at(i).diagonal().cwiseMax(1e-6).cwiseMin(1e32);
+            Vector6d dx = delta.segment<6>(i * 6);
+
+            modelReduction += 0.5 * lambda * dx.dot(d.cwiseProduct(dx));
+        }
+
+        double rho = (cost - newCost) / modelReduction;
+        if (modelReduction > 0.0 && rho > 1e-3)
+        {
+            m_vertices.swap(vertices);
+
+            double r = 2.0 * rho - 1.0;
+            lambda *= std::max(1.0 / 3.0, 1.0 - r * r * r);
+            nu = 2.0;
+
+            converged = (cost - newCost <= 1e-6 * cost);
+
+            cost = linearize();
+
+            if (m_gradient.lpNorm<Eigen::Infinity>() <= 1e-10)
+            {
+                converged = true;
+            }
+        }
+        else
+        {
+            lambda *= nu;
+            nu *= 2.0;
+        }
+    }
+
+    for (size_t i = 0; i < m_vertices.size(); ++i)
+    {
+        Vertex& vertex = m_vertices.at(i);
+        if (vertex.constant)
+        {
+            continue;
+        }
+
+        double roll, pitch, yaw;
+        mat2RPY(vertex.R, roll, pitch, yaw);
+
+        vertex.pose->position() = vertex.t;
+        vertex.pose->attitude() = Eigen::Vector3d(yaw, pitch, roll);
+    }
+
+    if (m_verbose)
+    {
+        std::cout << "# INFO: Pose graph optimizer: Iterations: " << nIterations
+                  << ", Initial cost: " << initialCost
+                  << ", Final cost: " << cost
+                  << ", Converged: " << (converged ? "yes" : "no") << std::endl;
+    }
+
+    return nIterations;
+}
+
+double
+PoseGraphOptimizer::cost(void) const
+{
+    return evaluateCost(m_vertices);
+}
+
+int
+PoseGraphOptimizer::addVertex(const OdometryPtr& pose)
+{
+    std::map<const Odometry*, int>::iterator it = m_vertexMap.find(pose.get());
+    if (it != m_vertexMap.end())
+    {
+        return it->second;
+    }
+
+    Eigen::Matrix4d H = pose->toMatrix();
+
+    Vertex vertex;
+    vertex.pose = pose;
+    vertex.R = H.block<3,3>(0,0);
+    vertex.t = H.block<3,1>(0,3);
+    vertex.constant = false;
+    vertex.block = -1;
+
+    m_vertices.push_back(vertex);
+    m_vertexMap.insert(std::make_pair(pose.get(), m_vertices.size() - 1));
+
+    return m_vertices.size() - 1;
+}
+
+double
+PoseGraphOptimizer::evaluateEdge(const Edge& edge,
+                                 const std::vector<Vertex>& vertices,
+                                 Vector6d& residual,
+                                 Matrix6d* J0, Matrix6d* J1) const
+{
+    double scale = edge.scale ? *edge.scale : 1.0;
+    if (scale == 0.0)
+    {
+        return 0.0;
+    }
+
+    const Vertex& v0 = vertices.at(edge.vertex[0]);
+    const Vertex& v1 = vertices.at(edge.vertex[1]);
+
+    // err_H = meas_H_01 * H0^-1 * H1
+    Eigen::Matrix3d A = edge.meas_R_01 * v0.R.transpose();
+    Eigen::Vector3d d = v0.R.transpose() * (v1.t - v0.t);
+    Eigen::Vector3d phi = RotationToAngleAxis<double>(A * v1.R);
+
+    residual.head<3>() = edge.meas_R_01 * d + edge.meas_t_01;
+    residual.tail<3>() = phi;
+
+    Vector6d w = edge.weight * scale;
+    residual = residual.cwiseProduct(w);
+
+    double s = residual.squaredNorm();
+    double rho[3] = {s, 1.0, 0.0};
+    if (edge.lossFunction)
+    {
+        edge.lossFunction->Evaluate(s, rho);
+    }
+
+    if (J0 && J1)
+    {
+        J0->setZero();
+        J0->block<3,3>(0,0) = -A;
+        J0->block<3,3>(0,3) = edge.meas_R_01 * skew(d);
+        J0->block<3,3>(3,3) = -rightJacobianInverse(-phi) * edge.meas_R_01;
+
+        J1->setZero();
+        J1->block<3,3>(0,0) = A;
+        J1->block<3,3>(3,3) = rightJacobianInverse(phi);
+
+        double sqrtWeight = sqrt(std::max(rho[1], 0.0));
+
+        *J0 = sqrtWeight * w.asDiagonal() * (*J0);
+        *J1 = sqrtWeight * w.asDiagonal() * (*J1);
+        residual *= sqrtWeight;
+    }
+
+    return 0.5 * rho[0];
+}
+
+double
+PoseGraphOptimizer::evaluateCost(const std::vector<Vertex>& vertices) const
+{
+    double cost = 0.0;
+    Vector6d residual;
+    for (size_t i = 0; i < m_edges.size(); ++i)
+    {
+        cost += evaluateEdge(m_edges.at(i), vertices, residual);
+    }
+
+    return cost;
+}
+
+double
+PoseGraphOptimizer::linearize(void)
+{
+    for (size_t i = 0; i < m_hessianDiag.size(); ++i)
+    {
+        m_hessianDiag.at(i).setZero();
+
+        Matrix6dVector& col = m_hessianCols.at(i);
+        for (size_t j = 0; j < col.size(); ++j)
+        {
+            col.at(j).setZero();
+        }
+    }
+    m_gradient.setZero();
+
+    double cost = 0.0;
+    for (size_t i = 0; i < m_edges.size(); ++i)
+    {
+        const Edge& edge = m_edges.at(i);
+        if (edge.scale && *edge.scale == 0.0)
+        {
+            continue;
+        }
+
+        Vector6d r;
+        Matrix6d J0, J1;
+        cost += evaluateEdge(edge, m_vertices, r, &J0, &J1);
+
+        int b0 = m_vertices.at(edge.vertex[0]).block;
+        int b1 = m_vertices.at(edge.vertex[1]).block;
+
+        if (b0 == b1)
+        {
+            J0 += J1;
+            b1 = -1;
+        }
+
+        if (b0 != -1)
+        {
+            m_hessianDiag.at(b0) += J0.transpose() * J0;
+            m_gradient.segment<6>(b0 * 6) += J0.transpose() * r;
+        }
+        if (b1 != -1)
+        {
+            m_hessianDiag.at(b1) += J1.transpose() * J1;
+            m_gradient.segment<6>(b1 * 6) += J1.transpose() * r;
+        }
+        if (b0 != -1 && b1 != -1)
+        {
+            Matrix6d& H = m_hessianCols.at(edge.column).at(edge.offset);
+            if (b0 < b1)
+            {
+                H += J1.transpose() * J0;
+            }
+            else
+            {
+                H += J0.transpose() * J1;
+            }
+        }
+    }
+
+    return cost;
+}
+
+void
+PoseGraphOptimizer::analyzeStructure(void)
+{
+    std::vector<int> variables;
+    for (size_t i = 0; i < m_vertices.size(); ++i)
+    {
+        m_vertices.at(i).block = -1;
+
+        if (!m_vertices.at(i).constant)
+        {
+            m_vertices.at(i).block = variables.size();
+            variables.push_back(i);
+        }
+    }
+
+    int nBlocks = variables.size();
+
+    // compute a fill-reducing ordering of the block pattern
+    std::vector<Eigen::Triplet<double> > triplets;
+    for (int i = 0; i < nBlocks; ++i)
+    {
+        triplets.push_back(Eigen::Triplet<double>(i, i, 1.0));
+    }
+    for (size_t i = 0; i < m_edges.size(); ++i)
+    {
+        int b0 = m_vertices.at(m_edges.at(i).vertex[0]).block;
+        int b1 = m_vertices.at(m_edges.at(i).vertex[1]).block;
+
+        if (b0 != -1 && b1 != -1 && b0 != b1)
+        {
+            triplets.push_back(Eigen::Triplet<double>(b0, b1, 1.0));
+            triplets.push_back(Eigen::Triplet<double>(b1, b0, 1.0));
+        }
+    }
+
+    Eigen::SparseMatrix<double> pattern(nBlocks, nBlocks);
+    pattern.setFromTriplets(triplets.begin(), triplets.end());
+
+    Eigen::PermutationMatrix<Eigen::Dynamic, Eigen::Dynamic, int> ordering;
+    Eigen::AMDOrdering<int> amd;
+    amd(pattern, ordering);
+
+    // ordering.indices()(k) is the block eliminated at step k
+    for (int k = 0; k < nBlocks; ++k)
+    {
+        m_vertices.at(variables.at(ordering.indices()(k))).block = k;
+    }
+
+    // symbolic factorization: the structure of block column j of the
+    // factor is the lower structure of the Hessian in column j merged
+    // with the structures of the children of j in the elimination tree
+    std::vector<std::vector<int> > lower(nBlocks);
+    for (size_t i = 0; i < m_edges.size(); ++i)
+    {
+        int b0 = m_vertices.at(m_edges.at(i).vertex[0]).block;
+        int b1 = m_vertices.at(m_edges.at(i).vertex[1]).block;
+
+        if (b0 != -1 && b1 != -1 && b0 != b1)
+        {
+            lower.at(std::min(b0, b1)).push_back(std::max(b0, b1));
+        }
+    }
+
+    std::vector<std::vector<int> > children(nBlocks);
+    m_factorRows.assign(nBlocks, std::vector<int>());
+    for (int j = 0; j < nBlocks; ++j)
+    {
+        std::vector<int>& rows = m_factorRows.at(j);
+        rows.swap(lower.at(j));
+
+        for (size_t i = 0; i < children.at(j).size(); ++i)
+        {
+            const std::vector<int>& childRows = m_factorRows.at(children.at(j).at(i));
+
+            // the first row of a child column is j itself
+            rows.insert(rows.end(), childRows.begin() + 1, childRows.end());
+        }
+
+        std::sort(rows.begin(), rows.end());
+        rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+
+        if (!rows.empty())
+        {
+            children.at(rows.front()).push_back(j);
+        }
+    }
+
+    m_hessianDiag.assign(nBlocks, Matrix6d::Zero());
+    m_hessianCols.assign(nBlocks, Matrix6dVector());
+    m_factorDiag.assign(nBlocks, Matrix6d::Zero());
+    m_factorCols.assign(nBlocks, Matrix6dVector());
+    for (int j = 0; j < nBlocks; ++j)
+    {
+        m_hessianCols.at(j).assign(m_factorRows.at(j).size(), Matrix6d::Zero());
+        m_factorCols.at(j).assign(m_factorRows.at(j).size(), Matrix6d::Zero());
+    }
+    m_gradient = Eigen::VectorXd::Zero(nBlocks * 6);
+
+    for (size_t i = 0; i < m_edges.size(); ++i)
+    {
+        Edge& edge = m_edges.at(i);
+
+        int b0 = m_vertices.at(edge.vertex[0]).block;
+        int b1 = m_vertices.at(edge.vertex[1]).block;
+
+        if (b0 != -1 && b1 != -1 && b0 != b1)
+        {
+            edge.column = std::min(b0, b1);
+            edge.offset = findBlock(std::max(b0, b1), edge.column);
+        }
+        else
+        {
+            edge.column = -1;
+            edge.offset = -1;
+        }
+    }
+
+    m_structureValid = true;
+}
+
+bool
+PoseGraphOptimizer::factorize(double lambda)
+{
+    int nBlocks = m_hessianDiag.size();
+
+    for (int j = 0; j < nBlocks; ++j)
+    {
+        Vector6d d = m_hessianDiag.at(j).diagonal().cwiseMax(1e-6).cwiseMin(1e32);
+
+        m_factorDiag.at(j) = m_hessianDiag.at(j);
+        m_factorDiag.at(j).diagonal() += lambda * d;
+
+        m_factorCols.at(j) = m_hessianCols.at(j);
+    }
+
+    // right-looking block Cholesky factorization
+    for (int j = 0; j < nBlocks; ++j)
+    {
+        Eigen::LLT<Matrix6d> llt(m_factorDiag.at(j));
+        if (llt.info() != Eigen::Success)
+        {
+            return false;
+        }
+
+        Matrix6d& L_jj = m_factorDiag.at(j);
+        L_jj = llt.matrixL();
+
+        const std::vector<int>& rows = m_factorRows.at(j);
+        Matrix6dVector& col = m_factorCols.at(j);
+
+        for (size_t a = 0; a < rows.size(); ++a)
+        {
+            L_jj.triangularView<Eigen::Lower>().transpose().solveInPlace<Eigen::OnTheRight>(col.at(a));
+        }
+
+        for (size_t a = 0; a < rows.size(); ++a)
+        {
+            m_factorDiag.at(rows.at(a)) -= col.at(a) * col.at(a).transpose();
+
+            for (size_t b = a + 1; b < rows.size(); ++b)
+            {
+                int offset = findBlock(rows.at(b), rows.at(a));
+
+                m_factorCols.at(rows.at(a)).at(offset) -= col.at(b) * col.at(a).transpose();
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+PoseGraphOptimizer::solveFactorized(Eigen::VectorXd& x) const
+{
+    int nBlocks = m_factorDiag.size();
+
+    // forward substitution with L
+    for (int j = 0; j < nBlocks; ++j)
+    {
+        m_factorDiag.at(j).triangularView<Eigen::Lower>().solveInPlace(x.segment<6>(j * 6));
+
+        const std::vector<int>& rows = m_factorRows.at(j);
+        for (size_t a = 0; a < rows.size(); ++a)
+        {
+            x.segment<6>(rows.at(a) * 6) -= m_factorCols.at(j).at(a) * x.segment<6>(j * 6);
+        }
+    }
+
+    // back substitution with L^T
+    for (int j = nBlocks - 1; j >= 0; --j)
+    {
+        const std::vector<int>& rows = m_factorRows.at(j);
+        for (size_t a = 0; a < rows.size(); ++a)
+        {
+            x.segment<6>(j * 6) -= m_factorCols.at(j).at(a).transpose() * x.segment<6>(rows.at(a) * 6);
+        }
+
+        m_factorDiag.at(j).triangularView<Eigen::Lower>().transpose().solveInPlace(x.segment<6>(j * 6));
+    }
+}
+
+int
+PoseGraphOptimizer::findBlock(int row, int column) const
+{
+    const std::vector<int>& rows = m_factorRows.at(column);
+
+    return std::lower_bound(rows.begin(), rows.end(), row) - rows.begin();
+}
+
+}
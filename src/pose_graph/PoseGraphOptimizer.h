@@ -0,0 +1,126 @@
+#ifndef POSEGRAPHOPTIMIZER_H
+#define POSEGRAPHOPTIMIZER_H
+
+#include <camodocal/sparse_graph/Odometry.h>
+#include <camodocal/sparse_graph/Transform.h>
+#include <map>
+#include <vector>
+
+namespace ceres
+{
+class LossFunction;
+}
+
+namespace camodocal
+{
+
+// Levenberg-Marquardt optimizer for pose graphs over odometry vertices.
+//
+// Each vertex is kept as an SE(3) pose and is updated on a 6-DoF tangent
+// block, with the rotation increment applied on the right. The edge
+// Jacobians are analytic, and the damped normal equations are solved
+// with a 6x6 block-sparse Cholesky factorization under an approximate
+// minimum degree ordering which is computed once per graph structure.
+//
+// An edge residual is the translation and the rotation vector of
+// meas_H_01 * (H1^-1 * H0)^-1, weighted component-wise as in
+// PoseGraphError. The residual is also multiplied by *scale, which is
+// read at each evaluation so that an edge can be switched on and off
+// between calls to solve(). A robust loss is applied through iteratively
+// reweighted least squares, with weight rho'(s) at the squared norm s of
+// the weighted residual.
+class PoseGraphOptimizer
+{
+public:
+    PoseGraphOptimizer();
+
+    void setVerbose(bool onoff);
+    void setMaxIterations(int maxIterations);
+
+    // The loss function is not owned by the optimizer.
+    void addEdge(const OdometryPtr& pose0, const OdometryPtr& pose1,
+                 const Transform& meas_T_01,
+                 const std::vector<double>& weight,
+                 const double* scale = 0,
+                 ceres::LossFunction* lossFunction = 0);
+
+    void setVertexConstant(const OdometryPtr& pose);
+
+    // Optimizes the vertex poses starting from the result of the previous
+    // call, and writes them back to the odometry vertices.
+    // Returns the number of iterations performed.
+    int solve(void);
+
+    double cost(void) const;
+
+private:
+    typedef Eigen::Matrix<double,6,6> Matrix6d;
+    typedef Eigen::Matrix<double,6,1> Vector6d;
+    typedef std::vector<Matrix6d, Eigen::aligned_allocator<Matrix6d> > Matrix6dVector;
+
+    struct Vertex
+    {
+        OdometryPtr pose;
+        Eigen::Matrix3d R;
+        Eigen::Vector3d t;
+        bool constant;
+        // index of the tangent block in the elimination order,
+        // or -1 if the vertex is constant
+        int block;
+    };
+
+    struct Edge
+    {
+        EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+        int vertex[2];
+        Eigen::Matrix3d meas_R_01;
+        Eigen::Vector3d meas_t_01;
+        Vector6d weight;
+        const double* scale;
+        ceres::LossFunction* lossFunction;
+        // location of the off-diagonal Hessian block in the factor
+        int column;
+        int offset;
+    };
+
+    int addVertex(const OdometryPtr& pose);
+
+    // Returns the cost of the edge. The residual and the Jacobians
+    // are weighted, and scaled by the square root of the IRLS weight.
+    double evaluateEdge(const Edge& edge,
+                        const std::vector<Vertex>& vertices,
+                        Vector6d& residual,
+                        Matrix6d* J0 = 0, Matrix6d* J1 = 0) const;
+    double evaluateCost(const std::vector<Vertex>& vertices) const;
+    double linearize(void);
+
+    void analyzeStructure(void);
+    bool factorize(double lambda);
+    void solveFactorized(Eigen::VectorXd& x) const;
+
+    int findBlock(int row, int column) const;
+
+    std::vector<Vertex> m_vertices;
+    std::vector<Edge, Eigen::aligned_allocator<Edge> > m_edges;
+    std::map<const Odometry*, int> m_vertexMap;
+
+    // Hessian and gradient in the elimination order
+    Matrix6dVector m_hessianDiag;
+    std::vector<Matrix6dVector> m_hessianCols;
+    Eigen::VectorXd m_gradient;
+
+    // lower-triangular block factor; m_factorRows[j] holds the sorted
+    // block rows below the diagonal of block column j
+    std::vector<std::vector<int> > m_factorRows;
+    Matrix6dVector m_factorDiag;
+    std::vector<Matrix6dVector> m_factorCols;
+    bool m_structureValid;
+
+    int m_maxIterations;
+    bool m_verbose;
+};
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+#include <ceres/loss_function.h>
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include "PoseGraphOptimizer.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// two laps of a circle with varying height, pitch and roll
+void
+generateTrajectory(std::vector<OdometryPtr>& poses, int nPosesPerLap)
+{
+    for (int i = 0; i < 2 * nPosesPerLap; ++i)
+    {
+        double theta = 2.0 * M_PI * i / nPosesPerLap;
+
+        OdometryPtr pose(new Odometry);
+        pose->position() << 20.0 * cos(theta), 20.0 * sin(theta), sin(3.0 * theta) + 0.01 * i;
+        pose->attitude() << theta + M_PI / 2.0, 0.1 * sin(theta), 0.05 * cos(2.0 * theta);
+
+        poses.push_back(pose);
+    }
+}
+
+OdometryPtr
+perturb(const OdometryConstPtr& pose, cv::RNG& rng, double sigma)
+{
+    OdometryPtr perturbed(new Odometry);
+    *perturbed = *pose;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        perturbed->position()(i) += rng.gaussian(sigma);
+        perturbed->attitude()(i) += rng.gaussian(sigma * 0.1);
+    }
+
+    return perturbed;
+}
+
+Transform
+relativeTransform(const OdometryConstPtr& pose0, const OdometryConstPtr& pose1)
+{
+    return Transform(pose1->toMatrix().inverse() * pose0->toMatrix());
+}
+
+double
+maxPositionError(const std::vector<OdometryPtr>& poses,
+                 const std::vector<OdometryPtr>& posesTrue)
+{
+    double maxError = 0.0;
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        maxError = std::max(maxError,
+                            (poses.at(i)->position() - posesTrue.at(i)->position()).norm());
+    }
+
+    return maxError;
+}
+
+}
+
+TEST(PoseGraphOptimizer, ExactMeasurements)
+{
+    cv::RNG rng;
+
+    const int nPosesPerLap = 100;
+
+    std::vector<OdometryPtr> posesTrue;
+    generateTrajectory(posesTrue, nPosesPerLap);
+
+    std::vector<OdometryPtr> poses;
+    poses.push_back(posesTrue.front());
+    for (size_t i = 1; i < posesTrue.size(); ++i)
+    {
+        poses.push_back(perturb(posesTrue.at(i), rng, 0.5));
+    }
+
+    std::vector<double> weight(6, 1.0);
+
+    PoseGraphOptimizer optimizer;
+    for (size_t i = 0; i + 1 < poses.size(); ++i)
+    {
+        optimizer.addEdge(poses.at(i), poses.at(i + 1),
+                          relativeTransform(posesTrue.at(i), posesTrue.at(i + 1)),
+                          weight);
+    }
+    for (int i = 0; i < nPosesPerLap; i += 10)
+    {
+        optimizer.addEdge(poses.at(i), poses.at(i + nPosesPerLap),
+                          relativeTransform(posesTrue.at(i), posesTrue.at(i + nPosesPerLap)),
+                          weight);
+    }
+    optimizer.setVertexConstant(poses.front());
+
+    EXPECT_GT(optimizer.solve(), 0);
+    EXPECT_LT(optimizer.cost(), 1e-12);
+    EXPECT_LT(maxPositionError(poses, posesTrue), 1e-5);
+
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        Eigen::Matrix4d H_err = poses.at(i)->toMatrix().inverse() * posesTrue.at(i)->toMatrix();
+
+        EXPECT_LT((H_err - Eigen::Matrix4d::Identity()).norm(), 1e-5);
+    }
+}
+
+TEST(PoseGraphOptimizer, SwitchedLoopClosures)
+{
+    cv::RNG rng;
+
+    const int nPosesPerLap = 100;
+
+    std::vector<OdometryPtr> posesTrue;
+    generateTrajectory(posesTrue, nPosesPerLap);
+
+    std::vector<OdometryPtr> poses;
+    for (size_t i = 0; i < posesTrue.size(); ++i)
+    {
+        poses.push_back(perturb(posesTrue.at(i), rng, 0.0));
+    }
+
+    std::vector<double> weight(6, 1.0);
+
+    // one loop closure edge is a gross outlier
+    std::vector<double> switches;
+    std::vector<Transform, Eigen::aligned_allocator<Transform> > loopClosures;
+    for (int i = 0; i < nPosesPerLap; i += 10)
+    {
+        loopClosures.push_back(relativeTransform(posesTrue.at(i), posesTrue.at(i + nPosesPerLap)));
+        switches.push_back(1.0);
+    }
+    loopClosures.at(3).translation() += Eigen::Vector3d(5.0, -5.0, 1.0);
+    switches.at(3) = 0.0;
+
+    ceres::CauchyLoss lossFunction(0.01);
+
+    PoseGraphOptimizer optimizer;
+    for (size_t i = 0; i + 1 < poses.size(); ++i)
+    {
+        optimizer.addEdge(poses.at(i), poses.at(i + 1),
+                          relativeTransform(posesTrue.at(i), posesTrue.at(i + 1)),
+                          weight);
+    }
+    for (size_t i = 0; i < loopClosures.size(); ++i)
+    {
+        optimizer.addEdge(poses.at(i * 10), poses.at(i * 10 + nPosesPerLap),
+                          loopClosures.at(i), weight, &switches.at(i),
+                          &lossFunction);
+    }
+    optimizer.setVertexConstant(poses.front());
+
+    // the outlier is switched off, and the poses stay at the ground truth
+    optimizer.solve();
+    EXPECT_LT(maxPositionError(poses, posesTrue), 1e-6);
+
+    // with the outlier switched on, the robust loss keeps the trajectory
+    // close to the ground truth
+    switches.at(3) = 1.0;
+    EXPECT_GT(optimizer.solve(), 0);
+    EXPECT_GT(maxPositionError(poses, posesTrue), 1e-5);
+    EXPECT_LT(maxPositionError(poses, posesTrue), 1e-2);
+
+    // switching it off again recovers the ground truth
+    switches.at(3) = 0.0;
+    EXPECT_GT(optimizer.solve(), 0);
+    EXPECT_LT(maxPositionError(poses, posesTrue), 1e-4);
+}
+
+}
@@ -0,0 +1,138 @@
+#ifndef POSITIONKDTREE_H
+#define POSITIONKDTREE_H
+
+#include <algorithm>
+#include <vector>
+
+#include <Eigen/Dense>
+
+namespace camodocal
+{
+
+// Static 3D kd-tree over a set of positions for radius queries.
+// The tree is stored implicitly: each range of the index array is split
+// at its median along the axis of largest extent, and the splitting axis
+// is stored at the position of the median.
+class PositionKdTree
+{
+public:
+    PositionKdTree(const std::vector<Eigen::Vector3d>& points)
+     : mPoints(points)
+     , mAxis(points.size(), 0)
+     , k_leafSize(8)
+    {
+        mIndices.resize(points.size());
+        for (size_t i = 0; i < mIndices.size(); ++i)
+        {
+            mIndices.at(i) = i;
+        }
+
+        build(0, mIndices.size());
+    }
+
+    // Collects the indices of the points within the given radius of p,
+    // sorted in ascending order.
+    void radiusSearch(const Eigen::Vector3d& p, double radius,
+                      std::vector<int>& indices) const
+    {
+        indices.clear();
+
+        search(0, mIndices.size(), p, radius, indices);
+
+        std::sort(indices.begin(), indices.end());
+    }
+
+private:
+    class AxisLess
+    {
+    public:
+        AxisLess(const std::vector<Eigen::Vector3d>& points, int axis)
+         : mPoints(points)
+         , mAxis(axis)
+        {
+
+        }
+
+        bool operator()(int a, int b) const
+        {
+            return mPoints[a](mAxis) < mPoints[b](mAxis);
+        }
+
+    private:
+        const std::vector<Eigen::Vector3d>& mPoints;
+        int mAxis;
+    };
+
+    void build(int begin, int end)
+    {
+        if (end - begin <= k_leafSize)
+        {
+            return;
+        }
+
+        Eigen::Vector3d minP = mPoints[mIndices[begin]];
+        Eigen::Vector3d maxP = minP;
+        for (int i = begin + 1; i < end; ++i)
+        {
+            minP = minP.cwiseMin(mPoints[mIndices[i]]);
+            maxP = maxP.cwiseMax(mPoints[mIndices[i]]);
+        }
+
+        int axis;
+        (maxP - minP).maxCoeff(&axis);
+
+        int mid = (begin + end) / 2;
+        std::nth_element(mIndices.begin() + begin, mIndices.begin() + mid,
+                         mIndices.begin() + end, AxisLess(mPoints, axis));
+        mAxis[mid] = axis;
+
+        build(begin, mid);
+        build(mid + 1, end);
+    }
+
+    void search(int begin, int end, const Eigen::Vector3d& p, double radius,
+                std::vector<int>& indices) const
+    {
+        double radius2 = radius * radius;
+
+        if (end - begin <= k_leafSize)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                if ((mPoints[mIndices[i]] - p).squaredNorm() <= radius2)
+                {
+                    indices.push_back(mIndices[i]);
+                }
+            }
+            return;
+        }
+
+        int mid = (begin + end) / 2;
+        const Eigen::Vector3d& q = mPoints[mIndices[mid]];
+
+        if ((q - p).squaredNorm() <= radius2)
+        {
+            indices.push_back(mIndices[mid]);
+        }
+
+        double d = p(mAxis[mid]) - q(mAxis[mid]);
+        if (d <= radius)
+        {
+            search(begin, mid, p, radius, indices);
+        }
+        if (d >= -radius)
+        {
+            search(mid + 1, end, p, radius, indices);
+        }
+    }
+
+    const std::vector<Eigen::Vector3d> mPoints;
+    std::vector<int> mIndices;
+    std::vector<int> mAxis;
+
+    const int k_leafSize;
+};
+
+}
+
+#endif
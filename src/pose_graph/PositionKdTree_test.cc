@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include <opencv2/core/core.hpp>
+
+#include "PositionKdTree.h"
+
+namespace camodocal
+{
+
+TEST(PositionKdTree, RadiusSearch)
+{
+    cv::RNG rng;
+
+    // positions along a noisy trajectory with repeated visits
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 1000; ++i)
+    {
+        double s = (i % 250) * 0.4;
+        points.push_back(Eigen::Vector3d(s + rng.uniform(-1.0, 1.0),
+                                         0.1 * s * s + rng.uniform(-1.0, 1.0),
+                                         rng.uniform(-0.1, 0.1)));
+    }
+
+    PositionKdTree kdTree(points);
+
+    for (int k = 0; k < 100; ++k)
+    {
+        Eigen::Vector3d p(rng.uniform(-10.0, 110.0),
+                          rng.uniform(-10.0, 1000.0),
+                          0.0);
+        double radius = rng.uniform(0.5, 50.0);
+
+        std::vector<int> expected;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            if ((points.at(i) - p).norm() <= radius)
+            {
+                expected.push_back(i);
+            }
+        }
+
+        std::vector<int> indices;
+        kdTree.radiusSearch(p, radius, indices);
+
+        EXPECT_EQ(expected, indices);
+    }
+}
+
+TEST(PositionKdTree, Empty)
+{
+    std::vector<Eigen::Vector3d> points;
+    PositionKdTree kdTree(points);
+
+    std::vector<int> indices(1, 0);
+    kdTree.radiusSearch(Eigen::Vector3d::Zero(), 1.0, indices);
+
+    EXPECT_TRUE(indices.empty());
+}
+
+}
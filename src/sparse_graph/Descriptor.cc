@@ -0,0 +1,459 @@
+#include <camodocal/sparse_graph/Descriptor.h>
+
+#include <algorithm>
+#include <boost/cstdint.hpp>
+#include <cmath>
+#include <cstring>
+#if defined(__AVX__) || defined(__F16C__) || defined(__POPCNT__)
+#include <immintrin.h>
+#endif
+
+namespace camodocal
+{
+
+namespace
+{
+
+unsigned short
+floatToHalf(float f)
+{
+#ifdef __F16C__
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    boost::uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+
+    boost::uint32_t sign = (x >> 16) & 0x8000;
+    boost::uint32_t mantissa = x & 0x7fffff;
+    int exponent = static_cast<int>((x >> 23) & 0xff) - 127 + 15;
+
+    if (((x >> 23) & 0xff) == 0xff)
+    {
+        // infinity or NaN
+        return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+    }
+    if (exponent >= 31)
+    {
+        return sign | 0x7c00;
+    }
+
+    boost::uint32_t h;
+    boost::uint32_t remainder;
+    boost::uint32_t halfway;
+    if (exponent <= 0)
+    {
+        // subnormal
+        if (exponent < -10)
+        {
+            return sign;
+        }
+
+        int shift = 14 - exponent;
+        mantissa |= 0x800000;
+
+        h = mantissa >> shift;
+        remainder = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        h = (static_cast<boost::uint32_t>(exponent) << 10) | (mantissa >> 13);
+        remainder = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+
+    // round to nearest even; a carry into the exponent is correct
+    if (remainder > halfway || (remainder == halfway && (h & 1)))
+    {
+        ++h;
+    }
+
+    return sign | h;
+#endif
+}
+
+float
+halfToFloat(unsigned short h)
+{
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    boost::uint32_t sign = static_cast<boost::uint32_t>(h & 0x8000) << 16;
+    boost::uint32_t exponent = (h >> 10) & 0x1f;
+    boost::uint32_t mantissa = h & 0x3ff;
+
+    if (exponent == 0)
+    {
+        // zero or subnormal
+        float f = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -f : f;
+    }
+
+    boost::uint32_t x;
+    if (exponent == 31)
+    {
+        x = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        x = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+#endif
+}
+
+#ifdef __AVX__
+float
+horizontalSum(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+__m256
+squaredDifferenceSum(__m256 acc, __m256 a, __m256 b)
+{
+    __m256 d = _mm256_sub_ps(a, b);
+#ifdef __FMA__
+    return _mm256_fmadd_ps(d, d, acc);
+#else
+    return _mm256_add_ps(acc, _mm256_mul_ps(d, d));
+#endif
+}
+#endif
+
+#ifdef __AVX2__
+int
+horizontalSum(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+
+// acc + sums of adjacent products of 16-bit integers
+__m256i
+dotProductSum(__m256i acc, __m256i a, __m256i b)
+{
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+    return _mm256_dpwssd_epi32(acc, a, b);
+#elif defined(__AVXVNNI__)
+    return _mm256_dpwssd_avx_epi32(acc, a, b);
+#else
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(a, b));
+#endif
+}
+#endif
+
+float
+distanceFloat(const float* a, const float* b, int n)
+{
+    float sum = 0.0f;
+    int i = 0;
+#ifdef __AVX__
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        acc = squaredDifferenceSum(acc, _mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i)
+    {
+        float d = a[i] - b[i];
+        sum += d * d;
+    }
+
+    return sum;
+}
+
+float
+distanceHalf(const unsigned short* a, const unsigned short* b, int n)
+{
+    float sum = 0.0f;
+    int i = 0;
+#if defined(__AVX__) && defined(__F16C__)
+    __m256 acc = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 va = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256 vb = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = squaredDifferenceSum(acc, va, vb);
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i)
+    {
+        float d = halfToFloat(a[i]) - halfToFloat(b[i]);
+        sum += d * d;
+    }
+
+    return sum;
+}
+
+// |a - b|^2 = |a|^2 + |b|^2 - 2 sa sb qa.qb, where the dot product of
+// the quantized values is exact in integer arithmetic
+float
+distanceInt8(const signed char* a, float sa, float aa,
+             const signed char* b, float sb, float bb, int n)
+{
+    int ab = 0;
+    int i = 0;
+#ifdef __AVX2__
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+
+        acc = dotProductSum(acc, va, vb);
+    }
+    ab = horizontalSum(acc);
+#endif
+    for (; i < n; ++i)
+    {
+        ab += a[i] * b[i];
+    }
+
+    double d = static_cast<double>(aa) + bb - 2.0 * static_cast<double>(sa) * sb * ab;
+
+    return d > 0.0 ? static_cast<float>(d) : 0.0f;
+}
+
+// number of bytes which hold the scale and the squared norm
+const int k_int8Trailer = 2 * sizeof(float);
+
+void
+int8Trailer(const cv::Mat& dtor, float& scale, float& squaredNorm)
+{
+    const signed char* p = dtor.ptr<signed char>(0) + dtor.cols - k_int8Trailer;
+
+    memcpy(&scale, p, sizeof(float));
+    memcpy(&squaredNorm, p + sizeof(float), sizeof(float));
+}
+
+}
+
+int
+hammingDistance(const unsigned char* a, const unsigned char* b, int n)
+{
+    int i = 0;
+#if defined(__AVX512VPOPCNTDQ__) && defined(__AVX512VL__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        acc = _mm256_add_epi64(acc, _mm256_popcnt_epi64(x));
+    }
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    boost::uint64_t count = _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+#elif defined(__AVX2__)
+    // bit counts of the nibbles by table lookup, summed per 64 bits
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0f);
+
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+                                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(x, lowMask));
+        __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), lowMask));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+    }
+    __m128i s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    boost::uint64_t count = _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+#else
+    boost::uint64_t count = 0;
+#endif
+    for (; i + 8 <= n; i += 8)
+    {
+        boost::uint64_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+#ifdef __POPCNT__
+        count += _mm_popcnt_u64(x ^ y);
+#else
+        count += __builtin_popcountll(x ^ y);
+#endif
+    }
+    for (; i < n; ++i)
+    {
+        count += __builtin_popcount(a[i] ^ b[i]);
+    }
+
+    return static_cast<int>(count);
+}
+
+cv::Mat
+compactDescriptor(const cv::Mat& dtor, DescriptorFormat format)
+{
+    const float* d = dtor.ptr<float>(0);
+    const int n = dtor.cols;
+
+    switch (format)
+    {
+    case DESCRIPTOR_HALF:
+    {
+        cv::Mat half(1, n, CV_16UC1);
+        unsigned short* h = half.ptr<unsigned short>(0);
+
+        for (int i = 0; i < n; ++i)
+        {
+            h[i] = floatToHalf(d[i]);
+        }
+
+        return half;
+    }
+    case DESCRIPTOR_INT8:
+    {
+        float maxAbs = 0.0f;
+        for (int i = 0; i < n; ++i)
+        {
+            maxAbs = std::max(maxAbs, std::fabs(d[i]));
+        }
+
+        float scale = maxAbs / 127.0f;
+        float invScale = (scale > 0.0f) ? 1.0f / scale : 0.0f;
+
+        cv::Mat q(1, n + k_int8Trailer, CV_8SC1);
+        signed char* p = q.ptr<signed char>(0);
+
+        int qq = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            float v = std::floor(d[i] * invScale + 0.5f);
+            p[i] = static_cast<signed char>(std::max(-127.0f, std::min(127.0f, v)));
+
+            qq += p[i] * p[i];
+        }
+
+        // the squared norm of the quantized descriptor
+        float squaredNorm = static_cast<double>(scale) * scale * qq;
+
+        memcpy(p + n, &scale, sizeof(float));
+        memcpy(p + n + sizeof(float), &squaredNorm, sizeof(float));
+
+        return q;
+    }
+    case DESCRIPTOR_FLOAT:
+    default:
+        return dtor;
+    }
+}
+
+cv::Mat
+expandDescriptor(const cv::Mat& dtor)
+{
+    switch (dtor.type())
+    {
+    case CV_16UC1:
+    {
+        cv::Mat f(1, dtor.cols, CV_32FC1);
+        const unsigned short* h = dtor.ptr<unsigned short>(0);
+        float* d = f.ptr<float>(0);
+
+        for (int i = 0; i < dtor.cols; ++i)
+        {
+            d[i] = halfToFloat(h[i]);
+        }
+
+        return f;
+    }
+    case CV_8SC1:
+    {
+        const int n = dtor.cols - k_int8Trailer;
+
+        float scale, squaredNorm;
+        int8Trailer(dtor, scale, squaredNorm);
+
+        cv::Mat f(1, n, CV_32FC1);
+        const signed char* q = dtor.ptr<signed char>(0);
+        float* d = f.ptr<float>(0);
+
+        for (int i = 0; i < n; ++i)
+        {
+            d[i] = q[i] * scale;
+        }
+
+        return f;
+    }
+    default:
+        return dtor;
+    }
+}
+
+float
+descriptorDistanceSquared(const cv::Mat& dtor1, const cv::Mat& dtor2)
+{
+    if (dtor1.type() == dtor2.type())
+    {
+        switch (dtor1.type())
+        {
+        case CV_32FC1:
+            return distanceFloat(dtor1.ptr<float>(0), dtor2.ptr<float>(0), dtor1.cols);
+        case CV_16UC1:
+            return distanceHalf(dtor1.ptr<unsigned short>(0),
+                                dtor2.ptr<unsigned short>(0), dtor1.cols);
+        case CV_8UC1:
+        {
+            // binary descriptors
+            float d = hammingDistance(dtor1.ptr<unsigned char>(0),
+                                      dtor2.ptr<unsigned char>(0), dtor1.cols);
+            return d * d;
+        }
+        case CV_8SC1:
+        {
+            float scale1, squaredNorm1, scale2, squaredNorm2;
+            int8Trailer(dtor1, scale1, squaredNorm1);
+            int8Trailer(dtor2, scale2, squaredNorm2);
+
+            return distanceInt8(dtor1.ptr<signed char>(0), scale1, squaredNorm1,
+                                dtor2.ptr<signed char>(0), scale2, squaredNorm2,
+                                dtor1.cols - k_int8Trailer);
+        }
+        }
+    }
+
+    // mixed types, e.g. a query frame against compacted graph frames
+    cv::Mat d1 = expandDescriptor(dtor1);
+    cv::Mat d2 = expandDescriptor(dtor2);
+    if (d1.type() == CV_32FC1 && d2.type() == CV_32FC1)
+    {
+        return distanceFloat(d1.ptr<float>(0), d2.ptr<float>(0), d1.cols);
+    }
+
+    return cv::norm(d1, d2, cv::NORM_L2SQR);
+}
+
+void
+compactDescriptors(const std::vector<Point2DFeaturePtr>& features,
+                   DescriptorFormat format)
+{
+    for (size_t i = 0; i < features.size(); ++i)
+    {
+        cv::Mat& dtor = features.at(i)->descriptor();
+        if (dtor.empty())
+        {
+            continue;
+        }
+
+        cv::Mat f = expandDescriptor(dtor);
+        if (f.type() != CV_32FC1)
+        {
+            continue;
+        }
+
+        dtor = compactDescriptor(f, format);
+    }
+}
+
+}
@@ -0,0 +1,220 @@
+#include <camodocal/sparse_graph/Descriptor.h>
+#include <cmath>
+#include <ctime>
+#include <gtest/gtest.h>
+#include <iostream>
+
+namespace camodocal
+{
+
+namespace
+{
+
+// unit-length descriptors, as produced by SURF
+cv::Mat
+generateDescriptor(cv::RNG& rng, int n)
+{
+    cv::Mat dtor(1, n, CV_32FC1);
+    float* d = dtor.ptr<float>(0);
+
+    float norm = 0.0f;
+    for (int i = 0; i < n; ++i)
+    {
+        d[i] = rng.gaussian(1.0);
+        norm += d[i] * d[i];
+    }
+
+    norm = std::sqrt(norm);
+    for (int i = 0; i < n; ++i)
+    {
+        d[i] /= norm;
+    }
+
+    return dtor;
+}
+
+cv::Mat
+perturbDescriptor(cv::RNG& rng, const cv::Mat& dtor, double sigma)
+{
+    cv::Mat perturbed(1, dtor.cols, CV_32FC1);
+
+    for (int i = 0; i < dtor.cols; ++i)
+    {
+        perturbed.ptr<float>(0)[i] = dtor.ptr<float>(0)[i] + rng.gaussian(sigma);
+    }
+
+    return perturbed;
+}
+
+int
+nearestNeighbour(const cv::Mat& query, const std::vector<cv::Mat>& train)
+{
+    int index = -1;
+    float minDistance = 0.0f;
+    for (size_t i = 0; i < train.size(); ++i)
+    {
+        float d = descriptorDistanceSquared(query, train.at(i));
+        if (index == -1 || d < minDistance)
+        {
+            index = i;
+            minDistance = d;
+        }
+    }
+
+    return index;
+}
+
+// Fraction of queries whose nearest neighbour among the compacted train
+// descriptors is the nearest neighbour found with float descriptors.
+double
+recall(DescriptorFormat type)
+{
+    const int n = 64;
+    const int nTrain = 2000;
+    const int nQueries = 500;
+
+    cv::RNG rng(0);
+
+    std::vector<cv::Mat> train, compactTrain;
+    for (int i = 0; i < nTrain; ++i)
+    {
+        train.push_back(generateDescriptor(rng, n));
+        compactTrain.push_back(compactDescriptor(train.back(), type));
+    }
+
+    std::vector<cv::Mat> queries, compactQueries;
+    for (int i = 0; i < nQueries; ++i)
+    {
+        queries.push_back(perturbDescriptor(rng, train.at(rng.uniform(0, nTrain)), 0.15));
+        compactQueries.push_back(compactDescriptor(queries.back(), type));
+    }
+
+    clock_t start = clock();
+
+    std::vector<int> compactMatches(nQueries);
+    for (int i = 0; i < nQueries; ++i)
+    {
+        compactMatches.at(i) = nearestNeighbour(compactQueries.at(i), compactTrain);
+    }
+
+    double duration = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+    int nCorrect = 0;
+    for (int i = 0; i < nQueries; ++i)
+    {
+        if (compactMatches.at(i) == nearestNeighbour(queries.at(i), train))
+        {
+            ++nCorrect;
+        }
+    }
+
+    double r = static_cast<double>(nCorrect) / nQueries;
+
+    std::cout << "# INFO: Descriptor format " << type << ": recall " << r
+              << ", " << duration * 1e9 / (static_cast<double>(nQueries) * nTrain)
+              << " ns per distance, " << compactTrain.front().cols * compactTrain.front().elemSize()
+              << " bytes per descriptor." << std::endl;
+
+    return r;
+}
+
+void
+testDistance(DescriptorFormat type, double tolerance)
+{
+    cv::RNG rng(1);
+
+    // odd length to cover the scalar tail of the kernels
+    for (int n = 63; n <= 64; ++n)
+    {
+        for (int i = 0; i < 100; ++i)
+        {
+            cv::Mat d1 = generateDescriptor(rng, n);
+            cv::Mat d2 = perturbDescriptor(rng, d1, 0.1);
+
+            cv::Mat c1 = compactDescriptor(d1, type);
+            cv::Mat c2 = compactDescriptor(d2, type);
+
+            float expected = descriptorDistanceSquared(d1, d2);
+
+            // agrees with the float distance of the decoded descriptors
+            EXPECT_NEAR(descriptorDistanceSquared(c1, c2),
+                        descriptorDistanceSquared(expandDescriptor(c1), expandDescriptor(c2)),
+                        1e-5);
+            EXPECT_NEAR(descriptorDistanceSquared(c1, c2), expected, tolerance);
+
+            // mixed types
+            EXPECT_NEAR(descriptorDistanceSquared(d1, c2), expected, tolerance);
+
+            cv::Mat e1 = expandDescriptor(c1);
+            ASSERT_EQ(e1.cols, n);
+            for (int j = 0; j < n; ++j)
+            {
+                EXPECT_NEAR(e1.ptr<float>(0)[j], d1.ptr<float>(0)[j], tolerance);
+            }
+        }
+    }
+}
+
+}
+
+TEST(Descriptor, DistanceFloat)
+{
+    testDistance(DESCRIPTOR_FLOAT, 1e-6);
+}
+
+TEST(Descriptor, DistanceHalf)
+{
+    testDistance(DESCRIPTOR_HALF, 1e-3);
+}
+
+TEST(Descriptor, DistanceInt8)
+{
+    testDistance(DESCRIPTOR_INT8, 1e-2);
+}
+
+TEST(Descriptor, Hamming)
+{
+    cv::RNG rng(2);
+
+    // 32-byte ORB and 64-byte BRISK descriptors, and lengths which
+    // cover the tails of the kernel
+    const int lengths[] = {32, 64, 45, 7};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l)
+    {
+        const int n = lengths[l];
+
+        for (int i = 0; i < 100; ++i)
+        {
+            cv::Mat d1(1, n, CV_8UC1);
+            cv::Mat d2(1, n, CV_8UC1);
+            for (int j = 0; j < n; ++j)
+            {
+                d1.ptr<unsigned char>(0)[j] = rng.uniform(0, 256);
+                d2.ptr<unsigned char>(0)[j] = rng.uniform(0, 256);
+            }
+
+            int expected = 0;
+            for (int j = 0; j < n; ++j)
+            {
+                unsigned char x = d1.ptr<unsigned char>(0)[j] ^ d2.ptr<unsigned char>(0)[j];
+                for (; x != 0; x >>= 1)
+                {
+                    expected += x & 1;
+                }
+            }
+
+            EXPECT_EQ(hammingDistance(d1.ptr<unsigned char>(0), d2.ptr<unsigned char>(0), n),
+                      expected);
+            EXPECT_EQ(descriptorDistanceSquared(d1, d2), expected * expected);
+        }
+    }
+}
+
+TEST(Descriptor, Recall)
+{
+    EXPECT_EQ(recall(DESCRIPTOR_FLOAT), 1.0);
+    EXPECT_GE(recall(DESCRIPTOR_HALF), 0.99);
+    EXPECT_GE(recall(DESCRIPTOR_INT8), 0.97);
+}
+
+}
@@ -0,0 +1,410 @@
+#include <camodocal/sparse_graph/ImageStore.h>
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iostream>
+#include <opencv2/highgui/highgui.hpp>
+#include <sstream>
+
+namespace camodocal
+{
+
+ImageStore::ImageStore(const std::string& directory,
+                       Format format,
+                       size_t cacheSize,
+                       int nThreads)
+ : k_directory(directory)
+ , k_format(format)
+ , k_cacheSize(cacheSize)
+ , m_nextKey(0)
+ , m_cachedBytes(0)
+ , m_pendingBytes(0)
+ , m_stop(false)
+{
+    boost::filesystem::create_directories(k_directory);
+
+    m_threads.resize(std::max(nThreads, 1));
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads.at(i).reset(new boost::thread(&ImageStore::processJobs, this));
+    }
+}
+
+ImageStore::~ImageStore()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_stop = true;
+    }
+    m_jobCond.notify_all();
+
+    for (size_t i = 0; i < m_threads.size(); ++i)
+    {
+        m_threads.at(i)->join();
+    }
+
+    for (boost::unordered_map<size_t, Entry>::iterator it = m_entries.begin();
+            it != m_entries.end(); ++it)
+    {
+        if (it->second.written)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(it->second.filename, ec);
+        }
+    }
+}
+
+size_t
+ImageStore::add(const cv::Mat& image)
+{
+    Entry entry;
+    entry.image = image;
+    entry.bytes = image.total() * image.elemSize();
+    entry.pending = true;
+    entry.written = false;
+    entry.cached = false;
+    entry.prefetching = false;
+
+    bool png = k_format == PNG &&
+               (image.depth() == CV_8U || image.depth() == CV_16U) &&
+               image.channels() != 2;
+
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    // limit the memory held by images which are waiting to be written
+    while (m_pendingBytes > 0 && m_pendingBytes + entry.bytes > k_cacheSize)
+    {
+        m_writtenCond.wait(lock);
+    }
+
+    size_t key = m_nextKey++;
+
+    std::ostringstream oss;
+    oss << key << (png ? ".png" : ".raw");
+
+    boost::filesystem::path filename(k_directory);
+    filename /= oss.str();
+    entry.filename = filename.string();
+
+    m_entries[key] = entry;
+    m_pendingBytes += entry.bytes;
+
+    Job job;
+    job.key = key;
+    job.write = true;
+    m_jobs.push_back(job);
+
+    m_jobCond.notify_one();
+
+    return key;
+}
+
+cv::Mat
+ImageStore::get(size_t key)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    return loadImage(lock, key);
+}
+
+void
+ImageStore::prefetch(size_t key)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    boost::unordered_map<size_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+
+    Entry& entry = it->second;
+    if (!entry.written || !entry.image.empty() || entry.prefetching)
+    {
+        return;
+    }
+
+    entry.prefetching = true;
+
+    Job job;
+    job.key = key;
+    job.write = false;
+    m_jobs.push_back(job);
+
+    m_jobCond.notify_one();
+}
+
+void
+ImageStore::remove(size_t key)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    boost::unordered_map<size_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        return;
+    }
+
+    Entry& entry = it->second;
+    if (entry.cached)
+    {
+        m_lru.erase(entry.lruIt);
+        m_cachedBytes -= entry.bytes;
+    }
+
+    if (entry.written)
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove(entry.filename, ec);
+    }
+    else if (entry.pending)
+    {
+        // the file is deleted once it is written
+        m_pendingBytes -= entry.bytes;
+        m_writtenCond.notify_all();
+    }
+
+    m_entries.erase(it);
+}
+
+size_t
+ImageStore::size(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_entries.size();
+}
+
+size_t
+ImageStore::cachedBytes(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_cachedBytes;
+}
+
+void
+ImageStore::processJobs(void)
+{
+    while (true)
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        while (!m_stop && m_jobs.empty())
+        {
+            m_jobCond.wait(lock);
+        }
+
+        if (m_stop)
+        {
+            return;
+        }
+
+        Job job = m_jobs.front();
+        m_jobs.pop_front();
+
+        boost::unordered_map<size_t, Entry>::iterator it = m_entries.find(job.key);
+        if (it == m_entries.end())
+        {
+            continue;
+        }
+
+        std::string filename = it->second.filename;
+        cv::Mat image = it->second.image;
+
+        lock.unlock();
+
+        if (job.write)
+        {
+            bool success = writeImage(filename, image);
+
+            lock.lock();
+
+            it = m_entries.find(job.key);
+            if (it == m_entries.end())
+            {
+                // removed while being written
+                boost::system::error_code ec;
+                boost::filesystem::remove(filename, ec);
+                continue;
+            }
+
+            Entry& entry = it->second;
+
+            entry.pending = false;
+            m_pendingBytes -= entry.bytes;
+            m_writtenCond.notify_all();
+
+            if (!success)
+            {
+                // keep the image in memory
+                std::cout << "# ERROR: Unable to write image to "
+                          << filename << "." << std::endl;
+                continue;
+            }
+
+            entry.written = true;
+
+            cacheImage(entry, job.key);
+            evictImages();
+        }
+        else
+        {
+            image = readImage(filename);
+
+            lock.lock();
+
+            it = m_entries.find(job.key);
+            if (it == m_entries.end())
+            {
+                continue;
+            }
+
+            Entry& entry = it->second;
+            entry.prefetching = false;
+
+            if (entry.image.empty() && !image.empty())
+            {
+                entry.image = image;
+
+                cacheImage(entry, job.key);
+                evictImages();
+            }
+        }
+    }
+}
+
+bool
+ImageStore::writeImage(const std::string& filename, const cv::Mat& image) const
+{
+    if (boost::filesystem::path(filename).extension() == ".png")
+    {
+        return cv::imwrite(filename, image);
+    }
+
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
+
+    int header[3] = {image.rows, image.cols, image.type()};
+    ofs.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    for (int r = 0; r < image.rows; ++r)
+    {
+        ofs.write(image.ptr<char>(r), image.cols * image.elemSize());
+    }
+
+    return ofs.good();
+}
+
+cv::Mat
+ImageStore::readImage(const std::string& filename) const
+{
+    if (boost::filesystem::path(filename).extension() == ".png")
+    {
+        return cv::imread(filename, -1);
+    }
+
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return cv::Mat();
+    }
+
+    int header[3];
+    ifs.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!ifs.good())
+    {
+        return cv::Mat();
+    }
+
+    cv::Mat image(header[0], header[1], header[2]);
+    ifs.read(image.ptr<char>(0), image.total() * image.elemSize());
+    if (!ifs.good())
+    {
+        return cv::Mat();
+    }
+
+    return image;
+}
+
+cv::Mat
+ImageStore::loadImage(boost::unique_lock<boost::mutex>& lock, size_t key)
+{
+    boost::unordered_map<size_t, Entry>::iterator it = m_entries.find(key);
+    if (it == m_entries.end())
+    {
+        return cv::Mat();
+    }
+
+    if (!it->second.image.empty())
+    {
+        if (it->second.cached)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+        }
+
+        return it->second.image;
+    }
+
+    std::string filename = it->second.filename;
+
+    lock.unlock();
+    cv::Mat image = readImage(filename);
+    lock.lock();
+
+    it = m_entries.find(key);
+    if (it == m_entries.end() || image.empty())
+    {
+        return image;
+    }
+
+    Entry& entry = it->second;
+    if (!entry.image.empty())
+    {
+        // loaded concurrently
+        if (entry.cached)
+        {
+            m_lru.splice(m_lru.begin(), m_lru, entry.lruIt);
+        }
+
+        return entry.image;
+    }
+
+    entry.image = image;
+
+    cacheImage(entry, key);
+    evictImages();
+
+    return image;
+}
+
+void
+ImageStore::cacheImage(Entry& entry, size_t key)
+{
+    m_lru.push_front(key);
+    entry.lruIt = m_lru.begin();
+    entry.cached = true;
+
+    m_cachedBytes += entry.bytes;
+}
+
+void
+ImageStore::evictImages(void)
+{
+    while (m_cachedBytes > k_cacheSize && !m_lru.empty())
+    {
+        Entry& entry = m_entries[m_lru.back()];
+        m_lru.pop_back();
+
+        entry.image.release();
+        entry.cached = false;
+
+        m_cachedBytes -= entry.bytes;
+    }
+}
+
+}
@@ -0,0 +1,115 @@
+#include <boost/filesystem.hpp>
+#include <camodocal/sparse_graph/ImageStore.h>
+#include <gtest/gtest.h>
+
+namespace camodocal
+{
+
+namespace
+{
+
+cv::Mat
+generateImage(int rows, int cols, int type, int seed)
+{
+    cv::Mat image(rows, cols, type);
+
+    cv::RNG rng(seed);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 255);
+
+    return image;
+}
+
+bool
+equal(const cv::Mat& image1, const cv::Mat& image2)
+{
+    if (image1.rows != image2.rows || image1.cols != image2.cols ||
+        image1.type() != image2.type())
+    {
+        return false;
+    }
+
+    for (int r = 0; r < image1.rows; ++r)
+    {
+        if (memcmp(image1.ptr(r), image2.ptr(r), image1.cols * image1.elemSize()) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t
+fileCount(const boost::filesystem::path& directory)
+{
+    size_t count = 0;
+    for (boost::filesystem::directory_iterator it(directory);
+            it != boost::filesystem::directory_iterator(); ++it)
+    {
+        ++count;
+    }
+
+    return count;
+}
+
+void
+testRoundTrip(ImageStore::Format format, int type)
+{
+    boost::filesystem::path directory = boost::filesystem::temp_directory_path() /
+                                        boost::filesystem::unique_path();
+
+    const int nImages = 20;
+    const size_t imageBytes = 64 * 48 * CV_ELEM_SIZE(type);
+
+    std::vector<cv::Mat> images;
+    std::vector<size_t> keys;
+    {
+        // room for 4 images
+        ImageStore store(directory.string(), format, 4 * imageBytes);
+
+        for (int i = 0; i < nImages; ++i)
+        {
+            images.push_back(generateImage(48, 64, type, i));
+            keys.push_back(store.add(images.back()));
+        }
+
+        for (int i = nImages - 1; i >= 0; --i)
+        {
+            if (i > 0)
+            {
+                store.prefetch(keys.at(i - 1));
+            }
+
+            EXPECT_TRUE(equal(store.get(keys.at(i)), images.at(i)));
+            EXPECT_LE(store.cachedBytes(), 4 * imageBytes);
+        }
+
+        store.remove(keys.at(3));
+        EXPECT_TRUE(store.get(keys.at(3)).empty());
+        EXPECT_EQ(store.size(), static_cast<size_t>(nImages - 1));
+    }
+
+    // files are deleted with the store
+    EXPECT_EQ(fileCount(directory), 0u);
+
+    boost::filesystem::remove_all(directory);
+}
+
+}
+
+TEST(ImageStore, RoundTripRaw)
+{
+    testRoundTrip(ImageStore::RAW, CV_8UC1);
+    testRoundTrip(ImageStore::RAW, CV_32FC2);
+}
+
+TEST(ImageStore, RoundTripPng)
+{
+    testRoundTrip(ImageStore::PNG, CV_8UC1);
+    testRoundTrip(ImageStore::PNG, CV_8UC3);
+    testRoundTrip(ImageStore::PNG, CV_16UC1);
+    // stored as RAW
+    testRoundTrip(ImageStore::PNG, CV_32FC1);
+}
+
+}
@@ -13,10 +13,19 @@ namespace camodocal
 
 Frame::Frame()
  : m_cameraId(-1)
+ , m_imageKey(0)
 {
 
 }
 
+Frame::~Frame()
+{
+    if (m_imageStore.get() != 0)
+    {
+        m_imageStore->remove(m_imageKey);
+    }
+}
+
 PosePtr&
 Frame::cameraPose(void)
 {
@@ -89,16 +98,50 @@ Frame::features2D(void) const
     return m_features2D;
 }
 
-cv::Mat&
-Frame::image(void)
+cv::Mat
+Frame::image(void) const
 {
+    if (m_imageStore.get() != 0)
+    {
+        return m_imageStore->get(m_imageKey);
+    }
+
     return m_image;
 }
 
-const cv::Mat&
-Frame::image(void) const
+void
+Frame::setImage(const cv::Mat& image)
 {
-    return m_image;
+    if (m_imageStore.get() != 0)
+    {
+        m_imageStore->remove(m_imageKey);
+        m_imageStore.reset();
+    }
+
+    m_image = image;
+}
+
+void
+Frame::storeImage(const ImageStorePtr& imageStore)
+{
+    if (m_imageStore.get() != 0 || m_image.empty())
+    {
+        return;
+    }
+
+    m_imageKey = imageStore->add(m_image);
+    m_imageStore = imageStore;
+
+    m_image.release();
+}
+
+void
+Frame::prefetchImage(void) const
+{
+    if (m_imageStore.get() != 0)
+    {
+        m_imageStore->prefetch(m_imageKey);
+    }
 }
 
 Point2DFeature::Point2DFeature()
@@ -563,7 +606,7 @@ SparseGraph::readFromBinaryFile(const std::string& filename)
             boost::filesystem::path imagePath = rootDir;
             imagePath /= imageFilename;
 
-            frame->image() = cv::imread(imagePath.string().c_str(), -1);
+            frame->setImage(cv::imread(imagePath.string().c_str(), -1));
 
             delete imageFilename;
         }
@@ -1017,12 +1060,13 @@ SparseGraph::writeToBinaryFile(const std::string& filename) const
         writeData(ofs, it->second);
 
         // attributes
-        if (!frame->image().empty())
+        cv::Mat image = frame->image();
+        if (!image.empty())
         {
             char imageFilename[1024];
             sprintf(imageFilename, "%s/%s.png",
                     imageDir.string().c_str(), frameName);
-            cv::imwrite(imageFilename, frame->image());
+            cv::imwrite(imageFilename, image);
 
             memset(imageFilename, 0, 1024);
             sprintf(imageFilename, "images/%s.png", frameName);
@@ -1,5 +1,8 @@
 #include <camodocal/sparse_graph/SparseGraphUtils.h>
 
+#include <boost/thread.hpp>
+#include <camodocal/sparse_graph/Descriptor.h>
+
 namespace camodocal
 {
 
@@ -15,11 +18,14 @@ buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
          }
     }
 
-    cv::Mat dtor(indices.size(), features.at(0)->descriptor().cols, features.at(0)->descriptor().type());
+    // compact descriptors are matched as floats
+    cv::Mat dtor0 = expandDescriptor(features.at(0)->descriptor());
+
+    cv::Mat dtor(indices.size(), dtor0.cols, dtor0.type());
 
     for (size_t i = 0; i < indices.size(); ++i)
     {
-         features.at(indices.at(i))->descriptor().copyTo(dtor.row(i));
+         expandDescriptor(features.at(indices.at(i))->descriptor()).copyTo(dtor.row(i));
     }
 
     return dtor;
@@ -30,12 +36,13 @@ matchFeatures(const std::vector<Point2DFeaturePtr>& features1,
               const std::vector<Point2DFeaturePtr>& features2,
               float maxDistanceRatio)
 {
-    cv::BFMatcher descriptorMatcher(cv::NORM_L2, false);
-
     std::vector<size_t> indices1, indices2;
     cv::Mat dtor1 = buildDescriptorMat(features1, indices1);
     cv::Mat dtor2 = buildDescriptorMat(features2, indices2);
 
+    // binary descriptors are compared by Hamming distance
+    cv::BFMatcher descriptorMatcher(dtor1.type() == CV_8UC1 ? cv::NORM_HAMMING : cv::NORM_L2, false);
+
     std::vector<std::vector<cv::DMatch> > candidateFwdMatches;
     descriptorMatcher.knnMatch(dtor1, dtor2, candidateFwdMatches, 2);
 
@@ -157,4 +164,73 @@ rectifyImagePoints(const CameraConstPtr& camera,
     }
 }
 
+void
+graphFrames(const SparseGraph& graph, std::vector<FramePtr>& frames)
+{
+    frames.clear();
+
+    for (size_t i = 0; i < graph.frameSetSegments().size(); ++i)
+    {
+        const FrameSetSegment& segment = graph.frameSetSegment(i);
+
+        for (size_t j = 0; j < segment.size(); ++j)
+        {
+            const FrameSetPtr& frameSet = segment.at(j);
+
+            for (size_t k = 0; k < frameSet->frames().size(); ++k)
+            {
+                const FramePtr& frame = frameSet->frames().at(k);
+
+                if (frame.get() == 0)
+                {
+                    continue;
+                }
+
+                frames.push_back(frame);
+            }
+        }
+    }
+}
+
+namespace
+{
+
+void
+parallelForRange(size_t begin, size_t end,
+                 const boost::function<void (size_t)>* f)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        (*f)(i);
+    }
+}
+
+}
+
+void
+parallelFor(size_t n, const boost::function<void (size_t)>& f)
+{
+    size_t nThreads = std::min(static_cast<size_t>(std::max(boost::thread::hardware_concurrency(), 1u)), n);
+
+    if (nThreads <= 1)
+    {
+        parallelForRange(0, n, &f);
+        return;
+    }
+
+    std::vector<boost::shared_ptr<boost::thread> > threads(nThreads);
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        threads.at(i).reset(new boost::thread(&parallelForRange,
+                                              n * i / nThreads,
+                                              n * (i + 1) / nThreads,
+                                              &f));
+    }
+
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        threads.at(i)->join();
+    }
+}
+
 }
@@ -0,0 +1,154 @@
+#include "camodocal/sparse_graph/VisualizationPublisher.h"
+
+#include <algorithm>
+
+namespace camodocal
+{
+
+VisualizationPublisher::VisualizationPublisher(size_t capacity,
+                                               double publishInterval)
+ : k_capacity(std::max(capacity, static_cast<size_t>(1)))
+ , k_publishInterval(publishInterval)
+ , m_attachCount(0)
+ , m_busy(false)
+ , m_stop(false)
+{
+
+}
+
+VisualizationPublisher::~VisualizationPublisher()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_stop = true;
+    }
+
+    m_taskCond.notify_all();
+
+    if (m_thread.get() != 0)
+    {
+        m_thread->join();
+    }
+}
+
+VisualizationPublisher*
+VisualizationPublisher::instance(void)
+{
+    static VisualizationPublisher publisher;
+
+    return &publisher;
+}
+
+void
+VisualizationPublisher::attach(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    ++m_attachCount;
+
+    if (m_thread.get() == 0)
+    {
+        m_thread.reset(new boost::thread(&VisualizationPublisher::processTasks, this));
+    }
+}
+
+void
+VisualizationPublisher::detach(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (m_attachCount > 0)
+    {
+        --m_attachCount;
+    }
+}
+
+bool
+VisualizationPublisher::attached(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_attachCount > 0;
+}
+
+void
+VisualizationPublisher::publish(const std::string& key, const Task& task)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        if (m_attachCount == 0)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < m_tasks.size(); ++i)
+        {
+            if (m_tasks.at(i).first == key)
+            {
+                m_tasks.at(i).second = task;
+                return;
+            }
+        }
+
+        if (m_tasks.size() >= k_capacity)
+        {
+            m_tasks.pop_front();
+        }
+
+        m_tasks.push_back(std::make_pair(key, task));
+    }
+
+    m_taskCond.notify_one();
+}
+
+void
+VisualizationPublisher::flush(void)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    while (!m_tasks.empty() || m_busy)
+    {
+        m_idleCond.wait(lock);
+    }
+}
+
+void
+VisualizationPublisher::processTasks(void)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        while (m_tasks.empty() && !m_stop)
+        {
+            m_taskCond.wait(lock);
+        }
+
+        if (m_tasks.empty())
+        {
+            break;
+        }
+
+        Task task = m_tasks.front().second;
+        m_tasks.pop_front();
+        m_busy = true;
+
+        lock.unlock();
+
+        task();
+
+        if (k_publishInterval > 0.0)
+        {
+            boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(k_publishInterval * 1e6)));
+        }
+
+        lock.lock();
+
+        m_busy = false;
+        m_idleCond.notify_all();
+    }
+}
+
+}
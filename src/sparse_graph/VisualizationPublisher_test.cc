@@ -0,0 +1,124 @@
+#include <camodocal/sparse_graph/VisualizationPublisher.h>
+#include <gtest/gtest.h>
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+record(std::vector<int>* published, int value)
+{
+    published->push_back(value);
+}
+
+// holds up the publisher thread until it is opened
+class Gate
+{
+public:
+    Gate()
+     : started(false)
+     , open(false)
+    {
+
+    }
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool started;
+    bool open;
+};
+
+void
+pass(Gate* gate)
+{
+    boost::unique_lock<boost::mutex> lock(gate->mutex);
+
+    gate->started = true;
+    gate->cond.notify_all();
+
+    while (!gate->open)
+    {
+        gate->cond.wait(lock);
+    }
+}
+
+}
+
+TEST(VisualizationPublisher, Detached)
+{
+    VisualizationPublisher publisher(4, 0.0);
+
+    std::vector<int> published;
+    publisher.publish("a", boost::bind(&record, &published, 1));
+    publisher.flush();
+
+    EXPECT_TRUE(published.empty());
+}
+
+TEST(VisualizationPublisher, LatestSnapshots)
+{
+    VisualizationPublisher publisher(2, 0.0);
+    publisher.attach();
+
+    Gate gate;
+    publisher.publish("gate", boost::bind(&pass, &gate));
+    {
+        boost::unique_lock<boost::mutex> lock(gate.mutex);
+
+        while (!gate.started)
+        {
+            gate.cond.wait(lock);
+        }
+    }
+
+    std::vector<int> published;
+    publisher.publish("a", boost::bind(&record, &published, 1));
+    publisher.publish("b", boost::bind(&record, &published, 2));
+    // replaces the queued task for "a"
+    publisher.publish("a", boost::bind(&record, &published, 3));
+    // drops the oldest task, which is the one for "a"
+    publisher.publish("c", boost::bind(&record, &published, 4));
+
+    {
+        boost::lock_guard<boost::mutex> lock(gate.mutex);
+
+        gate.open = true;
+    }
+    gate.cond.notify_all();
+
+    publisher.flush();
+
+    std::vector<int> expected;
+    expected.push_back(2);
+    expected.push_back(4);
+    EXPECT_EQ(published, expected);
+}
+
+TEST(VisualizationPublisher, NestedAttach)
+{
+    VisualizationPublisher publisher(4, 0.0);
+    publisher.attach();
+    publisher.attach();
+
+    // still attached for the other viewer
+    publisher.detach();
+    EXPECT_TRUE(publisher.attached());
+
+    std::vector<int> published;
+    publisher.publish("a", boost::bind(&record, &published, 1));
+    publisher.flush();
+
+    publisher.detach();
+    EXPECT_FALSE(publisher.attached());
+
+    publisher.publish("b", boost::bind(&record, &published, 2));
+    publisher.flush();
+
+    std::vector<int> expected;
+    expected.push_back(1);
+    EXPECT_EQ(published, expected);
+}
+
+}
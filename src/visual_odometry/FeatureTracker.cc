@@ -5,13 +5,17 @@
 #include <opencv2/gpu/gpu.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/nonfree/features2d.hpp>
+#include <opencv2/video/tracking.hpp>
 
 #include "../brisk/include/brisk/brisk.h"
 #include "../gpl/gpl.h"
 #include "../gpl/EigenUtils.h"
 #include "../gpl/OpenCVUtils.h"
 #include "../npoint/five-point/five-point.hpp"
+#include "../npoint/five-point/rt-iter.hpp"
+#include "../npoint/one-point/one-point.hpp"
 #include "FeatureTracker.h"
+#include "KeypointGrid.h"
 
 namespace camodocal
 {
@@ -47,6 +51,9 @@ FeatureTracker::FeatureTracker(DetectorType detectorType,
     case SURF_GPU_DETECTOR:
         mSURF_GPU = SurfGPU::instance(200.0);
         break; 
+    case BRISK_DETECTOR:
+        mFeatureDetector = cv::Ptr<cv::FeatureDetector>(new cv::BriskFeatureDetector(60, 4));
+        break;
     case SURF_DETECTOR:
     default:
         mFeatureDetector = cv::Ptr<cv::FeatureDetector>(new cv::SurfFeatureDetector(500.0, 5, 2));
@@ -300,29 +307,24 @@ FeatureTracker::matchPointFeaturesWithRatioTest(const cv::Mat& dtor1,
         mDescriptorMatcher->knnMatch(dtor1, dtor2, rawMatches, knn, mask, true);
     }
 
-    for (size_t i = 0; i < rawMatches.size(); ++i)
-    {
-        std::vector<cv::DMatch>& rawMatch = rawMatches.at(i);
-
-        if (rawMatch.size() < 2)
-        {
-            continue;
-        }
-
-        std::vector<cv::DMatch> match;
+    ratioTest(rawMatches, matches);
 
-        float distanceRatio = rawMatch.at(0).distance / rawMatch.at(1).distance;
+    if (mVerbose)
+    {
+        std::cout << "# INFO: Descriptor matching took " << timeInSeconds() - ts << "s." << std::endl;
+    }
+}
 
-        if (distanceRatio < mMaxDistanceRatio)
-        {
-            match.push_back(rawMatch.at(0));
-        }
+void
+FeatureTracker::matchPointFeaturesWithRadiusTest(const cv::Mat& dtor1,
+                                                 const cv::Mat& dtor2,
+                                                 std::vector<std::vector<cv::DMatch> >& matches,
+                                                 const std::vector<std::vector<int> >& candidates,
+                                                 float maxDistance)
+{
+    double ts = timeInSeconds();
 
-        if (!match.empty())
-        {
-            matches.push_back(match);
-        }
-    }
+    mWindowedMatcher.radiusMatch(dtor1, dtor2, candidates, matches, maxDistance, true);
 
     if (mVerbose)
     {
@@ -331,37 +333,69 @@ FeatureTracker::matchPointFeaturesWithRatioTest(const cv::Mat& dtor1,
 }
 
 void
-FeatureTracker::windowedMatchingMask(const std::vector<cv::KeyPoint>& keypoints1,
-                                     const std::vector<cv::KeyPoint>& keypoints2,
-                                     float maxDeltaX, float maxDeltaY,
-                                     cv::Mat& mask) const
+FeatureTracker::matchPointFeaturesWithRatioTest(const cv::Mat& dtor1,
+                                                const cv::Mat& dtor2,
+                                                std::vector<std::vector<cv::DMatch> >& matches,
+                                                const std::vector<std::vector<int> >& candidates)
 {
-    if (keypoints1.empty() || keypoints2.empty())
+    double ts = timeInSeconds();
+    size_t knn = 5;
+    matches.clear();
+
+    std::vector<std::vector<cv::DMatch> > rawMatches;
+    mWindowedMatcher.knnMatch(dtor1, dtor2, candidates, rawMatches, knn, true);
+
+    ratioTest(rawMatches, matches);
+
+    if (mVerbose)
     {
-        mask = cv::Scalar(0);
-        return;
+        std::cout << "# INFO: Descriptor matching took " << timeInSeconds() - ts << "s." << std::endl;
     }
+}
 
-    int n1 = static_cast<int>(keypoints1.size());
-    int n2 = static_cast<int>(keypoints2.size());
+void
+FeatureTracker::windowedMatchingCandidates(const std::vector<cv::KeyPoint>& keypoints1,
+                                           const std::vector<cv::KeyPoint>& keypoints2,
+                                           float maxDeltaX, float maxDeltaY,
+                                           std::vector<std::vector<int> >& candidates) const
+{
+    candidates.resize(keypoints1.size());
 
-    int rows = std::max(n1, mask.rows);
-    int cols = std::max(n2, mask.cols);
+    // with cells as large as the window, each query visits at most 3x3 cells
+    KeypointGrid grid;
+    grid.build(keypoints2, std::max(maxDeltaX, maxDeltaY));
 
-    if (rows != mask.rows || cols != mask.cols)
+    for (size_t i = 0; i < keypoints1.size(); ++i)
     {
-        mask = cv::Mat(rows, cols, CV_8UC1);
+        grid.query(keypoints1.at(i).pt, maxDeltaX, maxDeltaY, candidates.at(i));
     }
+}
 
-    mask = cv::Scalar(0);
-    for (int i = 0; i < n1; ++i)
+void
+FeatureTracker::ratioTest(std::vector<std::vector<cv::DMatch> >& rawMatches,
+                          std::vector<std::vector<cv::DMatch> >& matches) const
+{
+    for (size_t i = 0; i < rawMatches.size(); ++i)
     {
-        const cv::Point2f& keypoint1 = keypoints1.at(i).pt;
-        for (int j = 0; j < n2; ++j)
+        std::vector<cv::DMatch>& rawMatch = rawMatches.at(i);
+
+        if (rawMatch.size() < 2)
         {
-            cv::Point2f diff = keypoints2.at(j).pt - keypoint1;
+            continue;
+        }
 
-            mask.at<uchar>(i, j) = std::abs(diff.x) < maxDeltaX && std::abs(diff.y) < maxDeltaY;
+        std::vector<cv::DMatch> match;
+
+        float distanceRatio = rawMatch.at(0).distance / rawMatch.at(1).distance;
+
+        if (distanceRatio < mMaxDistanceRatio)
+        {
+            match.push_back(rawMatch.at(0));
+        }
+
+        if (!match.empty())
+        {
+            matches.push_back(match);
         }
     }
 }
@@ -377,12 +411,28 @@ TemporalFeatureTracker::TemporalFeatureTracker(const CameraConstPtr& camera,
                                                bool preprocess)
  : FeatureTracker(detectorType, descriptorType, matchTestType, preprocess)
  , kCamera(camera)
+ , mSketchValid(false)
  , mInit(false)
  , m_BA(camera)
+ , mVOMode(VO_5POINT)
+ , mYawAxis(Eigen::Vector3d::Zero())
+ , mYawAxisSamples(0)
+ , mTrackingMode(TRACK_DESCRIPTORS)
  , kMaxDelta(80.0f)
  , kMinFeatureCorrespondences(15)
  , kNominalFocalLength(300.0)
  , kReprojErrorThresh(1.0)
+ , kMinYawForAxis(2.0 / 180.0 * M_PI)
+ , kMinYawAxisSamples(3)
+ , kMaxOnePointAxisAngle(5.0 / 180.0 * M_PI)
+ , kMinPriorInlierRatio(0.5)
+ , kMaxPriorRotationError(3.0 / 180.0 * M_PI)
+ , kPriorRefinementIterations(20)
+ , kKLTWindowSize(21, 21)
+ , kKLTMaxLevel(3)
+ , kMaxForwardBackwardError(0.5f)
+ , kMaxTrackedFeatureDistance(3.0f)
+ , kMinTrackedFeatureRatio(0.5)
 {
 
 }
@@ -391,32 +441,57 @@ bool
 TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
                                  Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel)
 {
-    if (frame->image().channels() > 1)
-    {
-        cv::cvtColor(frame->image(), mImage, CV_BGR2GRAY);
-    }
-    else
-    {
-        frame->image().copyTo(mImage);
-    }
+    return addFrame(frame, mask, OdometryConstPtr(), R_rel, t_rel);
+}
 
+bool
+TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
+                                 const OdometryConstPtr& odometry,
+                                 Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel)
+{
+    Features features;
+    extractFeatures(frame->image(), mask, features);
+
+    return addFrame(frame, features, odometry, R_rel, t_rel);
+}
+
+void
+TemporalFeatureTracker::extractFeatures(const cv::Mat& image, const cv::Mat& mask,
+                                        Features& features)
+{
     if (mask.empty())
     {
-        mMask = cv::Mat();
+        features.mask = cv::Mat();
     }
     else
     {
-        mMask = mask > 0;
+        features.mask = mask > 0;
     }
 
-    if (mPreprocess)
+    convertImage(image, features.mask, features.image);
+
+    detectFeatures(features.image, features.keypoints, features.mask);
+    computeDescriptors(features.image, features.keypoints, features.descriptors);
+}
+
+bool
+TemporalFeatureTracker::addFrame(FramePtr& frame, const Features& features,
+                                 const OdometryConstPtr& odometry,
+                                 Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel)
+{
+    mOdometryPrev = mOdometry;
+    mOdometry = odometry;
+
+    mImage = features.image;
+    mMask = features.mask;
+    mKpts = features.keypoints;
+    mDtor = features.descriptors;
+
+    if (mTrackingMode == TRACK_KLT)
     {
-        preprocessImage(mImage, mMask);
+        trackFeatures(mImage);
     }
 
-    detectFeatures(mImage, mKpts, mMask);
-    computeDescriptors(mImage, mKpts, mDtor);
-
     if (m_BA.empty())
     {
         mFrames.clear();
@@ -448,21 +523,36 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
     {
         std::vector<std::vector<cv::DMatch> > matches;
 
-        windowedMatchingMask(mKpts, mKptsPrev, kMaxDelta, kMaxDelta, mMatchingMask);
+        if (mTrackingMode == TRACK_KLT)
+        {
+            matchTrackedFeatures(matches);
 
-        cv::Mat matchingMaskROI(mMatchingMask, cv::Rect(0, 0, mKptsPrev.size(), mKpts.size()));
+            if (mVerbose)
+            {
+                std::cout << "# INFO: Associated " << matches.size() << " tracked features." << std::endl;
+            }
+        }
 
-        switch (mMatchTestType)
+        // descriptor matching, or recovery from lost tracks
+        if (matches.size() < static_cast<size_t>(kMinFeatureCorrespondences))
         {
-        case BEST_MATCH:
-            matchPointFeaturesWithBestMatchTest(mDtor, mDtorPrev, matches, matchingMaskROI);
-            break;
-        case RADIUS:
-            matchPointFeaturesWithRadiusTest(mDtor, mDtorPrev, matches, matchingMaskROI);
-            break;
-        case RATIO:
-        default:
-            matchPointFeaturesWithRatioTest(mDtor, mDtorPrev, matches, matchingMaskROI);
+            matches.clear();
+
+            std::vector<std::vector<int> > candidates;
+            windowedMatchingCandidates(mKpts, mKptsPrev, kMaxDelta, kMaxDelta, candidates);
+
+            switch (mMatchTestType)
+            {
+            case BEST_MATCH:
+                matchPointFeaturesWithBestMatchTest(mDtor, mDtorPrev, matches);
+                break;
+            case RADIUS:
+                matchPointFeaturesWithRadiusTest(mDtor, mDtorPrev, matches, candidates);
+                break;
+            case RATIO:
+            default:
+                matchPointFeaturesWithRatioTest(mDtor, mDtorPrev, matches, candidates);
+            }
         }
 
         for (size_t i = 0; i < matches.size(); ++i)
@@ -553,9 +643,23 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
     mKptsPrev = mKpts;
     mDtor.copyTo(mDtorPrev);
 
+    // from now on, the features of this frame are tracked
+    if (mTrackingMode == TRACK_KLT)
+    {
+        mTrackedPoints.resize(mKpts.size());
+        mTrackedIndices.resize(mKpts.size());
+        for (size_t i = 0; i < mKpts.size(); ++i)
+        {
+            mTrackedPoints.at(i) = mKpts.at(i).pt;
+            mTrackedIndices.at(i) = i;
+        }
+    }
+
+    // the image is not modified once it is converted, so the frame
+    // shares it
     if (!mImage.empty())
     {
-        mImage.copyTo(frame->image());
+        frame->setImage(mImage);
     }
 
     frame->features2D() = mPointFeatures;
@@ -588,6 +692,8 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
 
     if (voValid)
     {
+        updateYawAxis(R_rel);
+
         // mark inliers from VO
         int mark = -1;
         for (size_t i = 0; i < mPointFeatures.size(); ++i)
@@ -691,10 +797,7 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask,
         }
     }
 
-    cv::cvtColor(mImage, mSketch, CV_GRAY2BGR);
-    cv::drawKeypoints(mSketch, mKpts, mSketch, cv::Scalar(0, 0, 255));
-
-    visualizeTracks();
+    mSketchValid = false;
 
     return voValid;
 }
@@ -715,6 +818,58 @@ TemporalFeatureTracker::clear(void)
     m_BA.clear();
     mFrames.clear();
     mPoses.clear();
+
+    mOdometry.reset();
+    mOdometryPrev.reset();
+
+    mTrackPyramid.clear();
+    mTrackedPoints.clear();
+    mTrackedIndices.clear();
+}
+
+const cv::Mat&
+TemporalFeatureTracker::getSketch(void)
+{
+    if (!mSketchValid && !mImage.empty())
+    {
+        cv::cvtColor(mImage, mSketch, CV_GRAY2BGR);
+        cv::drawKeypoints(mSketch, mKpts, mSketch, cv::Scalar(0, 0, 255));
+
+        visualizeTracks();
+
+        mSketchValid = true;
+    }
+
+    return mSketch;
+}
+
+bool
+TemporalFeatureTracker::trackFrame(const cv::Mat& image)
+{
+    if (mTrackingMode != TRACK_KLT || !mInit)
+    {
+        return true;
+    }
+
+    cv::Mat grayImage;
+    convertImage(image, mMask, grayImage);
+
+    trackFeatures(grayImage);
+
+    return mTrackedPoints.size() >= static_cast<size_t>(kMinFeatureCorrespondences) &&
+           mTrackedPoints.size() >= kMinTrackedFeatureRatio * mKptsPrev.size();
+}
+
+void
+TemporalFeatureTracker::setVOMode(VOMode mode)
+{
+    mVOMode = mode;
+}
+
+void
+TemporalFeatureTracker::setTrackingMode(TrackingMode mode)
+{
+    mTrackingMode = mode;
 }
 
 void
@@ -802,6 +957,12 @@ TemporalFeatureTracker::computeVO(Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel
         return false;
     }
 
+    if (mVOMode == VO_ODOMETRY_AIDED &&
+        computeVOWithPrior(pointsPrev, points, R_rel, t_rel, inliers))
+    {
+        return true;
+    }
+
     cv::Mat E, R_rel_cv, t_rel_cv;
     E = findEssentialMat(pointsPrev, points, 1.0, cv::Point2d(0.0, 0.0), CV_FM_RANSAC, 0.99, kReprojErrorThresh / kNominalFocalLength, 1000, inliers);
     recoverPose(E, pointsPrev, points, R_rel_cv, t_rel_cv, 1.0, cv::Point2d(0.0, 0.0), inliers);
@@ -817,6 +978,152 @@ TemporalFeatureTracker::computeVO(Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel
     return true;
 }
 
+bool
+TemporalFeatureTracker::computeVOWithPrior(const std::vector<cv::Point2f>& pointsPrev,
+                                           const std::vector<cv::Point2f>& points,
+                                           Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel,
+                                           cv::Mat& inliers)
+{
+    Eigen::Matrix3d R_prior;
+    if (!rotationPrior(R_prior))
+    {
+        return false;
+    }
+
+    const double thresh = kReprojErrorThresh / kNominalFocalLength;
+    const int minInlierCount = std::max(kMinFeatureCorrespondences,
+                                        static_cast<int>(kMinPriorInlierRatio * points.size()));
+
+    // 1. If the camera rotates about its y-axis, the motion fits the planar
+    //    circular motion model and a 1-point sample suffices.
+    // 2. Otherwise, use the rotation prior and estimate the translation
+    //    direction from 2-point samples.
+    cv::Mat inliersPrior;
+    if (fabs(mYawAxis.normalized()(1)) > cos(kMaxOnePointAxisAngle))
+    {
+        cv::Mat rvec, tvec;
+        findPose_1pt(pointsPrev, points, 1.0, cv::Point2d(0.0, 0.0), rvec, tvec,
+                     CV_RANSAC, 0.99, thresh, inliersPrior);
+
+        if (mVerbose)
+        {
+            std::cout << "# INFO: 1-point RANSAC: " << cv::countNonZero(inliersPrior)
+                      << "/" << points.size() << " inliers." << std::endl;
+        }
+    }
+
+    if (inliersPrior.empty() || cv::countNonZero(inliersPrior) < minInlierCount)
+    {
+        cv::Mat R_prior_cv;
+        cv::eigen2cv(R_prior, R_prior_cv);
+
+        iterateTranslation(pointsPrev, points, R_prior_cv, 1.0, cv::Point2d(0.0, 0.0),
+                           CV_FM_RANSAC, 0.99, thresh, inliersPrior);
+
+        if (mVerbose)
+        {
+            std::cout << "# INFO: 2-point RANSAC: " << cv::countNonZero(inliersPrior)
+                      << "/" << points.size() << " inliers." << std::endl;
+        }
+    }
+
+    if (cv::countNonZero(inliersPrior) < minInlierCount)
+    {
+        return false;
+    }
+
+    // refine the full relative pose on the inliers of the minimal model
+    std::vector<cv::Point2f> inlierPointsPrev, inlierPoints;
+    std::vector<size_t> inlierIds;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (inliersPrior.at<unsigned char>(0, i))
+        {
+            inlierPointsPrev.push_back(pointsPrev.at(i));
+            inlierPoints.push_back(points.at(i));
+            inlierIds.push_back(i);
+        }
+    }
+
+    cv::Mat E, R_rel_cv, t_rel_cv, refinedInliers;
+    E = findEssentialMat(inlierPointsPrev, inlierPoints, 1.0, cv::Point2d(0.0, 0.0), CV_FM_RANSAC, 0.99, thresh, kPriorRefinementIterations, refinedInliers);
+    recoverPose(E, inlierPointsPrev, inlierPoints, R_rel_cv, t_rel_cv, 1.0, cv::Point2d(0.0, 0.0), refinedInliers);
+
+    if (cv::countNonZero(refinedInliers) < minInlierCount)
+    {
+        return false;
+    }
+
+    Eigen::Matrix3d R;
+    cv::cv2eigen(R_rel_cv, R);
+
+    // fall back to 5-point RANSAC if the prior disagrees with the estimate
+    double rotationError = Eigen::AngleAxisd(R * R_prior.transpose()).angle();
+    if (rotationError > kMaxPriorRotationError)
+    {
+        if (mVerbose)
+        {
+            std::cout << "# INFO: Odometry prior disagrees with VO by "
+                      << rotationError / M_PI * 180.0 << " deg." << std::endl;
+        }
+
+        return false;
+    }
+
+    inliers = cv::Mat::zeros(1, points.size(), CV_8U);
+    for (size_t i = 0; i < inlierIds.size(); ++i)
+    {
+        if (refinedInliers.at<unsigned char>(0, i))
+        {
+            inliers.at<unsigned char>(0, inlierIds.at(i)) = 1;
+        }
+    }
+
+    R_rel = R;
+    cv::cv2eigen(t_rel_cv, t_rel);
+
+    return true;
+}
+
+bool
+TemporalFeatureTracker::rotationPrior(Eigen::Matrix3d& R_prior) const
+{
+    if (mOdometry.get() == 0 || mOdometryPrev.get() == 0 ||
+        mYawAxisSamples < kMinYawAxisSamples)
+    {
+        return false;
+    }
+
+    // The rotation angle of the camera equals the odometry yaw change,
+    // and the rotation axis is the vehicle yaw axis in the camera frame.
+    double dYaw = normalizeTheta(mOdometry->yaw() - mOdometryPrev->yaw());
+
+    R_prior = Eigen::AngleAxisd(dYaw, mYawAxis.normalized()).toRotationMatrix();
+
+    return true;
+}
+
+void
+TemporalFeatureTracker::updateYawAxis(const Eigen::Matrix3d& R_rel)
+{
+    if (mOdometry.get() == 0 || mOdometryPrev.get() == 0)
+    {
+        return;
+    }
+
+    double dYaw = normalizeTheta(mOdometry->yaw() - mOdometryPrev->yaw());
+    if (fabs(dYaw) < kMinYawForAxis)
+    {
+        return;
+    }
+
+    // Weighting the rotation vector by the yaw change makes the sum
+    // independent of the turning direction.
+    Eigen::AngleAxisd aa(R_rel);
+    mYawAxis += aa.angle() * aa.axis() * dYaw;
+    ++mYawAxisSamples;
+}
+
 int
 TemporalFeatureTracker::findInliers(const Eigen::Matrix3d& R_rel,
                                     const Eigen::Vector3d& t_rel,
@@ -949,6 +1256,149 @@ TemporalFeatureTracker::visualizeTracks(void)
     }
 }
 
+void
+TemporalFeatureTracker::convertImage(const cv::Mat& src, const cv::Mat& mask,
+                                     cv::Mat& dst) const
+{
+    if (src.channels() > 1)
+    {
+        cv::cvtColor(src, dst, CV_BGR2GRAY);
+    }
+    else if (mPreprocess)
+    {
+        src.copyTo(dst);
+    }
+    else
+    {
+        // the image is only read, so it is shared
+        dst = src;
+    }
+
+    if (mPreprocess)
+    {
+        preprocessImage(dst, mask);
+    }
+}
+
+void
+TemporalFeatureTracker::trackFeatures(const cv::Mat& image)
+{
+    double ts = timeInSeconds();
+
+    std::vector<cv::Mat> pyramid;
+    cv::buildOpticalFlowPyramid(image, pyramid, kKLTWindowSize, kKLTMaxLevel);
+
+    if (!mTrackPyramid.empty() && !mTrackedPoints.empty())
+    {
+        cv::TermCriteria criteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.01);
+
+        std::vector<cv::Point2f> points;
+        std::vector<uchar> status;
+        std::vector<float> err;
+        cv::calcOpticalFlowPyrLK(mTrackPyramid, pyramid, mTrackedPoints, points,
+                                 status, err, kKLTWindowSize, kKLTMaxLevel, criteria);
+
+        // forward-backward consistency check
+        std::vector<cv::Point2f> pointsBack;
+        std::vector<uchar> statusBack;
+        cv::calcOpticalFlowPyrLK(pyramid, mTrackPyramid, points, pointsBack,
+                                 statusBack, err, kKLTWindowSize, kKLTMaxLevel, criteria);
+
+        size_t nTracked = 0;
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            const cv::Point2f& p = points.at(i);
+
+            if (!status.at(i) || !statusBack.at(i) ||
+                cv::norm(pointsBack.at(i) - mTrackedPoints.at(i)) > kMaxForwardBackwardError)
+            {
+                continue;
+            }
+
+            if (p.x < 0.0f || p.x > image.cols - 1 || p.y < 0.0f || p.y > image.rows - 1)
+            {
+                continue;
+            }
+
+            if (!mMask.empty() && mMask.at<uchar>(cvRound(p.y), cvRound(p.x)) == 0)
+            {
+                continue;
+            }
+
+            mTrackedPoints.at(nTracked) = p;
+            mTrackedIndices.at(nTracked) = mTrackedIndices.at(i);
+            ++nTracked;
+        }
+
+        if (mVerbose)
+        {
+            std::cout << "# INFO: Tracked " << nTracked << "/" << points.size()
+                      << " features in " << timeInSeconds() - ts << "s." << std::endl;
+        }
+
+        mTrackedPoints.resize(nTracked);
+        mTrackedIndices.resize(nTracked);
+    }
+
+    mTrackPyramid.swap(pyramid);
+}
+
+void
+TemporalFeatureTracker::matchTrackedFeatures(std::vector<std::vector<cv::DMatch> >& matches) const
+{
+    matches.clear();
+
+    KeypointGrid grid;
+    grid.build(mKpts, kMaxTrackedFeatureDistance);
+
+    // the nearest detected keypoint of each tracked feature, and the
+    // nearest tracked feature of each keypoint
+    std::vector<cv::DMatch> trackMatches(mTrackedPoints.size());
+    std::vector<cv::DMatch> keypointMatches(mKpts.size());
+
+    std::vector<int> candidates;
+    for (size_t i = 0; i < mTrackedPoints.size(); ++i)
+    {
+        grid.query(mTrackedPoints.at(i), kMaxTrackedFeatureDistance, kMaxTrackedFeatureDistance,
+                   candidates);
+
+        for (size_t j = 0; j < candidates.size(); ++j)
+        {
+            int idx = candidates.at(j);
+
+            float distance = cv::norm(mKpts.at(idx).pt - mTrackedPoints.at(i));
+            if (distance > kMaxTrackedFeatureDistance)
+            {
+                continue;
+            }
+
+            cv::DMatch match(idx, mTrackedIndices.at(i), distance);
+
+            if (distance < trackMatches.at(i).distance)
+            {
+                trackMatches.at(i) = match;
+            }
+            if (distance < keypointMatches.at(idx).distance)
+            {
+                keypointMatches.at(idx) = match;
+            }
+        }
+    }
+
+    // keep mutual nearest neighbours only
+    for (size_t i = 0; i < trackMatches.size(); ++i)
+    {
+        const cv::DMatch& match = trackMatches.at(i);
+        if (match.queryIdx == -1 ||
+            keypointMatches.at(match.queryIdx).trainIdx != match.trainIdx)
+        {
+            continue;
+        }
+
+        matches.push_back(std::vector<cv::DMatch>(1, match));
+    }
+}
+
 /***************************************************/
 /* Camera Rig Temporal Feature Tracker                           */
 /***************************************************/
@@ -994,10 +1444,9 @@ CameraRigTemporalFeatureTracker::addFrame(const std::vector<cv::Mat>& images,
     for (size_t i = 0; i < mCameraMetadata.size(); ++i)
     {
         pointFeatures.at(i) = mCameraMetadata.at(i).pointFeatures;
+        mCameraMetadata.at(i).sketchValid = false;
     }
 
-    visualizeTracks();
-
     return true;
 }
 
@@ -1008,9 +1457,21 @@ CameraRigTemporalFeatureTracker::clear(void)
 }
 
 const cv::Mat&
-CameraRigTemporalFeatureTracker::getSketch(int idx) const
+CameraRigTemporalFeatureTracker::getSketch(int idx)
 {
-    return mCameraMetadata.at(idx).sketch;
+    CameraMetadata& metadata = mCameraMetadata.at(idx);
+
+    if (!metadata.sketchValid && !metadata.image.empty())
+    {
+        cv::cvtColor(metadata.image, metadata.sketch, CV_GRAY2BGR);
+        cv::drawKeypoints(metadata.sketch, metadata.kpts, metadata.sketch, cv::Scalar(0, 0, 255));
+
+        visualizeTracks(metadata);
+
+        metadata.sketchValid = true;
+    }
+
+    return metadata.sketch;
 }
 
 void
@@ -1062,21 +1523,20 @@ CameraRigTemporalFeatureTracker::processImage(const cv::Mat& image, const cv::Ma
     {
         std::vector<std::vector<cv::DMatch> > matches;
 
-        windowedMatchingMask(metadata->kpts, metadata->kptsPrev, kMaxDelta, kMaxDelta, mMatchingMask);
-
-        cv::Mat matchingMaskROI(mMatchingMask, cv::Rect(0, 0, metadata->kptsPrev.size(), metadata->kpts.size()));
+        std::vector<std::vector<int> > candidates;
+        windowedMatchingCandidates(metadata->kpts, metadata->kptsPrev, kMaxDelta, kMaxDelta, candidates);
 
         switch (mMatchTestType)
         {
         case BEST_MATCH:
-            matchPointFeaturesWithBestMatchTest(metadata->dtor, metadata->dtorPrev, matches, matchingMaskROI);
+            matchPointFeaturesWithBestMatchTest(metadata->dtor, metadata->dtorPrev, matches);
             break;
         case RADIUS:
-            matchPointFeaturesWithRadiusTest(metadata->dtor, metadata->dtorPrev, matches, matchingMaskROI);
+            matchPointFeaturesWithRadiusTest(metadata->dtor, metadata->dtorPrev, matches, candidates);
             break;
         case RATIO:
         default:
-            matchPointFeaturesWithRatioTest(metadata->dtor, metadata->dtorPrev, matches, matchingMaskROI);
+            matchPointFeaturesWithRatioTest(metadata->dtor, metadata->dtorPrev, matches, candidates);
         }
 
         for (size_t j = 0; j < matches.size(); ++j)
@@ -1211,9 +1671,6 @@ CameraRigTemporalFeatureTracker::processImage(const cv::Mat& image, const cv::Ma
 
     metadata->kptsPrev = metadata->kpts;
     metadata->dtor.copyTo(metadata->dtorPrev);
-
-    cv::cvtColor(metadata->image, metadata->sketch, CV_GRAY2BGR);
-    cv::drawKeypoints(metadata->sketch, metadata->kpts, metadata->sketch, cv::Scalar(0, 0, 255));
 }
 
 void
@@ -1231,52 +1688,47 @@ CameraRigTemporalFeatureTracker::rectifyImagePoint(const CameraConstPtr& camera,
 }
 
 void
-CameraRigTemporalFeatureTracker::visualizeTracks(void)
+CameraRigTemporalFeatureTracker::visualizeTracks(CameraMetadata& metadata)
 {
     int drawShiftBits = 4;
     int drawMultiplier = 1 << drawShiftBits;
 
     cv::Scalar green(0, 255, 0);
 
-    for (size_t i = 0; i < mCameraMetadata.size(); ++i)
+    for (size_t j = 0; j < metadata.pointFeatures.size(); ++j)
     {
-        CameraMetadata& metadata = mCameraMetadata.at(i);
+        std::vector<cv::Point2f> pts;
 
-        for (size_t j = 0; j < metadata.pointFeatures.size(); ++j)
+        Point2DFeaturePtr pt = metadata.pointFeatures.at(j);
+        pts.push_back(pt->keypoint().pt);
+        while (!pt->prevMatches().empty() && pt->bestPrevMatchId() != -1)
         {
-            std::vector<cv::Point2f> pts;
+            pt = pt->prevMatches().at(pt->bestPrevMatchId()).lock();
 
-            Point2DFeaturePtr pt = metadata.pointFeatures.at(j);
-            pts.push_back(pt->keypoint().pt);
-            while (!pt->prevMatches().empty() && pt->bestPrevMatchId() != -1)
+            if (pt.get() == 0)
             {
-                pt = pt->prevMatches().at(pt->bestPrevMatchId()).lock();
+                break;
+            }
 
-                if (pt.get() == 0)
-                {
-                    break;
-                }
+            pts.push_back(pt->keypoint().pt);
+        }
 
-                pts.push_back(pt->keypoint().pt);
-            }
+        if (pts.size() < 2)
+        {
+            continue;
+        }
 
-            if (pts.size() < 2)
-            {
-                continue;
-            }
+        for (size_t k = 0; k < pts.size() - 1; ++k)
+        {
+            const cv::Point2f& p1 = pts.at(k);
+            const cv::Point2f& p2 = pts.at(k + 1);
 
-            for (size_t k = 0; k < pts.size() - 1; ++k)
-            {
-                const cv::Point2f& p1 = pts.at(k);
-                const cv::Point2f& p2 = pts.at(k + 1);
-
-                cv::line(metadata.sketch,
-                         cv::Point(cvRound(p1.x * drawMultiplier),
-                                   cvRound(p1.y * drawMultiplier)),
-                         cv::Point(cvRound(p2.x * drawMultiplier),
-                                   cvRound(p2.y * drawMultiplier)),
-                         green, 2, CV_AA, drawShiftBits);
-            }
+            cv::line(metadata.sketch,
+                     cv::Point(cvRound(p1.x * drawMultiplier),
+                               cvRound(p1.y * drawMultiplier)),
+                     cv::Point(cvRound(p2.x * drawMultiplier),
+                               cvRound(p2.y * drawMultiplier)),
+                     green, 2, CV_AA, drawShiftBits);
         }
     }
 }
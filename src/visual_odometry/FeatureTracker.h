@@ -9,6 +9,7 @@
 #include "../features2d/ORBGPU.h"
 #include "../features2d/SurfGPU.h"
 #include "SlidingWindowBA.h"
+#include "WindowedMatcher.h"
 
 namespace camodocal
 {
@@ -20,7 +21,8 @@ enum DetectorType
     ORB_GPU_DETECTOR = 0x11,
     STAR_DETECTOR = 0x2,
     SURF_DETECTOR = 0x3,
-    SURF_GPU_DETECTOR = 0x13
+    SURF_GPU_DETECTOR = 0x13,
+    BRISK_DETECTOR = 0x4
 };
 
 enum DescriptorType
@@ -78,10 +80,24 @@ protected:
                                          std::vector<std::vector<cv::DMatch> >& matches,
                                          const cv::Mat& mask = cv::Mat());
 
-    void windowedMatchingMask(const std::vector<cv::KeyPoint>& keypoints1,
-                              const std::vector<cv::KeyPoint>& keypoints2,
-                              float maxDeltaX, float maxDeltaY,
-                              cv::Mat& mask) const;
+    // The same tests with the train features of each query feature
+    // restricted to a candidate list, see windowedMatchingCandidates().
+    void matchPointFeaturesWithRadiusTest(const cv::Mat& dtor1,
+                                          const cv::Mat& dtor2,
+                                          std::vector<std::vector<cv::DMatch> >& matches,
+                                          const std::vector<std::vector<int> >& candidates,
+                                          float maxDistance = 0.01f);
+    void matchPointFeaturesWithRatioTest(const cv::Mat& dtor1,
+                                         const cv::Mat& dtor2,
+                                         std::vector<std::vector<cv::DMatch> >& matches,
+                                         const std::vector<std::vector<int> >& candidates);
+
+    // For each keypoint in keypoints1, finds the keypoints in keypoints2
+    // which lie inside a window around it.
+    void windowedMatchingCandidates(const std::vector<cv::KeyPoint>& keypoints1,
+                                    const std::vector<cv::KeyPoint>& keypoints2,
+                                    float maxDeltaX, float maxDeltaY,
+                                    std::vector<std::vector<int> >& candidates) const;
 
     int mCameraIdx;
     cv::Mat mCameraMatrix;
@@ -93,6 +109,8 @@ protected:
     cv::Ptr<cv::FeatureDetector> mFeatureDetector;
     cv::Ptr<cv::DescriptorExtractor> mDescriptorExtractor;
     cv::Ptr<cv::DescriptorMatcher> mDescriptorMatcher;
+    // CPU matcher for candidate lists
+    WindowedMatcher mWindowedMatcher;
 
     cv::Ptr<SurfGPU> mSURF_GPU;
     cv::Ptr<ORBGPU> mORB_GPU;
@@ -103,11 +121,40 @@ protected:
     bool mPreprocess;
 
     bool mVerbose;
+
+private:
+    void ratioTest(std::vector<std::vector<cv::DMatch> >& rawMatches,
+                   std::vector<std::vector<cv::DMatch> >& matches) const;
 };
 
 class TemporalFeatureTracker: public FeatureTracker
 {
 public:
+    enum VOMode
+    {
+        VO_5POINT,          // 5-point RANSAC only
+        VO_ODOMETRY_AIDED   // 1-point / 2-point RANSAC with an odometry prior,
+                            // falling back to 5-point RANSAC
+    };
+
+    enum TrackingMode
+    {
+        TRACK_DESCRIPTORS,  // features are matched by descriptor between frames
+        TRACK_KLT           // features are tracked with pyramidal Lucas-Kanade
+                            // through all frames, including the ones passed to
+                            // trackFrame(), falling back to descriptor matching
+    };
+
+    // The grayscale image of a frame and its features.
+    class Features
+    {
+    public:
+        cv::Mat image;
+        cv::Mat mask;
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+    };
+
     TemporalFeatureTracker(const CameraConstPtr& camera,
                            DetectorType detectorType = ORB_DETECTOR,
                            DescriptorType descriptorType = ORB_DESCRIPTOR,
@@ -115,8 +162,29 @@ public:
                            bool preprocess = false);
     bool addFrame(FramePtr& frame, const cv::Mat& mask,
                   Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel);
+    bool addFrame(FramePtr& frame, const cv::Mat& mask,
+                  const OdometryConstPtr& odometry,
+                  Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel);
+    bool addFrame(FramePtr& frame, const Features& features,
+                  const OdometryConstPtr& odometry,
+                  Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel);
+    // Detects and describes the features of an image. This does not touch
+    // the tracker state, so it can run concurrently with addFrame() for
+    // an earlier image.
+    void extractFeatures(const cv::Mat& image, const cv::Mat& mask,
+                         Features& features);
+    // Tracks the features of the last frame passed to addFrame() into an
+    // image which is not added as a frame. Only has an effect in TRACK_KLT
+    // mode. Returns false if too few features are left, in which case
+    // the image should be added as a frame.
+    bool trackFrame(const cv::Mat& image);
     void clear(void);
 
+    void setVOMode(VOMode mode);
+    void setTrackingMode(TrackingMode mode);
+
+    // The sketch of the last frame is drawn when it is first requested.
+    const cv::Mat& getSketch(void);
     void getMatches(std::vector<cv::Point2f>& matchedPoints,
                     std::vector<cv::Point2f>& matchedPointsPrev) const;
     std::vector<FramePtr>& getFrames(void);
@@ -127,6 +195,13 @@ public:
 
 protected:
     bool computeVO(Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel, cv::Mat& inliers);
+    bool computeVOWithPrior(const std::vector<cv::Point2f>& pointsPrev,
+                            const std::vector<cv::Point2f>& points,
+                            Eigen::Matrix3d& R_rel, Eigen::Vector3d& t_rel,
+                            cv::Mat& inliers);
+
+    bool rotationPrior(Eigen::Matrix3d& R_prior) const;
+    void updateYawAxis(const Eigen::Matrix3d& R_rel);
 
     int findInliers(const Eigen::Matrix3d& R_rel, const Eigen::Vector3d& t_rel,
                     double reprojErrorThresh = 1.0);
@@ -135,10 +210,15 @@ protected:
 
     void visualizeTracks(void);
 
+    void convertImage(const cv::Mat& src, const cv::Mat& mask, cv::Mat& dst) const;
+    void trackFeatures(const cv::Mat& image);
+    void matchTrackedFeatures(std::vector<std::vector<cv::DMatch> >& matches) const;
+
     const CameraConstPtr kCamera;
 
     cv::Mat mImage;
     cv::Mat mMask;
+    bool mSketchValid;
 
     bool mInit;
 
@@ -151,11 +231,44 @@ protected:
     std::vector<FramePtr> mFrames;
     std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > mPoses;
 
-    cv::Mat mMatchingMask;
+    VOMode mVOMode;
+    OdometryConstPtr mOdometry;
+    OdometryConstPtr mOdometryPrev;
+    // vehicle yaw axis in the camera frame, scaled by the accumulated
+    // squared odometry yaw
+    Eigen::Vector3d mYawAxis;
+    int mYawAxisSamples;
+
+    TrackingMode mTrackingMode;
+    // pyramid of the last tracked image, and the positions in it of the
+    // features of the last frame with their indices
+    std::vector<cv::Mat> mTrackPyramid;
+    std::vector<cv::Point2f> mTrackedPoints;
+    std::vector<int> mTrackedIndices;
+
     const float kMaxDelta;
     const int kMinFeatureCorrespondences;
     const double kNominalFocalLength;
     const double kReprojErrorThresh;
+
+    // odometry-aided VO parameters
+    const double kMinYawForAxis;
+    const int kMinYawAxisSamples;
+    const double kMaxOnePointAxisAngle;
+    const double kMinPriorInlierRatio;
+    const double kMaxPriorRotationError;
+    const int kPriorRefinementIterations;
+
+    // KLT tracking parameters
+    const cv::Size kKLTWindowSize;
+    const int kKLTMaxLevel;
+    const float kMaxForwardBackwardError;
+    // maximum distance between a tracked feature and the detected
+    // keypoint it is associated with
+    const float kMaxTrackedFeatureDistance;
+    // fraction of the features of the last frame which must still be
+    // tracked for an image to be skipped
+    const double kMinTrackedFeatureRatio;
 };
 
 class CameraRigTemporalFeatureTracker: public FeatureTracker
@@ -170,7 +283,8 @@ public:
                   const std::vector<cv::Mat>& masks);
     void clear(void);
 
-    const cv::Mat& getSketch(int idx) const;
+    // The sketch of the last frame is drawn when it is first requested.
+    const cv::Mat& getSketch(int idx);
 
 protected:
     class CameraMetadata
@@ -178,6 +292,7 @@ protected:
     public:
         CameraMetadata(const CameraConstPtr& _camera)
          : camera(_camera)
+         , sketchValid(false)
         {
 
         }
@@ -189,6 +304,7 @@ protected:
         cv::Mat dtor, dtorPrev;
         std::vector<Point2DFeaturePtr> pointFeatures;
         cv::Mat sketch;
+        bool sketchValid;
     };
 
     void processImage(const cv::Mat& image, const cv::Mat& mask,
@@ -197,11 +313,10 @@ protected:
     void rectifyImagePoint(const CameraConstPtr& camera,
                            const cv::Point2f& src, cv::Point2f& dst) const;
 
-    void visualizeTracks(void);
+    void visualizeTracks(CameraMetadata& metadata);
 
     std::vector<CameraMetadata> mCameraMetadata;
 
-    cv::Mat mMatchingMask;
     const float kMaxDelta;
     const int kMinFeatureCorrespondences;
     const double kNominalFocalLength;
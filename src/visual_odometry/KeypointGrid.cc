@@ -0,0 +1,133 @@
+#include "KeypointGrid.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace camodocal
+{
+
+KeypointGrid::KeypointGrid()
+ : mCellSize(1.0f)
+ , mCols(0)
+ , mRows(0)
+{
+
+}
+
+void
+KeypointGrid::build(const std::vector<cv::KeyPoint>& keypoints, float cellSize)
+{
+    mCellSize = std::max(cellSize, 1.0f);
+
+    mPoints.resize(keypoints.size());
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        mPoints.at(i) = keypoints.at(i).pt;
+    }
+
+    if (mPoints.empty())
+    {
+        mCols = 0;
+        mRows = 0;
+        mCellStart.assign(1, 0);
+        mIndices.clear();
+        return;
+    }
+
+    cv::Point2f minPt = mPoints.front();
+    cv::Point2f maxPt = mPoints.front();
+    for (size_t i = 1; i < mPoints.size(); ++i)
+    {
+        minPt.x = std::min(minPt.x, mPoints.at(i).x);
+        minPt.y = std::min(minPt.y, mPoints.at(i).y);
+        maxPt.x = std::max(maxPt.x, mPoints.at(i).x);
+        maxPt.y = std::max(maxPt.y, mPoints.at(i).y);
+    }
+
+    mOrigin = minPt;
+    mCols = static_cast<int>((maxPt.x - minPt.x) / mCellSize) + 1;
+    mRows = static_cast<int>((maxPt.y - minPt.y) / mCellSize) + 1;
+
+    // counting sort of the keypoints by cell, which keeps the indices
+    // in each cell in ascending order
+    std::vector<int> cells(mPoints.size());
+    mCellStart.assign(mCols * mRows + 1, 0);
+    for (size_t i = 0; i < mPoints.size(); ++i)
+    {
+        cells.at(i) = cellY(mPoints.at(i).y) * mCols + cellX(mPoints.at(i).x);
+        ++mCellStart.at(cells.at(i) + 1);
+    }
+
+    for (size_t i = 1; i < mCellStart.size(); ++i)
+    {
+        mCellStart.at(i) += mCellStart.at(i - 1);
+    }
+
+    std::vector<int> next(mCellStart.begin(), mCellStart.end() - 1);
+    mIndices.resize(mPoints.size());
+    for (size_t i = 0; i < mPoints.size(); ++i)
+    {
+        mIndices.at(next.at(cells.at(i))++) = i;
+    }
+}
+
+void
+KeypointGrid::query(const cv::Point2f& pt, float maxDeltaX, float maxDeltaY,
+                    std::vector<int>& indices) const
+{
+    indices.clear();
+
+    if (mPoints.empty())
+    {
+        return;
+    }
+
+    int x0 = cellX(pt.x - maxDeltaX);
+    int x1 = cellX(pt.x + maxDeltaX);
+    int y0 = cellY(pt.y - maxDeltaY);
+    int y1 = cellY(pt.y + maxDeltaY);
+
+    for (int y = y0; y <= y1; ++y)
+    {
+        for (int x = x0; x <= x1; ++x)
+        {
+            int cell = y * mCols + x;
+            for (int i = mCellStart.at(cell); i < mCellStart.at(cell + 1); ++i)
+            {
+                int idx = mIndices.at(i);
+                cv::Point2f diff = mPoints.at(idx) - pt;
+
+                if (std::abs(diff.x) < maxDeltaX && std::abs(diff.y) < maxDeltaY)
+                {
+                    indices.push_back(idx);
+                }
+            }
+        }
+    }
+
+    std::sort(indices.begin(), indices.end());
+}
+
+size_t
+KeypointGrid::size(void) const
+{
+    return mPoints.size();
+}
+
+int
+KeypointGrid::cellX(float x) const
+{
+    float cx = std::floor((x - mOrigin.x) / mCellSize);
+
+    return static_cast<int>(std::min(std::max(cx, 0.0f), static_cast<float>(mCols - 1)));
+}
+
+int
+KeypointGrid::cellY(float y) const
+{
+    float cy = std::floor((y - mOrigin.y) / mCellSize);
+
+    return static_cast<int>(std::min(std::max(cy, 0.0f), static_cast<float>(mRows - 1)));
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef KEYPOINTGRID_H
+#define KEYPOINTGRID_H
+
+#include <opencv2/features2d/features2d.hpp>
+
+namespace camodocal
+{
+
+// Spatial index over the keypoints of an image. The keypoints are binned
+// into square cells, so a window query only visits the cells which overlap
+// the window instead of all keypoints.
+class KeypointGrid
+{
+public:
+    KeypointGrid();
+
+    void build(const std::vector<cv::KeyPoint>& keypoints, float cellSize);
+
+    // Returns in ascending order the indices of the keypoints p with
+    // |p.x - pt.x| < maxDeltaX and |p.y - pt.y| < maxDeltaY.
+    void query(const cv::Point2f& pt, float maxDeltaX, float maxDeltaY,
+               std::vector<int>& indices) const;
+
+    size_t size(void) const;
+
+private:
+    int cellX(float x) const;
+    int cellY(float y) const;
+
+    float mCellSize;
+    cv::Point2f mOrigin;
+    int mCols;
+    int mRows;
+
+    // keypoint indices sorted by cell, and the first entry of each cell
+    std::vector<int> mCellStart;
+    std::vector<int> mIndices;
+    std::vector<cv::Point2f> mPoints;
+};
+
+}
+
+#endif
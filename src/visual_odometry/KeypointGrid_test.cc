@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include "KeypointGrid.h"
+#include "WindowedMatcher.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+std::vector<cv::KeyPoint>
+generateKeypoints(cv::RNG& rng, int n)
+{
+    std::vector<cv::KeyPoint> keypoints;
+    for (int i = 0; i < n; ++i)
+    {
+        keypoints.push_back(cv::KeyPoint(rng.uniform(0.0f, 640.0f),
+                                         rng.uniform(0.0f, 480.0f), 1.0f));
+    }
+
+    return keypoints;
+}
+
+// the dense window test which the grid replaces
+std::vector<int>
+bruteForceWindow(const std::vector<cv::KeyPoint>& keypoints, const cv::Point2f& pt,
+                 float maxDeltaX, float maxDeltaY)
+{
+    std::vector<int> indices;
+    for (size_t i = 0; i < keypoints.size(); ++i)
+    {
+        cv::Point2f diff = keypoints.at(i).pt - pt;
+        if (std::abs(diff.x) < maxDeltaX && std::abs(diff.y) < maxDeltaY)
+        {
+            indices.push_back(i);
+        }
+    }
+
+    return indices;
+}
+
+}
+
+TEST(KeypointGrid, Query)
+{
+    cv::RNG rng(0);
+
+    std::vector<cv::KeyPoint> keypoints = generateKeypoints(rng, 2000);
+    std::vector<cv::KeyPoint> queries = generateKeypoints(rng, 500);
+
+    // queries outside the extent of the keypoints
+    queries.push_back(cv::KeyPoint(-50.0f, -50.0f, 1.0f));
+    queries.push_back(cv::KeyPoint(700.0f, 240.0f, 1.0f));
+
+    const float cellSizes[] = {80.0f, 20.0f, 500.0f};
+    for (size_t c = 0; c < sizeof(cellSizes) / sizeof(cellSizes[0]); ++c)
+    {
+        KeypointGrid grid;
+        grid.build(keypoints, cellSizes[c]);
+        EXPECT_EQ(grid.size(), keypoints.size());
+
+        std::vector<int> indices;
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            grid.query(queries.at(i).pt, 80.0f, 40.0f, indices);
+
+            EXPECT_EQ(indices, bruteForceWindow(keypoints, queries.at(i).pt, 80.0f, 40.0f));
+        }
+    }
+}
+
+TEST(KeypointGrid, Empty)
+{
+    KeypointGrid grid;
+    grid.build(std::vector<cv::KeyPoint>(), 80.0f);
+
+    std::vector<int> indices(1, 0);
+    grid.query(cv::Point2f(0.0f, 0.0f), 80.0f, 80.0f, indices);
+
+    EXPECT_TRUE(indices.empty());
+}
+
+TEST(WindowedMatcher, Hamming)
+{
+    cv::RNG rng(1);
+
+    cv::Mat query(20, 32, CV_8UC1);
+    cv::Mat train(50, 32, CV_8UC1);
+    rng.fill(query, cv::RNG::UNIFORM, 0, 256);
+    rng.fill(train, cv::RNG::UNIFORM, 0, 256);
+
+    // each query is a copy of one train descriptor, which is not
+    // a candidate of every query
+    std::vector<std::vector<int> > candidates(query.rows);
+    for (int i = 0; i < query.rows; ++i)
+    {
+        train.row(2 * i).copyTo(query.row(i));
+
+        for (int j = 0; j < train.rows; j += 3)
+        {
+            candidates.at(i).push_back(j);
+        }
+    }
+
+    WindowedMatcher matcher;
+    std::vector<std::vector<cv::DMatch> > matches;
+    matcher.knnMatch(query, train, candidates, matches, 2);
+
+    ASSERT_EQ(matches.size(), static_cast<size_t>(query.rows));
+    for (int i = 0; i < query.rows; ++i)
+    {
+        ASSERT_EQ(matches.at(i).size(), 2u);
+        EXPECT_LE(matches.at(i).at(0).distance, matches.at(i).at(1).distance);
+        EXPECT_EQ(matches.at(i).at(0).trainIdx % 3, 0);
+
+        if ((2 * i) % 3 == 0)
+        {
+            EXPECT_EQ(matches.at(i).at(0).trainIdx, 2 * i);
+            EXPECT_EQ(matches.at(i).at(0).distance, 0.0f);
+        }
+    }
+
+    matcher.radiusMatch(query, train, candidates, matches, 1.0f, true);
+    for (size_t i = 0; i < matches.size(); ++i)
+    {
+        ASSERT_EQ(matches.at(i).size(), 1u);
+        EXPECT_EQ(matches.at(i).at(0).trainIdx, 2 * matches.at(i).at(0).queryIdx);
+    }
+}
+
+}
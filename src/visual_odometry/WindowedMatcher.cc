@@ -0,0 +1,113 @@
+#include "WindowedMatcher.h"
+
+#include <algorithm>
+#include <camodocal/sparse_graph/Descriptor.h>
+#include <cmath>
+
+namespace camodocal
+{
+
+void
+WindowedMatcher::knnMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                          const std::vector<std::vector<int> >& candidates,
+                          std::vector<std::vector<cv::DMatch> >& matches, int k,
+                          bool compactResult) const
+{
+    matches.clear();
+    matches.reserve(queryDescriptors.rows);
+
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        const std::vector<int>& queryCandidates = candidates.at(i);
+
+        // k best matches in ascending order of distance
+        std::vector<cv::DMatch> best;
+        best.reserve(k + 1);
+
+        for (size_t c = 0; c < queryCandidates.size(); ++c)
+        {
+            int j = queryCandidates.at(c);
+
+            float d = distance(queryDescriptors, i, trainDescriptors, j);
+
+            if (static_cast<int>(best.size()) == k && d >= best.back().distance)
+            {
+                continue;
+            }
+
+            cv::DMatch match(i, j, d);
+
+            std::vector<cv::DMatch>::iterator it = best.end();
+            while (it != best.begin() && (it - 1)->distance > match.distance)
+            {
+                --it;
+            }
+            best.insert(it, match);
+
+            if (static_cast<int>(best.size()) > k)
+            {
+                best.pop_back();
+            }
+        }
+
+        if (best.empty() && compactResult)
+        {
+            continue;
+        }
+
+        matches.push_back(best);
+    }
+}
+
+void
+WindowedMatcher::radiusMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                             const std::vector<std::vector<int> >& candidates,
+                             std::vector<std::vector<cv::DMatch> >& matches, float maxDistance,
+                             bool compactResult) const
+{
+    matches.clear();
+    matches.reserve(queryDescriptors.rows);
+
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        const std::vector<int>& queryCandidates = candidates.at(i);
+
+        std::vector<cv::DMatch> inRange;
+        for (size_t c = 0; c < queryCandidates.size(); ++c)
+        {
+            int j = queryCandidates.at(c);
+
+            float d = distance(queryDescriptors, i, trainDescriptors, j);
+            if (d < maxDistance)
+            {
+                inRange.push_back(cv::DMatch(i, j, d));
+            }
+        }
+
+        if (inRange.empty() && compactResult)
+        {
+            continue;
+        }
+
+        std::sort(inRange.begin(), inRange.end());
+
+        matches.push_back(inRange);
+    }
+}
+
+float
+WindowedMatcher::distance(const cv::Mat& queryDescriptors, int queryIdx,
+                          const cv::Mat& trainDescriptors, int trainIdx) const
+{
+    if (queryDescriptors.type() == CV_8UC1 && trainDescriptors.type() == CV_8UC1)
+    {
+        return hammingDistance(queryDescriptors.ptr<unsigned char>(queryIdx),
+                               trainDescriptors.ptr<unsigned char>(trainIdx),
+                               queryDescriptors.cols);
+    }
+
+    return std::sqrt(descriptorDistanceSquared(queryDescriptors.row(queryIdx),
+                                               trainDescriptors.row(trainIdx)));
+}
+
+}
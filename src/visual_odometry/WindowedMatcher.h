@@ -0,0 +1,33 @@
+#ifndef WINDOWEDMATCHER_H
+#define WINDOWEDMATCHER_H
+
+#include <opencv2/features2d/features2d.hpp>
+
+namespace camodocal
+{
+
+// Matcher which compares each query descriptor only with a list of
+// candidate train descriptors, e.g. the ones in a window around the query
+// keypoint found with a KeypointGrid. Binary (CV_8UC1) descriptors are
+// compared with the Hamming distance, and all other descriptors with the
+// L2 distance, as cv::BFMatcher does with NORM_HAMMING and NORM_L2.
+class WindowedMatcher
+{
+public:
+    void knnMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                  const std::vector<std::vector<int> >& candidates,
+                  std::vector<std::vector<cv::DMatch> >& matches, int k,
+                  bool compactResult = false) const;
+    void radiusMatch(const cv::Mat& queryDescriptors, const cv::Mat& trainDescriptors,
+                     const std::vector<std::vector<int> >& candidates,
+                     std::vector<std::vector<cv::DMatch> >& matches, float maxDistance,
+                     bool compactResult = false) const;
+
+private:
+    float distance(const cv::Mat& queryDescriptors, int queryIdx,
+                   const cv::Mat& trainDescriptors, int trainIdx) const;
+};
+
+}
+
+#endif